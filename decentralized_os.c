@@ -28,6 +28,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
+#include <sys/stat.h>
+#include <poll.h>
 
 // Networking
 #include <sys/socket.h>
@@ -48,15 +50,45 @@
 #define MAX_NODES          64
 #define MAX_TASKS          256
 #define MAX_MEMORY_BLOCKS  512
-#define MAX_LOCKS          128
+#define LOCK_SHARDS        64    // Particiones de la tabla de locks (potencia de 2)
+#define LOCK_SHARD_BUCKETS 16    // Buckets iniciales de cada partición
+#define LOCK_GC_IDLE       30    // Segundos sin uso antes de liberar un lock
+#define LOCK_GC_SHARDS     8     // Particiones revisadas en cada pasada del GC
+#define LOCK_LEASE_TIMEOUT 10    // Segundos sin heartbeat del dueño antes de revocar
+#define LOCK_READ_LEASE_MS 5000  // Validez local de un lease de lectura cacheado
 
 #define BROADCAST_INTERVAL 3
 #define HEARTBEAT_TIMEOUT  15
 #define TASK_TIMEOUT       60
+#define TASK_MAX_ATTEMPTS  2     // Reintentos antes de dar la tarea por fallida
+#define DEFAULT_RUNTIME_MS 1000  // Estimación inicial de duración de tarea
+
+// Ejecución especulativa de tareas rezagadas
+#define STRAGGLER_FACTOR   1.5   // Rezagada si supera 1.5x la duración de su clase
+#define STRAGGLER_MIN_MS   500   // No especular sobre tareas más cortas
+#define SPECULATION_BUDGET 4     // Copias especulativas simultáneas en todo el cluster
+#define TASK_CLASSES       11    // Clase de tarea = prioridad (1-10)
 
 #define BUFFER_SIZE        4096
 #define NODE_ID_SIZE       16
 
+#define RESULT_WINDOW_CHUNKS 64  // Fragmentos en vuelo por canal de resultado
+
+#define MEMORY_PAGE_SIZE   4096  // Granularidad del seguimiento de escrituras
+#define MAX_REPLICAS       3
+#define REPLICA_ACK_TIMEOUT 5    // Segundos esperando confirmación de réplica
+
+// Tiering de memoria: por encima de la marca alta se desalojan los bloques
+// más fríos a un nodo con memoria libre o a disco hasta bajar de la baja
+#define TIER_HIGH_WATERMARK  0.85f
+#define TIER_LOW_WATERMARK   0.75f
+#define TIER_LIMIT_LOW       0.80f  // Con límite explícito, bajar al 80% de él
+#define TIER_MIN_IDLE_MS     1000   // No desalojar bloques usados hace menos
+#define TIER_MAX_SPILLS      16     // Desalojos por ronda del hilo de tiering
+#define TIER_PEER_MAX_USAGE  0.60f  // Solo nodos por debajo de este uso de RAM
+#define TIER_PREFETCH_DEPTH  2      // Bloques adelantados en accesos secuenciales
+#define TIER_SPILL_DIR       "/tmp/dos_spill"
+
 // Tipos de mensajes de red
 typedef enum {
     MSG_DISCOVERY = 1,
@@ -70,7 +102,9 @@ typedef enum {
     MSG_SYNC_UNLOCK,
     MSG_NODE_FAILURE,
     MSG_LEADER_ELECTION,
-    MSG_TASK_MIGRATE
+    MSG_TASK_MIGRATE,
+    MSG_SYNC_GRANT,
+    MSG_SYNC_REVOKE
 } MessageType;
 
 // Estados de nodo
@@ -89,9 +123,22 @@ typedef enum {
     TASK_RUNNING,
     TASK_COMPLETED,
     TASK_FAILED,
-    TASK_MIGRATING
+    TASK_MIGRATING,
+    TASK_CANCELLED
 } TaskStatus;
 
+// Política de despacho del scheduler
+typedef enum {
+    SCHED_MODE_SCORE = 0,    // Asignación inmediata por puntuación de nodo
+    SCHED_MODE_EDF           // Earliest Deadline First sobre la cola de listas
+} SchedulingMode;
+
+// Qué hacer con tareas que no pasan el test de admisión
+typedef enum {
+    ADMISSION_FLAG = 0,      // Aceptar pero marcar como "en riesgo"
+    ADMISSION_REJECT         // Rechazar la tarea
+} AdmissionPolicy;
+
 // ============================================================================
 // ESTRUCTURAS DE DATOS
 // ============================================================================
@@ -109,6 +156,8 @@ typedef struct {
     float reputation;        // 0.0 - 1.0 (inicialmente 0.5)
     uint32_t tasks_completed;
     uint32_t tasks_failed;
+    uint16_t speculative_running;  // Copias especulativas activas (heartbeat)
+    uint32_t memory_available_mb;  // RAM disponible anunciada (heartbeat)
     
     NodeStatus status;
     time_t last_seen;
@@ -122,49 +171,120 @@ typedef struct {
     pthread_mutex_t lock;
 } NodeRegistry;
 
-// Tarea distribuida
+// Tarea distribuida. Solo contiene handles: la entrada vive en un bloque de
+// memoria compartida y el resultado en un ResultChannel, de modo que el
+// descriptor ocupa dos líneas de cache (la descripción va aparte, en frío).
 typedef struct {
     uint64_t task_id;
     uint64_t owner_node;     // Nodo que creó la tarea
     uint64_t assigned_node;  // Nodo que ejecuta la tarea
     
-    char description[128];
     int priority;            // 1-10 (10 = máxima prioridad)
-    
     TaskStatus status;
+    int exit_code;
+    uint8_t attempts;
+    bool deadline_at_risk;
+    
     time_t created_at;
     time_t started_at;
     time_t completed_at;
     
-    // Datos de la tarea
-    uint8_t data[1024];
-    size_t data_size;
+    // Plazo (EDF): instante absoluto en ms monotónicos, 0 = sin plazo
+    uint64_t deadline_ms;
+    uint64_t estimated_runtime_ms;
+    uint64_t dispatched_ms;
     
-    // Resultado
-    uint8_t result[1024];
-    size_t result_size;
-    int exit_code;
+    // Ejecución especulativa: una tarea original y como mucho una copia
+    uint64_t speculative_of;  // En la copia: ID de la tarea original
+    uint64_t backup_task_id;  // En la original: ID de su copia especulativa
+    
+    // Entrada: bloque de memoria compartida (0 = sin datos)
+    uint64_t input_block;
+    // Resultado: canal de streaming (0 = ninguno, si no índice + 1)
+    uint64_t result_channel;
 } DistributedTask;
 
+_Static_assert(sizeof(DistributedTask) <= 2 * 64,
+               "DistributedTask debe caber en dos líneas de cache");
+
+// Fragmento de resultado en cola
+typedef struct ResultChunk {
+    struct ResultChunk* next;
+    size_t len;
+    size_t offset;           // Bytes ya consumidos
+    uint8_t data[];
+} ResultChunk;
+
+// Canal de resultados: cola acotada de fragmentos con control de flujo.
+// El productor se bloquea cuando hay RESULT_WINDOW_CHUNKS sin consumir y el
+// consumidor puede leer antes de que la tarea termine.
+typedef struct {
+    uint64_t task_id;
+    
+    ResultChunk* head;
+    ResultChunk* tail;
+    size_t queued_chunks;
+    
+    uint64_t bytes_written;
+    uint64_t bytes_read;
+    bool closed;
+    int exit_code;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} ResultChannel;
+
+// Lado productor de un resultado: canal local o conexión TCP al owner
+typedef struct {
+    uint64_t task_id;
+    ResultChannel* local;
+    int remote_fd;
+} ResultStream;
+
 // Scheduler Distribuido
 typedef struct {
     DistributedTask tasks[MAX_TASKS];
+    char descriptions[MAX_TASKS][128];     // Datos fríos, fuera del descriptor
+    ResultChannel* channels[MAX_TASKS];
+    uint64_t released_blocks[MAX_TASKS];   // Entradas a liberar fuera del lock
+    size_t released_count;
     size_t task_count;
     uint64_t next_task_id;
     
     pthread_mutex_t lock;
     pthread_cond_t task_available;
     
+    // Modo EDF: min-heap de índices en tasks[] ordenado por deadline
+    SchedulingMode mode;
+    AdmissionPolicy admission;
+    uint32_t ready_heap[MAX_TASKS];
+    size_t ready_count;
+    double avg_runtime_ms;   // Media móvil de duración de tareas
+    double class_runtime_ms[TASK_CLASSES];
+    uint32_t class_samples[TASK_CLASSES];
+    uint32_t speculative_running;
+    
     // Estadísticas
     uint64_t total_assigned;
     uint64_t total_completed;
     uint64_t total_failed;
     uint64_t total_migrated;
+    uint64_t total_rejected;
+    uint64_t total_deadline_missed;
+    uint64_t total_speculative;
+    uint64_t total_speculative_won;
 } DistributedScheduler;
 
-// Bloque de memoria distribuida
+// Bloque de memoria distribuida. Los IDs son handles: generación en los 32
+// bits altos e índice de slot en los bajos. La cabecera vive en la tabla de
+// slots y no se libera nunca; liberar el bloque pone block_id a 0 y avanza
+// la generación del slot, así un handle viejo deja de validar.
 typedef struct {
-    uint64_t block_id;
+    _Atomic uint64_t block_id;   // 0 = slot libre
+    uint32_t generation;
+    uint32_t slot_index;         // Posición en la tabla (fija desde que se crea)
+    uint32_t next_free;          // Siguiente slot libre (solo en la lista libre)
     uint64_t owner_node;
     
     void* data;
@@ -173,49 +293,210 @@ typedef struct {
     uint32_t version;        // Para consistencia
     int ref_count;
     bool is_replicated;
-    uint64_t replica_nodes[3]; // Hasta 3 réplicas
+    uint64_t replica_nodes[MAX_REPLICAS];
     int replica_count;
     
+    // Estado de cada réplica: páginas escritas desde su último sync (un bit
+    // por página), versión que confirmó y handle del bloque en el nodo remoto
+    uint64_t* replica_dirty[MAX_REPLICAS];
+    uint32_t replica_acked[MAX_REPLICAS];
+    uint64_t replica_remote[MAX_REPLICAS];
+    
+    // Si este bloque es réplica de uno remoto: su ID en el owner (0 = propio)
+    uint64_t origin_block;
+    
+    // Tiering: con el bloque desalojado data es NULL y el contenido vive en
+    // un fichero local o en un bloque de otro nodo (spill_node/spill_remote)
+    _Atomic uint64_t last_access;  // ms del último acceso
+    uint8_t tier;
+    uint64_t spill_node;
+    uint64_t spill_remote;
+    
+    // Mayor fencing token que escribió: los menores son de dueños caducados
+    uint64_t fence;
+    
     pthread_rwlock_t rwlock;
 } SharedMemoryBlock;
 
+// Dónde están los datos de un bloque
+typedef enum {
+    TIER_RAM = 0,
+    TIER_DISK,
+    TIER_PEER
+} MemoryTier;
+
+// La tabla crece por segmentos de MAX_MEMORY_BLOCKS cabeceras que nunca se
+// mueven, para que los lectores la indexen sin lock
+#define MEMORY_TABLE_SEGMENTS 2048
+#define MEMORY_SLOT_NONE      UINT32_MAX
+
 // Gestor de Memoria Distribuida
 typedef struct {
-    SharedMemoryBlock* blocks[MAX_MEMORY_BLOCKS];
-    size_t block_count;
-    uint64_t next_block_id;
+    _Atomic(SharedMemoryBlock*) segments[MEMORY_TABLE_SEGMENTS];
+    _Atomic uint32_t slot_count;   // Slots usados alguna vez
+    uint32_t free_head;            // Lista de slots libres
+    size_t block_count;            // Bloques vivos
     
     size_t total_allocated;
     size_t total_shared;
     
+    // Replicación
+    uint64_t replica_syncs;
+    uint64_t replica_bytes_sent;
+    uint64_t replica_pages_sent;
+    pthread_mutex_t sync_lock;     // Serializa sync_memory_replicas()
+    
+    // Tiering por presión de memoria
+    _Atomic size_t resident_bytes; // Datos de bloques en RAM
+    size_t tier_limit;             // Límite de bytes residentes (0 = solo presión)
+    size_t spilled_bytes;
+    uint64_t spills_disk;
+    uint64_t spills_peer;
+    uint64_t tier_fetches;
+    uint64_t tier_prefetches;
+    uint32_t last_fault;           // Índice del último bloque traído de vuelta
+    uint32_t prefetch_next;        // Próximo índice a adelantar
+    int prefetch_left;
+    char spill_dir[64];
+    pthread_mutex_t tier_lock;
+    pthread_cond_t tier_wakeup;
+    
     pthread_mutex_t lock;
 } DistributedMemoryManager;
 
-// Lock distribuido para sincronización
+// Modo de una petición de lock
+typedef enum {
+    LOCK_MODE_WRITE = 0,         // Exclusivo
+    LOCK_MODE_READ               // Compartido
+} LockMode;
+
+// Nodo o hilo esperando un lock en su nodo hogar
+typedef struct LockWaiter {
+    uint64_t node_id;
+    uint64_t task_id;
+    uint8_t mode;
+    int fd;                      // Conexión del nodo remoto (-1 = hilo local)
+    bool granted;
+    uint64_t fencing_token;
+    pthread_cond_t cond;         // Solo hilos locales
+    struct LockWaiter* next;
+} LockWaiter;
+
+// Nodo remoto con un lease de lectura concedido por el hogar
 typedef struct {
-    uint64_t lock_id;
+    uint64_t node_id;
+    int fd;
+    time_t lease_expires;        // Se prorroga con cada heartbeat del nodo
+    bool revoked;                // Ya se le pidió devolverlo
+} LockReader;
+
+// Lock distribuido para sincronización. El modo escritura es exclusivo; en
+// lectura el hogar concede un lease por nodo, y ese nodo vuelve a entrar sin
+// mensajes mientras el lease siga vigente. Un escritor en cola frena nuevas
+// lecturas y revoca los leases cacheados (preferencia de escritura).
+typedef struct DistributedLock {
+    uint64_t lock_id;            // Hash del nombre, igual en todos los nodos
     char name[64];
     
+    // Tabla de locks: se crea al primer uso y el GC lo libera tras
+    // LOCK_GC_IDLE segundos sin referencias
+    struct DistributedLock* hash_next;
+    _Atomic int refs;            // Usos en curso; estar en la lista de activos cuenta uno
+    _Atomic time_t last_used;
+    
+    // Lista de locks con estado (bajo active_lock; 'active' también bajo local_lock)
+    struct DistributedLock* active_next;
+    struct DistributedLock* active_prev;
+    bool active;
+    
+    // Estado en el nodo hogar
     uint64_t owner_node;
     uint64_t owner_task;
+    int owner_fd;                // Conexión del dueño remoto (-1 = local)
     
     bool is_locked;
     time_t locked_at;
+    time_t lease_expires;        // Se prorroga con cada heartbeat del dueño
     
-    // Cola de espera
-    uint64_t waiting_nodes[MAX_NODES];
+    // Cola de espera FIFO
+    LockWaiter* wait_head;
+    LockWaiter* wait_tail;
     int waiting_count;
+    int waiting_writers;
+    
+    // Lectores en el hogar: hilos propios y leases de nodos remotos
+    int local_readers;
+    LockReader* readers;         // Crece bajo demanda
+    int reader_count;
+    int reader_capacity;
+    
+    // Fencing: época del hogar (bits altos) y concesiones en ella (bajos)
+    uint32_t term;
+    uint32_t grants;
+    uint64_t fencing_token;      // Última concesión hecha aquí
+    
+    // Posesión de este nodo
+    uint64_t held_token;
+    int remote_fd;               // Conexión con el hogar remoto que lo concedió
+    uint64_t remote_home;
+    uint64_t remote_task;
+    
+    // Lease de lectura cacheado de un hogar remoto
+    int read_fd;                 // La lee solo el hilo del lease
+    uint64_t read_lease_until;   // ms locales; medido desde que se pidió
+    uint64_t read_requested_ms;  // Petición en curso (0 = ninguna)
+    int read_holds;              // Lecturas locales en curso bajo el lease
+    bool read_revoked;
     
     pthread_mutex_t local_lock;
+    pthread_cond_t read_cond;
 } DistributedLock;
 
+// Partición de la tabla de locks: los locks que no comparten partición
+// nunca compiten por el mismo mutex
+typedef struct {
+    DistributedLock** buckets;
+    size_t bucket_count;         // Potencia de 2; se duplica al llenarse
+    size_t count;
+    pthread_mutex_t lock;
+} LockShard;
+
+// Conexión libre con el hogar de otro nodo
+typedef struct {
+    uint64_t node_id;
+    int fd;                      // -1 = entrada vacía
+} LockConnection;
+
 // Gestor de Sincronización
 typedef struct {
-    DistributedLock locks[MAX_LOCKS];
-    size_t lock_count;
-    uint64_t next_lock_id;
+    LockShard shards[LOCK_SHARDS];
+    _Atomic size_t lock_count;
+    int gc_cursor;               // Próxima partición que revisa el GC
     
-    pthread_mutex_t lock;
+    // Locks con colas, dueños, lectores o leases: lo único que recorren los
+    // leases, los fallos y el estado
+    DistributedLock* active_head;
+    size_t active_count;
+    pthread_mutex_t active_lock;
+    
+    // Épocas de fencing: la mayor usada aquí y la mayor vista en otros nodos
+    _Atomic uint32_t term;
+    _Atomic uint32_t remote_term;
+    
+    // Como mucho una conexión libre por hogar remoto, reutilizada entre
+    // adquisiciones en lugar de conectar en cada una
+    LockConnection idle_conns[MAX_NODES];
+    pthread_mutex_t conn_lock;
+    
+    // Estadísticas
+    _Atomic uint64_t grants;
+    _Atomic uint64_t remote_grants;
+    _Atomic uint64_t lease_expirations;
+    _Atomic uint64_t read_grants;
+    _Atomic uint64_t read_cache_hits;
+    _Atomic uint64_t read_revocations;
+    _Atomic uint64_t locks_created;
+    _Atomic uint64_t locks_collected;
 } SyncManager;
 
 // Mensaje de red genérico
@@ -239,8 +520,62 @@ typedef struct __attribute__((packed)) {
     uint32_t tasks_completed;
     uint32_t tasks_failed;
     uint8_t status;
+    uint16_t speculative_running;
+    uint32_t memory_available_mb;
+    uint32_t lock_term;          // Mayor época de fencing conocida
 } DiscoveryPayload;
 
+// Cabecera de un fragmento de resultado (MSG_TASK_RESULT)
+typedef struct __attribute__((packed)) {
+    uint64_t task_id;
+    uint8_t flags;
+    int32_t exit_code;
+    uint16_t length;
+} ResultChunkHeader;
+
+#define RESULT_FLAG_EOF    0x01
+#define RESULT_CHUNK_SIZE  (sizeof(((NetworkMessage*)0)->payload) - sizeof(ResultChunkHeader))
+
+// Cabecera de un tramo de páginas replicadas (MSG_MEMORY_REPLICATE)
+typedef struct __attribute__((packed)) {
+    uint64_t block_id;       // Bloque en el owner (emisor)
+    uint64_t replica_block;  // Bloque en el receptor (0 = crear)
+    uint64_t block_size;
+    uint64_t offset;
+    uint32_t version;
+    uint16_t length;
+    uint8_t flags;
+} ReplicaPageHeader;
+
+// Confirmación de réplica (MSG_MEMORY_RESPONSE)
+typedef struct __attribute__((packed)) {
+    uint64_t block_id;
+    uint64_t replica_block;
+    uint32_t version;        // 0 = réplica desconocida, reenviar completo
+} ReplicaAck;
+
+#define REPLICA_FLAG_COMMIT  0x01  // Último tramo: fijar versión y confirmar
+#define REPLICA_CHUNK_SIZE   (sizeof(((NetworkMessage*)0)->payload) - sizeof(ReplicaPageHeader))
+
+// Petición sobre un bloque desalojado en otro nodo (MSG_MEMORY_REQUEST)
+typedef struct __attribute__((packed)) {
+    uint64_t block_id;       // Bloque en el owner
+    uint64_t remote_block;   // Copia en el nodo que la guarda
+    uint8_t flags;
+} SpillRequest;
+
+// Petición, concesión o liberación de un lock (MSG_SYNC_*)
+typedef struct __attribute__((packed)) {
+    uint64_t lock_id;
+    uint64_t task_id;
+    uint64_t fencing_token;  // GRANT: token concedido; LOCK: último conocido
+    char name[64];
+    uint8_t mode;            // LockMode
+} LockPayload;
+
+#define SPILL_FLAG_FETCH    0x01  // Devolver el contenido como MSG_MEMORY_REPLICATE
+#define SPILL_FLAG_RELEASE  0x02  // Liberar la copia después
+
 // Kernel Distribuido Principal
 typedef struct {
     uint64_t node_id;
@@ -263,6 +598,7 @@ typedef struct {
     pthread_t data_server_thread;
     pthread_t scheduler_thread;
     pthread_t failure_detector_thread;
+    pthread_t tiering_thread;
     pthread_t command_thread;
     
     volatile bool running;
@@ -342,27 +678,41 @@ static float get_cpu_load(void) {
     return load > 1.0 ? 1.0 : load;
 }
 
-// Obtener uso de memoria
-static float get_memory_usage(void) {
+// Leer MemTotal y MemAvailable (KB)
+static bool read_meminfo(long* total, long* available) {
     FILE* f = fopen("/proc/meminfo", "r");
-    if (!f) return 0.5;
+    if (!f) return false;
     
-    long total = 0, available = 0;
+    *total = 0;
+    *available = 0;
     char line[256];
     
     while (fgets(line, sizeof(line), f)) {
         if (strncmp(line, "MemTotal:", 9) == 0) {
-            sscanf(line + 9, "%ld", &total);
+            sscanf(line + 9, "%ld", total);
         } else if (strncmp(line, "MemAvailable:", 13) == 0) {
-            sscanf(line + 13, "%ld", &available);
+            sscanf(line + 13, "%ld", available);
         }
     }
     fclose(f);
     
-    if (total == 0) return 0.5;
+    return *total > 0;
+}
+
+// Obtener uso de memoria
+static float get_memory_usage(void) {
+    long total, available;
+    if (!read_meminfo(&total, &available)) return 0.5;
     return 1.0 - ((float)available / total);
 }
 
+// RAM disponible en MB, para anunciarla en el heartbeat
+static uint32_t get_memory_available_mb(void) {
+    long total, available;
+    if (!read_meminfo(&total, &available)) return 0;
+    return (uint32_t)(available / 1024);
+}
+
 // Timestamp actual en ms
 static uint64_t current_time_ms(void) {
     struct timespec ts;
@@ -370,6 +720,67 @@ static uint64_t current_time_ms(void) {
     return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+// Timestamp actual en ns, para medir operaciones cortas
+static uint64_t current_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Enviar/recibir exactamente len bytes por un socket TCP
+static int send_all(int fd, const void* buf, size_t len) {
+    const uint8_t* p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void* buf, size_t len) {
+    uint8_t* p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Abrir conexión TCP al servidor de datos de un nodo conocido
+static int connect_to_node(uint64_t node_id) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    
+    bool found = false;
+    pthread_mutex_lock(&g_kernel->registry->lock);
+    for (int i = 0; i < g_kernel->registry->count; i++) {
+        NodeInfo* node = &g_kernel->registry->nodes[i];
+        if (node->node_id == node_id) {
+            addr.sin_port = htons(node->data_port);
+            found = inet_pton(AF_INET, node->ip_address, &addr.sin_addr) == 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_kernel->registry->lock);
+    
+    if (!found) return -1;
+    
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    
+    return fd;
+}
+
 // ============================================================================
 // 1. DESCUBRIMIENTO DE NODOS (RED AD-HOC)
 // ============================================================================
@@ -435,6 +846,11 @@ static void send_discovery_broadcast(void) {
     payload->tasks_completed = g_kernel->local_info.tasks_completed;
     payload->tasks_failed = g_kernel->local_info.tasks_failed;
     payload->status = g_kernel->local_info.status;
+    payload->speculative_running = (uint16_t)g_kernel->scheduler->speculative_running;
+    payload->memory_available_mb = get_memory_available_mb();
+    uint32_t term = atomic_load(&g_kernel->sync->term);
+    uint32_t remote_term = atomic_load(&g_kernel->sync->remote_term);
+    payload->lock_term = term > remote_term ? term : remote_term;
     
     msg.payload_size = sizeof(DiscoveryPayload);
     
@@ -467,6 +883,9 @@ static void send_discovery_broadcast(void) {
     }
 }
 
+static void observe_lock_term(uint32_t term);
+static void renew_lock_leases(uint64_t node_id);
+
 // Procesar mensaje de descubrimiento recibido
 static void process_discovery_message(NetworkMessage* msg, struct sockaddr_in* sender) {
     if (!g_kernel || !msg) return;
@@ -513,10 +932,16 @@ static void process_discovery_message(NetworkMessage* msg, struct sockaddr_in* s
     node->tasks_completed = payload->tasks_completed;
     node->tasks_failed = payload->tasks_failed;
     node->status = (NodeStatus)payload->status;
+    node->speculative_running = payload->speculative_running;
+    node->memory_available_mb = payload->memory_available_mb;
     node->last_seen = time(NULL);
     node->is_local = false;
     
     pthread_mutex_unlock(&g_kernel->registry->lock);
+    
+    // El heartbeat también renueva los leases de lock que tiene el nodo
+    observe_lock_term(payload->lock_term);
+    renew_lock_leases(payload->node_id);
 }
 
 // Thread de escucha de descubrimiento
@@ -606,8 +1031,8 @@ static float calculate_node_score(NodeInfo* node, int task_priority) {
     return score;
 }
 
-// Seleccionar mejor nodo para una tarea
-static uint64_t select_best_node(int task_priority) {
+// Seleccionar mejor nodo para una tarea, descartando exclude (0 = ninguno)
+static uint64_t select_best_node_excluding(int task_priority, uint64_t exclude) {
     if (!g_kernel) return 0;
     
     pthread_mutex_lock(&g_kernel->registry->lock);
@@ -618,7 +1043,7 @@ static uint64_t select_best_node(int task_priority) {
     for (int i = 0; i < g_kernel->registry->count; i++) {
         NodeInfo* node = &g_kernel->registry->nodes[i];
         
-        if (node->status != NODE_ACTIVE) continue;
+        if (node->status != NODE_ACTIVE || node->node_id == exclude) continue;
         
         float score = calculate_node_score(node, task_priority);
         if (score > best_score) {
@@ -629,7 +1054,7 @@ static uint64_t select_best_node(int task_priority) {
     
     // También considerar el nodo local
     float local_score = calculate_node_score(&g_kernel->local_info, task_priority);
-    if (local_score > best_score) {
+    if (g_kernel->node_id != exclude && local_score > best_score) {
         best_node = g_kernel->node_id;
     }
     
@@ -638,55 +1063,205 @@ static uint64_t select_best_node(int task_priority) {
     return best_node;
 }
 
-// Crear nueva tarea
-static uint64_t create_task(const char* description, int priority, 
-                           void* data, size_t data_size) {
+static uint64_t select_best_node(int task_priority) {
+    return select_best_node_excluding(task_priority, 0);
+}
+
+// Duración estimada para una clase de tarea (requiere scheduler->lock)
+static uint64_t class_runtime_estimate(DistributedScheduler* sched, int priority) {
+    if (sched->class_samples[priority] > 0) {
+        return (uint64_t)sched->class_runtime_ms[priority];
+    }
+    return (uint64_t)sched->avg_runtime_ms;
+}
+
+// Deadline efectivo para ordenar: las tareas sin plazo (batch) van al final
+static inline uint64_t task_sort_key(const DistributedTask* task) {
+    return task->deadline_ms ? task->deadline_ms : UINT64_MAX;
+}
+
+// Insertar tarea en la cola EDF (requiere scheduler->lock)
+static void ready_heap_push(DistributedScheduler* sched, uint32_t idx) {
+    size_t pos = sched->ready_count++;
+    
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (task_sort_key(&sched->tasks[sched->ready_heap[parent]]) <=
+            task_sort_key(&sched->tasks[idx])) {
+            break;
+        }
+        sched->ready_heap[pos] = sched->ready_heap[parent];
+        pos = parent;
+    }
+    
+    sched->ready_heap[pos] = idx;
+}
+
+// Extraer la tarea con deadline más cercano (requiere scheduler->lock)
+static uint32_t ready_heap_pop(DistributedScheduler* sched) {
+    uint32_t top = sched->ready_heap[0];
+    uint32_t last = sched->ready_heap[--sched->ready_count];
+    uint64_t key = task_sort_key(&sched->tasks[last]);
+    size_t pos = 0;
+    
+    while (2 * pos + 1 < sched->ready_count) {
+        size_t child = 2 * pos + 1;
+        if (child + 1 < sched->ready_count &&
+            task_sort_key(&sched->tasks[sched->ready_heap[child + 1]]) <
+            task_sort_key(&sched->tasks[sched->ready_heap[child]])) {
+            child++;
+        }
+        if (key <= task_sort_key(&sched->tasks[sched->ready_heap[child]])) break;
+        
+        sched->ready_heap[pos] = sched->ready_heap[child];
+        pos = child;
+    }
+    
+    sched->ready_heap[pos] = last;
+    return top;
+}
+
+// Test de admisión: ¿puede la tarea terminar antes de su deadline en el nodo
+// destino, dado el trabajo con deadline anterior que ya tiene asignado y el
+// que espera en la cola EDF? (requiere scheduler->lock)
+static bool admission_test(DistributedScheduler* sched, DistributedTask* task,
+                           uint64_t target, uint64_t now) {
+    if (!task->deadline_ms) return true;
+    
+    uint64_t key = task->deadline_ms;
+    uint64_t load_ms = 0;
+    
+    for (size_t i = 0; i < sched->task_count; i++) {
+        DistributedTask* other = &sched->tasks[i];
+        if (other == task || task_sort_key(other) > key) continue;
+        
+        if (other->assigned_node == target &&
+            (other->status == TASK_ASSIGNED || other->status == TASK_RUNNING)) {
+            uint64_t elapsed = now - other->dispatched_ms;
+            if (elapsed < other->estimated_runtime_ms) {
+                load_ms += other->estimated_runtime_ms - elapsed;
+            }
+        }
+    }
+    
+    // Lo que está por delante en la cola competirá por el mismo nodo
+    for (size_t i = 0; i < sched->ready_count; i++) {
+        DistributedTask* other = &sched->tasks[sched->ready_heap[i]];
+        if (other != task && task_sort_key(other) <= key) {
+            load_ms += other->estimated_runtime_ms;
+        }
+    }
+    
+    return now + load_ms + task->estimated_runtime_ms <= task->deadline_ms;
+}
+
+// Asignar una tarea a un nodo (requiere scheduler->lock)
+static bool dispatch_task(DistributedScheduler* sched, DistributedTask* task,
+                          uint64_t target, uint64_t now) {
+    if (!target) return false;
+    
+    task->assigned_node = target;
+    task->status = TASK_ASSIGNED;
+    task->started_at = time(NULL);
+    task->dispatched_ms = now;
+    task->attempts++;
+    sched->total_assigned++;
+    
+    printf("[SCHEDULER] Tarea %lu asignada al nodo %016lX\n",
+           task->task_id, target);
+    return true;
+}
+
+static uint64_t create_shared_memory(size_t size);
+static int write_shared_memory(uint64_t block_id, const void* data, size_t size, size_t offset);
+static void free_shared_memory(uint64_t block_id);
+
+// Crear nueva tarea. deadline_ms es relativo a ahora (0 = sin plazo) y
+// runtime_ms la duración estimada (0 = usar la media observada).
+static uint64_t create_task_with_deadline(const char* description, int priority,
+                                          void* data, size_t data_size,
+                                          uint64_t deadline_ms, uint64_t runtime_ms) {
     if (!g_kernel || !g_kernel->scheduler) return 0;
     
-    pthread_mutex_lock(&g_kernel->scheduler->lock);
+    DistributedScheduler* sched = g_kernel->scheduler;
+    
+    // La entrada se copia a memoria compartida antes de tomar el lock del
+    // scheduler; el descriptor solo guarda el ID del bloque
+    uint64_t input_block = 0;
+    if (data && data_size > 0) {
+        input_block = create_shared_memory(data_size);
+        if (!input_block) return 0;
+        write_shared_memory(input_block, data, data_size, 0);
+    }
+    
+    pthread_mutex_lock(&sched->lock);
     
-    if (g_kernel->scheduler->task_count >= MAX_TASKS) {
-        pthread_mutex_unlock(&g_kernel->scheduler->lock);
+    if (sched->task_count >= MAX_TASKS) {
+        pthread_mutex_unlock(&sched->lock);
+        if (input_block) free_shared_memory(input_block);
         return 0;
     }
     
-    DistributedTask* task = &g_kernel->scheduler->tasks[g_kernel->scheduler->task_count];
+    uint32_t idx = (uint32_t)sched->task_count;
+    DistributedTask* task = &sched->tasks[idx];
     memset(task, 0, sizeof(DistributedTask));
     
-    task->task_id = ++g_kernel->scheduler->next_task_id;
+    uint64_t now = current_time_ms();
+    
+    task->task_id = sched->next_task_id + 1;
     task->owner_node = g_kernel->node_id;
     task->priority = (priority < 1) ? 1 : (priority > 10) ? 10 : priority;
     task->status = TASK_PENDING;
     task->created_at = time(NULL);
+    task->deadline_ms = deadline_ms ? now + deadline_ms : 0;
+    task->estimated_runtime_ms = runtime_ms ? runtime_ms :
+                                 class_runtime_estimate(sched, task->priority);
     
-    if (description) {
-        strncpy(task->description, description, sizeof(task->description) - 1);
-    }
+    task->input_block = input_block;
     
-    if (data && data_size > 0 && data_size <= sizeof(task->data)) {
-        memcpy(task->data, data, data_size);
-        task->data_size = data_size;
+    char* desc = sched->descriptions[idx];
+    memset(desc, 0, sizeof(sched->descriptions[idx]));
+    if (description) {
+        strncpy(desc, description, sizeof(sched->descriptions[idx]) - 1);
     }
     
     // Seleccionar nodo para ejecutar
     uint64_t target = select_best_node(task->priority);
-    if (target) {
-        task->assigned_node = target;
-        task->status = TASK_ASSIGNED;
-        g_kernel->scheduler->total_assigned++;
-        
-        printf("[SCHEDULER] Tarea %lu asignada al nodo %016lX\n",
-               task->task_id, target);
+    
+    if (!admission_test(sched, task, target, now)) {
+        if (sched->admission == ADMISSION_REJECT) {
+            sched->total_rejected++;
+            printf("[SCHEDULER] Tarea '%s' rechazada: no cumpliría su deadline\n", desc);
+            pthread_mutex_unlock(&sched->lock);
+            if (input_block) free_shared_memory(input_block);
+            return 0;
+        }
+        task->deadline_at_risk = true;
+        printf("[SCHEDULER] ⚠ Tarea %lu admitida con deadline en riesgo\n",
+               task->task_id);
     }
     
-    g_kernel->scheduler->task_count++;
+    sched->next_task_id++;
+    sched->task_count++;
     
-    pthread_cond_signal(&g_kernel->scheduler->task_available);
-    pthread_mutex_unlock(&g_kernel->scheduler->lock);
+    if (sched->mode == SCHED_MODE_EDF) {
+        // El thread del scheduler despacha en orden de deadline
+        ready_heap_push(sched, idx);
+    } else {
+        dispatch_task(sched, task, target, now);
+    }
+    
+    pthread_cond_signal(&sched->task_available);
+    pthread_mutex_unlock(&sched->lock);
     
     return task->task_id;
 }
 
+static uint64_t create_task(const char* description, int priority, 
+                           void* data, size_t data_size) {
+    return create_task_with_deadline(description, priority, data, data_size, 0, 0);
+}
+
 // Actualizar reputación de un nodo
 static void update_node_reputation(uint64_t node_id, bool success) {
     if (!g_kernel) return;
@@ -718,353 +1293,2793 @@ static void update_node_reputation(uint64_t node_id, bool success) {
     pthread_mutex_unlock(&g_kernel->registry->lock);
 }
 
-// Completar tarea
-static void complete_task(uint64_t task_id, int exit_code, void* result, size_t result_size) {
-    if (!g_kernel) return;
+// Buscar tarea por ID (requiere scheduler->lock)
+static DistributedTask* find_task(DistributedScheduler* sched, uint64_t task_id) {
+    for (size_t i = 0; i < sched->task_count; i++) {
+        if (sched->tasks[i].task_id == task_id) {
+            return &sched->tasks[i];
+        }
+    }
+    return NULL;
+}
+
+static inline bool task_is_live(const DistributedTask* task) {
+    return task->status == TASK_ASSIGNED || task->status == TASK_RUNNING ||
+           task->status == TASK_MIGRATING;
+}
+
+// Crear canal de resultados vacío
+static ResultChannel* result_channel_create(uint64_t task_id) {
+    ResultChannel* ch = calloc(1, sizeof(ResultChannel));
+    if (!ch) return NULL;
     
-    pthread_mutex_lock(&g_kernel->scheduler->lock);
+    ch->task_id = task_id;
+    pthread_mutex_init(&ch->lock, NULL);
+    pthread_cond_init(&ch->not_empty, NULL);
+    pthread_cond_init(&ch->not_full, NULL);
     
-    for (size_t i = 0; i < g_kernel->scheduler->task_count; i++) {
-        DistributedTask* task = &g_kernel->scheduler->tasks[i];
-        
-        if (task->task_id == task_id) {
-            task->status = (exit_code == 0) ? TASK_COMPLETED : TASK_FAILED;
-            task->completed_at = time(NULL);
-            task->exit_code = exit_code;
-            
-            if (result && result_size > 0 && result_size <= sizeof(task->result)) {
-                memcpy(task->result, result, result_size);
-                task->result_size = result_size;
-            }
-            
-            if (exit_code == 0) {
-                g_kernel->scheduler->total_completed++;
-            } else {
-                g_kernel->scheduler->total_failed++;
-            }
-            
-            // Actualizar reputación del nodo
-            update_node_reputation(task->assigned_node, exit_code == 0);
-            
-            break;
-        }
+    return ch;
+}
+
+static void result_channel_destroy(ResultChannel* ch) {
+    if (!ch) return;
+    
+    while (ch->head) {
+        ResultChunk* next = ch->head->next;
+        free(ch->head);
+        ch->head = next;
     }
     
-    pthread_mutex_unlock(&g_kernel->scheduler->lock);
+    pthread_mutex_destroy(&ch->lock);
+    pthread_cond_destroy(&ch->not_empty);
+    pthread_cond_destroy(&ch->not_full);
+    free(ch);
 }
 
-// Migrar tarea a otro nodo (tolerancia a fallos)
-static bool migrate_task(uint64_t task_id, uint64_t new_node) {
-    if (!g_kernel) return false;
+// Encolar un fragmento. Con block=true espera mientras la ventana esté
+// llena (control de flujo); sin él encola siempre, para resultados que ya
+// están completos en memoria.
+static int result_channel_push(ResultChannel* ch, const void* data, size_t len, bool block) {
+    ResultChunk* chunk = malloc(sizeof(ResultChunk) + len);
+    if (!chunk) return -1;
+    
+    chunk->next = NULL;
+    chunk->len = len;
+    chunk->offset = 0;
+    memcpy(chunk->data, data, len);
+    
+    pthread_mutex_lock(&ch->lock);
+    
+    while (block && !ch->closed && ch->queued_chunks >= RESULT_WINDOW_CHUNKS) {
+        pthread_cond_wait(&ch->not_full, &ch->lock);
+    }
     
-    pthread_mutex_lock(&g_kernel->scheduler->lock);
+    if (ch->closed) {
+        pthread_mutex_unlock(&ch->lock);
+        free(chunk);
+        return -1;
+    }
     
-    for (size_t i = 0; i < g_kernel->scheduler->task_count; i++) {
-        DistributedTask* task = &g_kernel->scheduler->tasks[i];
-        
-        if (task->task_id == task_id && 
-            (task->status == TASK_ASSIGNED || task->status == TASK_RUNNING)) {
-            
-            uint64_t old_node = task->assigned_node;
-            task->assigned_node = new_node;
-            task->status = TASK_MIGRATING;
-            g_kernel->scheduler->total_migrated++;
-            
-            printf("[SCHEDULER] Tarea %lu migrada: %016lX -> %016lX\n",
-                   task_id, old_node, new_node);
-            
-            pthread_mutex_unlock(&g_kernel->scheduler->lock);
-            return true;
-        }
+    if (ch->tail) {
+        ch->tail->next = chunk;
+    } else {
+        ch->head = chunk;
     }
+    ch->tail = chunk;
+    ch->queued_chunks++;
+    ch->bytes_written += len;
     
-    pthread_mutex_unlock(&g_kernel->scheduler->lock);
-    return false;
+    pthread_cond_signal(&ch->not_empty);
+    pthread_mutex_unlock(&ch->lock);
+    
+    return 0;
 }
 
-// ============================================================================
-// 3. GESTIÓN DE MEMORIA DISTRIBUIDA
-// ============================================================================
+// Marcar fin de flujo: los lectores drenan lo pendiente y reciben 0
+static void result_channel_finish(ResultChannel* ch, int exit_code) {
+    pthread_mutex_lock(&ch->lock);
+    ch->closed = true;
+    ch->exit_code = exit_code;
+    pthread_cond_broadcast(&ch->not_empty);
+    pthread_cond_broadcast(&ch->not_full);
+    pthread_mutex_unlock(&ch->lock);
+}
 
-// Crear bloque de memoria compartida
-static uint64_t create_shared_memory(size_t size) {
-    if (!g_kernel || !g_kernel->memory || size == 0) return 0;
+// Leer hasta len bytes. Devuelve los bytes leídos, 0 al final del flujo o
+// -1 si vence timeout_ms (< 0 = esperar indefinidamente) sin datos.
+static ssize_t result_channel_read(ResultChannel* ch, void* buf, size_t len, int timeout_ms) {
+    pthread_mutex_lock(&ch->lock);
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
     
-    pthread_mutex_lock(&g_kernel->memory->lock);
+    while (!ch->head && !ch->closed) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&ch->not_empty, &ch->lock);
+        } else if (timeout_ms == 0 ||
+                   pthread_cond_timedwait(&ch->not_empty, &ch->lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&ch->lock);
+            return -1;
+        }
+    }
     
-    if (g_kernel->memory->block_count >= MAX_MEMORY_BLOCKS) {
-        pthread_mutex_unlock(&g_kernel->memory->lock);
-        return 0;
+    size_t copied = 0;
+    while (ch->head && copied < len) {
+        ResultChunk* chunk = ch->head;
+        size_t n = chunk->len - chunk->offset;
+        if (n > len - copied) n = len - copied;
+        
+        memcpy((uint8_t*)buf + copied, chunk->data + chunk->offset, n);
+        chunk->offset += n;
+        copied += n;
+        
+        if (chunk->offset == chunk->len) {
+            ch->head = chunk->next;
+            if (!ch->head) ch->tail = NULL;
+            ch->queued_chunks--;
+            free(chunk);
+        }
     }
     
-    SharedMemoryBlock* block = calloc(1, sizeof(SharedMemoryBlock));
-    if (!block) {
-        pthread_mutex_unlock(&g_kernel->memory->lock);
-        return 0;
+    ch->bytes_read += copied;
+    pthread_cond_signal(&ch->not_full);
+    pthread_mutex_unlock(&ch->lock);
+    
+    return (ssize_t)copied;
+}
+
+// Canal de resultados de una tarea; las copias especulativas comparten el
+// de su original. Con create=false no lo crea si no existe.
+static ResultChannel* get_result_channel(uint64_t task_id, bool create) {
+    DistributedScheduler* sched = g_kernel->scheduler;
+    
+    pthread_mutex_lock(&sched->lock);
+    
+    DistributedTask* task = find_task(sched, task_id);
+    if (task && task->speculative_of) {
+        task = find_task(sched, task->speculative_of);
     }
     
-    block->data = calloc(1, size);
-    if (!block->data) {
-        free(block);
-        pthread_mutex_unlock(&g_kernel->memory->lock);
-        return 0;
+    ResultChannel* ch = NULL;
+    if (task) {
+        size_t slot = (size_t)(task - sched->tasks);
+        if (!sched->channels[slot] && create) {
+            sched->channels[slot] = result_channel_create(task->task_id);
+            task->result_channel = slot + 1;
+        }
+        ch = sched->channels[slot];
     }
     
-    block->block_id = ++g_kernel->memory->next_block_id;
+    pthread_mutex_unlock(&sched->lock);
+    return ch;
+}
+
+// Abrir el flujo de salida de una tarea. Si el owner es remoto los
+// fragmentos viajan por TCP a su puerto de datos y el control de flujo lo
+// da la ventana TCP; si es local van directos al canal.
+//
+// Streaming y especulación se excluyen: una copia especulativa no puede
+// abrir flujo (debe entregar su resultado con complete_task) y si la
+// original empieza a emitir se cancela su copia.
+static ResultStream* open_result_stream(uint64_t task_id, uint64_t owner_node) {
+    if (!g_kernel) return NULL;
+    
+    ResultStream* stream = calloc(1, sizeof(ResultStream));
+    if (!stream) return NULL;
+    
+    stream->task_id = task_id;
+    stream->remote_fd = -1;
+    
+    if (!owner_node || owner_node == g_kernel->node_id) {
+        DistributedScheduler* sched = g_kernel->scheduler;
+        
+        pthread_mutex_lock(&sched->lock);
+        DistributedTask* task = find_task(sched, task_id);
+        bool allowed = task && !task->speculative_of;
+        if (allowed && task->backup_task_id) {
+            DistributedTask* backup = find_task(sched, task->backup_task_id);
+            if (backup && task_is_live(backup)) {
+                backup->status = TASK_CANCELLED;
+                backup->completed_at = time(NULL);
+            }
+        }
+        pthread_mutex_unlock(&sched->lock);
+        
+        stream->local = allowed ? get_result_channel(task_id, true) : NULL;
+        if (!stream->local) {
+            free(stream);
+            return NULL;
+        }
+        return stream;
+    }
+    
+    // Owner remoto: conectar a su servidor de datos
+    stream->remote_fd = connect_to_node(owner_node);
+    if (stream->remote_fd < 0) {
+        free(stream);
+        return NULL;
+    }
+    
+    return stream;
+}
+
+// Enviar un fragmento MSG_TASK_RESULT por la conexión del flujo
+static int send_result_chunk(ResultStream* stream, const void* data, size_t len,
+                             uint8_t flags, int exit_code) {
+    NetworkMessage msg;
+    msg.type = MSG_TASK_RESULT;
+    msg.sender_id = g_kernel->node_id;
+    msg.timestamp = (uint64_t)time(NULL);
+    msg.payload_size = (uint16_t)(sizeof(ResultChunkHeader) + len);
+    
+    ResultChunkHeader hdr = {
+        .task_id = stream->task_id,
+        .flags = flags,
+        .exit_code = exit_code,
+        .length = (uint16_t)len
+    };
+    memcpy(msg.payload, &hdr, sizeof(hdr));
+    if (len > 0) memcpy(msg.payload + sizeof(hdr), data, len);
+    
+    return send_all(stream->remote_fd, &msg,
+                    sizeof(msg) - sizeof(msg.payload) + msg.payload_size);
+}
+
+// Emitir salida de la tarea; se bloquea si el consumidor va por detrás
+static int result_stream_write(ResultStream* stream, const void* data, size_t len) {
+    if (!stream || (!data && len > 0)) return -1;
+    
+    if (stream->local) {
+        return result_channel_push(stream->local, data, len, true);
+    }
+    
+    const uint8_t* p = data;
+    while (len > 0) {
+        size_t n = len > RESULT_CHUNK_SIZE ? RESULT_CHUNK_SIZE : len;
+        if (send_result_chunk(stream, p, n, 0, 0) < 0) return -1;
+        p += n;
+        len -= n;
+    }
+    
+    return 0;
+}
+
+static void complete_task(uint64_t task_id, int exit_code, void* result, size_t result_size);
+
+// Cerrar el flujo y completar la tarea en su owner
+static void result_stream_close(ResultStream* stream, int exit_code) {
+    if (!stream) return;
+    
+    if (stream->local) {
+        complete_task(stream->task_id, exit_code, NULL, 0);
+    } else {
+        send_result_chunk(stream, NULL, 0, RESULT_FLAG_EOF, exit_code);
+        close(stream->remote_fd);
+    }
+    
+    free(stream);
+}
+
+// Cierre común de una tarea terminada (completada, cancelada o fallida):
+// entrega el resultado si lo hay, cierra el canal de la original (los
+// lectores reciben fin de flujo y los productores dejan de esperar
+// ventana) y aparta su bloque de entrada para free_released_blocks().
+// No hace nada mientras la otra copia especulativa siga viva.
+// Requiere scheduler->lock.
+static void release_task_resources(DistributedScheduler* sched, DistributedTask* task,
+                                   int exit_code, const void* result, size_t result_size) {
+    DistributedTask* primary = task->speculative_of ?
+                               find_task(sched, task->speculative_of) : task;
+    if (!primary) primary = task;
+    
+    DistributedTask* twin = NULL;
+    if (primary != task) {
+        twin = primary;
+    } else if (task->backup_task_id) {
+        twin = find_task(sched, task->backup_task_id);
+    }
+    if (twin && task_is_live(twin)) return;
+    
+    size_t slot = (size_t)(primary - sched->tasks);
+    if (result && result_size > 0 && !sched->channels[slot]) {
+        sched->channels[slot] = result_channel_create(primary->task_id);
+        if (sched->channels[slot]) primary->result_channel = slot + 1;
+    }
+    
+    ResultChannel* ch = sched->channels[slot];
+    if (ch) {
+        // Sin bloquear: nunca espera ventana con el lock del scheduler
+        if (result && result_size > 0) {
+            result_channel_push(ch, result, result_size, false);
+        }
+        result_channel_finish(ch, exit_code);
+    }
+    
+    if (primary->input_block && sched->released_count < MAX_TASKS) {
+        sched->released_blocks[sched->released_count++] = primary->input_block;
+        primary->input_block = 0;
+    }
+}
+
+// Liberar los bloques de entrada apartados. Sin scheduler->lock: liberar
+// un bloque desalojado puede hablar con otro nodo.
+static void free_released_blocks(DistributedScheduler* sched) {
+    uint64_t blocks[MAX_TASKS];
+    
+    pthread_mutex_lock(&sched->lock);
+    size_t count = sched->released_count;
+    memcpy(blocks, sched->released_blocks, count * sizeof(uint64_t));
+    sched->released_count = 0;
+    pthread_mutex_unlock(&sched->lock);
+    
+    for (size_t i = 0; i < count; i++) free_shared_memory(blocks[i]);
+}
+
+// Completar tarea. Si la tarea tiene copia especulativa, el primer resultado
+// correcto gana y la otra copia se cancela.
+static void complete_task(uint64_t task_id, int exit_code, void* result, size_t result_size) {
+    if (!g_kernel) return;
+    
+    DistributedScheduler* sched = g_kernel->scheduler;
+    
+    pthread_mutex_lock(&sched->lock);
+    
+    DistributedTask* task = find_task(sched, task_id);
+    
+    // Ignorar resultados de tareas ya canceladas o resueltas por su copia
+    if (!task || task->status == TASK_CANCELLED || task->status == TASK_COMPLETED) {
+        pthread_mutex_unlock(&sched->lock);
+        return;
+    }
+    
+    DistributedTask* primary = task->speculative_of ?
+                               find_task(sched, task->speculative_of) : task;
+    if (!primary) primary = task;
+    
+    DistributedTask* twin = NULL;
+    if (task->speculative_of) {
+        twin = (primary != task) ? primary : NULL;
+    } else if (task->backup_task_id) {
+        twin = find_task(sched, task->backup_task_id);
+    }
+    
+    // Actualizar reputación del nodo
+    update_node_reputation(task->assigned_node, exit_code == 0);
+    
+    task->completed_at = time(NULL);
+    task->exit_code = exit_code;
+    
+    // Si falla una copia mientras la otra sigue viva, esperar a la otra
+    if (exit_code != 0 && twin && task_is_live(twin)) {
+        task->status = TASK_FAILED;
+        pthread_mutex_unlock(&sched->lock);
+        return;
+    }
+    
+    task->status = (exit_code == 0) ? TASK_COMPLETED : TASK_FAILED;
+    
+    if (primary != task) {
+        primary->status = task->status;
+        primary->completed_at = task->completed_at;
+        primary->exit_code = exit_code;
+        if (exit_code == 0) sched->total_speculative_won++;
+    }
+    
+    if (twin && task_is_live(twin)) {
+        twin->status = TASK_CANCELLED;
+        twin->completed_at = task->completed_at;
+        printf("[SCHEDULER] Tarea %lu cancelada: la copia %lu terminó antes\n",
+               twin->task_id, task->task_id);
+    }
+    
+    // Alimentar la estimación de duración de la clase (admisión EDF y
+    // detección de rezagadas)
+    if (exit_code == 0 && task->dispatched_ms) {
+        double runtime = (double)(current_time_ms() - task->dispatched_ms);
+        int cls = task->priority;
+        
+        sched->avg_runtime_ms = 0.8 * sched->avg_runtime_ms + 0.2 * runtime;
+        sched->class_runtime_ms[cls] = sched->class_samples[cls] ?
+            0.8 * sched->class_runtime_ms[cls] + 0.2 * runtime : runtime;
+        sched->class_samples[cls]++;
+    }
+    
+    if (exit_code == 0) {
+        sched->total_completed++;
+    } else {
+        sched->total_failed++;
+    }
+    
+    // El resultado completo (de cualquier tamaño) se entrega por el canal
+    release_task_resources(sched, task, exit_code, result, result_size);
+    pthread_mutex_unlock(&sched->lock);
+    
+    free_released_blocks(sched);
+}
+
+// Migrar tarea a otro nodo (tolerancia a fallos)
+static bool migrate_task(uint64_t task_id, uint64_t new_node) {
+    if (!g_kernel) return false;
+    
+    pthread_mutex_lock(&g_kernel->scheduler->lock);
+    
+    for (size_t i = 0; i < g_kernel->scheduler->task_count; i++) {
+        DistributedTask* task = &g_kernel->scheduler->tasks[i];
+        
+        if (task->task_id == task_id && 
+            (task->status == TASK_ASSIGNED || task->status == TASK_RUNNING)) {
+            
+            uint64_t old_node = task->assigned_node;
+            task->assigned_node = new_node;
+            task->status = TASK_MIGRATING;
+            g_kernel->scheduler->total_migrated++;
+            
+            printf("[SCHEDULER] Tarea %lu migrada: %016lX -> %016lX\n",
+                   task_id, old_node, new_node);
+            
+            pthread_mutex_unlock(&g_kernel->scheduler->lock);
+            return true;
+        }
+    }
+    
+    pthread_mutex_unlock(&g_kernel->scheduler->lock);
+    return false;
+}
+
+// Cancelar una tarea que excedió su deadline (requiere scheduler->lock)
+static void cancel_task(DistributedScheduler* sched, DistributedTask* task) {
+    task->status = TASK_CANCELLED;
+    task->completed_at = time(NULL);
+    task->exit_code = -ETIMEDOUT;
+    sched->total_deadline_missed++;
+    release_task_resources(sched, task, task->exit_code, NULL, 0);
+    
+    printf("[SCHEDULER] Tarea %lu cancelada: deadline excedido\n", task->task_id);
+}
+
+// Despachar la cola EDF en orden de deadline (requiere scheduler->lock)
+static void dispatch_ready_tasks(DistributedScheduler* sched, uint64_t now) {
+    while (sched->ready_count > 0) {
+        DistributedTask* task = &sched->tasks[ready_heap_pop(sched)];
+        
+        if (task->status != TASK_PENDING) continue;
+        
+        if (task->deadline_ms && now > task->deadline_ms) {
+            cancel_task(sched, task);
+            continue;
+        }
+        
+        dispatch_task(sched, task, select_best_node(task->priority), now);
+    }
+}
+
+// Aplicar deadlines y TASK_TIMEOUT a tareas en ejecución (requiere scheduler->lock)
+static void enforce_task_timeouts(DistributedScheduler* sched, uint64_t now) {
+    for (size_t i = 0; i < sched->task_count; i++) {
+        DistributedTask* task = &sched->tasks[i];
+        
+        if (task->status != TASK_ASSIGNED && task->status != TASK_RUNNING &&
+            task->status != TASK_MIGRATING) {
+            continue;
+        }
+        
+        if (task->deadline_ms) {
+            // Pasado el deadline el resultado ya no sirve: cancelar
+            if (now > task->deadline_ms) {
+                cancel_task(sched, task);
+                update_node_reputation(task->assigned_node, false);
+            }
+            continue;
+        }
+        
+        if (now - task->dispatched_ms < (uint64_t)TASK_TIMEOUT * 1000) continue;
+        
+        // Sin deadline: re-despachar hasta TASK_MAX_ATTEMPTS, luego fallar
+        uint64_t old_node = task->assigned_node;
+        update_node_reputation(old_node, false);
+        
+        if (task->attempts < TASK_MAX_ATTEMPTS &&
+            dispatch_task(sched, task, select_best_node(task->priority), now)) {
+            sched->total_migrated++;
+            printf("[SCHEDULER] Tarea %lu excedió %ds en %016lX, re-despachada\n",
+                   task->task_id, TASK_TIMEOUT, old_node);
+        } else {
+            task->status = TASK_FAILED;
+            task->completed_at = time(NULL);
+            task->exit_code = -ETIMEDOUT;
+            if (!task->speculative_of) sched->total_failed++;
+            release_task_resources(sched, task, task->exit_code, NULL, 0);
+            printf("[SCHEDULER] Tarea %lu fallida por timeout\n", task->task_id);
+        }
+    }
+}
+
+// Copias especulativas activas en el resto del cluster, según heartbeats
+static uint32_t remote_speculative_running(void) {
+    uint32_t total = 0;
+    
+    pthread_mutex_lock(&g_kernel->registry->lock);
+    for (int i = 0; i < g_kernel->registry->count; i++) {
+        NodeInfo* node = &g_kernel->registry->nodes[i];
+        if (node->status == NODE_ACTIVE || node->status == NODE_BUSY) {
+            total += node->speculative_running;
+        }
+    }
+    pthread_mutex_unlock(&g_kernel->registry->lock);
+    
+    return total;
+}
+
+// Lanzar copias especulativas de tareas rezagadas en otro nodo
+// (requiere scheduler->lock)
+static void detect_stragglers(DistributedScheduler* sched, uint64_t now) {
+    uint32_t local = 0;
+    for (size_t i = 0; i < sched->task_count; i++) {
+        if (sched->tasks[i].speculative_of && task_is_live(&sched->tasks[i])) {
+            local++;
+        }
+    }
+    sched->speculative_running = local;
+    
+    uint32_t cluster = local + remote_speculative_running();
+    size_t count = sched->task_count;
+    
+    for (size_t i = 0; i < count && cluster < SPECULATION_BUDGET; i++) {
+        DistributedTask* task = &sched->tasks[i];
+        
+        // Las tareas que ya emiten resultados por streaming no se duplican
+        if (!task_is_live(task) || task->speculative_of || task->backup_task_id ||
+            task->result_channel) {
+            continue;
+        }
+        
+        uint64_t elapsed = now - task->dispatched_ms;
+        uint64_t expected = sched->class_samples[task->priority] ?
+                            class_runtime_estimate(sched, task->priority) :
+                            task->estimated_runtime_ms;
+        
+        if (elapsed < STRAGGLER_MIN_MS || elapsed < expected * STRAGGLER_FACTOR) {
+            continue;
+        }
+        
+        if (sched->task_count >= MAX_TASKS) break;
+        
+        uint64_t target = select_best_node_excluding(task->priority, task->assigned_node);
+        if (!target) continue;
+        
+        size_t backup_idx = sched->task_count++;
+        DistributedTask* backup = &sched->tasks[backup_idx];
+        *backup = *task;
+        memcpy(sched->descriptions[backup_idx], sched->descriptions[i],
+               sizeof(sched->descriptions[i]));
+        backup->task_id = ++sched->next_task_id;
+        backup->speculative_of = task->task_id;
+        backup->backup_task_id = 0;
+        // Las copias no se re-despachan por timeout
+        backup->attempts = TASK_MAX_ATTEMPTS - 1;
+        
+        dispatch_task(sched, backup, target, now);
+        task->backup_task_id = backup->task_id;
+        
+        sched->speculative_running++;
+        sched->total_speculative++;
+        cluster++;
+        
+        printf("[SCHEDULER] Tarea %lu rezagada (%lu ms, esperado %lu ms): copia %lu\n",
+               task->task_id, elapsed, expected, backup->task_id);
+    }
+}
+
+// Thread del scheduler: despacho EDF y vigilancia de timeouts
+static void* scheduler_thread(void* arg) {
+    (void)arg;
+    
+    DistributedScheduler* sched = g_kernel->scheduler;
+    
+    while (g_kernel && g_kernel->running) {
+        pthread_mutex_lock(&sched->lock);
+        
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 100 * 1000000L;  // 100ms
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&sched->task_available, &sched->lock, &ts);
+        
+        uint64_t now = current_time_ms();
+        dispatch_ready_tasks(sched, now);
+        enforce_task_timeouts(sched, now);
+        detect_stragglers(sched, now);
+        
+        pthread_mutex_unlock(&sched->lock);
+        free_released_blocks(sched);
+    }
+    
+    return NULL;
+}
+
+// ============================================================================
+// 3. GESTIÓN DE MEMORIA DISTRIBUIDA
+// ============================================================================
+
+// Cabecera de un slot por índice, o NULL si su segmento aún no existe
+static SharedMemoryBlock* memory_slot(uint32_t index) {
+    SharedMemoryBlock* segment = atomic_load_explicit(
+        &g_kernel->memory->segments[index / MAX_MEMORY_BLOCKS], memory_order_acquire);
+    return segment ? &segment[index % MAX_MEMORY_BLOCKS] : NULL;
+}
+
+// Validar un handle en O(1) sin lock global. El llamador debe volver a
+// comprobar block_id tras tomar el rwlock del bloque.
+static SharedMemoryBlock* lookup_block(uint64_t block_id) {
+    uint32_t index = (uint32_t)block_id;
+    
+    if (!block_id || index >= atomic_load_explicit(&g_kernel->memory->slot_count,
+                                                   memory_order_acquire)) {
+        return NULL;
+    }
+    
+    SharedMemoryBlock* block = memory_slot(index);
+    if (!block || atomic_load_explicit(&block->block_id, memory_order_acquire) != block_id) {
+        return NULL;
+    }
+    
+    return block;
+}
+
+// Obtener un slot libre (requiere memory->lock)
+static SharedMemoryBlock* reserve_block_slot(void) {
+    DistributedMemoryManager* mm = g_kernel->memory;
+    
+    if (mm->free_head != MEMORY_SLOT_NONE) {
+        SharedMemoryBlock* block = memory_slot(mm->free_head);
+        mm->free_head = block->next_free;
+        block->next_free = MEMORY_SLOT_NONE;
+        return block;
+    }
+    
+    uint32_t index = atomic_load(&mm->slot_count);
+    uint32_t seg = index / MAX_MEMORY_BLOCKS;
+    if (seg >= MEMORY_TABLE_SEGMENTS) return NULL;
+    
+    if (!atomic_load(&mm->segments[seg])) {
+        SharedMemoryBlock* segment = calloc(MAX_MEMORY_BLOCKS, sizeof(SharedMemoryBlock));
+        if (!segment) return NULL;
+        
+        for (uint32_t i = 0; i < MAX_MEMORY_BLOCKS; i++) {
+            pthread_rwlock_init(&segment[i].rwlock, NULL);
+        }
+        atomic_store_explicit(&mm->segments[seg], segment, memory_order_release);
+    }
+    
+    atomic_store_explicit(&mm->slot_count, index + 1, memory_order_release);
+    
+    SharedMemoryBlock* block = memory_slot(index);
+    block->slot_index = index;
+    block->next_free = MEMORY_SLOT_NONE;
+    return block;
+}
+
+// Tiering (definido al final de la sección)
+static int fault_in_block(SharedMemoryBlock* block, bool prefetch);
+static size_t tier_reclaim(size_t need, uint64_t min_idle_ms);
+
+// Crear bloque de memoria compartida
+static uint64_t create_shared_memory(size_t size) {
+    if (!g_kernel || !g_kernel->memory || size == 0) return 0;
+    
+    void* data = calloc(1, size);
+    if (!data) {
+        // Sin RAM: desalojar bloques fríos y reintentar una vez
+        tier_reclaim(size, 0);
+        data = calloc(1, size);
+    }
+    if (!data) return 0;
+    
+    pthread_mutex_lock(&g_kernel->memory->lock);
+    
+    SharedMemoryBlock* block = reserve_block_slot();
+    if (!block) {
+        pthread_mutex_unlock(&g_kernel->memory->lock);
+        free(data);
+        return 0;
+    }
+    
+    uint32_t index = block->slot_index;
+    if (++block->generation == 0) block->generation = 1;
+    
     block->owner_node = g_kernel->node_id;
+    block->data = data;
     block->size = size;
     block->version = 1;
     block->ref_count = 1;
-    pthread_rwlock_init(&block->rwlock, NULL);
+    block->is_replicated = false;
+    block->replica_count = 0;
+    block->origin_block = 0;
+    block->tier = TIER_RAM;
+    block->fence = 0;
+    atomic_store_explicit(&block->last_access, current_time_ms(), memory_order_relaxed);
+    
+    uint64_t block_id = ((uint64_t)block->generation << 32) | index;
+    atomic_store_explicit(&block->block_id, block_id, memory_order_release);
+    
+    g_kernel->memory->block_count++;
+    g_kernel->memory->total_allocated += size;
+    size_t resident = atomic_fetch_add(&g_kernel->memory->resident_bytes, size) + size;
+    
+    pthread_mutex_unlock(&g_kernel->memory->lock);
+    
+    // Por encima del límite: que el hilo de tiering desaloje en segundo plano
+    if (g_kernel->memory->tier_limit && resident > g_kernel->memory->tier_limit) {
+        pthread_cond_signal(&g_kernel->memory->tier_wakeup);
+    }
+    
+    return block_id;
+}
+
+static inline size_t block_bitmap_words(size_t size) {
+    size_t pages = (size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+    return (pages + 63) / 64;
+}
+
+// Marcar las páginas [first, last] en un bitmap de páginas sucias
+static void mark_pages_dirty(uint64_t* bitmap, size_t first, size_t last) {
+    for (size_t page = first; page <= last; ) {
+        size_t bit = page % 64;
+        size_t n = 64 - bit;
+        if (n > last - page + 1) n = last - page + 1;
+        
+        uint64_t mask = n == 64 ? UINT64_MAX : ((1ULL << n) - 1) << bit;
+        bitmap[page / 64] |= mask;
+        page += n;
+    }
+}
+
+// Escribir en memoria compartida bajo un lock: con fencing_token != 0 se
+// rechaza la escritura si el bloque ya vio un token mayor
+static int write_shared_memory_fenced(uint64_t block_id, const void* data,
+                                      size_t size, size_t offset, uint64_t fencing_token) {
+    if (!g_kernel || !data) return -1;
+    
+    SharedMemoryBlock* block = lookup_block(block_id);
+    if (!block) return -1;
+    
+    pthread_rwlock_wrlock(&block->rwlock);
+    
+    // El bloque pudo liberarse entre la búsqueda y el lock
+    if (atomic_load(&block->block_id) != block_id || offset + size > block->size ||
+        (!block->data && fault_in_block(block, false) < 0)) {
+        pthread_rwlock_unlock(&block->rwlock);
+        return -1;
+    }
+    
+    if (fencing_token) {
+        if (fencing_token < block->fence) {
+            uint64_t fence = block->fence;
+            pthread_rwlock_unlock(&block->rwlock);
+            printf("[SYNC] Escritura en bloque %lu rechazada: token %016lX < %016lX\n",
+                   block_id, fencing_token, fence);
+            return -1;
+        }
+        block->fence = fencing_token;
+    }
+    
+    atomic_store_explicit(&block->last_access, current_time_ms(), memory_order_relaxed);
+    memcpy((uint8_t*)block->data + offset, data, size);
+    block->version++;
+    
+    // Cada réplica acumula sus propias páginas pendientes
+    if (size > 0) {
+        size_t first = offset / MEMORY_PAGE_SIZE;
+        size_t last = (offset + size - 1) / MEMORY_PAGE_SIZE;
+        for (int r = 0; r < block->replica_count; r++) {
+            mark_pages_dirty(block->replica_dirty[r], first, last);
+        }
+    }
+    pthread_rwlock_unlock(&block->rwlock);
+    
+    return 0;
+}
+
+// Escribir en memoria compartida
+static int write_shared_memory(uint64_t block_id, const void* data, 
+                               size_t size, size_t offset) {
+    return write_shared_memory_fenced(block_id, data, size, offset, 0);
+}
+
+// Leer de memoria compartida
+static int read_shared_memory(uint64_t block_id, void* buffer, 
+                              size_t size, size_t offset) {
+    if (!g_kernel || !buffer) return -1;
+    
+    SharedMemoryBlock* block = lookup_block(block_id);
+    if (!block) return -1;
+    
+    pthread_rwlock_rdlock(&block->rwlock);
+    
+    while (atomic_load(&block->block_id) == block_id && !block->data) {
+        // Desalojado: traerlo con el lock exclusivo y volver a comprobar
+        pthread_rwlock_unlock(&block->rwlock);
+        pthread_rwlock_wrlock(&block->rwlock);
+        int rc = atomic_load(&block->block_id) == block_id && !block->data ?
+                 fault_in_block(block, false) : 0;
+        pthread_rwlock_unlock(&block->rwlock);
+        if (rc < 0) return -1;
+        pthread_rwlock_rdlock(&block->rwlock);
+    }
+    
+    if (atomic_load(&block->block_id) != block_id || offset + size > block->size) {
+        pthread_rwlock_unlock(&block->rwlock);
+        return -1;
+    }
+    
+    atomic_store_explicit(&block->last_access, current_time_ms(), memory_order_relaxed);
+    memcpy(buffer, (uint8_t*)block->data + offset, size);
+    pthread_rwlock_unlock(&block->rwlock);
+    
+    return 0;
+}
+
+// Enviar un tramo del bloque como mensajes MSG_MEMORY_REPLICATE hacia el
+// bloque remote del receptor (requiere el rwlock del bloque)
+static int send_replica_range(int fd, SharedMemoryBlock* block, uint64_t remote,
+                              size_t offset, size_t len, uint8_t flags) {
+    NetworkMessage msg;
+    msg.type = MSG_MEMORY_REPLICATE;
+    msg.sender_id = g_kernel->node_id;
+    msg.timestamp = (uint64_t)time(NULL);
+    
+    ReplicaPageHeader hdr = {
+        .block_id = block->block_id,
+        .replica_block = remote,
+        .block_size = block->size,
+        .version = block->version
+    };
+    
+    do {
+        size_t n = len > REPLICA_CHUNK_SIZE ? REPLICA_CHUNK_SIZE : len;
+        hdr.offset = offset;
+        hdr.length = (uint16_t)n;
+        hdr.flags = n == len ? flags : 0;
+        
+        memcpy(msg.payload, &hdr, sizeof(hdr));
+        memcpy(msg.payload + sizeof(hdr), (uint8_t*)block->data + offset, n);
+        msg.payload_size = (uint16_t)(sizeof(hdr) + n);
+        
+        if (send_all(fd, &msg, sizeof(msg) - sizeof(msg.payload) + msg.payload_size) < 0) {
+            return -1;
+        }
+        offset += n;
+        len -= n;
+    } while (len > 0);
+    
+    return 0;
+}
+
+// Recibir un mensaje de memoria con el timeout de confirmación de réplica
+static int recv_memory_message(int fd, NetworkMessage* msg) {
+    struct timeval tv = { .tv_sec = REPLICA_ACK_TIMEOUT, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    
+    const size_t header_size = sizeof(*msg) - sizeof(msg->payload);
+    if (recv_all(fd, msg, header_size) < 0 ||
+        msg->payload_size > sizeof(msg->payload) ||
+        recv_all(fd, msg->payload, msg->payload_size) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Esperar la confirmación (MSG_MEMORY_RESPONSE) de un envío de réplica
+static int recv_replica_ack(int fd, ReplicaAck* ack) {
+    NetworkMessage msg;
+    if (recv_memory_message(fd, &msg) < 0 ||
+        msg.type != MSG_MEMORY_RESPONSE || msg.payload_size < sizeof(*ack)) {
+        return -1;
+    }
+    memcpy(ack, msg.payload, sizeof(*ack));
+    return 0;
+}
+
+// Sincronizar una réplica: enviar solo las páginas sucias, agrupadas en
+// tramos contiguos, y esperar a que confirme la versión. Devuelve los bytes
+// enviados o -1 si la réplica no confirmó (sus páginas vuelven a quedar
+// pendientes).
+static ssize_t sync_replica(uint64_t block_id, int r) {
+    SharedMemoryBlock* block = lookup_block(block_id);
+    if (!block) return -1;
+    
+    // El rdlock deja leer durante el envío pero frena a los escritores, así
+    // las páginas enviadas corresponden exactamente a la versión anunciada
+    pthread_rwlock_rdlock(&block->rwlock);
+    if (atomic_load(&block->block_id) != block_id || r >= block->replica_count) {
+        pthread_rwlock_unlock(&block->rwlock);
+        return -1;
+    }
+    
+    uint32_t version = block->version;
+    if (block->replica_acked[r] == version) {
+        pthread_rwlock_unlock(&block->rwlock);
+        return 0;
+    }
+    
+    size_t words = block_bitmap_words(block->size);
+    uint64_t* pending = malloc(words * sizeof(uint64_t));
+    int fd = pending ? connect_to_node(block->replica_nodes[r]) : -1;
+    if (fd < 0) {
+        pthread_rwlock_unlock(&block->rwlock);
+        free(pending);
+        return -1;
+    }
+    
+    // Tomar las páginas pendientes; si el envío falla se devuelven
+    memcpy(pending, block->replica_dirty[r], words * sizeof(uint64_t));
+    memset(block->replica_dirty[r], 0, words * sizeof(uint64_t));
+    
+    size_t pages = (block->size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+    size_t bytes = 0, sent_pages = 0;
+    int rc = 0;
+    
+    for (size_t page = 0; page < pages && rc == 0; ) {
+        if (!(pending[page / 64] & (1ULL << (page % 64)))) {
+            page++;
+            continue;
+        }
+        
+        size_t end = page;
+        while (end < pages && (pending[end / 64] & (1ULL << (end % 64)))) end++;
+        
+        size_t offset = page * MEMORY_PAGE_SIZE;
+        size_t len = end * MEMORY_PAGE_SIZE;
+        if (len > block->size) len = block->size;
+        len -= offset;
+        
+        rc = send_replica_range(fd, block, block->replica_remote[r], offset, len, 0);
+        bytes += len;
+        sent_pages += end - page;
+        page = end;
+    }
+    
+    // Tramo vacío de cierre: el receptor fija la versión y confirma
+    if (rc == 0) {
+        rc = send_replica_range(fd, block, block->replica_remote[r], 0, 0,
+                                REPLICA_FLAG_COMMIT);
+    }
+    pthread_rwlock_unlock(&block->rwlock);
+    
+    ReplicaAck ack = {0};
+    if (rc == 0) {
+        rc = recv_replica_ack(fd, &ack);
+    }
+    close(fd);
+    
+    pthread_rwlock_rdlock(&block->rwlock);
+    if (atomic_load(&block->block_id) == block_id && r < block->replica_count) {
+        if (rc == 0 && ack.version == version) {
+            block->replica_acked[r] = version;
+            block->replica_remote[r] = ack.replica_block;
+        } else if (rc == 0) {
+            // El receptor no reconoce la réplica: próxima vez, copia completa
+            block->replica_remote[r] = 0;
+            mark_pages_dirty(block->replica_dirty[r], 0,
+                             (block->size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE - 1);
+            rc = -1;
+        } else {
+            for (size_t w = 0; w < words; w++) {
+                block->replica_dirty[r][w] |= pending[w];
+            }
+        }
+    }
+    pthread_rwlock_unlock(&block->rwlock);
+    
+    free(pending);
+    
+    if (rc < 0) return -1;
+    
+    g_kernel->memory->replica_syncs++;
+    g_kernel->memory->replica_bytes_sent += bytes;
+    g_kernel->memory->replica_pages_sent += sent_pages;
+    return (ssize_t)bytes;
+}
+
+// Sincronizar todas las réplicas de un bloque. Devuelve los bytes de datos
+// enviados, o -1 si alguna réplica no confirmó.
+static ssize_t sync_memory_replicas(uint64_t block_id) {
+    if (!g_kernel) return -1;
+    
+    SharedMemoryBlock* block = lookup_block(block_id);
+    if (!block) return -1;
+    
+    pthread_mutex_lock(&g_kernel->memory->sync_lock);
+    
+    ssize_t total = 0;
+    bool failed = false;
+    for (int r = 0; r < MAX_REPLICAS; r++) {
+        pthread_rwlock_rdlock(&block->rwlock);
+        bool exists = atomic_load(&block->block_id) == block_id && r < block->replica_count;
+        pthread_rwlock_unlock(&block->rwlock);
+        if (!exists) break;
+        
+        ssize_t sent = sync_replica(block_id, r);
+        if (sent < 0) {
+            failed = true;
+        } else {
+            total += sent;
+        }
+    }
+    
+    pthread_mutex_unlock(&g_kernel->memory->sync_lock);
+    
+    return failed ? -1 : total;
+}
+
+// Replicar bloque de memoria a otro nodo: la primera sincronización envía
+// el bloque completo, las siguientes solo las páginas escritas
+static int replicate_memory_block(uint64_t block_id, uint64_t target_node) {
+    if (!g_kernel || target_node == g_kernel->node_id) return -1;
+    
+    pthread_mutex_lock(&g_kernel->memory->lock);
+    
+    SharedMemoryBlock* block = lookup_block(block_id);
+    if (!block) {
+        pthread_mutex_unlock(&g_kernel->memory->lock);
+        return -1;
+    }
+    
+    // Los escritores recorren la lista de réplicas con el rwlock tomado
+    pthread_rwlock_wrlock(&block->rwlock);
+    
+    bool duplicate = false;
+    for (int r = 0; r < block->replica_count; r++) {
+        if (block->replica_nodes[r] == target_node) duplicate = true;
+    }
+    
+    size_t words = block_bitmap_words(block->size);
+    uint64_t* dirty = NULL;
+    if (!duplicate && block->replica_count < MAX_REPLICAS && !block->origin_block) {
+        dirty = calloc(words, sizeof(uint64_t));
+    }
+    
+    // La copia inicial se envía desde RAM
+    if (dirty && !block->data && fault_in_block(block, false) < 0) {
+        free(dirty);
+        dirty = NULL;
+    }
+    
+    if (!dirty) {
+        pthread_rwlock_unlock(&block->rwlock);
+        pthread_mutex_unlock(&g_kernel->memory->lock);
+        return duplicate ? 0 : -1;
+    }
+    
+    int r = block->replica_count++;
+    mark_pages_dirty(dirty, 0, (block->size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE - 1);
+    block->replica_nodes[r] = target_node;
+    block->replica_dirty[r] = dirty;
+    block->replica_acked[r] = 0;
+    block->replica_remote[r] = 0;
+    block->is_replicated = true;
+    g_kernel->memory->total_shared += block->size;
+    
+    pthread_rwlock_unlock(&block->rwlock);
+    pthread_mutex_unlock(&g_kernel->memory->lock);
+    
+    printf("[MEMORY] Bloque %lu replicado al nodo %016lX\n", block_id, target_node);
+    
+    // Copia inicial; si falla, las páginas quedan pendientes para el próximo sync
+    return sync_memory_replicas(block_id) < 0 ? -1 : 0;
+}
+
+// Aplicar un tramo recibido de un bloque remoto. *local guarda el bloque
+// réplica entre tramos de la misma conexión (0 = aún no resuelto,
+// UINT64_MAX = réplica desconocida). Devuelve 1 tras el tramo de cierre.
+static int apply_replica_range(int fd, NetworkMessage* msg, uint64_t* local) {
+    ReplicaPageHeader hdr;
+    if (msg->payload_size < sizeof(hdr)) return -1;
+    memcpy(&hdr, msg->payload, sizeof(hdr));
+    if (hdr.length > msg->payload_size - sizeof(hdr)) return -1;
+    
+    if (*local == 0) {
+        if (hdr.replica_block) {
+            // Solo aceptar deltas sobre una réplica válida de ese bloque
+            SharedMemoryBlock* block = lookup_block(hdr.replica_block);
+            bool valid = false;
+            if (block) {
+                pthread_rwlock_rdlock(&block->rwlock);
+                valid = atomic_load(&block->block_id) == hdr.replica_block &&
+                        block->owner_node == msg->sender_id &&
+                        block->origin_block == hdr.block_id &&
+                        block->size == hdr.block_size;
+                pthread_rwlock_unlock(&block->rwlock);
+            }
+            *local = valid ? hdr.replica_block : UINT64_MAX;
+        } else {
+            *local = create_shared_memory(hdr.block_size);
+            SharedMemoryBlock* block = *local ? lookup_block(*local) : NULL;
+            if (!block) {
+                *local = UINT64_MAX;
+            } else {
+                pthread_rwlock_wrlock(&block->rwlock);
+                block->owner_node = msg->sender_id;
+                block->origin_block = hdr.block_id;
+                pthread_rwlock_unlock(&block->rwlock);
+            }
+        }
+    }
+    
+    if (*local != UINT64_MAX && hdr.length > 0) {
+        write_shared_memory(*local, msg->payload + sizeof(hdr), hdr.length, hdr.offset);
+    }
+    
+    if (!(hdr.flags & REPLICA_FLAG_COMMIT)) return 0;
+    
+    ReplicaAck ack = { .block_id = hdr.block_id };
+    SharedMemoryBlock* block = *local != UINT64_MAX ? lookup_block(*local) : NULL;
+    if (block) {
+        pthread_rwlock_wrlock(&block->rwlock);
+        if (atomic_load(&block->block_id) == *local) {
+            block->version = hdr.version;
+            ack.replica_block = *local;
+            ack.version = hdr.version;
+        }
+        pthread_rwlock_unlock(&block->rwlock);
+    }
+    
+    NetworkMessage reply;
+    reply.type = MSG_MEMORY_RESPONSE;
+    reply.sender_id = g_kernel->node_id;
+    reply.timestamp = (uint64_t)time(NULL);
+    reply.payload_size = sizeof(ack);
+    memcpy(reply.payload, &ack, sizeof(ack));
+    send_all(fd, &reply, sizeof(reply) - sizeof(reply.payload) + reply.payload_size);
+    
+    *local = 0;
+    return 1;
+}
+
+// ----------------------------------------------------------------------------
+// Tiering por presión de memoria
+// ----------------------------------------------------------------------------
+
+static void tier_spill_path(uint64_t block_id, char* path, size_t len) {
+    snprintf(path, len, "%s/%016lX.blk", g_kernel->memory->spill_dir, block_id);
+}
+
+static void tier_unlink_spill_file(uint64_t block_id) {
+    char path[128];
+    tier_spill_path(block_id, path, sizeof(path));
+    unlink(path);
+}
+
+// Nodo activo con más RAM libre que pueda guardar size bytes con holgura
+static uint64_t select_spill_peer(size_t size) {
+    uint64_t best = 0;
+    uint32_t best_mb = 0;
+    size_t need_mb = (2 * size) / (1024 * 1024) + 1;
+    
+    pthread_mutex_lock(&g_kernel->registry->lock);
+    for (int i = 0; i < g_kernel->registry->count; i++) {
+        NodeInfo* node = &g_kernel->registry->nodes[i];
+        if (node->status != NODE_ACTIVE || node->is_local ||
+            node->memory_usage > TIER_PEER_MAX_USAGE ||
+            node->memory_available_mb < need_mb) {
+            continue;
+        }
+        if (node->memory_available_mb > best_mb) {
+            best_mb = node->memory_available_mb;
+            best = node->node_id;
+        }
+    }
+    pthread_mutex_unlock(&g_kernel->registry->lock);
+    
+    return best;
+}
+
+// Copiar el bloque completo a un nodo remoto con el protocolo de réplicas;
+// el receptor lo guarda como bloque propio y devuelve su handle
+// (requiere el wrlock del bloque)
+static int spill_to_peer(SharedMemoryBlock* block, uint64_t peer) {
+    int fd = connect_to_node(peer);
+    if (fd < 0) return -1;
+    
+    ReplicaAck ack = {0};
+    int rc = send_replica_range(fd, block, 0, 0, block->size, REPLICA_FLAG_COMMIT);
+    if (rc == 0) {
+        rc = recv_replica_ack(fd, &ack);
+    }
+    close(fd);
+    
+    if (rc < 0 || ack.version != block->version || !ack.replica_block) return -1;
+    
+    block->spill_node = peer;
+    block->spill_remote = ack.replica_block;
+    return 0;
+}
+
+static int spill_to_disk(SharedMemoryBlock* block) {
+    char path[128];
+    tier_spill_path(block->block_id, path, sizeof(path));
+    
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return -1;
+    
+    size_t done = 0;
+    while (done < block->size) {
+        ssize_t n = pwrite(fd, (uint8_t*)block->data + done, block->size - done, (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    close(fd);
+    
+    if (done < block->size) {
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Desalojar un bloque: primero a un nodo con memoria libre, si no a disco.
+// Devuelve los bytes liberados o -1.
+static ssize_t spill_block(uint64_t block_id) {
+    SharedMemoryBlock* block = lookup_block(block_id);
+    if (!block) return -1;
+    
+    // Sin esperar: un bloque con el lock tomado no está frío
+    if (pthread_rwlock_trywrlock(&block->rwlock) != 0) return -1;
+    
+    if (atomic_load(&block->block_id) != block_id || !block->data ||
+        block->replica_count > 0 || block->origin_block) {
+        pthread_rwlock_unlock(&block->rwlock);
+        return -1;
+    }
+    
+    uint64_t peer = select_spill_peer(block->size);
+    int tier = TIER_PEER;
+    if (!peer || spill_to_peer(block, peer) < 0) {
+        tier = TIER_DISK;
+        if (spill_to_disk(block) < 0) {
+            pthread_rwlock_unlock(&block->rwlock);
+            return -1;
+        }
+    }
+    
+    free(block->data);
+    block->data = NULL;
+    block->tier = (uint8_t)tier;
+    size_t size = block->size;
+    pthread_rwlock_unlock(&block->rwlock);
+    
+    DistributedMemoryManager* mm = g_kernel->memory;
+    atomic_fetch_sub(&mm->resident_bytes, size);
+    pthread_mutex_lock(&mm->tier_lock);
+    mm->spilled_bytes += size;
+    if (tier == TIER_PEER) {
+        mm->spills_peer++;
+    } else {
+        mm->spills_disk++;
+    }
+    pthread_mutex_unlock(&mm->tier_lock);
+    
+    if (tier == TIER_PEER) {
+        printf("[TIER] Bloque %lu (%zu bytes) desalojado al nodo %016lX\n",
+               block_id, size, peer);
+    } else {
+        printf("[TIER] Bloque %lu (%zu bytes) desalojado a disco\n", block_id, size);
+    }
+    return (ssize_t)size;
+}
+
+static int fetch_from_disk(SharedMemoryBlock* block, void* data) {
+    char path[128];
+    tier_spill_path(block->block_id, path, sizeof(path));
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    
+    size_t done = 0;
+    while (done < block->size) {
+        ssize_t n = pread(fd, (uint8_t*)data + done, block->size - done, (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    close(fd);
+    
+    if (done < block->size) return -1;
+    unlink(path);
+    return 0;
+}
+
+// Pedir a un nodo la copia de un bloque desalojado en él
+static int send_spill_request(int fd, uint64_t block_id, uint64_t remote, uint8_t flags) {
+    NetworkMessage msg;
+    msg.type = MSG_MEMORY_REQUEST;
+    msg.sender_id = g_kernel->node_id;
+    msg.timestamp = (uint64_t)time(NULL);
+    
+    SpillRequest req = { .block_id = block_id, .remote_block = remote, .flags = flags };
+    memcpy(msg.payload, &req, sizeof(req));
+    msg.payload_size = sizeof(req);
+    
+    return send_all(fd, &msg, sizeof(msg) - sizeof(msg.payload) + msg.payload_size);
+}
+
+// Traer el contenido desde el nodo que lo guarda y liberar allí la copia
+static int fetch_from_peer(SharedMemoryBlock* block, void* data) {
+    int fd = connect_to_node(block->spill_node);
+    if (fd < 0) return -1;
+    
+    int rc = send_spill_request(fd, block->block_id, block->spill_remote,
+                                SPILL_FLAG_FETCH | SPILL_FLAG_RELEASE);
+    size_t received = 0;
+    
+    while (rc == 0) {
+        NetworkMessage msg;
+        ReplicaPageHeader hdr;
+        if (recv_memory_message(fd, &msg) < 0 || msg.type != MSG_MEMORY_REPLICATE ||
+            msg.payload_size < sizeof(hdr)) {
+            rc = -1;
+            break;
+        }
+        memcpy(&hdr, msg.payload, sizeof(hdr));
+        if (hdr.block_size != block->size || hdr.length > msg.payload_size - sizeof(hdr) ||
+            hdr.offset + hdr.length > block->size) {
+            rc = -1;
+            break;
+        }
+        memcpy((uint8_t*)data + hdr.offset, msg.payload + sizeof(hdr), hdr.length);
+        received += hdr.length;
+        if (hdr.flags & REPLICA_FLAG_COMMIT) break;
+    }
+    close(fd);
+    
+    return rc == 0 && received == block->size ? 0 : -1;
+}
+
+// Descartar la copia remota de un bloque liberado mientras estaba desalojado
+static void tier_release_peer_copy(uint64_t block_id, uint64_t node, uint64_t remote) {
+    int fd = connect_to_node(node);
+    if (fd < 0) return;
+    send_spill_request(fd, block_id, remote, SPILL_FLAG_RELEASE);
+    close(fd);
+}
+
+// Atender en el nodo que guarda la copia una petición de su owner
+static int serve_spill_request(int fd, NetworkMessage* msg) {
+    SpillRequest req;
+    if (msg->payload_size < sizeof(req)) return -1;
+    memcpy(&req, msg->payload, sizeof(req));
+    
+    SharedMemoryBlock* block = lookup_block(req.remote_block);
+    bool valid = false;
+    if (block) {
+        pthread_rwlock_rdlock(&block->rwlock);
+        valid = atomic_load(&block->block_id) == req.remote_block &&
+                block->owner_node == msg->sender_id &&
+                block->origin_block == req.block_id && block->data;
+        if (valid && (req.flags & SPILL_FLAG_FETCH) &&
+            send_replica_range(fd, block, req.block_id, 0, block->size,
+                               REPLICA_FLAG_COMMIT) < 0) {
+            valid = false;
+        }
+        pthread_rwlock_unlock(&block->rwlock);
+    }
+    
+    if (valid && (req.flags & SPILL_FLAG_RELEASE)) {
+        free_shared_memory(req.remote_block);
+    } else if (!valid && (req.flags & SPILL_FLAG_FETCH)) {
+        // Copia desconocida: responder con una confirmación vacía
+        ReplicaAck ack = { .block_id = req.block_id };
+        NetworkMessage reply;
+        reply.type = MSG_MEMORY_RESPONSE;
+        reply.sender_id = g_kernel->node_id;
+        reply.timestamp = (uint64_t)time(NULL);
+        reply.payload_size = sizeof(ack);
+        memcpy(reply.payload, &ack, sizeof(ack));
+        send_all(fd, &reply, sizeof(reply) - sizeof(reply.payload) + reply.payload_size);
+    }
+    
+    return 1;
+}
+
+// Traer de vuelta a RAM un bloque desalojado (requiere el wrlock del bloque).
+// Dos fallos seguidos en bloques consecutivos piden prefetch de los siguientes.
+static int fault_in_block(SharedMemoryBlock* block, bool prefetch) {
+    DistributedMemoryManager* mm = g_kernel->memory;
+    
+    void* data = malloc(block->size);
+    if (!data) {
+        tier_reclaim(block->size, 0);
+        data = malloc(block->size);
+    }
+    if (!data) return -1;
+    
+    int rc = block->tier == TIER_PEER ? fetch_from_peer(block, data) :
+             block->tier == TIER_DISK ? fetch_from_disk(block, data) : -1;
+    if (rc < 0) {
+        free(data);
+        printf("[TIER] ⚠ No se pudo recuperar el bloque %lu\n", block->block_id);
+        return -1;
+    }
+    
+    block->data = data;
+    block->tier = TIER_RAM;
+    block->spill_node = 0;
+    block->spill_remote = 0;
+    atomic_store_explicit(&block->last_access, current_time_ms(), memory_order_relaxed);
+    size_t resident = atomic_fetch_add(&mm->resident_bytes, block->size) + block->size;
+    
+    uint32_t index = (uint32_t)block->block_id;
+    pthread_mutex_lock(&mm->tier_lock);
+    mm->spilled_bytes -= block->size;
+    if (prefetch) {
+        mm->tier_prefetches++;
+    } else {
+        mm->tier_fetches++;
+        if (mm->last_fault != MEMORY_SLOT_NONE && index == mm->last_fault + 1) {
+            mm->prefetch_next = index + 1;
+            mm->prefetch_left = TIER_PREFETCH_DEPTH;
+        }
+    }
+    // Un bloque adelantado cuenta como fallo para seguir la secuencia
+    mm->last_fault = index;
+    if (mm->prefetch_left > 0 || (mm->tier_limit && resident > mm->tier_limit)) {
+        pthread_cond_signal(&mm->tier_wakeup);
+    }
+    pthread_mutex_unlock(&mm->tier_lock);
+    
+    return 0;
+}
+
+// Bloque propio residente sin réplicas usado hace más tiempo
+static uint64_t select_cold_block(uint64_t min_idle_ms) {
+    uint64_t now = current_time_ms();
+    uint64_t victim = 0, oldest = UINT64_MAX;
+    
+    uint32_t slots = atomic_load(&g_kernel->memory->slot_count);
+    for (uint32_t i = 0; i < slots; i++) {
+        SharedMemoryBlock* b = memory_slot(i);
+        uint64_t id = atomic_load(&b->block_id);
+        uint64_t last = atomic_load_explicit(&b->last_access, memory_order_relaxed);
+        if (!id || last >= oldest || now - last < min_idle_ms) continue;
+        if (pthread_rwlock_tryrdlock(&b->rwlock) != 0) continue;
+        
+        if (atomic_load(&b->block_id) == id && b->data &&
+            b->replica_count == 0 && !b->origin_block) {
+            victim = id;
+            oldest = last;
+        }
+        pthread_rwlock_unlock(&b->rwlock);
+    }
+    
+    return victim;
+}
+
+// Desalojar bloques fríos si hay presión: por encima de la marca alta de RAM
+// del sistema, del límite configurado, o cuando hacen falta need bytes.
+// Devuelve los bytes liberados.
+static size_t tier_reclaim(size_t need, uint64_t min_idle_ms) {
+    DistributedMemoryManager* mm = g_kernel->memory;
+    size_t limit = mm->tier_limit;
+    
+    bool over_limit = limit && atomic_load(&mm->resident_bytes) + need > limit;
+    bool pressure = get_memory_usage() > TIER_HIGH_WATERMARK;
+    if (!need && !over_limit && !pressure) return 0;
+    
+    size_t freed = 0;
+    for (int i = 0; i < TIER_MAX_SPILLS; i++) {
+        size_t resident = atomic_load(&mm->resident_bytes);
+        bool more = freed < need ||
+                    (over_limit && resident + need > (size_t)(limit * TIER_LIMIT_LOW)) ||
+                    (pressure && get_memory_usage() > TIER_LOW_WATERMARK);
+        if (!more) break;
+        
+        uint64_t victim = select_cold_block(min_idle_ms);
+        if (!victim) break;
+        
+        ssize_t n = spill_block(victim);
+        if (n > 0) freed += (size_t)n;
+    }
+    
+    return freed;
+}
+
+// Adelantar los bloques siguientes a un acceso secuencial
+static void tier_prefetch(void) {
+    DistributedMemoryManager* mm = g_kernel->memory;
+    
+    pthread_mutex_lock(&mm->tier_lock);
+    while (mm->prefetch_left > 0) {
+        uint32_t index = mm->prefetch_next++;
+        mm->prefetch_left--;
+        pthread_mutex_unlock(&mm->tier_lock);
+        
+        SharedMemoryBlock* block = index < atomic_load(&mm->slot_count) ?
+                                   memory_slot(index) : NULL;
+        uint64_t id = block ? atomic_load(&block->block_id) : 0;
+        if (id) {
+            pthread_rwlock_wrlock(&block->rwlock);
+            if (atomic_load(&block->block_id) == id && !block->data) {
+                fault_in_block(block, true);
+            }
+            pthread_rwlock_unlock(&block->rwlock);
+        }
+        
+        pthread_mutex_lock(&mm->tier_lock);
+    }
+    pthread_mutex_unlock(&mm->tier_lock);
+}
+
+// Thread de tiering: prefetch pendiente y desalojo periódico por presión
+static void* tiering_thread(void* arg) {
+    (void)arg;
+    DistributedMemoryManager* mm = g_kernel->memory;
+    
+    while (g_kernel && g_kernel->running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        
+        pthread_mutex_lock(&mm->tier_lock);
+        if (mm->prefetch_left == 0) {
+            pthread_cond_timedwait(&mm->tier_wakeup, &mm->tier_lock, &deadline);
+        }
+        pthread_mutex_unlock(&mm->tier_lock);
+        if (!g_kernel->running) break;
+        
+        tier_prefetch();
+        tier_reclaim(0, TIER_MIN_IDLE_MS);
+    }
+    
+    return NULL;
+}
+
+// Liberar bloque de memoria
+static void free_shared_memory(uint64_t block_id) {
+    if (!g_kernel) return;
+    
+    uint64_t spill_node = 0, spill_remote = 0;
+    
+    pthread_mutex_lock(&g_kernel->memory->lock);
+    
+    SharedMemoryBlock* block = lookup_block(block_id);
+    
+    if (block && --block->ref_count <= 0) {
+        // Esperar a lectores/escritores en curso e invalidar el handle
+        pthread_rwlock_wrlock(&block->rwlock);
+        atomic_store_explicit(&block->block_id, 0, memory_order_release);
+        if (block->data) {
+            atomic_fetch_sub(&g_kernel->memory->resident_bytes, block->size);
+        } else {
+            // Desalojado: descartar la copia en disco o en el otro nodo
+            if (block->tier == TIER_DISK) {
+                tier_unlink_spill_file(block_id);
+            } else if (block->tier == TIER_PEER) {
+                spill_node = block->spill_node;
+                spill_remote = block->spill_remote;
+            }
+            pthread_mutex_lock(&g_kernel->memory->tier_lock);
+            g_kernel->memory->spilled_bytes -= block->size;
+            pthread_mutex_unlock(&g_kernel->memory->tier_lock);
+            block->tier = TIER_RAM;
+        }
+        free(block->data);
+        block->data = NULL;
+        for (int r = 0; r < block->replica_count; r++) {
+            free(block->replica_dirty[r]);
+            block->replica_dirty[r] = NULL;
+        }
+        g_kernel->memory->total_shared -= block->size * block->replica_count;
+        block->replica_count = 0;
+        pthread_rwlock_unlock(&block->rwlock);
+        
+        g_kernel->memory->total_allocated -= block->size;
+        g_kernel->memory->block_count--;
+        
+        block->next_free = g_kernel->memory->free_head;
+        g_kernel->memory->free_head = (uint32_t)block_id;
+    }
+    
+    pthread_mutex_unlock(&g_kernel->memory->lock);
+    
+    if (spill_node) {
+        tier_release_peer_copy(block_id, spill_node, spill_remote);
+    }
+}
+
+// ============================================================================
+// 4. SINCRONIZACIÓN DE PROCESOS DISTRIBUIDOS
+// ============================================================================
+
+// Cada lock tiene un nodo hogar (rendezvous hashing sobre los nodos activos)
+// que guarda la cola FIFO y concede. Un nodo remoto pide con MSG_SYNC_LOCK
+// por una conexión que deja abierta: la concesión (MSG_SYNC_GRANT) le llega
+// por ella en cuanto el anterior libera, y por ella devuelve el lock con
+// MSG_SYNC_UNLOCK. El lease del dueño se renueva con cada heartbeat suyo.
+// En lectura la conexión queda abierta mientras dure el lease cacheado: si
+// llega un escritor, el hogar manda MSG_SYNC_REVOKE y espera a que el nodo
+// devuelva el lease (o a que venza) antes de concederle.
+
+// ID de lock igual en todos los nodos: hash FNV-1a del nombre
+static uint64_t lock_name_hash(const char* name) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *name; name++) {
+        h ^= (uint8_t)*name;
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+static uint64_t lock_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Nodo hogar: el de mayor peso hash(lock, nodo) entre los activos
+static uint64_t lock_home(uint64_t lock_id) {
+    uint64_t best = g_kernel->node_id;
+    uint64_t best_score = lock_mix(lock_id ^ best);
     
-    g_kernel->memory->blocks[g_kernel->memory->block_count++] = block;
-    g_kernel->memory->total_allocated += size;
+    pthread_mutex_lock(&g_kernel->registry->lock);
+    for (int i = 0; i < g_kernel->registry->count; i++) {
+        NodeInfo* node = &g_kernel->registry->nodes[i];
+        if (node->status != NODE_ACTIVE && node->status != NODE_BUSY) continue;
+        uint64_t score = lock_mix(lock_id ^ node->node_id);
+        if (score > best_score) {
+            best_score = score;
+            best = node->node_id;
+        }
+    }
+    pthread_mutex_unlock(&g_kernel->registry->lock);
     
-    pthread_mutex_unlock(&g_kernel->memory->lock);
+    return best;
+}
+
+// Partición y bucket salen de mitades distintas del hash mezclado
+static LockShard* lock_shard(uint64_t lock_id) {
+    return &g_kernel->sync->shards[lock_mix(lock_id) & (LOCK_SHARDS - 1)];
+}
+
+static size_t lock_bucket(LockShard* shard, uint64_t lock_id) {
+    return (size_t)(lock_mix(lock_id) >> 32) & (shard->bucket_count - 1);
+}
+
+// Requiere shard->lock
+static DistributedLock* shard_find(LockShard* shard, uint64_t lock_id) {
+    DistributedLock* lock = shard->buckets[lock_bucket(shard, lock_id)];
+    while (lock && lock->lock_id != lock_id) lock = lock->hash_next;
+    return lock;
+}
+
+// Duplicar los buckets al superar un lock por bucket (requiere shard->lock)
+static void shard_grow(LockShard* shard) {
+    size_t new_count = shard->bucket_count * 2;
+    DistributedLock** buckets = calloc(new_count, sizeof(DistributedLock*));
+    if (!buckets) return;   // Seguir con cadenas más largas
+    
+    DistributedLock** old = shard->buckets;
+    size_t old_count = shard->bucket_count;
+    shard->buckets = buckets;
+    shard->bucket_count = new_count;
+    
+    for (size_t i = 0; i < old_count; i++) {
+        DistributedLock* lock = old[i];
+        while (lock) {
+            DistributedLock* next = lock->hash_next;
+            size_t b = lock_bucket(shard, lock->lock_id);
+            lock->hash_next = buckets[b];
+            buckets[b] = lock;
+            lock = next;
+        }
+    }
+    free(old);
+}
+
+static DistributedLock* new_lock(uint64_t lock_id, const char* name) {
+    DistributedLock* lock = calloc(1, sizeof(DistributedLock));
+    if (!lock) return NULL;
+    
+    lock->lock_id = lock_id;
+    strncpy(lock->name, name, sizeof(lock->name) - 1);
+    lock->owner_fd = -1;
+    lock->remote_fd = -1;
+    lock->read_fd = -1;
+    pthread_mutex_init(&lock->local_lock, NULL);
+    pthread_cond_init(&lock->read_cond, NULL);
     
-    return block->block_id;
+    return lock;
 }
 
-// Escribir en memoria compartida
-static int write_shared_memory(uint64_t block_id, const void* data, 
-                               size_t size, size_t offset) {
-    if (!g_kernel || !data) return -1;
+static void free_lock(DistributedLock* lock) {
+    while (lock->wait_head) {
+        LockWaiter* w = lock->wait_head;
+        lock->wait_head = w->next;
+        if (w->fd >= 0) free(w);
+    }
+    free(lock->readers);
+    pthread_cond_destroy(&lock->read_cond);
+    pthread_mutex_destroy(&lock->local_lock);
+    free(lock);
+}
+
+// Buscar un lock tomando una referencia, que se devuelve con put_lock().
+// Con name, crearlo si no existe.
+static DistributedLock* get_lock(uint64_t lock_id, const char* name) {
+    LockShard* shard = lock_shard(lock_id);
+    
+    pthread_mutex_lock(&shard->lock);
+    DistributedLock* lock = shard_find(shard, lock_id);
+    if (!lock && name && (lock = new_lock(lock_id, name))) {
+        if (shard->count >= shard->bucket_count) shard_grow(shard);
+        size_t b = lock_bucket(shard, lock_id);
+        lock->hash_next = shard->buckets[b];
+        shard->buckets[b] = lock;
+        shard->count++;
+        atomic_fetch_add(&g_kernel->sync->lock_count, 1);
+        g_kernel->sync->locks_created++;
+    }
+    if (lock) atomic_fetch_add(&lock->refs, 1);
+    pthread_mutex_unlock(&shard->lock);
     
-    pthread_mutex_lock(&g_kernel->memory->lock);
+    return lock;
+}
+
+static void put_lock(DistributedLock* lock) {
+    atomic_store(&lock->last_used, time(NULL));
+    atomic_fetch_sub(&lock->refs, 1);
+}
+
+// Sin nada que el GC o los leases tengan que mirar (requiere local_lock)
+static bool lock_is_idle(DistributedLock* lock) {
+    return !lock->is_locked && !lock->wait_head && lock->local_readers == 0 &&
+           lock->reader_count == 0 && lock->remote_fd < 0 && lock->read_fd < 0;
+}
+
+// Apuntar un lock que acaba de ganar estado (requiere local_lock)
+static void mark_lock_active(DistributedLock* lock) {
+    if (lock->active) return;
+    
+    pthread_mutex_lock(&g_kernel->sync->active_lock);
+    lock->active = true;
+    lock->active_prev = NULL;
+    lock->active_next = g_kernel->sync->active_head;
+    if (lock->active_next) lock->active_next->active_prev = lock;
+    g_kernel->sync->active_head = lock;
+    g_kernel->sync->active_count++;
+    atomic_fetch_add(&lock->refs, 1);
+    pthread_mutex_unlock(&g_kernel->sync->active_lock);
+}
+
+// Referencias a los locks con estado, para recorrerlos sin active_lock
+// (quien tiene local_lock puede estar esperando active_lock)
+static DistributedLock** pin_active_locks(size_t* count) {
+    pthread_mutex_lock(&g_kernel->sync->active_lock);
+    
+    size_t n = 0;
+    DistributedLock** locks = malloc((g_kernel->sync->active_count + 1) * sizeof(DistributedLock*));
+    if (locks) {
+        for (DistributedLock* lock = g_kernel->sync->active_head; lock; lock = lock->active_next) {
+            atomic_fetch_add(&lock->refs, 1);
+            locks[n++] = lock;
+        }
+    }
     
-    SharedMemoryBlock* block = NULL;
-    for (size_t i = 0; i < g_kernel->memory->block_count; i++) {
-        if (g_kernel->memory->blocks[i]->block_id == block_id) {
-            block = g_kernel->memory->blocks[i];
-            break;
+    pthread_mutex_unlock(&g_kernel->sync->active_lock);
+    *count = n;
+    return locks;
+}
+
+static void unpin_locks(DistributedLock** locks, size_t count) {
+    for (size_t i = 0; i < count; i++) put_lock(locks[i]);
+    free(locks);
+}
+
+// GC: sacar de la lista de activos los que quedaron ociosos y liberar los
+// que llevan LOCK_GC_IDLE segundos sin referencias. Revisa LOCK_GC_SHARDS
+// particiones por pasada para no recorrer millones de locks de golpe.
+static void collect_idle_locks(void) {
+    SyncManager* sm = g_kernel->sync;
+    
+    pthread_mutex_lock(&sm->active_lock);
+    DistributedLock* lock = sm->active_head;
+    while (lock) {
+        DistributedLock* next = lock->active_next;
+        // trylock: el orden normal es local_lock -> active_lock
+        if (pthread_mutex_trylock(&lock->local_lock) == 0) {
+            if (lock_is_idle(lock)) {
+                if (lock->active_prev) lock->active_prev->active_next = next;
+                else sm->active_head = next;
+                if (next) next->active_prev = lock->active_prev;
+                lock->active = false;
+                sm->active_count--;
+                put_lock(lock);
+            }
+            pthread_mutex_unlock(&lock->local_lock);
         }
+        lock = next;
     }
+    pthread_mutex_unlock(&sm->active_lock);
     
-    if (!block || offset + size > block->size) {
-        pthread_mutex_unlock(&g_kernel->memory->lock);
-        return -1;
+    time_t now = time(NULL);
+    for (int i = 0; i < LOCK_GC_SHARDS; i++) {
+        LockShard* shard = &sm->shards[sm->gc_cursor];
+        sm->gc_cursor = (sm->gc_cursor + 1) % LOCK_SHARDS;
+        
+        pthread_mutex_lock(&shard->lock);
+        for (size_t b = 0; b < shard->bucket_count; b++) {
+            DistributedLock** link = &shard->buckets[b];
+            while (*link) {
+                DistributedLock* victim = *link;
+                // Sin referencias nadie puede tomar una sin pasar por shard->lock
+                if (atomic_load(&victim->refs) == 0 &&
+                    now - atomic_load(&victim->last_used) >= LOCK_GC_IDLE) {
+                    *link = victim->hash_next;
+                    shard->count--;
+                    atomic_fetch_sub(&sm->lock_count, 1);
+                    sm->locks_collected++;
+                    free_lock(victim);
+                } else {
+                    link = &victim->hash_next;
+                }
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+// Época vista en otro nodo (heartbeat o token de una petición)
+static void observe_lock_term(uint32_t term) {
+    uint32_t seen = atomic_load(&g_kernel->sync->remote_term);
+    while (term > seen &&
+           !atomic_compare_exchange_weak(&g_kernel->sync->remote_term, &seen, term)) {
+    }
+}
+
+// Siguiente fencing token: época del hogar en los bits altos, concesiones
+// en los bajos. Si otro nodo usó una época igual o mayor (pudo ser hogar de
+// este lock), se pasa a una nueva (requiere local_lock).
+static uint64_t next_fencing_token(DistributedLock* lock) {
+    uint32_t remote = atomic_load(&g_kernel->sync->remote_term);
+    
+    if (lock->term == 0 || lock->term <= remote) {
+        uint32_t own = atomic_load(&g_kernel->sync->term);
+        uint32_t term = (own > remote ? own : remote) + 1;
+        while (own < term &&
+               !atomic_compare_exchange_weak(&g_kernel->sync->term, &own, term)) {
+        }
+        lock->term = term;
+        lock->grants = 0;
     }
     
-    pthread_rwlock_wrlock(&block->rwlock);
-    memcpy((uint8_t*)block->data + offset, data, size);
-    block->version++;
-    pthread_rwlock_unlock(&block->rwlock);
+    return ((uint64_t)lock->term << 32) | ++lock->grants;
+}
+
+static int send_lock_message(int fd, uint8_t type, DistributedLock* lock,
+                             uint64_t task_id, uint64_t fencing_token, uint8_t mode) {
+    NetworkMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = type;
+    msg.sender_id = g_kernel->node_id;
+    msg.timestamp = (uint64_t)time(NULL);
     
-    pthread_mutex_unlock(&g_kernel->memory->lock);
+    LockPayload payload;
+    memset(&payload, 0, sizeof(payload));
+    payload.lock_id = lock->lock_id;
+    payload.task_id = task_id;
+    payload.fencing_token = fencing_token;
+    payload.mode = mode;
+    memcpy(payload.name, lock->name, sizeof(payload.name));
+    memcpy(msg.payload, &payload, sizeof(payload));
+    msg.payload_size = sizeof(payload);
+    
+    return send_all(fd, &msg, sizeof(msg) - sizeof(msg.payload) + msg.payload_size);
+}
+
+// Quitar un waiter de la cola (requiere local_lock)
+static bool unlink_lock_waiter(DistributedLock* lock, LockWaiter* target) {
+    LockWaiter* prev = NULL;
+    for (LockWaiter* w = lock->wait_head; w; prev = w, w = w->next) {
+        if (w != target) continue;
+        if (prev) prev->next = w->next;
+        else lock->wait_head = w->next;
+        if (lock->wait_tail == w) lock->wait_tail = prev;
+        lock->waiting_count--;
+        if (w->mode == LOCK_MODE_WRITE) lock->waiting_writers--;
+        return true;
+    }
+    return false;
+}
+
+// Lease de lectura de un nodo remoto (requiere local_lock)
+static LockReader* find_lock_reader(DistributedLock* lock, int fd) {
+    for (int i = 0; i < lock->reader_count; i++) {
+        if (lock->readers[i].fd == fd) return &lock->readers[i];
+    }
+    return NULL;
+}
+
+static void remove_lock_reader(DistributedLock* lock, LockReader* reader) {
+    *reader = lock->readers[--lock->reader_count];
+}
+
+// Conceder (o prorrogar) un lease de lectura a un nodo remoto
+static int grant_read_lease(DistributedLock* lock, uint64_t node_id, int fd,
+                            uint64_t task_id) {
+    LockReader* reader = find_lock_reader(lock, fd);
+    if (!reader) {
+        if (lock->reader_count == lock->reader_capacity) {
+            int capacity = lock->reader_capacity ? lock->reader_capacity * 2 : 4;
+            LockReader* readers = realloc(lock->readers, capacity * sizeof(LockReader));
+            if (!readers) return -1;
+            lock->readers = readers;
+            lock->reader_capacity = capacity;
+        }
+        reader = &lock->readers[lock->reader_count++];
+        memset(reader, 0, sizeof(LockReader));
+        reader->node_id = node_id;
+        reader->fd = fd;
+    }
+    reader->lease_expires = time(NULL) + LOCK_LEASE_TIMEOUT;
     
+    if (send_lock_message(fd, MSG_SYNC_GRANT, lock, task_id, 0, LOCK_MODE_READ) < 0) {
+        remove_lock_reader(lock, reader);
+        return -1;
+    }
+    g_kernel->sync->read_grants++;
     return 0;
 }
 
-// Leer de memoria compartida
-static int read_shared_memory(uint64_t block_id, void* buffer, 
-                              size_t size, size_t offset) {
-    if (!g_kernel || !buffer) return -1;
+// Pedir a los nodos con lease de lectura que lo devuelvan
+static void revoke_read_leases(DistributedLock* lock) {
+    for (int i = 0; i < lock->reader_count; i++) {
+        LockReader* reader = &lock->readers[i];
+        if (reader->revoked) continue;
+        reader->revoked = true;
+        send_lock_message(reader->fd, MSG_SYNC_REVOKE, lock, 0, 0, LOCK_MODE_READ);
+        g_kernel->sync->read_revocations++;
+    }
+}
+
+// Conceder en orden FIFO: lecturas consecutivas a la vez, una escritura
+// cuando no queda ningún lector (requiere local_lock)
+static void lock_grant_next(DistributedLock* lock) {
+    while (!lock->is_locked && lock->wait_head) {
+        LockWaiter* w = lock->wait_head;
+        
+        if (w->mode == LOCK_MODE_READ) {
+            unlink_lock_waiter(lock, w);
+            if (w->fd < 0) {
+                lock->local_readers++;
+                g_kernel->sync->read_grants++;
+                w->granted = true;
+                pthread_cond_signal(&w->cond);
+            } else {
+                grant_read_lease(lock, w->node_id, w->fd, w->task_id);
+                free(w);
+            }
+            continue;
+        }
+        
+        // Escritor en cabeza: esperar a que los lectores terminen
+        if (lock->local_readers > 0 || lock->reader_count > 0) {
+            revoke_read_leases(lock);
+            return;
+        }
+        
+        unlink_lock_waiter(lock, w);
+        
+        lock->is_locked = true;
+        lock->owner_node = w->node_id;
+        lock->owner_task = w->task_id;
+        lock->owner_fd = w->fd;
+        lock->locked_at = time(NULL);
+        lock->lease_expires = lock->locked_at + LOCK_LEASE_TIMEOUT;
+        lock->fencing_token = next_fencing_token(lock);
+        g_kernel->sync->grants++;
+        
+        if (w->fd < 0) {
+            // Hilo local: despertarlo directamente
+            w->fencing_token = lock->fencing_token;
+            w->granted = true;
+            pthread_cond_signal(&w->cond);
+            return;
+        }
+        
+        // Remoto: un único mensaje por la conexión en la que espera
+        int rc = send_lock_message(w->fd, MSG_SYNC_GRANT, lock, w->task_id,
+                                   lock->fencing_token, LOCK_MODE_WRITE);
+        free(w);
+        if (rc == 0) {
+            g_kernel->sync->remote_grants++;
+            return;
+        }
+        
+        // Se fue mientras esperaba: seguir con el siguiente
+        lock->is_locked = false;
+        lock->owner_node = 0;
+        lock->owner_fd = -1;
+    }
+}
+
+// Liberar en el hogar y pasar el lock al siguiente (requiere local_lock)
+static void lock_release_owner(DistributedLock* lock) {
+    lock->is_locked = false;
+    lock->owner_node = 0;
+    lock->owner_task = 0;
+    lock->owner_fd = -1;
+    lock_grant_next(lock);
+}
+
+static void enqueue_lock_waiter(DistributedLock* lock, LockWaiter* w) {
+    w->next = NULL;
+    if (lock->wait_tail) lock->wait_tail->next = w;
+    else lock->wait_head = w;
+    lock->wait_tail = w;
+    lock->waiting_count++;
+    if (w->mode == LOCK_MODE_WRITE) lock->waiting_writers++;
+    mark_lock_active(lock);
+    lock_grant_next(lock);
+}
+
+// Crear lock distribuido. Si pasa LOCK_GC_IDLE segundos sin usarse y sin
+// estado el GC lo libera: para volver a usar el ID hay que crearlo de nuevo.
+static uint64_t create_distributed_lock(const char* name) {
+    if (!g_kernel || !g_kernel->sync) return 0;
     
-    pthread_mutex_lock(&g_kernel->memory->lock);
+    uint64_t lock_id = lock_name_hash(name);
     
-    SharedMemoryBlock* block = NULL;
-    for (size_t i = 0; i < g_kernel->memory->block_count; i++) {
-        if (g_kernel->memory->blocks[i]->block_id == block_id) {
-            block = g_kernel->memory->blocks[i];
-            break;
+    // Si ya existe (también si otro nodo ya lo pidió aquí) se reutiliza
+    DistributedLock* lock = get_lock(lock_id, name);
+    if (!lock) return 0;
+    
+    put_lock(lock);
+    return lock_id;
+}
+
+// Esperar en la cola del propio nodo hogar
+static int acquire_local_lock(DistributedLock* lock, uint64_t task_id,
+                              uint8_t mode, int timeout_ms) {
+    // Lectura sin nadie escribiendo ni en cola: entrar directamente
+    if (mode == LOCK_MODE_READ) {
+        pthread_mutex_lock(&lock->local_lock);
+        bool free_now = !lock->is_locked && !lock->wait_head;
+        if (free_now) {
+            lock->local_readers++;
+            g_kernel->sync->read_grants++;
+            mark_lock_active(lock);
         }
+        pthread_mutex_unlock(&lock->local_lock);
+        if (free_now) return 0;
     }
     
-    if (!block || offset + size > block->size) {
-        pthread_mutex_unlock(&g_kernel->memory->lock);
-        return -1;
+    LockWaiter w;
+    memset(&w, 0, sizeof(w));
+    w.node_id = g_kernel->node_id;
+    w.task_id = task_id;
+    w.mode = mode;
+    w.fd = -1;
+    pthread_cond_init(&w.cond, NULL);
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
     }
     
-    pthread_rwlock_rdlock(&block->rwlock);
-    memcpy(buffer, (uint8_t*)block->data + offset, size);
-    pthread_rwlock_unlock(&block->rwlock);
+    pthread_mutex_lock(&lock->local_lock);
+    enqueue_lock_waiter(lock, &w);
     
-    pthread_mutex_unlock(&g_kernel->memory->lock);
+    while (!w.granted) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&w.cond, &lock->local_lock);
+        } else if (pthread_cond_timedwait(&w.cond, &lock->local_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    
+    if (w.granted) {
+        if (mode == LOCK_MODE_WRITE) lock->held_token = w.fencing_token;
+    } else {
+        // Un escritor que se rinde puede estar frenando lecturas detrás
+        unlink_lock_waiter(lock, &w);
+        lock_grant_next(lock);
+    }
+    pthread_mutex_unlock(&lock->local_lock);
     
+    pthread_cond_destroy(&w.cond);
+    return w.granted ? 0 : -1;
+}
+
+// Recibir la respuesta del hogar (tras poll)
+static int recv_lock_message(int fd, NetworkMessage* msg, LockPayload* payload) {
+    const size_t header_size = sizeof(*msg) - sizeof(msg->payload);
+    if (recv_all(fd, msg, header_size) < 0 ||
+        msg->payload_size > sizeof(msg->payload) ||
+        recv_all(fd, msg->payload, msg->payload_size) < 0 ||
+        msg->payload_size < sizeof(*payload)) {
+        return -1;
+    }
+    memcpy(payload, msg->payload, sizeof(*payload));
     return 0;
 }
 
-// Replicar bloque de memoria a otros nodos
-static int replicate_memory_block(uint64_t block_id, uint64_t target_node) {
-    if (!g_kernel) return -1;
-    
-    pthread_mutex_lock(&g_kernel->memory->lock);
+// Tomar la conexión libre con el hogar o abrir una nueva. Queda en exclusiva
+// hasta devolverla: el hogar identifica al dueño del lock por la conexión.
+static int take_lock_connection(uint64_t home) {
+    SyncManager* sm = g_kernel->sync;
+    int fd = -1;
+    
+    pthread_mutex_lock(&sm->conn_lock);
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (sm->idle_conns[i].fd >= 0 && sm->idle_conns[i].node_id == home) {
+            fd = sm->idle_conns[i].fd;
+            sm->idle_conns[i].fd = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sm->conn_lock);
+    
+    // Una conexión libre no tiene nada que leer: si lo tiene, el hogar la cerró
+    if (fd >= 0) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, 0) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
     
-    SharedMemoryBlock* block = NULL;
-    for (size_t i = 0; i < g_kernel->memory->block_count; i++) {
-        if (g_kernel->memory->blocks[i]->block_id == block_id) {
-            block = g_kernel->memory->blocks[i];
+    return fd >= 0 ? fd : connect_to_node(home);
+}
+
+// Guardar una conexión sin concesiones en camino para la próxima adquisición
+static void put_lock_connection(uint64_t home, int fd) {
+    SyncManager* sm = g_kernel->sync;
+    LockConnection* slot = NULL;
+    
+    pthread_mutex_lock(&sm->conn_lock);
+    for (int i = 0; i < MAX_NODES; i++) {
+        LockConnection* conn = &sm->idle_conns[i];
+        if (conn->fd < 0) {
+            if (!slot) slot = conn;
+        } else if (conn->node_id == home) {
+            slot = NULL;   // Ya hay una libre para este hogar
             break;
         }
     }
+    if (slot) {
+        slot->node_id = home;
+        slot->fd = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&sm->conn_lock);
     
-    if (!block || block->replica_count >= 3) {
-        pthread_mutex_unlock(&g_kernel->memory->lock);
+    if (fd >= 0) close(fd);
+}
+
+// Encolarse en un hogar remoto y esperar su MSG_SYNC_GRANT
+static int acquire_remote_lock(DistributedLock* lock, uint64_t home,
+                               uint64_t task_id, int timeout_ms) {
+    int fd = take_lock_connection(home);
+    if (fd < 0) return -1;
+    
+    // El último token conocido evita que un hogar nuevo emita uno menor
+    pthread_mutex_lock(&lock->local_lock);
+    uint64_t last_token = lock->held_token > lock->fencing_token ?
+                          lock->held_token : lock->fencing_token;
+    pthread_mutex_unlock(&lock->local_lock);
+    
+    if (send_lock_message(fd, MSG_SYNC_LOCK, lock, task_id, last_token,
+                          LOCK_MODE_WRITE) < 0) {
+        close(fd);
         return -1;
     }
     
-    block->replica_nodes[block->replica_count++] = target_node;
-    block->is_replicated = true;
-    g_kernel->memory->total_shared += block->size;
+    uint64_t start = current_time_ms();
+    while (g_kernel->running) {
+        int wait_ms = 1000;
+        if (timeout_ms >= 0) {
+            int64_t remaining = (int64_t)timeout_ms - (int64_t)(current_time_ms() - start);
+            if (remaining <= 0) break;
+            if (remaining < wait_ms) wait_ms = (int)remaining;
+        }
+        
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int rc = poll(&pfd, 1, wait_ms);
+        if (rc < 0 && errno != EINTR) break;
+        if (rc <= 0) continue;
+        
+        NetworkMessage msg;
+        LockPayload grant;
+        if (recv_lock_message(fd, &msg, &grant) < 0 || msg.type != MSG_SYNC_GRANT) {
+            close(fd);
+            return -1;
+        }
+        
+        observe_lock_term((uint32_t)(grant.fencing_token >> 32));
+        pthread_mutex_lock(&lock->local_lock);
+        lock->remote_fd = fd;
+        lock->remote_home = home;
+        lock->remote_task = task_id;
+        lock->held_token = grant.fencing_token;
+        mark_lock_active(lock);
+        pthread_mutex_unlock(&lock->local_lock);
+        return 0;
+    }
     
-    printf("[MEMORY] Bloque %lu replicado al nodo %016lX\n", block_id, target_node);
+    // Timeout: salir de la cola, o devolverlo si la concesión ya venía en camino
+    send_lock_message(fd, MSG_SYNC_UNLOCK, lock, task_id, 0, LOCK_MODE_WRITE);
+    close(fd);
+    return -1;
+}
+
+// Adquirir lock distribuido (timeout_ms < 0 = sin límite)
+static int acquire_distributed_lock(uint64_t lock_id, uint64_t task_id, int timeout_ms) {
+    if (!g_kernel) return -1;
     
-    pthread_mutex_unlock(&g_kernel->memory->lock);
+    DistributedLock* lock = get_lock(lock_id, NULL);
+    if (!lock) return -1;
+    
+    int rc;
+    uint64_t home = lock_home(lock_id);
+    if (home == g_kernel->node_id) {
+        rc = acquire_local_lock(lock, task_id, LOCK_MODE_WRITE, timeout_ms);
+    } else {
+        rc = acquire_remote_lock(lock, home, task_id, timeout_ms);
+    }
+    
+    put_lock(lock);
+    return rc;
+}
+
+// Liberar lock distribuido
+static int release_distributed_lock(uint64_t lock_id) {
+    if (!g_kernel) return -1;
     
-    // TODO: Enviar datos por red al nodo destino
+    DistributedLock* lock = get_lock(lock_id, NULL);
+    if (!lock) return -1;
+
+    pthread_mutex_lock(&lock->local_lock);
+    
+    if (lock->remote_fd >= 0) {
+        // Concedido por otro nodo: devolverlo por la misma conexión
+        int fd = lock->remote_fd;
+        uint64_t home = lock->remote_home;
+        uint64_t task_id = lock->remote_task;
+        lock->remote_fd = -1;
+        lock->held_token = 0;
+        pthread_mutex_unlock(&lock->local_lock);
+        
+        // Tras el UNLOCK el hogar no envía nada más por ella: reutilizable
+        if (send_lock_message(fd, MSG_SYNC_UNLOCK, lock, task_id, 0, LOCK_MODE_WRITE) == 0) {
+            put_lock_connection(home, fd);
+        } else {
+            close(fd);
+        }
+        put_lock(lock);
+        return 0;
+    }
+    
+    if (lock->is_locked && lock->owner_node == g_kernel->node_id && lock->owner_fd < 0) {
+        lock->held_token = 0;
+        lock_release_owner(lock);
+    }
     
+    pthread_mutex_unlock(&lock->local_lock);
+    put_lock(lock);
     return 0;
 }
 
-// Liberar bloque de memoria
-static void free_shared_memory(uint64_t block_id) {
-    if (!g_kernel) return;
+// Token de la posesión actual, para presentarlo al almacenamiento
+static uint64_t lock_fencing_token(uint64_t lock_id) {
+    DistributedLock* lock = get_lock(lock_id, NULL);
+    if (!lock) return 0;
     
-    pthread_mutex_lock(&g_kernel->memory->lock);
+    pthread_mutex_lock(&lock->local_lock);
+    uint64_t token = lock->held_token;
+    pthread_mutex_unlock(&lock->local_lock);
+    
+    put_lock(lock);
+    return token;
+}
+
+// Hilo dueño de la conexión de un lease de lectura: recibe las concesiones
+// y la revocación del hogar. Retiene una referencia al lock mientras vive.
+typedef struct {
+    DistributedLock* lock;
+    int fd;
+} ReadLeaseArgs;
+
+static void* read_lease_thread(void* arg) {
+    ReadLeaseArgs* args = (ReadLeaseArgs*)arg;
+    DistributedLock* lock = args->lock;
+    int fd = args->fd;
+    free(args);
+    
+    NetworkMessage msg;
+    LockPayload payload;
+    while (recv_lock_message(fd, &msg, &payload) == 0) {
+        pthread_mutex_lock(&lock->local_lock);
+        
+        if (msg.type == MSG_SYNC_GRANT && lock->read_requested_ms) {
+            // Contado desde el envío: el hogar lo mantiene al menos eso
+            lock->read_lease_until = lock->read_requested_ms + LOCK_READ_LEASE_MS;
+            lock->read_requested_ms = 0;
+            pthread_cond_broadcast(&lock->read_cond);
+        } else if (msg.type == MSG_SYNC_REVOKE && !lock->read_revoked) {
+            // Las lecturas en curso terminan; las nuevas esperan al cierre
+            lock->read_revoked = true;
+            if (lock->read_holds == 0) {
+                send_lock_message(fd, MSG_SYNC_UNLOCK, lock, 0, 0, LOCK_MODE_READ);
+                shutdown(fd, SHUT_RDWR);
+            }
+        }
+        
+        pthread_mutex_unlock(&lock->local_lock);
+    }
+    
+    pthread_mutex_lock(&lock->local_lock);
+    if (lock->read_fd == fd) {
+        lock->read_fd = -1;
+        lock->read_lease_until = 0;
+        lock->read_requested_ms = 0;
+        lock->read_revoked = false;
+    }
+    pthread_cond_broadcast(&lock->read_cond);
+    pthread_mutex_unlock(&lock->local_lock);
+    
+    close(fd);
+    put_lock(lock);
+    return NULL;
+}
+
+// Lectura con hogar remoto: con un lease vigente no hay ningún mensaje
+static int acquire_remote_read_lock(DistributedLock* lock, uint64_t home,
+                                    uint64_t task_id, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
     
-    for (size_t i = 0; i < g_kernel->memory->block_count; i++) {
-        if (g_kernel->memory->blocks[i]->block_id == block_id) {
-            SharedMemoryBlock* block = g_kernel->memory->blocks[i];
+    pthread_mutex_lock(&lock->local_lock);
+    
+    bool asked = false;
+    int rc = -1;
+    while (g_kernel->running) {
+        if (lock->read_fd >= 0 && !lock->read_revoked &&
+            current_time_ms() < lock->read_lease_until) {
+            lock->read_holds++;
+            if (!asked) g_kernel->sync->read_cache_hits++;
+            rc = 0;
+            break;
+        }
+        
+        if (lock->read_fd >= 0 && !lock->read_revoked && !lock->read_requested_ms) {
+            // Lease vencido pero no revocado: renovarlo por la misma conexión
+            lock->read_requested_ms = current_time_ms();
+            send_lock_message(lock->read_fd, MSG_SYNC_LOCK, lock, task_id, 0,
+                              LOCK_MODE_READ);
+            asked = true;
+        } else if (lock->read_fd < 0 && !lock->read_requested_ms) {
+            lock->read_requested_ms = current_time_ms();
+            pthread_mutex_unlock(&lock->local_lock);
             
-            block->ref_count--;
-            if (block->ref_count <= 0) {
-                g_kernel->memory->total_allocated -= block->size;
-                free(block->data);
-                pthread_rwlock_destroy(&block->rwlock);
-                free(block);
-                
-                // Compactar array
-                for (size_t j = i; j < g_kernel->memory->block_count - 1; j++) {
-                    g_kernel->memory->blocks[j] = g_kernel->memory->blocks[j + 1];
+            int fd = connect_to_node(home);
+            ReadLeaseArgs* args = fd >= 0 ? malloc(sizeof(ReadLeaseArgs)) : NULL;
+            pthread_t tid;
+            bool started = false;
+            if (args) {
+                args->lock = lock;
+                args->fd = fd;
+                if (send_lock_message(fd, MSG_SYNC_LOCK, lock, task_id, 0,
+                                      LOCK_MODE_READ) == 0) {
+                    pthread_mutex_lock(&lock->local_lock);
+                    lock->read_fd = fd;
+                    lock->read_revoked = false;
+                    mark_lock_active(lock);
+                    pthread_mutex_unlock(&lock->local_lock);
+                    atomic_fetch_add(&lock->refs, 1);
+                    started = pthread_create(&tid, NULL, read_lease_thread, args) == 0;
+                    if (!started) atomic_fetch_sub(&lock->refs, 1);
                 }
-                g_kernel->memory->block_count--;
             }
             
+            pthread_mutex_lock(&lock->local_lock);
+            if (!started) {
+                if (lock->read_fd == fd) lock->read_fd = -1;
+                lock->read_requested_ms = 0;
+                pthread_mutex_unlock(&lock->local_lock);
+                free(args);
+                if (fd >= 0) close(fd);
+                return -1;
+            }
+            pthread_detach(tid);
+            asked = true;
+            continue;
+        }
+        
+        // Esperar la concesión, o el cierre si el lease fue revocado
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&lock->read_cond, &lock->local_lock);
+        } else if (pthread_cond_timedwait(&lock->read_cond, &lock->local_lock,
+                                          &deadline) == ETIMEDOUT) {
             break;
         }
     }
     
-    pthread_mutex_unlock(&g_kernel->memory->lock);
+    pthread_mutex_unlock(&lock->local_lock);
+    return rc;
+}
+
+// Adquirir en modo compartido (timeout_ms < 0 = sin límite)
+static int acquire_distributed_read_lock(uint64_t lock_id, uint64_t task_id, int timeout_ms) {
+    if (!g_kernel) return -1;
+    
+    DistributedLock* lock = get_lock(lock_id, NULL);
+    if (!lock) return -1;
+    
+    int rc;
+    uint64_t home = lock_home(lock_id);
+    if (home == g_kernel->node_id) {
+        rc = acquire_local_lock(lock, task_id, LOCK_MODE_READ, timeout_ms);
+    } else {
+        rc = acquire_remote_read_lock(lock, home, task_id, timeout_ms);
+    }
+    
+    put_lock(lock);
+    return rc;
+}
+
+// Terminar una lectura. El lease cacheado sigue vigente salvo que el hogar
+// ya lo haya revocado: entonces la última lectura lo devuelve.
+static int release_distributed_read_lock(uint64_t lock_id) {
+    if (!g_kernel) return -1;
+    
+    DistributedLock* lock = get_lock(lock_id, NULL);
+    if (!lock) return -1;
+    
+    pthread_mutex_lock(&lock->local_lock);
+    
+    if (lock->read_holds > 0) {
+        if (--lock->read_holds == 0 && lock->read_revoked && lock->read_fd >= 0) {
+            send_lock_message(lock->read_fd, MSG_SYNC_UNLOCK, lock, 0, 0, LOCK_MODE_READ);
+            shutdown(lock->read_fd, SHUT_RDWR);
+        }
+    } else if (lock->local_readers > 0) {
+        lock->local_readers--;
+        lock_grant_next(lock);
+    }
+    
+    pthread_mutex_unlock(&lock->local_lock);
+    put_lock(lock);
+    return 0;
 }
 
-// ============================================================================
-// 4. SINCRONIZACIÓN DE PROCESOS DISTRIBUIDOS
-// ============================================================================
+// MSG_SYNC_LOCK en el hogar: encolar al nodo remoto
+static int serve_lock_request(int fd, NetworkMessage* msg) {
+    LockPayload req;
+    if (msg->payload_size < sizeof(req)) return -1;
+    memcpy(&req, msg->payload, sizeof(req));
+    req.name[sizeof(req.name) - 1] = '\0';
+    
+    DistributedLock* lock = get_lock(req.lock_id, req.name);
+    if (!lock) return -1;
 
-// Crear lock distribuido
-static uint64_t create_distributed_lock(const char* name) {
-    if (!g_kernel || !g_kernel->sync) return 0;
+    observe_lock_term((uint32_t)(req.fencing_token >> 32));
     
-    pthread_mutex_lock(&g_kernel->sync->lock);
+    pthread_mutex_lock(&lock->local_lock);
     
-    // Verificar si ya existe
-    for (size_t i = 0; i < g_kernel->sync->lock_count; i++) {
-        if (strcmp(g_kernel->sync->locks[i].name, name) == 0) {
-            uint64_t id = g_kernel->sync->locks[i].lock_id;
-            pthread_mutex_unlock(&g_kernel->sync->lock);
-            return id;
+    // Renovación de un lease de lectura: no si hay escritores esperando
+    // (la revocación ya va en camino)
+    LockReader* reader = find_lock_reader(lock, fd);
+    if (reader) {
+        if (lock->waiting_writers == 0 && !reader->revoked) {
+            grant_read_lease(lock, msg->sender_id, fd, req.task_id);
         }
-    }
-    
-    if (g_kernel->sync->lock_count >= MAX_LOCKS) {
-        pthread_mutex_unlock(&g_kernel->sync->lock);
+        pthread_mutex_unlock(&lock->local_lock);
+        put_lock(lock);
         return 0;
     }
     
-    DistributedLock* lock = &g_kernel->sync->locks[g_kernel->sync->lock_count++];
-    memset(lock, 0, sizeof(DistributedLock));
+    LockWaiter* w = calloc(1, sizeof(LockWaiter));
+    if (!w) {
+        pthread_mutex_unlock(&lock->local_lock);
+        put_lock(lock);
+        return -1;   // Cerrar la conexión: el remoto verá el fallo
+    }
     
-    lock->lock_id = ++g_kernel->sync->next_lock_id;
-    strncpy(lock->name, name, sizeof(lock->name) - 1);
-    pthread_mutex_init(&lock->local_lock, NULL);
+    w->node_id = msg->sender_id;
+    w->task_id = req.task_id;
+    w->mode = req.mode == LOCK_MODE_READ ? LOCK_MODE_READ : LOCK_MODE_WRITE;
+    w->fd = fd;
     
-    pthread_mutex_unlock(&g_kernel->sync->lock);
+    enqueue_lock_waiter(lock, w);
+    pthread_mutex_unlock(&lock->local_lock);
     
-    return lock->lock_id;
+    put_lock(lock);
+    return 0;
 }
 
-// Adquirir lock distribuido
-static int acquire_distributed_lock(uint64_t lock_id, uint64_t task_id, int timeout_ms) {
-    if (!g_kernel) return -1;
-    
-    pthread_mutex_lock(&g_kernel->sync->lock);
-    
-    DistributedLock* lock = NULL;
-    for (size_t i = 0; i < g_kernel->sync->lock_count; i++) {
-        if (g_kernel->sync->locks[i].lock_id == lock_id) {
-            lock = &g_kernel->sync->locks[i];
-            break;
+// MSG_SYNC_UNLOCK en el hogar: liberar o abandonar la cola
+static int serve_lock_release(int fd, NetworkMessage* msg) {
+    LockPayload req;
+    if (msg->payload_size < sizeof(req)) return -1;
+    memcpy(&req, msg->payload, sizeof(req));
+    
+    DistributedLock* lock = get_lock(req.lock_id, NULL);
+    if (!lock) return 0;
+
+    pthread_mutex_lock(&lock->local_lock);
+    LockReader* reader = find_lock_reader(lock, fd);
+    if (lock->is_locked && lock->owner_fd == fd) {
+        lock_release_owner(lock);
+    } else if (reader) {
+        remove_lock_reader(lock, reader);
+        lock_grant_next(lock);
+    } else {
+        for (LockWaiter* w = lock->wait_head; w; w = w->next) {
+            if (w->fd == fd) {
+                unlink_lock_waiter(lock, w);
+                free(w);
+                lock_grant_next(lock);
+                break;
+            }
         }
     }
+    pthread_mutex_unlock(&lock->local_lock);
     
-    if (!lock) {
-        pthread_mutex_unlock(&g_kernel->sync->lock);
-        return -1;
-    }
-    
-    pthread_mutex_unlock(&g_kernel->sync->lock);
-    
-    // Intentar adquirir
-    int elapsed = 0;
-    while (elapsed < timeout_ms || timeout_ms < 0) {
+    put_lock(lock);
+    return 0;
+}
+
+// Conexión cerrada: el proceso remoto ya no puede usar lo que tenía
+static void drop_lock_connection(int fd) {
+    size_t count;
+    DistributedLock** locks = pin_active_locks(&count);
+
+    for (size_t i = 0; i < count; i++) {
+        DistributedLock* lock = locks[i];
         pthread_mutex_lock(&lock->local_lock);
         
-        if (!lock->is_locked) {
-            lock->is_locked = true;
-            lock->owner_node = g_kernel->node_id;
-            lock->owner_task = task_id;
-            lock->locked_at = time(NULL);
-            pthread_mutex_unlock(&lock->local_lock);
-            return 0;
+        LockWaiter* w = lock->wait_head;
+        while (w) {
+            LockWaiter* next = w->next;
+            if (w->fd == fd) {
+                unlink_lock_waiter(lock, w);
+                free(w);
+            }
+            w = next;
+        }
+        LockReader* reader = find_lock_reader(lock, fd);
+        if (reader) remove_lock_reader(lock, reader);
+        if (lock->is_locked && lock->owner_fd == fd) {
+            lock_release_owner(lock);
+        } else {
+            lock_grant_next(lock);
         }
         
         pthread_mutex_unlock(&lock->local_lock);
+    }
+    unpin_locks(locks, count);
+}
+
+// Heartbeat de un nodo: prorrogar los leases de todo lo que tiene
+static void renew_lock_leases(uint64_t node_id) {
+    size_t count;
+    DistributedLock** locks = pin_active_locks(&count);
+
+    time_t expires = time(NULL) + LOCK_LEASE_TIMEOUT;
+    for (size_t i = 0; i < count; i++) {
+        DistributedLock* lock = locks[i];
+        pthread_mutex_lock(&lock->local_lock);
+        if (lock->is_locked && lock->owner_node == node_id) {
+            lock->lease_expires = expires;
+        }
+        for (int r = 0; r < lock->reader_count; r++) {
+            if (lock->readers[r].node_id == node_id) {
+                lock->readers[r].lease_expires = expires;
+            }
+        }
+        pthread_mutex_unlock(&lock->local_lock);
+    }
+    unpin_locks(locks, count);
+}
+
+// Revocar leases vencidos o de un nodo caído (failed_node = 0: solo vencidos).
+// Un dueño revocado que siga vivo queda con un fencing token viejo.
+static void expire_lock_leases(uint64_t failed_node) {
+    size_t count;
+    DistributedLock** locks = pin_active_locks(&count);
+
+    time_t now = time(NULL);
+    for (size_t i = 0; i < count; i++) {
+        DistributedLock* lock = locks[i];
+        pthread_mutex_lock(&lock->local_lock);
         
-        usleep(10000); // 10ms
-        elapsed += 10;
+        // Quienes esperaban desde el nodo caído no van a leer la concesión
+        if (failed_node) {
+            LockWaiter* w = lock->wait_head;
+            while (w) {
+                LockWaiter* next = w->next;
+                if (w->fd >= 0 && w->node_id == failed_node) {
+                    unlink_lock_waiter(lock, w);
+                    free(w);
+                }
+                w = next;
+            }
+        }
+        
+        for (int r = lock->reader_count - 1; r >= 0; r--) {
+            LockReader* reader = &lock->readers[r];
+            if (reader->node_id == failed_node || now > reader->lease_expires) {
+                printf("[SYNC] Lease de lectura de '%s' revocado a %016lX\n",
+                       lock->name, reader->node_id);
+                g_kernel->sync->lease_expirations++;
+                remove_lock_reader(lock, reader);
+            }
+        }
+        
+        if (lock->is_locked && lock->owner_node != g_kernel->node_id &&
+            (lock->owner_node == failed_node || now > lock->lease_expires)) {
+            printf("[SYNC] Lease de '%s' revocado a %016lX (token %016lX)\n",
+                   lock->name, lock->owner_node, lock->fencing_token);
+            g_kernel->sync->lease_expirations++;
+            lock_release_owner(lock);
+        } else {
+            lock_grant_next(lock);
+        }
+        
+        pthread_mutex_unlock(&lock->local_lock);
     }
+    unpin_locks(locks, count);
+}
+
+// Prueba de carga de la tabla: crear n locks, buscarlos desde varios hilos
+// a la vez y tomar/soltar los que tienen este nodo como hogar
+#define LOCK_BENCH_THREADS 4
+
+typedef struct {
+    size_t count;
+    size_t offset;
+    size_t found;
+} LockBenchArgs;
+
+static void* lock_bench_thread(void* arg) {
+    LockBenchArgs* args = (LockBenchArgs*)arg;
+    char name[64];
     
-    return -1; // Timeout
+    for (size_t i = 0; i < args->count; i++) {
+        snprintf(name, sizeof(name), "bench-%zu", (i * 7919 + args->offset) % args->count);
+        DistributedLock* lock = get_lock(lock_name_hash(name), NULL);
+        if (lock) {
+            args->found++;
+            put_lock(lock);
+        }
+    }
+    return NULL;
 }
 
-// Liberar lock distribuido
-static int release_distributed_lock(uint64_t lock_id) {
-    if (!g_kernel) return -1;
+static void benchmark_lock_table(size_t count) {
+    char name[64];
     
-    pthread_mutex_lock(&g_kernel->sync->lock);
+    printf("\n🔒 Tabla de locks: %zu locks, %d particiones\n", count, LOCK_SHARDS);
     
-    for (size_t i = 0; i < g_kernel->sync->lock_count; i++) {
-        if (g_kernel->sync->locks[i].lock_id == lock_id) {
-            DistributedLock* lock = &g_kernel->sync->locks[i];
-            
-            pthread_mutex_lock(&lock->local_lock);
-            
-            if (lock->owner_node == g_kernel->node_id) {
-                lock->is_locked = false;
-                lock->owner_node = 0;
-                lock->owner_task = 0;
-            }
-            
-            pthread_mutex_unlock(&lock->local_lock);
-            pthread_mutex_unlock(&g_kernel->sync->lock);
-            return 0;
+    uint64_t start = current_time_ns();
+    for (size_t i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "bench-%zu", i);
+        if (!create_distributed_lock(name)) {
+            printf("   Sin memoria tras %zu locks\n", i);
+            count = i;
+            break;
         }
     }
-    
-    pthread_mutex_unlock(&g_kernel->sync->lock);
-    return -1;
+    uint64_t elapsed = current_time_ns() - start;
+    printf("   Creación:  %8.0f locks/s (%.0f ns/lock)\n",
+           elapsed ? count * 1e9 / elapsed : 0.0, count ? (double)elapsed / count : 0.0);
+    if (count == 0) return;
+    
+    pthread_t threads[LOCK_BENCH_THREADS];
+    LockBenchArgs args[LOCK_BENCH_THREADS];
+    start = current_time_ns();
+    for (int t = 0; t < LOCK_BENCH_THREADS; t++) {
+        args[t] = (LockBenchArgs){ .count = count, .offset = (size_t)t * 131, .found = 0 };
+        pthread_create(&threads[t], NULL, lock_bench_thread, &args[t]);
+    }
+    size_t found = 0;
+    for (int t = 0; t < LOCK_BENCH_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        found += args[t].found;
+    }
+    elapsed = current_time_ns() - start;
+    printf("   Búsqueda:  %8.0f búsquedas/s (%d hilos, %zu/%zu encontrados)\n",
+           elapsed ? found * 1e9 / elapsed : 0.0, LOCK_BENCH_THREADS,
+           found, count * LOCK_BENCH_THREADS);
+    
+    size_t local = 0;
+    start = current_time_ns();
+    for (size_t i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "bench-%zu", i);
+        uint64_t lock_id = lock_name_hash(name);
+        if (lock_home(lock_id) != g_kernel->node_id) continue;
+        if (acquire_distributed_lock(lock_id, 0, 0) == 0) {
+            release_distributed_lock(lock_id);
+            local++;
+        }
+    }
+    elapsed = current_time_ns() - start;
+    printf("   Lock+unlock con hogar local: %8.0f ops/s (%.0f ns/op, %zu locks)\n",
+           elapsed ? local * 1e9 / elapsed : 0.0, local ? (double)elapsed / local : 0.0, local);
+    pthread_mutex_lock(&g_kernel->sync->active_lock);
+    size_t active = g_kernel->sync->active_count;
+    pthread_mutex_unlock(&g_kernel->sync->active_lock);
+    printf("   En la tabla: %zu | con estado: %zu (el GC libera el resto a los %d s)\n",
+           atomic_load(&g_kernel->sync->lock_count), active, LOCK_GC_IDLE);
 }
 
 // ============================================================================
 // 5. DETECCIÓN Y RECUPERACIÓN DE FALLOS
 // ============================================================================
 
+// Reasignar las tareas de un nodo caído
+static void reassign_tasks_from(uint64_t failed_node) {
+    pthread_mutex_lock(&g_kernel->scheduler->lock);
+    
+    for (size_t j = 0; j < g_kernel->scheduler->task_count; j++) {
+        DistributedTask* task = &g_kernel->scheduler->tasks[j];
+        
+        if (task->assigned_node == failed_node &&
+            (task->status == TASK_ASSIGNED || task->status == TASK_RUNNING)) {
+            
+            // Buscar otro nodo
+            uint64_t new_node = select_best_node(task->priority);
+            if (new_node && new_node != failed_node) {
+                task->assigned_node = new_node;
+                task->status = TASK_ASSIGNED;
+                task->dispatched_ms = current_time_ms();
+                g_kernel->scheduler->total_migrated++;
+                
+                printf("[FAILURE] Tarea %lu reasignada a %016lX\n",
+                       task->task_id, new_node);
+            }
+        }
+    }
+    
+    pthread_mutex_unlock(&g_kernel->scheduler->lock);
+}
+
 // Thread de detección de fallos
 static void* failure_detector_thread(void* arg) {
     (void)arg;
     
     while (g_kernel && g_kernel->running) {
         time_t now = time(NULL);
+        uint64_t failed[MAX_NODES];
+        int failed_count = 0;
         
         pthread_mutex_lock(&g_kernel->registry->lock);
         
@@ -1076,30 +4091,7 @@ static void* failure_detector_thread(void* arg) {
                     // Nodo no responde - marcar como fallido
                     printf("\n[FAILURE] ⚠ Nodo %016lX no responde!\n", node->node_id);
                     node->status = NODE_FAILED;
-                    
-                    // Reasignar tareas de este nodo
-                    pthread_mutex_lock(&g_kernel->scheduler->lock);
-                    
-                    for (size_t j = 0; j < g_kernel->scheduler->task_count; j++) {
-                        DistributedTask* task = &g_kernel->scheduler->tasks[j];
-                        
-                        if (task->assigned_node == node->node_id &&
-                            (task->status == TASK_ASSIGNED || task->status == TASK_RUNNING)) {
-                            
-                            // Buscar otro nodo
-                            uint64_t new_node = select_best_node(task->priority);
-                            if (new_node && new_node != node->node_id) {
-                                task->assigned_node = new_node;
-                                task->status = TASK_ASSIGNED;
-                                g_kernel->scheduler->total_migrated++;
-                                
-                                printf("[FAILURE] Tarea %lu reasignada a %016lX\n",
-                                       task->task_id, new_node);
-                            }
-                        }
-                    }
-                    
-                    pthread_mutex_unlock(&g_kernel->scheduler->lock);
+                    failed[failed_count++] = node->node_id;
                     
                     // Penalizar reputación
                     node->reputation *= 0.5;
@@ -1109,6 +4101,15 @@ static void* failure_detector_thread(void* arg) {
         
         pthread_mutex_unlock(&g_kernel->registry->lock);
         
+        // Reasignar fuera del lock del registro: el scheduler lo vuelve a
+        // tomar en select_best_node()
+        for (int i = 0; i < failed_count; i++) {
+            reassign_tasks_from(failed[i]);
+            expire_lock_leases(failed[i]);
+        }
+        expire_lock_leases(0);
+        collect_idle_locks();
+
         sleep(5);
     }
     
@@ -1149,23 +4150,96 @@ static int create_data_server(void) {
     return sock;
 }
 
+// Aplicar un fragmento de resultado de un nodo ejecutor. Si el consumidor
+// local va lento, result_channel_push() bloquea y la ventana TCP frena al
+// emisor. Devuelve 1 al recibir el fin del resultado.
+static int receive_result_chunk(NetworkMessage* msg) {
+    ResultChunkHeader hdr;
+    if (msg->payload_size < sizeof(hdr)) return 0;
+    memcpy(&hdr, msg->payload, sizeof(hdr));
+    if (hdr.length > msg->payload_size - sizeof(hdr)) return -1;
+    
+    if (hdr.length > 0) {
+        ResultChannel* ch = get_result_channel(hdr.task_id, true);
+        if (!ch || result_channel_push(ch, msg->payload + sizeof(hdr),
+                                       hdr.length, true) < 0) {
+            return -1;
+        }
+    }
+    
+    if (hdr.flags & RESULT_FLAG_EOF) {
+        complete_task(hdr.task_id, hdr.exit_code, NULL, 0);
+        return 1;
+    }
+    
+    return 0;
+}
+
+// Atender una conexión de datos: flujo de resultados, sincronización de
+// réplicas de memoria, bloques desalojados por otro nodo o locks
+static void* data_connection_thread(void* arg) {
+    int client = (int)(intptr_t)arg;
+    NetworkMessage msg;
+    const size_t header_size = sizeof(msg) - sizeof(msg.payload);
+    uint64_t replica_local = 0;
+    
+    while (g_kernel && g_kernel->running) {
+        if (recv_all(client, &msg, header_size) < 0) break;
+        if (msg.payload_size > sizeof(msg.payload) ||
+            recv_all(client, msg.payload, msg.payload_size) < 0) {
+            break;
+        }
+        
+        int rc = 0;
+        if (msg.type == MSG_TASK_RESULT) {
+            rc = receive_result_chunk(&msg);
+        } else if (msg.type == MSG_MEMORY_REPLICATE) {
+            rc = apply_replica_range(client, &msg, &replica_local);
+        } else if (msg.type == MSG_MEMORY_REQUEST) {
+            rc = serve_spill_request(client, &msg);
+        } else if (msg.type == MSG_SYNC_LOCK) {
+            rc = serve_lock_request(client, &msg);
+        } else if (msg.type == MSG_SYNC_UNLOCK) {
+            rc = serve_lock_release(client, &msg);
+        }
+        if (rc != 0) break;
+    }
+    
+    drop_lock_connection(client);
+    close(client);
+    return NULL;
+}
+
 static void* data_server_thread(void* arg) {
     (void)arg;
     
     while (g_kernel && g_kernel->running) {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        
-        int client = accept(g_kernel->data_socket, 
-                           (struct sockaddr*)&client_addr, &addr_len);
+        // Esperar conexiones sin dormir: el poll despierta en cuanto llega una
+        struct pollfd pfd = { .fd = g_kernel->data_socket, .events = POLLIN };
+        int rc = poll(&pfd, 1, 500);
+        if (rc <= 0) continue;
         
-        if (client >= 0) {
-            // TODO: Manejar conexión de datos
-            // Por ahora solo cerrar
-            close(client);
+        // Aceptar todo lo pendiente hasta que el socket (no bloqueante) se vacíe
+        while (true) {
+            struct sockaddr_in client_addr;
+            socklen_t addr_len = sizeof(client_addr);
+            
+            int client = accept(g_kernel->data_socket, 
+                               (struct sockaddr*)&client_addr, &addr_len);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                break;   // EAGAIN: no queda ninguna
+            }
+            
+            // Una conexión por flujo de resultados o sincronización
+            pthread_t tid;
+            if (pthread_create(&tid, NULL, data_connection_thread,
+                               (void*)(intptr_t)client) == 0) {
+                pthread_detach(tid);
+            } else {
+                close(client);
+            }
         }
-        
-        usleep(50000);
     }
     
     return NULL;
@@ -1193,6 +4267,22 @@ static void print_banner(void) {
     printf("\n");
 }
 
+static void print_tier_stats(void) {
+    DistributedMemoryManager* mm = g_kernel->memory;
+    
+    pthread_mutex_lock(&mm->tier_lock);
+    printf("   En RAM:        %zu bytes", atomic_load(&mm->resident_bytes));
+    if (mm->tier_limit) {
+        printf(" (límite %zu)", mm->tier_limit);
+    }
+    printf("\n");
+    printf("   Desalojada:    %zu bytes (%lu a nodos, %lu a disco)\n",
+           mm->spilled_bytes, mm->spills_peer, mm->spills_disk);
+    printf("   Recuperada:    %lu bajo demanda, %lu por prefetch\n",
+           mm->tier_fetches, mm->tier_prefetches);
+    pthread_mutex_unlock(&mm->tier_lock);
+}
+
 static void print_status(void) {
     printf("\n");
     printf("════════════════════════════════════════════════════════════════════\n");
@@ -1234,6 +4324,16 @@ static void print_status(void) {
     printf("   Tareas completadas: %lu\n", g_kernel->scheduler->total_completed);
     printf("   Tareas fallidas:    %lu\n", g_kernel->scheduler->total_failed);
     printf("   Tareas migradas:    %lu\n", g_kernel->scheduler->total_migrated);
+    printf("   Modo:               %s (admisión: %s)\n",
+           g_kernel->scheduler->mode == SCHED_MODE_EDF ? "EDF" : "score",
+           g_kernel->scheduler->admission == ADMISSION_REJECT ? "rechazar" : "marcar");
+    printf("   En cola EDF:        %zu\n", g_kernel->scheduler->ready_count);
+    printf("   Rechazadas:         %lu\n", g_kernel->scheduler->total_rejected);
+    printf("   Deadlines perdidos: %lu\n", g_kernel->scheduler->total_deadline_missed);
+    printf("   Especulativas:      %lu lanzadas, %lu ganadas, %u activas\n",
+           g_kernel->scheduler->total_speculative,
+           g_kernel->scheduler->total_speculative_won,
+           g_kernel->scheduler->speculative_running);
     pthread_mutex_unlock(&g_kernel->scheduler->lock);
     printf("\n");
     
@@ -1243,14 +4343,52 @@ static void print_status(void) {
     printf("   Bloques:       %zu\n", g_kernel->memory->block_count);
     printf("   Asignada:      %zu bytes\n", g_kernel->memory->total_allocated);
     printf("   Compartida:    %zu bytes\n", g_kernel->memory->total_shared);
+    printf("   Sync réplicas: %lu (%lu páginas, %lu bytes enviados)\n",
+           g_kernel->memory->replica_syncs, g_kernel->memory->replica_pages_sent,
+           g_kernel->memory->replica_bytes_sent);
     pthread_mutex_unlock(&g_kernel->memory->lock);
+    print_tier_stats();
     printf("\n");
     
     // Sincronización
-    pthread_mutex_lock(&g_kernel->sync->lock);
+    size_t lock_count;
+    DistributedLock** locks = pin_active_locks(&lock_count);
     printf("🔒 SINCRONIZACIÓN\n");
-    printf("   Locks activos: %zu\n", g_kernel->sync->lock_count);
-    pthread_mutex_unlock(&g_kernel->sync->lock);
+    printf("   Locks: %zu en la tabla, %zu con estado | %lu creados, %lu liberados por el GC\n",
+           atomic_load(&g_kernel->sync->lock_count), lock_count,
+           (unsigned long)g_kernel->sync->locks_created,
+           (unsigned long)g_kernel->sync->locks_collected);
+    uint64_t grants = 0, remote_grants = 0, expirations = 0;
+    for (size_t i = 0; i < lock_count; i++) {
+        DistributedLock* lock = locks[i];
+        pthread_mutex_lock(&lock->local_lock);
+        if (lock->is_locked) {
+            printf("   • %-20s dueño %016lX (tarea %lu, token %016lX, %d en cola)\n",
+                   lock->name, lock->owner_node, lock->owner_task,
+                   lock->fencing_token, lock->waiting_count);
+        } else if (lock->local_readers > 0 || lock->reader_count > 0) {
+            printf("   • %-20s lectura: %d locales, %d nodos con lease (%d en cola)\n",
+                   lock->name, lock->local_readers, lock->reader_count,
+                   lock->waiting_count);
+        }
+        if (lock->read_fd >= 0) {
+            printf("   • %-20s lease de lectura del hogar: %d en curso%s\n",
+                   lock->name, lock->read_holds,
+                   lock->read_revoked ? ", revocado" :
+                   current_time_ms() < lock->read_lease_until ? "" : ", vencido");
+        }
+        pthread_mutex_unlock(&lock->local_lock);
+    }
+    unpin_locks(locks, lock_count);
+grants = g_kernel->sync->grants;
+    remote_grants = g_kernel->sync->remote_grants;
+    expirations = g_kernel->sync->lease_expirations;
+    printf("   Concesiones: %lu (%lu a nodos remotos) | Leases revocados: %lu\n",
+           grants, remote_grants, expirations);
+    printf("   Lecturas: %lu concedidas | %lu sin red (lease cacheado) | %lu leases revocados por escritores\n",
+           (unsigned long)g_kernel->sync->read_grants,
+           (unsigned long)g_kernel->sync->read_cache_hits,
+           (unsigned long)g_kernel->sync->read_revocations);
     printf("\n");
 }
 
@@ -1318,14 +4456,17 @@ static void print_tasks(void) {
                 case TASK_COMPLETED: status_str = "COMPLETADA"; break;
                 case TASK_FAILED: status_str = "FALLIDA"; break;
                 case TASK_MIGRATING: status_str = "MIGRANDO"; break;
+                case TASK_CANCELLED: status_str = "CANCELADA"; break;
             }
             
             char desc[31];
-            strncpy(desc, t->description, 30);
+            strncpy(desc, g_kernel->scheduler->descriptions[i], 30);
             desc[30] = '\0';
             
-            printf("   %-5lu %-30s %016lX %-10s\n",
-                   t->task_id, desc, t->assigned_node, status_str);
+            printf("   %-5lu %-30s %016lX %-10s%s%s\n",
+                   t->task_id, desc, t->assigned_node, status_str,
+                   t->deadline_at_risk ? " ⚠" : "",
+                   t->speculative_of ? " (esp.)" : "");
         }
     }
     
@@ -1344,15 +4485,19 @@ static void print_memory(void) {
     if (g_kernel->memory->block_count == 0) {
         printf("   No hay bloques de memoria compartida.\n");
     } else {
-        printf("   %-8s %-18s %-10s %-8s %-10s\n",
-               "BLOQUE", "OWNER", "TAMAÑO", "VERSION", "REPLICAS");
-        printf("   ──────── ────────────────── ────────── ──────── ──────────\n");
+        printf("   %-12s %-18s %-10s %-8s %-10s %-6s\n",
+               "BLOQUE", "OWNER", "TAMAÑO", "VERSION", "REPLICAS", "NIVEL");
+        printf("   ──────────── ────────────────── ────────── ──────── ────────── ──────\n");
         
-        for (size_t i = 0; i < g_kernel->memory->block_count; i++) {
-            SharedMemoryBlock* b = g_kernel->memory->blocks[i];
+        uint32_t slots = atomic_load(&g_kernel->memory->slot_count);
+        for (uint32_t i = 0; i < slots; i++) {
+            SharedMemoryBlock* b = memory_slot(i);
+            if (!atomic_load(&b->block_id)) continue;
             
-            printf("   %-8lu %016lX %10zu %8u %10d\n",
-                   b->block_id, b->owner_node, b->size, b->version, b->replica_count);
+            const char* tier = b->tier == TIER_DISK ? "disco" :
+                               b->tier == TIER_PEER ? "nodo" : "RAM";
+            printf("   %-12lu %016lX %10zu %8u %10d %-6s\n",
+                   b->block_id, b->owner_node, b->size, b->version, b->replica_count, tier);
         }
     }
     
@@ -1376,9 +4521,36 @@ static void print_help(void) {
     printf("   task <desc>     Crear nueva tarea distribuida\n");
     printf("                   Ejemplo: task Procesar datos ML\n\n");
     
+    printf("   dtask <ms> <desc>  Crear tarea con deadline relativo en ms\n");
+    printf("                   Ejemplo: dtask 500 Inferencia online\n\n");
+    
+    printf("   sched <score|edf> [flag|reject]\n");
+    printf("                   Modo de despacho y política de admisión\n\n");
+    
+    printf("   result <id>     Leer el resultado disponible de una tarea\n\n");
+    
     printf("   alloc <bytes>   Asignar memoria compartida\n");
     printf("                   Ejemplo: alloc 1024\n\n");
     
+    printf("   mwrite <bloque> <offset> <texto>\n");
+    printf("                   Escribir en un bloque compartido\n\n");
+    
+    printf("   replicate <bloque> <nodo_hex>\n");
+    printf("                   Añadir réplica (copia completa inicial)\n\n");
+    
+    printf("   msync <bloque>  Enviar a las réplicas solo las páginas escritas\n\n");
+    
+    printf("   mread <bloque> <offset> <bytes>\n");
+    printf("                   Leer de un bloque (lo trae de vuelta si estaba desalojado)\n\n");
+    
+    printf("   tier [limite_mb] Ver tiering o fijar límite de RAM para bloques (0 = sin límite)\n\n");
+    
+    printf("   lock <nombre> [ms]  Adquirir un lock distribuido (espera en cola FIFO)\n");
+    printf("   unlock <nombre>     Liberar un lock distribuido\n");
+    printf("   rlock <nombre> [ms] Adquirir en modo lectura (compartido)\n");
+    printf("   runlock <nombre>    Terminar una lectura\n");
+    printf("   lockbench <n>       Medir creación y búsqueda con n locks\n\n");
+    
     printf("   demo            Ejecutar demostración de funcionalidades\n");
     printf("   help            Mostrar esta ayuda\n");
     printf("   exit            Salir del sistema\n\n");
@@ -1391,6 +4563,39 @@ static void print_help(void) {
     printf("   • Timeout de nodo: %d segundos\n\n", HEARTBEAT_TIMEOUT);
 }
 
+// Productor de la demo: emite 1 MB en fragmentos de 4 KB
+static void* demo_stream_producer(void* arg) {
+    uint64_t task_id = *(uint64_t*)arg;
+    uint8_t chunk[4096];
+    
+    ResultStream* stream = open_result_stream(task_id, 0);
+    if (!stream) return NULL;
+    
+    for (int i = 0; i < 256; i++) {
+        memset(chunk, i & 0xFF, sizeof(chunk));
+        if (result_stream_write(stream, chunk, sizeof(chunk)) < 0) break;
+    }
+    
+    result_stream_close(stream, 0);
+    return NULL;
+}
+
+// Productor que nunca termina por sí mismo: escribe hasta que el canal
+// se cierre (deadline vencido)
+static void* demo_endless_producer(void* arg) {
+    uint64_t task_id = *(uint64_t*)arg;
+    uint8_t chunk[4096];
+    memset(chunk, 0xAB, sizeof(chunk));
+    
+    ResultStream* stream = open_result_stream(task_id, 0);
+    if (!stream) return NULL;
+    
+    while (result_stream_write(stream, chunk, sizeof(chunk)) == 0) {}
+    
+    result_stream_close(stream, 0);
+    return NULL;
+}
+
 // Demostración de funcionalidades
 static void run_demo(void) {
     printf("\n");
@@ -1413,7 +4618,56 @@ static void run_demo(void) {
     // Simular completar una tarea
     sleep(1);
     complete_task(t1, 0, "OK", 2);
-    printf("   ✓ Tarea %lu completada exitosamente\n\n", t1);
+    printf("   ✓ Tarea %lu completada exitosamente\n", t1);
+    
+    // Resultado por streaming: el consumidor lee mientras la tarea produce
+    uint64_t t4 = create_task("Resultado grande (streaming)", 5, NULL, 0);
+    ResultChannel* ch = get_result_channel(t4, true);
+    pthread_t producer;
+    pthread_create(&producer, NULL, demo_stream_producer, &t4);
+    
+    uint8_t buf[8192];
+    size_t received = 0;
+    ssize_t n;
+    while (ch && (n = result_channel_read(ch, buf, sizeof(buf), 1000)) > 0) {
+        received += (size_t)n;
+    }
+    pthread_join(producer, NULL);
+    
+    printf("   ✓ Tarea %lu: %zu KB recibidos por streaming\n", t4, received / 1024);
+    
+    // Deadline vencido con un consumidor leyendo: el productor, bloqueado
+    // con la ventana llena, debe soltarse y el lector recibir fin de flujo
+    char input[] = "entrada de la tarea con deadline";
+    uint64_t t5 = create_task_with_deadline("Flujo con deadline", 5, input, sizeof(input), 300, 1);
+    uint64_t t5_input = 0;
+    pthread_mutex_lock(&g_kernel->scheduler->lock);
+    DistributedTask* t5_task = find_task(g_kernel->scheduler, t5);
+    if (t5_task) t5_input = t5_task->input_block;
+    pthread_mutex_unlock(&g_kernel->scheduler->lock);
+    
+    ch = t5 ? get_result_channel(t5, true) : NULL;
+    pthread_t endless;
+    bool started = ch && pthread_create(&endless, NULL, demo_endless_producer, &t5) == 0;
+    
+    received = 0;
+    n = -1;
+    if (ch && result_channel_read(ch, buf, sizeof(buf), 1000) > 0) {
+        // Dejar de leer hasta que venza el deadline: la ventana se llena
+        usleep(600 * 1000);
+        while ((n = result_channel_read(ch, buf, sizeof(buf), 2000)) > 0) {
+            received += (size_t)n;
+        }
+    }
+    if (started) pthread_join(endless, NULL);
+    
+    char probe[8];
+    bool eof = ch && n == 0;
+    bool freed = t5_input && read_shared_memory(t5_input, probe, sizeof(probe), 0) < 0;
+    printf("   %s Tarea %lu: deadline vencido con lector activo -> fin de flujo %s "
+           "(código %d), productor liberado, entrada %s\n\n",
+           eof && freed ? "✓" : "✗", t5, eof ? "recibido" : "NO recibido",
+           ch ? ch->exit_code : 0, freed ? "liberada" : "NO liberada");
     
     // 2. Memoria Distribuida
     printf("▶ 2. MEMORIA DISTRIBUIDA\n");
@@ -1440,9 +4694,19 @@ static void run_demo(void) {
     uint64_t lock2 = create_distributed_lock("base_datos");
     
     if (acquire_distributed_lock(lock1, 1, 1000) == 0) {
-        printf("   ✓ Lock '%s' adquirido\n", "recurso_compartido");
+        uint64_t token = lock_fencing_token(lock1);
+        printf("   ✓ Lock '%s' adquirido (token %016lX)\n", "recurso_compartido", token);
         release_distributed_lock(lock1);
         printf("   ✓ Lock liberado\n");
+        
+        // Un dueño anterior que siguiera escribiendo presenta un token menor
+        if (acquire_distributed_lock(lock1, 2, 1000) == 0) {
+            write_shared_memory_fenced(m1, "v2", 2, 0, lock_fencing_token(lock1));
+            bool rejected = write_shared_memory_fenced(m1, "v1", 2, 0, token) != 0;
+            printf("   ✓ Escritura con el token anterior %s\n",
+                   rejected ? "rechazada" : "ACEPTADA");
+            release_distributed_lock(lock1);
+        }
     }
     
     printf("   ✓ Lock ID %lu: recurso_compartido\n", lock1);
@@ -1516,6 +4780,63 @@ static void* command_thread(void* arg) {
                 printf("Uso: task <descripción>\n");
             }
         }
+        else if (strcmp(cmd, "dtask") == 0) {
+            unsigned long deadline = 0;
+            char desc[192] = "";
+            if (sscanf(args, "%lu %191[^\n]", &deadline, desc) == 2 && deadline > 0) {
+                uint64_t tid = create_task_with_deadline(desc, 5, NULL, 0, deadline, 0);
+                if (tid) {
+                    printf("Tarea %lu creada: %s (deadline %lu ms)\n", tid, desc, deadline);
+                } else {
+                    printf("Error: Tarea rechazada o cola llena\n");
+                }
+            } else {
+                printf("Uso: dtask <ms> <descripción>\n");
+            }
+        }
+        else if (strcmp(cmd, "sched") == 0) {
+            char mode[16] = "", policy[16] = "";
+            sscanf(args, "%15s %15s", mode, policy);
+            
+            pthread_mutex_lock(&g_kernel->scheduler->lock);
+            if (strcmp(mode, "edf") == 0) {
+                g_kernel->scheduler->mode = SCHED_MODE_EDF;
+            } else if (strcmp(mode, "score") == 0) {
+                g_kernel->scheduler->mode = SCHED_MODE_SCORE;
+                // Vaciar lo que quedara en la cola EDF
+                dispatch_ready_tasks(g_kernel->scheduler, current_time_ms());
+            }
+            if (strcmp(policy, "reject") == 0) {
+                g_kernel->scheduler->admission = ADMISSION_REJECT;
+            } else if (strcmp(policy, "flag") == 0) {
+                g_kernel->scheduler->admission = ADMISSION_FLAG;
+            }
+            printf("Scheduler: modo %s, admisión %s\n",
+                   g_kernel->scheduler->mode == SCHED_MODE_EDF ? "EDF" : "score",
+                   g_kernel->scheduler->admission == ADMISSION_REJECT ? "rechazar" : "marcar");
+            pthread_mutex_unlock(&g_kernel->scheduler->lock);
+        }
+        else if (strcmp(cmd, "result") == 0) {
+            unsigned long tid = 0;
+            ResultChannel* ch = NULL;
+            if (sscanf(args, "%lu", &tid) == 1) {
+                ch = get_result_channel(tid, false);
+            }
+            if (ch) {
+                // Mostrar lo disponible sin esperar a que la tarea termine
+                char buf[257];
+                ssize_t n;
+                size_t total = 0;
+                while ((n = result_channel_read(ch, buf, sizeof(buf) - 1, 0)) > 0) {
+                    buf[n] = '\0';
+                    total += (size_t)n;
+                    printf("%s", buf);
+                }
+                printf("\n[%zu bytes%s]\n", total, n == 0 ? ", fin del resultado" : "");
+            } else {
+                printf("Uso: result <task_id> (la tarea debe tener resultado)\n");
+            }
+        }
         else if (strcmp(cmd, "alloc") == 0) {
             int size = 0;
             if (sscanf(args, "%d", &size) == 1 && size > 0) {
@@ -1529,6 +4850,133 @@ static void* command_thread(void* arg) {
                 printf("Uso: alloc <bytes>\n");
             }
         }
+        else if (strcmp(cmd, "mwrite") == 0) {
+            unsigned long bid = 0, offset = 0;
+            char text[160] = "";
+            if (sscanf(args, "%lu %lu %159[^\n]", &bid, &offset, text) == 3) {
+                if (write_shared_memory(bid, text, strlen(text), offset) == 0) {
+                    printf("Bloque %lu: %zu bytes escritos en offset %lu\n",
+                           bid, strlen(text), offset);
+                } else {
+                    printf("Error: Bloque inexistente o fuera de rango\n");
+                }
+            } else {
+                printf("Uso: mwrite <bloque> <offset> <texto>\n");
+            }
+        }
+        else if (strcmp(cmd, "replicate") == 0) {
+            unsigned long bid = 0;
+            char node[32] = "";
+            if (sscanf(args, "%lu %31s", &bid, node) == 2) {
+                uint64_t target = strtoull(node, NULL, 16);
+                if (replicate_memory_block(bid, target) == 0) {
+                    printf("Bloque %lu replicado en %016lX\n", bid, target);
+                } else {
+                    printf("Error: No se pudo replicar (se reintentará en el próximo msync)\n");
+                }
+            } else {
+                printf("Uso: replicate <bloque> <nodo_hex>\n");
+            }
+        }
+        else if (strcmp(cmd, "msync") == 0) {
+            unsigned long bid = 0;
+            if (sscanf(args, "%lu", &bid) == 1) {
+                ssize_t sent = sync_memory_replicas(bid);
+                if (sent >= 0) {
+                    printf("Bloque %lu sincronizado: %zd bytes enviados\n", bid, sent);
+                } else {
+                    printf("Error: Alguna réplica no confirmó\n");
+                }
+            } else {
+                printf("Uso: msync <bloque>\n");
+            }
+        }
+        else if (strcmp(cmd, "mread") == 0) {
+            unsigned long bid = 0, offset = 0, len = 0;
+            char text[161];
+            if (sscanf(args, "%lu %lu %lu", &bid, &offset, &len) == 3 &&
+                len > 0 && len < sizeof(text)) {
+                if (read_shared_memory(bid, text, len, offset) == 0) {
+                    text[len] = '\0';
+                    printf("Bloque %lu [%lu..%lu]: %s\n", bid, offset, offset + len, text);
+                } else {
+                    printf("Error: Bloque inexistente, fuera de rango o no recuperable\n");
+                }
+            } else {
+                printf("Uso: mread <bloque> <offset> <bytes (max 160)>\n");
+            }
+        }
+        else if (strcmp(cmd, "tier") == 0) {
+            unsigned long limit_mb = 0;
+            if (sscanf(args, "%lu", &limit_mb) == 1) {
+                pthread_mutex_lock(&g_kernel->memory->tier_lock);
+                g_kernel->memory->tier_limit = (size_t)limit_mb * 1024 * 1024;
+                pthread_cond_signal(&g_kernel->memory->tier_wakeup);
+                pthread_mutex_unlock(&g_kernel->memory->tier_lock);
+            }
+            printf("\n💾 TIERING DE MEMORIA\n");
+            print_tier_stats();
+            printf("\n");
+        }
+        else if (strcmp(cmd, "lock") == 0) {
+            char name[64] = "";
+            int timeout_ms = 5000;
+            if (sscanf(args, "%63s %d", name, &timeout_ms) >= 1) {
+                uint64_t lock_id = create_distributed_lock(name);
+                uint64_t start = current_time_ms();
+                if (lock_id && acquire_distributed_lock(lock_id, 0, timeout_ms) == 0) {
+                    printf("Lock '%s' adquirido en %lu ms (hogar %016lX, token %016lX)\n",
+                           name, current_time_ms() - start, lock_home(lock_id),
+                           lock_fencing_token(lock_id));
+                } else {
+                    printf("Error: Lock '%s' no adquirido en %d ms\n", name, timeout_ms);
+                }
+            } else {
+                printf("Uso: lock <nombre> [timeout_ms]\n");
+            }
+        }
+        else if (strcmp(cmd, "unlock") == 0) {
+            char name[64] = "";
+            if (sscanf(args, "%63s", name) == 1) {
+                release_distributed_lock(create_distributed_lock(name));
+                printf("Lock '%s' liberado\n", name);
+            } else {
+                printf("Uso: unlock <nombre>\n");
+            }
+        }
+        else if (strcmp(cmd, "rlock") == 0) {
+            char name[64] = "";
+            int timeout_ms = 5000;
+            if (sscanf(args, "%63s %d", name, &timeout_ms) >= 1) {
+                uint64_t lock_id = create_distributed_lock(name);
+                uint64_t start = current_time_ms();
+                if (lock_id && acquire_distributed_read_lock(lock_id, 0, timeout_ms) == 0) {
+                    printf("Lectura de '%s' adquirida en %lu ms (hogar %016lX)\n",
+                           name, current_time_ms() - start, lock_home(lock_id));
+                } else {
+                    printf("Error: Lectura de '%s' no adquirida en %d ms\n", name, timeout_ms);
+                }
+            } else {
+                printf("Uso: rlock <nombre> [timeout_ms]\n");
+            }
+        }
+        else if (strcmp(cmd, "runlock") == 0) {
+            char name[64] = "";
+            if (sscanf(args, "%63s", name) == 1) {
+                release_distributed_read_lock(create_distributed_lock(name));
+                printf("Lectura de '%s' terminada\n", name);
+            } else {
+                printf("Uso: runlock <nombre>\n");
+            }
+        }
+        else if (strcmp(cmd, "lockbench") == 0) {
+            unsigned long count = 0;
+            if (sscanf(args, "%lu", &count) == 1 && count > 0) {
+                benchmark_lock_table((size_t)count);
+            } else {
+                printf("Uso: lockbench <n>\n");
+            }
+        }
         else if (strcmp(cmd, "demo") == 0) {
             run_demo();
         }
@@ -1585,15 +5033,39 @@ static int init_kernel(uint64_t node_id) {
     g_kernel->scheduler = calloc(1, sizeof(DistributedScheduler));
     pthread_mutex_init(&g_kernel->scheduler->lock, NULL);
     pthread_cond_init(&g_kernel->scheduler->task_available, NULL);
+    g_kernel->scheduler->mode = SCHED_MODE_SCORE;
+    g_kernel->scheduler->admission = ADMISSION_FLAG;
+    g_kernel->scheduler->avg_runtime_ms = DEFAULT_RUNTIME_MS;
     
     // Memoria distribuida
     g_kernel->memory = calloc(1, sizeof(DistributedMemoryManager));
     pthread_mutex_init(&g_kernel->memory->lock, NULL);
+    pthread_mutex_init(&g_kernel->memory->sync_lock, NULL);
+    pthread_mutex_init(&g_kernel->memory->tier_lock, NULL);
+    pthread_cond_init(&g_kernel->memory->tier_wakeup, NULL);
+    g_kernel->memory->free_head = MEMORY_SLOT_NONE;
+    g_kernel->memory->last_fault = MEMORY_SLOT_NONE;
+    
+    // Directorio de desalojo propio del nodo
+    snprintf(g_kernel->memory->spill_dir, sizeof(g_kernel->memory->spill_dir),
+             "%s/%016lX", TIER_SPILL_DIR, g_kernel->node_id);
+    mkdir(TIER_SPILL_DIR, 0700);
+    mkdir(g_kernel->memory->spill_dir, 0700);
     
     // Sincronización
     g_kernel->sync = calloc(1, sizeof(SyncManager));
-    pthread_mutex_init(&g_kernel->sync->lock, NULL);
-    
+    for (int i = 0; i < LOCK_SHARDS; i++) {
+        LockShard* shard = &g_kernel->sync->shards[i];
+        shard->bucket_count = LOCK_SHARD_BUCKETS;
+        shard->buckets = calloc(LOCK_SHARD_BUCKETS, sizeof(DistributedLock*));
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+    pthread_mutex_init(&g_kernel->sync->active_lock, NULL);
+    pthread_mutex_init(&g_kernel->sync->conn_lock, NULL);
+    for (int i = 0; i < MAX_NODES; i++) {
+        g_kernel->sync->idle_conns[i].fd = -1;
+    }
+
     // Sockets
     g_kernel->discovery_socket = create_discovery_socket();
     if (g_kernel->discovery_socket < 0) {
@@ -1615,6 +5087,8 @@ static void start_threads(void) {
     pthread_create(&g_kernel->discovery_thread, NULL, discovery_listener_thread, NULL);
     pthread_create(&g_kernel->heartbeat_thread, NULL, heartbeat_broadcast_thread, NULL);
     pthread_create(&g_kernel->failure_detector_thread, NULL, failure_detector_thread, NULL);
+    pthread_create(&g_kernel->scheduler_thread, NULL, scheduler_thread, NULL);
+    pthread_create(&g_kernel->tiering_thread, NULL, tiering_thread, NULL);
     
     if (g_kernel->data_socket >= 0) {
         pthread_create(&g_kernel->data_server_thread, NULL, data_server_thread, NULL);
@@ -1630,29 +5104,90 @@ static void cleanup(void) {
     pthread_join(g_kernel->discovery_thread, NULL);
     pthread_join(g_kernel->heartbeat_thread, NULL);
     pthread_join(g_kernel->failure_detector_thread, NULL);
+    pthread_join(g_kernel->scheduler_thread, NULL);
+    pthread_cond_signal(&g_kernel->memory->tier_wakeup);
+    pthread_join(g_kernel->tiering_thread, NULL);
     
     // Cerrar sockets
     if (g_kernel->discovery_socket >= 0) close(g_kernel->discovery_socket);
     if (g_kernel->data_socket >= 0) close(g_kernel->data_socket);
     
+    // Liberar canales de resultados
+    for (size_t i = 0; i < g_kernel->scheduler->task_count; i++) {
+        result_channel_destroy(g_kernel->scheduler->channels[i]);
+    }
+    
     // Liberar memoria distribuida
     pthread_mutex_lock(&g_kernel->memory->lock);
-    for (size_t i = 0; i < g_kernel->memory->block_count; i++) {
-        if (g_kernel->memory->blocks[i]) {
-            free(g_kernel->memory->blocks[i]->data);
-            pthread_rwlock_destroy(&g_kernel->memory->blocks[i]->rwlock);
-            free(g_kernel->memory->blocks[i]);
+    uint32_t slots = atomic_load(&g_kernel->memory->slot_count);
+    for (uint32_t i = 0; i < slots; i++) {
+        SharedMemoryBlock* block = memory_slot(i);
+        if (atomic_load(&block->block_id) && block->tier == TIER_DISK) {
+            tier_unlink_spill_file(block->block_id);
+        } else if (atomic_load(&block->block_id) && block->tier == TIER_PEER) {
+            tier_release_peer_copy(block->block_id, block->spill_node, block->spill_remote);
         }
+        free(block->data);
+        for (int r = 0; r < block->replica_count; r++) {
+            free(block->replica_dirty[r]);
+        }
+        pthread_rwlock_destroy(&block->rwlock);
+    }
+    for (int i = 0; i < MEMORY_TABLE_SEGMENTS; i++) {
+        free(atomic_load(&g_kernel->memory->segments[i]));
     }
     pthread_mutex_unlock(&g_kernel->memory->lock);
+    rmdir(g_kernel->memory->spill_dir);
     
     // Liberar estructuras
     pthread_mutex_destroy(&g_kernel->registry->lock);
     pthread_mutex_destroy(&g_kernel->scheduler->lock);
     pthread_cond_destroy(&g_kernel->scheduler->task_available);
     pthread_mutex_destroy(&g_kernel->memory->lock);
-    pthread_mutex_destroy(&g_kernel->sync->lock);
-    
+    pthread_mutex_destroy(&g_kernel->memory->sync_lock);
+    pthread_mutex_destroy(&g_kernel->memory->tier_lock);
+    pthread_cond_destroy(&g_kernel->memory->tier_wakeup);
+    for (int i = 0; i < LOCK_SHARDS; i++) {
+        LockShard* shard = &g_kernel->sync->shards[i];
+        for (size_t b = 0; b < shard->bucket_count; b++) {
+            DistributedLock* lock = shard->buckets[b];
+            while (lock) {
+                DistributedLock* next = lock->hash_next;
+                if (lock->remote_fd >= 0) close(lock->remote_fd);
+                
+                // El hilo del lease de lectura sale al cerrarse su conexión
+                pthread_mutex_lock(&lock->local_lock);
+                if (lock->read_fd >= 0) {
+                    shutdown(lock->read_fd, SHUT_RDWR);
+                    struct timespec deadline;
+                    clock_gettime(CLOCK_REALTIME, &deadline);
+                    deadline.tv_sec += 1;
+                    while (lock->read_fd >= 0 &&
+                           pthread_cond_timedwait(&lock->read_cond, &lock->local_lock,
+                                                  &deadline) != ETIMEDOUT) {
+                    }
+                }
+                pthread_mutex_unlock(&lock->local_lock);
+                
+                // ...y suelta su referencia justo después
+                for (int t = 0; t < 100 &&
+                     atomic_load(&lock->refs) > (lock->active ? 1 : 0); t++) {
+                    usleep(1000);
+                }
+                
+                free_lock(lock);
+                lock = next;
+            }
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    pthread_mutex_destroy(&g_kernel->sync->active_lock);
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (g_kernel->sync->idle_conns[i].fd >= 0) close(g_kernel->sync->idle_conns[i].fd);
+    }
+    pthread_mutex_destroy(&g_kernel->sync->conn_lock);
+
     free(g_kernel->registry);
     free(g_kernel->scheduler);
     free(g_kernel->memory);
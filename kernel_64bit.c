@@ -24,6 +24,19 @@
 #include <signal.h>
 #include <sys/syscall.h>
 #include <linux/futex.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <sched.h>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
 #include <immintrin.h>  // Para instrucciones SIMD
 
 // ========================================
@@ -120,6 +133,8 @@ typedef struct CACHE_ALIGNED {
     uint8_t cache_data[CACHE_LINE_SIZE * 4];
 } Node64;
 
+typedef struct SegmentCow SegmentCow;
+
 // Memoria compartida distribuida con soporte 64 bits
 typedef struct CACHE_ALIGNED {
     memory_id_t memory_id;
@@ -129,6 +144,9 @@ typedef struct CACHE_ALIGNED {
     void* mmap_addr;
     size_t mmap_size;
     int mmap_fd;
+    int numa_node;           // Nodo NUMA donde reside la memoria
+    int backing;             // SEGMENT_BACKING_* (pool, THP, 4 KB, arena)
+    size_t backing_page_size; // Tamaño de página real del respaldo
     
     // Gestión de páginas
     struct {
@@ -140,14 +158,13 @@ typedef struct CACHE_ALIGNED {
     
     // Versionado y consistencia
     _Atomic uint64_t version;
-    _Atomic uint32_t readers;
-    _Atomic uint32_t writers;
     
-    // Lock optimizado con futex
+    // Read-write lock con futex: estado (lectores activos, escritores en
+    // espera, bits de posesión) y concesiones pendientes para escritores
     union {
         struct {
-            _Atomic uint32_t lock;
-            uint32_t waiter_count;
+            _Atomic uint32_t rw_state;
+            _Atomic uint32_t rw_grants;
         };
         uint64_t lock_word;
     };
@@ -158,6 +175,9 @@ typedef struct CACHE_ALIGNED {
     
     // Checksum para integridad
     uint64_t checksum;
+    
+    // Estado copy-on-write (NULL hasta la primera snapshot)
+    SegmentCow* cow;
 } SharedMemory64;
 
 // ========================================
@@ -334,199 +354,4728 @@ void init_advanced_scheduler(void) {
             (uint64_t)(10000000 * (1 << i));  // 10ms * 2^i
     }
     
-    pthread_mutex_init(&scheduler64->lock, NULL);
-    
-    printf("[SCHEDULER] Scheduler avanzado inicializado (8 niveles de prioridad)\n");
+    pthread_mutex_init(&scheduler64->lock, NULL);
+    
+    printf("[SCHEDULER] Scheduler avanzado inicializado (8 niveles de prioridad)\n");
+}
+
+// Algoritmo de scheduling con machine learning básico
+node_id_t intelligent_task_assignment(Task64* task, Node64* nodes, int node_count) {
+    if (!task || !nodes || node_count == 0) return -1;
+    
+    double best_score = -1.0;
+    node_id_t best_node = -1;
+    
+    // Usar timestamp actual para predicción
+    uint64_t current_time = get_timestamp_ns();
+    
+    for (int i = 0; i < node_count; i++) {
+        Node64* node = &nodes[i];
+        
+        if (atomic_load(&node->status) == 0) continue;  // Nodo offline
+        
+        // Calcular score con múltiples factores
+        double cpu_score = 1.0 - (node->cpu_load / 100.0);
+        double mem_score = 1.0 - (node->memory_usage / 100.0);
+        double rep_score = node->reputation_score;
+        double task_score = 1.0 / (1.0 + atomic_load(&node->active_tasks));
+        
+        // Considerar ancho de banda para tareas con muchos datos
+        double bw_score = 1.0;
+        if (task->data_size > 1024 * 1024) {  // Más de 1MB
+            bw_score = node->network_bandwidth_mbps / 1000.0;  // Normalizar a Gbps
+        }
+        
+        // Score ponderado con pesos adaptativos
+        double score = (cpu_score * 0.3) + 
+                      (mem_score * 0.25) + 
+                      (rep_score * 0.2) + 
+                      (task_score * 0.15) + 
+                      (bw_score * 0.1);
+        
+        // Bonus por afinidad (si el nodo ya procesó tareas similares)
+        if (atomic_load(&node->total_tasks_completed) > 0) {
+            score *= 1.1;
+        }
+        
+        if (score > best_score) {
+            best_score = score;
+            best_node = node->node_id;
+        }
+    }
+    
+    if (best_node != -1) {
+        printf("[SCHEDULER] Tarea %lu asignada a nodo %lu (score: %.3f)\n", 
+               task->task_id, best_node, best_score);
+    }
+    
+    return best_node;
+}
+
+// ========================================
+// TOPOLOGÍA NUMA
+// ========================================
+
+#define MAX_NUMA_NODES     64
+#define NUMA_ARENA_CHUNK   (2 * 1024 * 1024)  // Trozo de arena por hilo
+
+typedef struct {
+    int node_count;
+    int max_node;                             // Mayor ID de nodo presente
+    bool present[MAX_NUMA_NODES];
+    cpu_set_t node_cpus[MAX_NUMA_NODES];
+    int cpu_node[CPU_SETSIZE];
+    
+    // Estadísticas de asignación por nodo
+    _Atomic uint64_t alloc_count[MAX_NUMA_NODES];
+    _Atomic uint64_t alloc_bytes[MAX_NUMA_NODES];
+    _Atomic uint64_t bind_failures;
+    _Atomic uint64_t arena_chunks_mapped;
+    _Atomic uint64_t arena_chunks_reused;
+} NumaTopology;
+
+static NumaTopology numa_topology;
+
+// Arena por hilo para segmentos pequeños: trozos ligados al nodo del hilo
+typedef struct {
+    int node;
+    uint8_t* base;
+    size_t used;
+    size_t capacity;
+} NumaArena;
+
+static _Thread_local NumaArena numa_thread_arena = { .node = -1 };
+
+// Cabecera al principio de cada trozo. Los trozos están alineados a su
+// tamaño, así que el de un segmento se obtiene de su dirección.
+typedef struct NumaArenaChunk {
+    _Atomic uint32_t live;          // Segmentos vivos, +1 mientras un hilo asigna de él
+    int node;
+    struct NumaArenaChunk* next;    // Siguiente en la lista libre del nodo
+} NumaArenaChunk;
+
+#define NUMA_ARENA_FREE_MAX  4      // Trozos libres que se guardan por nodo
+
+// Trozos vacíos por nodo, ya ligados a él, para no repetir mmap + mbind
+static struct {
+    pthread_mutex_t lock;
+    NumaArenaChunk* head[MAX_NUMA_NODES];
+    int count[MAX_NUMA_NODES];
+} numa_arena_free_chunks = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_key_t numa_arena_key;
+static pthread_once_t numa_arena_key_once = PTHREAD_ONCE_INIT;
+
+// Parsear listas de /sys del tipo "0-3,8-11"
+static void parse_cpulist(const char* list, void (*add)(int, void*), void* ctx) {
+    const char* p = list;
+    while (*p && *p != '\n') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) break;
+        if (*end == '-') last = strtol(end + 1, &end, 10);
+        for (long i = first; i <= last; i++) add((int)i, ctx);
+        p = (*end == ',') ? end + 1 : end;
+    }
+}
+
+static void add_numa_node(int node, void* ctx) {
+    (void)ctx;
+    if (node >= 0 && node < MAX_NUMA_NODES) numa_topology.present[node] = true;
+}
+
+static void add_node_cpu(int cpu, void* ctx) {
+    int node = *(int*)ctx;
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &numa_topology.node_cpus[node]);
+        numa_topology.cpu_node[cpu] = node;
+    }
+}
+
+static bool read_sys_line(const char* path, char* buf, size_t len) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(buf, (int)len, f) != NULL;
+    fclose(f);
+    return ok;
+}
+
+// Leer la topología de /sys/devices/system/node; sin NUMA, un único nodo
+void detect_numa_topology(void) {
+    char buf[4096];
+    
+    memset(&numa_topology, 0, sizeof(numa_topology));
+    
+    if (read_sys_line("/sys/devices/system/node/online", buf, sizeof(buf))) {
+        parse_cpulist(buf, add_numa_node, NULL);
+    }
+    
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        if (!numa_topology.present[node]) continue;
+        
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (read_sys_line(path, buf, sizeof(buf))) {
+            parse_cpulist(buf, add_node_cpu, &node);
+        }
+        numa_topology.node_count++;
+        numa_topology.max_node = node;
+    }
+    
+    if (numa_topology.node_count == 0) {
+        numa_topology.node_count = 1;
+        numa_topology.present[0] = true;
+        for (long cpu = 0; cpu < (long)kernel64->system_info.total_cores && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &numa_topology.node_cpus[0]);
+        }
+    }
+    
+    kernel64->system_info.numa_nodes = numa_topology.node_count;
+}
+
+// Nodo NUMA de la CPU en la que corre el hilo
+int numa_current_node(void) {
+    int cpu = sched_getcpu();
+    return (cpu >= 0 && cpu < CPU_SETSIZE) ? numa_topology.cpu_node[cpu] : 0;
+}
+
+// Preferir páginas del nodo indicado (antes del primer acceso a la región)
+static int numa_bind_memory(void* addr, size_t len, int node) {
+    if (numa_topology.node_count <= 1) return 0;
+    
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask,
+                (unsigned long)MAX_NUMA_NODES + 1, 0) < 0) {
+        atomic_fetch_add(&numa_topology.bind_failures, 1);
+        return -1;
+    }
+    return 0;
+}
+
+// Fijar un hilo a las CPUs de un nodo
+int numa_pin_thread(pthread_t thread, int node) {
+    if (numa_topology.node_count <= 1 || node < 0 || node >= MAX_NUMA_NODES ||
+        !numa_topology.present[node]) {
+        return 0;
+    }
+    return pthread_setaffinity_np(thread, sizeof(cpu_set_t), &numa_topology.node_cpus[node]);
+}
+
+// Soltar una referencia de un trozo. El último vacía sus páginas (el rango
+// conserva la política del nodo) y lo guarda en la lista libre del nodo, o
+// lo devuelve al sistema si la lista ya está llena.
+static void numa_arena_chunk_put(NumaArenaChunk* chunk) {
+    if (atomic_fetch_sub_explicit(&chunk->live, 1, memory_order_acq_rel) != 1) return;
+    
+    int node = chunk->node;
+    madvise(chunk, NUMA_ARENA_CHUNK, MADV_DONTNEED);
+    
+    pthread_mutex_lock(&numa_arena_free_chunks.lock);
+    if (numa_arena_free_chunks.count[node] < NUMA_ARENA_FREE_MAX) {
+        chunk->next = numa_arena_free_chunks.head[node];
+        numa_arena_free_chunks.head[node] = chunk;
+        numa_arena_free_chunks.count[node]++;
+        chunk = NULL;
+    }
+    pthread_mutex_unlock(&numa_arena_free_chunks.lock);
+    
+    if (chunk) munmap(chunk, NUMA_ARENA_CHUNK);
+}
+
+// Trozo nuevo para el nodo: de la lista libre o mapeado y ligado al nodo
+static NumaArenaChunk* numa_arena_chunk_get(int node) {
+    pthread_mutex_lock(&numa_arena_free_chunks.lock);
+    NumaArenaChunk* chunk = numa_arena_free_chunks.head[node];
+    if (chunk) {
+        numa_arena_free_chunks.head[node] = chunk->next;
+        numa_arena_free_chunks.count[node]--;
+    }
+    pthread_mutex_unlock(&numa_arena_free_chunks.lock);
+    
+    if (chunk) {
+        atomic_fetch_add(&numa_topology.arena_chunks_reused, 1);
+    } else {
+        uint8_t* raw = mmap(NULL, 2 * NUMA_ARENA_CHUNK, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return NULL;
+        
+        uint8_t* aligned = (uint8_t*)(((uintptr_t)raw + NUMA_ARENA_CHUNK - 1) &
+                                      ~(uintptr_t)(NUMA_ARENA_CHUNK - 1));
+        if (aligned > raw) munmap(raw, (size_t)(aligned - raw));
+        munmap(aligned + NUMA_ARENA_CHUNK, (size_t)(raw + NUMA_ARENA_CHUNK - aligned));
+        
+        chunk = (NumaArenaChunk*)aligned;
+        numa_bind_memory(chunk, NUMA_ARENA_CHUNK, node);
+        atomic_fetch_add(&numa_topology.arena_chunks_mapped, 1);
+    }
+    
+    chunk->node = node;
+    chunk->next = NULL;
+    atomic_store(&chunk->live, 1);   // Referencia del hilo que asigna de él
+    return chunk;
+}
+
+// Al salir un hilo se suelta la referencia de su trozo activo
+static void numa_arena_thread_exit(void* chunk) {
+    numa_arena_chunk_put(chunk);
+}
+
+static void numa_arena_key_init(void) {
+    pthread_key_create(&numa_arena_key, numa_arena_thread_exit);
+}
+
+// Asignación pequeña desde la arena del hilo, en su nodo actual. Cada
+// segmento cuenta como referencia de su trozo hasta numa_arena_free().
+static void* numa_arena_alloc(size_t size, int node) {
+    NumaArena* arena = &numa_thread_arena;
+    size = (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    
+    if (arena->node != node || arena->used + size > arena->capacity) {
+        NumaArenaChunk* chunk = numa_arena_chunk_get(node);
+        if (!chunk) return NULL;
+        
+        pthread_once(&numa_arena_key_once, numa_arena_key_init);
+        if (arena->base) numa_arena_chunk_put((NumaArenaChunk*)arena->base);
+        pthread_setspecific(numa_arena_key, chunk);
+        
+        arena->node = node;
+        arena->base = (uint8_t*)chunk;
+        arena->used = CACHE_LINE_SIZE;   // La cabecera ocupa la primera línea
+        arena->capacity = NUMA_ARENA_CHUNK;
+    }
+    
+    atomic_fetch_add_explicit(&((NumaArenaChunk*)arena->base)->live, 1, memory_order_relaxed);
+    void* ptr = arena->base + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+// Devolver un segmento de la arena a su trozo
+static void numa_arena_free(void* ptr) {
+    numa_arena_chunk_put((NumaArenaChunk*)((uintptr_t)ptr & ~(uintptr_t)(NUMA_ARENA_CHUNK - 1)));
+}
+
+void print_numa_stats(void) {
+    printf("  Nodos NUMA: %d\n", numa_topology.node_count);
+    for (int node = 0; node <= numa_topology.max_node; node++) {
+        if (!numa_topology.present[node]) continue;
+        printf("    Nodo %d: %d CPUs, %lu segmentos, %lu MB\n",
+               node, CPU_COUNT(&numa_topology.node_cpus[node]),
+               atomic_load(&numa_topology.alloc_count[node]),
+               atomic_load(&numa_topology.alloc_bytes[node]) / (1024 * 1024));
+    }
+    if (atomic_load(&numa_topology.bind_failures)) {
+        printf("    Fallos de mbind: %lu\n", atomic_load(&numa_topology.bind_failures));
+    }
+    printf("    Trozos de arena: %lu mapeados, %lu reutilizados\n",
+           atomic_load(&numa_topology.arena_chunks_mapped),
+           atomic_load(&numa_topology.arena_chunks_reused));
+}
+
+// ========================================
+// POOL DE HUGE PAGES
+// ========================================
+
+#define HUGE_PAGE_2MB          (2UL * 1024 * 1024)
+#define HUGE_PAGE_1GB          (1024UL * 1024 * 1024)
+#define HUGE_POOL_2MB_DEFAULT  64   // Páginas de 2 MB reservadas al arrancar
+#define HUGE_POOL_1GB_DEFAULT  0    // Páginas de 1 GB (requieren reserva en el boot)
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// Respaldo real de un segmento
+enum {
+    SEGMENT_BACKING_ARENA = 0,   // Arena NUMA del hilo (segmentos pequeños)
+    SEGMENT_BACKING_SMALL,       // mmap con páginas de 4 KB
+    SEGMENT_BACKING_THP,         // mmap alineado con madvise(MADV_HUGEPAGE)
+    SEGMENT_BACKING_POOL_2MB,    // Pool hugetlb de 2 MB
+    SEGMENT_BACKING_POOL_1GB,    // Pool hugetlb de 1 GB
+    SEGMENT_BACKING_MEMFD,       // memfd compartible por SCM_RIGHTS
+    SEGMENT_BACKING_FILE,        // Archivo en DOS_SHM_DIR (opcionalmente persistente)
+    SEGMENT_BACKING_IMPORTED     // Descriptor recibido de otro proceso
+};
+
+// Política de páginas al crear un segmento
+typedef enum {
+    HUGE_POLICY_AUTO,            // Pool -> THP -> 4 KB
+    HUGE_POLICY_NONE             // Forzar páginas de 4 KB (sin THP)
+} HugePagePolicy;
+
+// Región hugetlb reservada al arrancar, repartida por páginas completas
+typedef struct {
+    size_t page_size;
+    uint8_t* base;
+    size_t page_count;
+    uint8_t* in_use;             // Un byte por página
+    size_t free_pages;
+    int numa_node;               // Nodo donde se poblaron las páginas
+    pthread_mutex_t lock;
+    
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+} HugePagePool;
+
+static HugePagePool huge_pool_2mb = { .page_size = HUGE_PAGE_2MB, .lock = PTHREAD_MUTEX_INITIALIZER };
+static HugePagePool huge_pool_1gb = { .page_size = HUGE_PAGE_1GB, .lock = PTHREAD_MUTEX_INITIALIZER };
+static _Atomic uint64_t thp_segments = 0;
+static _Atomic uint64_t small_page_segments = 0;
+static bool thp_available = false;
+
+static inline size_t round_up_size(size_t size, size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+// Reservar page_count páginas; si el sistema no tiene tantas, probar con la mitad
+static void reserve_huge_page_pool(HugePagePool* pool, size_t page_count, int size_flag) {
+    while (page_count > 0) {
+        void* base = mmap(NULL, page_count * pool->page_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | size_flag | MAP_POPULATE,
+                          -1, 0);
+        if (base != MAP_FAILED) {
+            pool->base = (uint8_t*)base;
+            pool->page_count = page_count;
+            pool->free_pages = page_count;
+            pool->in_use = (uint8_t*)calloc(page_count, 1);
+            pool->numa_node = numa_current_node();
+            return;
+        }
+        page_count /= 2;
+    }
+}
+
+static size_t read_env_count(const char* name, size_t fallback) {
+    const char* value = getenv(name);
+    return value ? strtoull(value, NULL, 10) : fallback;
+}
+
+// Reservar los pools al arrancar (tamaños ajustables con DOS_HUGEPAGES_2MB
+// y DOS_HUGEPAGES_1GB) y comprobar si THP admite madvise
+void init_huge_page_pools(void) {
+    char buf[128];
+    
+    reserve_huge_page_pool(&huge_pool_2mb,
+                           read_env_count("DOS_HUGEPAGES_2MB", HUGE_POOL_2MB_DEFAULT),
+                           MAP_HUGE_2MB);
+    reserve_huge_page_pool(&huge_pool_1gb,
+                           read_env_count("DOS_HUGEPAGES_1GB", HUGE_POOL_1GB_DEFAULT),
+                           MAP_HUGE_1GB);
+    
+    // "always [madvise] never": basta con que no esté en never
+    if (read_sys_line("/sys/kernel/mm/transparent_hugepage/enabled", buf, sizeof(buf))) {
+        thp_available = strstr(buf, "[never]") == NULL;
+    }
+    
+    kernel64->system_info.huge_page_size = huge_pool_1gb.page_count ? HUGE_PAGE_1GB : HUGE_PAGE_2MB;
+    
+    printf("[KERNEL] Huge pages: pool 2 MB = %zu páginas, pool 1 GB = %zu páginas, THP %s\n",
+           huge_pool_2mb.page_count, huge_pool_1gb.page_count,
+           thp_available ? "disponible" : "desactivado");
+}
+
+// Tomar una racha contigua de páginas del pool (primer hueco que quepa)
+static void* huge_pool_alloc(HugePagePool* pool, size_t size, int numa_node) {
+    if (!pool->base) return NULL;
+    if (numa_topology.node_count > 1 && numa_node != pool->numa_node) return NULL;
+    
+    size_t needed = round_up_size(size, pool->page_size) / pool->page_size;
+    void* ptr = NULL;
+    
+    pthread_mutex_lock(&pool->lock);
+    if (needed <= pool->free_pages) {
+        size_t run = 0;
+        for (size_t i = 0; i < pool->page_count; i++) {
+            run = pool->in_use[i] ? 0 : run + 1;
+            if (run == needed) {
+                size_t first = i + 1 - needed;
+                memset(pool->in_use + first, 1, needed);
+                pool->free_pages -= needed;
+                ptr = pool->base + first * pool->page_size;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    
+    return ptr;
+}
+
+// Devolver páginas al pool, a cero para el siguiente segmento
+static void huge_pool_free(HugePagePool* pool, void* ptr, size_t size) {
+    size_t length = round_up_size(size, pool->page_size);
+    size_t first = (size_t)((uint8_t*)ptr - pool->base) / pool->page_size;
+    
+    memset(ptr, 0, length);
+    
+    pthread_mutex_lock(&pool->lock);
+    memset(pool->in_use + first, 0, length / pool->page_size);
+    pool->free_pages += length / pool->page_size;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Mapear con alineación de 2 MB y pedir THP; el kernel decide al tocar
+// cada tramo si le da una huge page
+static void* map_thp_region(size_t size) {
+    size_t length = round_up_size(size, HUGE_PAGE_2MB);
+    uint8_t* raw = mmap(NULL, length + HUGE_PAGE_2MB, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return MAP_FAILED;
+    
+    uint8_t* aligned = (uint8_t*)round_up_size((uintptr_t)raw, HUGE_PAGE_2MB);
+    if (aligned > raw) munmap(raw, (size_t)(aligned - raw));
+    size_t tail = (size_t)((raw + length + HUGE_PAGE_2MB) - (aligned + length));
+    if (tail) munmap(aligned + length, tail);
+    
+    madvise(aligned, length, MADV_HUGEPAGE);
+    return aligned;
+}
+
+// Bytes de un segmento THP que realmente están en huge pages (AnonHugePages
+// de su VMA en /proc/self/smaps)
+size_t segment_thp_bytes(const void* addr) {
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f) return 0;
+    
+    char line[256];
+    bool inside = false;
+    size_t bytes = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            inside = (uintptr_t)addr >= start && (uintptr_t)addr < end;
+        } else if (inside && strncmp(line, "AnonHugePages:", 14) == 0) {
+            bytes = strtoull(line + 14, NULL, 10) * 1024;
+            break;
+        }
+    }
+    fclose(f);
+    return bytes;
+}
+
+void print_huge_page_stats(void) {
+    printf("  Huge pages 2 MB: %lu aciertos, %lu fallos (%zu/%zu libres)\n",
+           atomic_load(&huge_pool_2mb.hits), atomic_load(&huge_pool_2mb.misses),
+           huge_pool_2mb.free_pages, huge_pool_2mb.page_count);
+    printf("  Huge pages 1 GB: %lu aciertos, %lu fallos (%zu/%zu libres)\n",
+           atomic_load(&huge_pool_1gb.hits), atomic_load(&huge_pool_1gb.misses),
+           huge_pool_1gb.free_pages, huge_pool_1gb.page_count);
+    printf("  Segmentos THP: %lu | Segmentos de 4 KB: %lu\n",
+           atomic_load(&thp_segments), atomic_load(&small_page_segments));
+}
+
+// ========================================
+// GESTIÓN DE MEMORIA DISTRIBUIDA AVANZADA
+// ========================================
+
+// Elegir el respaldo de un segmento grande: pool de 1 GB, pool de 2 MB,
+// THP y, en último caso, páginas de 4 KB
+static void* map_segment_backing(SharedMemory64* mem, size_t size, HugePagePolicy policy) {
+    void* addr = NULL;
+    
+    if (policy == HUGE_POLICY_AUTO) {
+        if (size >= HUGE_PAGE_1GB && huge_pool_1gb.base) {
+            addr = huge_pool_alloc(&huge_pool_1gb, size, mem->numa_node);
+            atomic_fetch_add(addr ? &huge_pool_1gb.hits : &huge_pool_1gb.misses, 1);
+            if (addr) {
+                mem->backing = SEGMENT_BACKING_POOL_1GB;
+                mem->backing_page_size = HUGE_PAGE_1GB;
+                return addr;
+            }
+        }
+        
+        addr = huge_pool_alloc(&huge_pool_2mb, size, mem->numa_node);
+        atomic_fetch_add(addr ? &huge_pool_2mb.hits : &huge_pool_2mb.misses, 1);
+        if (addr) {
+            mem->backing = SEGMENT_BACKING_POOL_2MB;
+            mem->backing_page_size = HUGE_PAGE_2MB;
+            return addr;
+        }
+        
+        if (thp_available) {
+            addr = map_thp_region(size);
+            if (addr != MAP_FAILED) {
+                numa_bind_memory(addr, round_up_size(size, HUGE_PAGE_2MB), mem->numa_node);
+                atomic_fetch_add(&thp_segments, 1);
+                mem->backing = SEGMENT_BACKING_THP;
+                mem->backing_page_size = HUGE_PAGE_2MB;
+                return addr;
+            }
+        }
+    }
+    
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) return NULL;
+    
+    // Con THP en "always" el kernel las usaría igualmente
+    if (policy == HUGE_POLICY_NONE) madvise(addr, size, MADV_NOHUGEPAGE);
+    
+    // La política se aplica antes del primer acceso, que es cuando se
+    // asignan las páginas físicas
+    numa_bind_memory(addr, size, mem->numa_node);
+    atomic_fetch_add(&small_page_segments, 1);
+    mem->backing = SEGMENT_BACKING_SMALL;
+    mem->backing_page_size = kernel64->system_info.page_size;
+    return addr;
+}
+
+static const char* segment_backing_name(int backing) {
+    switch (backing) {
+        case SEGMENT_BACKING_POOL_1GB: return "pool 1 GB";
+        case SEGMENT_BACKING_POOL_2MB: return "pool 2 MB";
+        case SEGMENT_BACKING_THP:      return "THP";
+        case SEGMENT_BACKING_SMALL:    return "4 KB";
+        case SEGMENT_BACKING_MEMFD:    return "memfd";
+        case SEGMENT_BACKING_FILE:     return "archivo";
+        case SEGMENT_BACKING_IMPORTED: return "importado";
+        default:                       return "arena";
+    }
+}
+
+// Registro de segmento vacío (sin memoria asociada todavía)
+static SharedMemory64* alloc_segment_record(memory_id_t memory_id, node_id_t owner,
+                                            int numa_node) {
+    SharedMemory64* mem = (SharedMemory64*)aligned_alloc(CACHE_LINE_SIZE, 
+                                                          sizeof(SharedMemory64));
+    if (!mem) return NULL;
+    
+    memset(mem, 0, sizeof(SharedMemory64));
+    
+    mem->memory_id = memory_id;
+    mem->owner_node = owner;
+    mem->numa_node = numa_node;
+    mem->mmap_fd = -1;
+    return mem;
+}
+
+// Contabilidad, tabla de páginas y estado inicial de un segmento ya mapeado
+static void init_segment_pages(SharedMemory64* mem, size_t size) {
+    mem->mmap_size = size;
+    
+    atomic_fetch_add(&numa_topology.alloc_count[mem->numa_node], 1);
+    atomic_fetch_add(&numa_topology.alloc_bytes[mem->numa_node], size);
+    atomic_fetch_add(&kernel64->stats.total_memory_allocated, size);
+    
+    // Inicializar gestión de páginas (granularidad lógica de 4 KB para
+    // dirty bitmap y DSM, independiente del respaldo)
+    mem->pages.page_size = 4096;
+    mem->pages.num_pages = (size + 4095) / 4096;
+    mem->pages.page_table = (uint64_t*)calloc(mem->pages.num_pages, sizeof(uint64_t));
+    mem->pages.dirty_bitmap = (_Atomic uint64_t*)calloc((mem->pages.num_pages + 63) / 64, 
+                                                        sizeof(uint64_t));
+    
+    atomic_store(&mem->version, 1);
+    atomic_store(&mem->rw_state, 0);
+    atomic_store(&mem->rw_grants, 0);
+    
+    printf("[MEMORY] Memoria compartida %lu creada (%zu MB, %zu páginas, nodo NUMA %d, "
+           "respaldo %s)\n", mem->memory_id, size / (1024*1024), mem->pages.num_pages,
+           mem->numa_node, segment_backing_name(mem->backing));
+}
+
+// Crear memoria compartida con una política de páginas y un nodo NUMA concretos
+SharedMemory64* create_shared_memory_paged(size_t size, node_id_t owner, int numa_node,
+                                           HugePagePolicy policy) {
+    SharedMemory64* mem = alloc_segment_record(atomic_fetch_add(&kernel64->next_memory_id, 1),
+                                               owner, numa_node);
+    if (!mem) return NULL;
+    
+    // Usar mmap para memoria grande
+    if (size > 1024 * 1024) {  // Más de 1MB
+        mem->mmap_addr = map_segment_backing(mem, size, policy);
+    } else {
+        mem->mmap_addr = numa_arena_alloc(size, numa_node);
+        mem->backing = SEGMENT_BACKING_ARENA;
+        mem->backing_page_size = kernel64->system_info.page_size;
+    }
+    
+    if (!mem->mmap_addr) {
+        free(mem);
+        return NULL;
+    }
+    
+    init_segment_pages(mem, size);
+    return mem;
+}
+
+// Crear memoria compartida con mmap en un nodo NUMA concreto
+SharedMemory64* create_shared_memory_on_node(size_t size, node_id_t owner, int numa_node) {
+    return create_shared_memory_paged(size, owner, numa_node, HUGE_POLICY_AUTO);
+}
+
+static void shm_unexport_segment(SharedMemory64* mem);
+static void segment_cow_detach(SharedMemory64* mem);
+
+// Liberar un segmento y devolver su respaldo
+void destroy_shared_memory_64(SharedMemory64* mem) {
+    if (!mem) return;
+    
+    segment_cow_detach(mem);
+    
+    switch (mem->backing) {
+        case SEGMENT_BACKING_ARENA:
+            numa_arena_free(mem->mmap_addr);
+            break;
+        case SEGMENT_BACKING_POOL_1GB:
+            huge_pool_free(&huge_pool_1gb, mem->mmap_addr, mem->mmap_size);
+            break;
+        case SEGMENT_BACKING_POOL_2MB:
+            huge_pool_free(&huge_pool_2mb, mem->mmap_addr, mem->mmap_size);
+            break;
+        case SEGMENT_BACKING_THP:
+            munmap(mem->mmap_addr, round_up_size(mem->mmap_size, HUGE_PAGE_2MB));
+            break;
+        case SEGMENT_BACKING_SMALL:
+            munmap(mem->mmap_addr, mem->mmap_size);
+            break;
+        case SEGMENT_BACKING_MEMFD:
+        case SEGMENT_BACKING_FILE:
+        case SEGMENT_BACKING_IMPORTED:
+            // Las páginas siguen vivas mientras otro proceso tenga el fd
+            shm_unexport_segment(mem);
+            munmap(mem->mmap_addr, mem->mmap_size);
+            close(mem->mmap_fd);
+            break;
+    }
+    
+    atomic_fetch_sub(&numa_topology.alloc_count[mem->numa_node], 1);
+    atomic_fetch_sub(&numa_topology.alloc_bytes[mem->numa_node], mem->mmap_size);
+    
+    free(mem->pages.page_table);
+    free((void*)mem->pages.dirty_bitmap);
+    free(mem);
+}
+
+// Crear memoria compartida en el nodo NUMA del hilo que la pide
+SharedMemory64* create_shared_memory_mmap(size_t size, node_id_t owner) {
+    return create_shared_memory_on_node(size, owner, numa_current_node());
+}
+
+// Llevar el hilo actual al socket donde reside un segmento
+int numa_bind_thread_to_segment(SharedMemory64* mem) {
+    return mem ? numa_pin_thread(pthread_self(), mem->numa_node) : -1;
+}
+
+// ========================================
+// SEGMENTOS COMPARTIDOS ENTRE PROCESOS
+// ========================================
+
+// Segmentos respaldados por memfd o por archivos de un directorio
+// configurable (DOS_SHM_DIR). Los procesos del mismo host se pasan el
+// descriptor por un socket Unix con SCM_RIGHTS y mapean las mismas páginas
+// físicas en lugar de copiar por TCP. Con DOS_SHM_PERSIST=1 los archivos se
+// conservan y se vuelven a mapear al reiniciar, sin recargar su contenido.
+
+#define SHM_MAX_EXPORTS      64
+#define SHM_PERSIST_DIR      "/var/tmp/dos_segments"
+
+typedef struct {
+    memory_id_t memory_id;
+    uint64_t size;
+    int32_t status;              // 0 = ok, -1 = segmento no exportado
+} ShmFdReply;
+
+typedef struct {
+    char dir[256];               // Vacío: memfd anónimo
+    bool persistent;
+    
+    SharedMemory64* exports[SHM_MAX_EXPORTS];
+    int export_count;
+    pthread_mutex_t lock;
+    
+    int listen_fd;
+    pthread_t server_thread;
+    _Atomic int server_running;
+    
+    _Atomic uint64_t fds_sent;
+    _Atomic uint64_t imports;
+} ShmFdState;
+
+static ShmFdState shm_fd_state = { .lock = PTHREAD_MUTEX_INITIALIZER, .listen_fd = -1 };
+
+static void segment_file_path(char* path, size_t len, node_id_t owner, memory_id_t memory_id) {
+    snprintf(path, len, "%s/segment-%lu-%lu.seg", shm_fd_state.dir, owner, memory_id);
+}
+
+// Socket del espacio abstracto: no deja archivos huérfanos si el nodo cae
+static socklen_t shm_socket_address(struct sockaddr_un* addr, node_id_t node) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "dos-shm-%lu", node);
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr->sun_path + 1));
+}
+
+// Mapear un descriptor como segmento (MAP_SHARED: mismas páginas que el resto)
+static SharedMemory64* map_fd_segment(int fd, memory_id_t memory_id, node_id_t owner,
+                                      int numa_node, size_t size, int backing) {
+    SharedMemory64* mem = alloc_segment_record(memory_id, owner, numa_node);
+    if (!mem) return NULL;
+    
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("[SHM] mmap");
+        free(mem);
+        return NULL;
+    }
+    numa_bind_memory(addr, size, numa_node);
+    
+    mem->mmap_addr = addr;
+    mem->mmap_fd = fd;
+    mem->backing = backing;
+    mem->backing_page_size = kernel64->system_info.page_size;
+    
+    init_segment_pages(mem, size);
+    return mem;
+}
+
+// Crear un segmento compartible entre procesos: memfd o archivo en DOS_SHM_DIR
+SharedMemory64* create_shared_memory_fd(size_t size, node_id_t owner, int numa_node) {
+    memory_id_t memory_id = atomic_fetch_add(&kernel64->next_memory_id, 1);
+    int backing;
+    int fd;
+    
+    if (shm_fd_state.dir[0]) {
+        char path[512];
+        segment_file_path(path, sizeof(path), owner, memory_id);
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        // Sin persistencia el archivo desaparece al cerrar el último descriptor
+        if (fd >= 0 && !shm_fd_state.persistent) unlink(path);
+        backing = SEGMENT_BACKING_FILE;
+    } else {
+        char name[64];
+        snprintf(name, sizeof(name), "dos-segment-%lu", memory_id);
+        fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        backing = SEGMENT_BACKING_MEMFD;
+    }
+    
+    if (fd < 0) {
+        perror("[SHM] No se pudo crear el respaldo del segmento");
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)size) < 0) {
+        perror("[SHM] ftruncate");
+        close(fd);
+        return NULL;
+    }
+    
+    // Tamaño sellado: quien reciba el descriptor puede fiarse de él
+    if (backing == SEGMENT_BACKING_MEMFD) {
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+    }
+    
+    SharedMemory64* mem = map_fd_segment(fd, memory_id, owner, numa_node, size, backing);
+    if (!mem) close(fd);
+    return mem;
+}
+
+static void shm_register_segment(SharedMemory64* mem) {
+    pthread_mutex_lock(&shm_fd_state.lock);
+    bool found = false;
+    for (int i = 0; i < shm_fd_state.export_count; i++) {
+        if (shm_fd_state.exports[i] == mem) found = true;
+    }
+    if (!found && shm_fd_state.export_count < SHM_MAX_EXPORTS) {
+        shm_fd_state.exports[shm_fd_state.export_count++] = mem;
+    }
+    pthread_mutex_unlock(&shm_fd_state.lock);
+}
+
+static void shm_unexport_segment(SharedMemory64* mem) {
+    pthread_mutex_lock(&shm_fd_state.lock);
+    for (int i = 0; i < shm_fd_state.export_count; i++) {
+        if (shm_fd_state.exports[i] == mem) {
+            shm_fd_state.exports[i] = shm_fd_state.exports[--shm_fd_state.export_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shm_fd_state.lock);
+}
+
+// Responder a una petición con la cabecera y, si existe, el descriptor
+static void shm_send_segment_fd(int client, memory_id_t memory_id) {
+    ShmFdReply reply = { .memory_id = memory_id, .status = -1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = &reply, .iov_len = sizeof(reply) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    
+    // El lock impide que el segmento se destruya mientras se envía su fd
+    pthread_mutex_lock(&shm_fd_state.lock);
+    for (int i = 0; i < shm_fd_state.export_count; i++) {
+        SharedMemory64* mem = shm_fd_state.exports[i];
+        if (mem->memory_id != memory_id) continue;
+        
+        reply.size = mem->mmap_size;
+        reply.status = 0;
+        
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &mem->mmap_fd, sizeof(int));
+        break;
+    }
+    
+    if (sendmsg(client, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(reply) && reply.status == 0) {
+        atomic_fetch_add(&shm_fd_state.fds_sent, 1);
+    }
+    pthread_mutex_unlock(&shm_fd_state.lock);
+}
+
+static void* shm_fd_server_thread(void* arg) {
+    (void)arg;
+    
+    while (atomic_load(&shm_fd_state.server_running)) {
+        struct pollfd pfd = { .fd = shm_fd_state.listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        
+        int client = accept4(shm_fd_state.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        
+        // Una conexión puede pedir varios segmentos seguidos
+        memory_id_t memory_id;
+        while (recv(client, &memory_id, sizeof(memory_id), MSG_WAITALL) == sizeof(memory_id)) {
+            shm_send_segment_fd(client, memory_id);
+        }
+        close(client);
+    }
+    
+    return NULL;
+}
+
+// Publicar un segmento para los procesos del host (arranca el servidor de fds)
+int shm_export_segment(SharedMemory64* mem) {
+    if (!mem || mem->mmap_fd < 0) return -1;
+    
+    shm_register_segment(mem);
+    if (atomic_load(&shm_fd_state.server_running)) return 0;
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr;
+    socklen_t len = shm_socket_address(&addr, kernel64->node_id);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, len) < 0 || listen(fd, 16) < 0) {
+        perror("[SHM] Socket de descriptores");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    
+    shm_fd_state.listen_fd = fd;
+    atomic_store(&shm_fd_state.server_running, 1);
+    pthread_create(&shm_fd_state.server_thread, NULL, shm_fd_server_thread, NULL);
+    
+    printf("[SHM] Exportando descriptores en @dos-shm-%lu\n", kernel64->node_id);
+    return 0;
+}
+
+void shm_stop_fd_server(void) {
+    if (!atomic_exchange(&shm_fd_state.server_running, 0)) return;
+    pthread_join(shm_fd_state.server_thread, NULL);
+    close(shm_fd_state.listen_fd);
+    shm_fd_state.listen_fd = -1;
+}
+
+// Pedir a un nodo del mismo host el descriptor de un segmento y mapearlo
+SharedMemory64* shm_import_segment(node_id_t home_node, memory_id_t memory_id) {
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return NULL;
+    
+    struct sockaddr_un addr;
+    socklen_t len = shm_socket_address(&addr, home_node);
+    if (connect(sock, (struct sockaddr*)&addr, len) < 0) {
+        perror("[SHM] No se pudo conectar con el nodo");
+        close(sock);
+        return NULL;
+    }
+    
+    ShmFdReply reply;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = &reply, .iov_len = sizeof(reply) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                          .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+    
+    int fd = -1;
+    if (send(sock, &memory_id, sizeof(memory_id), MSG_NOSIGNAL) == sizeof(memory_id) &&
+        recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) == (ssize_t)sizeof(reply)) {
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    close(sock);
+    
+    if (fd < 0 || reply.status != 0) {
+        fprintf(stderr, "[SHM] El nodo %lu no exporta el segmento %lu\n", home_node, memory_id);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    
+    SharedMemory64* mem = map_fd_segment(fd, memory_id, home_node, numa_current_node(),
+                                         reply.size, SEGMENT_BACKING_IMPORTED);
+    if (!mem) {
+        close(fd);
+        return NULL;
+    }
+    
+    atomic_fetch_add(&shm_fd_state.imports, 1);
+    return mem;
+}
+
+// Volver a mapear los segmentos persistentes de este nodo tal como quedaron
+static void load_persistent_segments(void) {
+    DIR* dir = opendir(shm_fd_state.dir);
+    if (!dir) return;
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned long owner, memory_id;
+        if (sscanf(entry->d_name, "segment-%lu-%lu.seg", &owner, &memory_id) != 2 ||
+            owner != kernel64->node_id) {
+            continue;
+        }
+        
+        char path[512];
+        segment_file_path(path, sizeof(path), owner, memory_id);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+            if (fd >= 0) close(fd);
+            continue;
+        }
+        
+        SharedMemory64* mem = map_fd_segment(fd, memory_id, owner, numa_current_node(),
+                                             (size_t)st.st_size, SEGMENT_BACKING_FILE);
+        if (!mem) {
+            close(fd);
+            continue;
+        }
+        
+        // Los IDs nuevos no deben pisar los recuperados
+        if (atomic_load(&kernel64->next_memory_id) <= memory_id) {
+            atomic_store(&kernel64->next_memory_id, memory_id + 1);
+        }
+        shm_register_segment(mem);
+        printf("[SHM] Segmento persistente %lu recuperado de %s\n", memory_id, path);
+    }
+    closedir(dir);
+}
+
+void init_shared_fd_segments(void) {
+    const char* dir = getenv("DOS_SHM_DIR");
+    const char* persist = getenv("DOS_SHM_PERSIST");
+    
+    shm_fd_state.persistent = persist && atoi(persist) != 0;
+    if (dir && dir[0]) {
+        snprintf(shm_fd_state.dir, sizeof(shm_fd_state.dir), "%s", dir);
+    } else if (shm_fd_state.persistent) {
+        snprintf(shm_fd_state.dir, sizeof(shm_fd_state.dir), "%s", SHM_PERSIST_DIR);
+    }
+    
+    if (shm_fd_state.dir[0]) {
+        mkdir(shm_fd_state.dir, 0700);
+        printf("[KERNEL] Segmentos compartidos en %s%s\n", shm_fd_state.dir,
+               shm_fd_state.persistent ? " (persistentes)" : "");
+        if (shm_fd_state.persistent) load_persistent_segments();
+    }
+}
+
+// Segmentos exportados de este nodo (el primero, si hay alguno)
+SharedMemory64* shm_first_export(void) {
+    pthread_mutex_lock(&shm_fd_state.lock);
+    SharedMemory64* mem = shm_fd_state.export_count ? shm_fd_state.exports[0] : NULL;
+    pthread_mutex_unlock(&shm_fd_state.lock);
+    return mem;
+}
+
+void print_shm_stats(void) {
+    printf("  Segmentos por descriptor: %d exportados | %lu fds enviados | %lu importados\n",
+           shm_fd_state.export_count, atomic_load(&shm_fd_state.fds_sent),
+           atomic_load(&shm_fd_state.imports));
+}
+
+// Read-write lock con preferencia de escritura
+//
+// rw_state:  bit 31     escritor dentro
+//            bit 30     hay lectores dormidos en rw_state
+//            bits 16-29 escritores esperando
+//            bits 0-15  lectores dentro
+// rw_grants: concesiones directas a escritores en espera (futex propio)
+//
+// Con escritores esperando no entran lectores nuevos. Al liberar, el último
+// lector o el escritor saliente entrega el lock a un escritor en espera
+// poniendo el bit de escritor en su nombre, sin dejar ventana a terceros.
+#define RW_WRITER         0x80000000u
+#define RW_READERS_SLEEP  0x40000000u
+#define RW_WAITER_ONE     0x00010000u
+#define RW_WAITER_MASK    0x3FFF0000u
+#define RW_READER_MASK    0x0000FFFFu
+#define RW_SPIN_LIMIT     128
+
+static inline void futex_wait_32(_Atomic uint32_t* addr, uint32_t expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static inline void futex_wake_32(_Atomic uint32_t* addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Entregar el lock (ya marcado con RW_WRITER) a un escritor dormido
+static inline void rw_grant_writer(SharedMemory64* mem) {
+    atomic_fetch_add_explicit(&mem->rw_grants, 1, memory_order_release);
+    futex_wake_32(&mem->rw_grants, 1);
+}
+
+void acquire_read_lock_64(SharedMemory64* mem) {
+    int spins = 0;
+    uint32_t state = atomic_load_explicit(&mem->rw_state, memory_order_relaxed);
+    
+    while (1) {
+        if (!(state & (RW_WRITER | RW_WAITER_MASK))) {
+            if (atomic_compare_exchange_weak_explicit(&mem->rw_state, &state, state + 1,
+                                                      memory_order_acquire,
+                                                      memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        
+        // Espera activa acotada antes de dormir
+        if (spins++ < RW_SPIN_LIMIT) {
+            _mm_pause();
+            state = atomic_load_explicit(&mem->rw_state, memory_order_relaxed);
+            continue;
+        }
+        
+        if (!(state & RW_READERS_SLEEP) &&
+            !atomic_compare_exchange_weak_explicit(&mem->rw_state, &state,
+                                                   state | RW_READERS_SLEEP,
+                                                   memory_order_relaxed,
+                                                   memory_order_relaxed)) {
+            continue;
+        }
+        
+        futex_wait_32(&mem->rw_state, state | RW_READERS_SLEEP);
+        state = atomic_load_explicit(&mem->rw_state, memory_order_relaxed);
+    }
+}
+
+void release_read_lock_64(SharedMemory64* mem) {
+    uint32_t state = atomic_fetch_sub_explicit(&mem->rw_state, 1, memory_order_release) - 1;
+    
+    // Último lector con escritores esperando: entregarle el lock
+    while ((state & RW_READER_MASK) == 0 && (state & RW_WAITER_MASK) &&
+           !(state & RW_WRITER)) {
+        if (atomic_compare_exchange_weak_explicit(&mem->rw_state, &state,
+                                                  (state - RW_WAITER_ONE) | RW_WRITER,
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed)) {
+            rw_grant_writer(mem);
+            return;
+        }
+    }
+}
+
+void acquire_write_lock_64(SharedMemory64* mem) {
+    uint32_t state = atomic_load_explicit(&mem->rw_state, memory_order_relaxed);
+    
+    // Camino rápido con espera activa acotada
+    for (int spins = 0; spins < RW_SPIN_LIMIT; spins++) {
+        if (!(state & (RW_WRITER | RW_READER_MASK | RW_WAITER_MASK))) {
+            if (atomic_compare_exchange_weak_explicit(&mem->rw_state, &state,
+                                                      state | RW_WRITER,
+                                                      memory_order_acquire,
+                                                      memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        _mm_pause();
+        state = atomic_load_explicit(&mem->rw_state, memory_order_relaxed);
+    }
+    
+    // Registrarse como escritor en espera: desde aquí no entran lectores
+    state = atomic_fetch_add_explicit(&mem->rw_state, RW_WAITER_ONE,
+                                      memory_order_relaxed) + RW_WAITER_ONE;
+    
+    while (1) {
+        // Lock libre sin que nadie nos lo haya entregado: tomarlo
+        if (!(state & (RW_WRITER | RW_READER_MASK))) {
+            if (atomic_compare_exchange_weak_explicit(&mem->rw_state, &state,
+                                                      (state - RW_WAITER_ONE) | RW_WRITER,
+                                                      memory_order_acquire,
+                                                      memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        
+        // Recoger una entrega directa del último lector o escritor
+        uint32_t grants = atomic_load_explicit(&mem->rw_grants, memory_order_acquire);
+        if (grants > 0) {
+            if (atomic_compare_exchange_weak_explicit(&mem->rw_grants, &grants, grants - 1,
+                                                      memory_order_acquire,
+                                                      memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        
+        futex_wait_32(&mem->rw_grants, 0);
+        state = atomic_load_explicit(&mem->rw_state, memory_order_relaxed);
+    }
+}
+
+void release_write_lock_64(SharedMemory64* mem) {
+    uint32_t state = atomic_load_explicit(&mem->rw_state, memory_order_relaxed);
+    
+    while (1) {
+        if (state & RW_WAITER_MASK) {
+            // Entrega directa al siguiente escritor: el lock no queda libre
+            if (atomic_compare_exchange_weak_explicit(&mem->rw_state, &state,
+                                                      state - RW_WAITER_ONE,
+                                                      memory_order_release,
+                                                      memory_order_relaxed)) {
+                rw_grant_writer(mem);
+                return;
+            }
+            continue;
+        }
+        
+        if (atomic_compare_exchange_weak_explicit(&mem->rw_state, &state,
+                                                  state & ~(RW_WRITER | RW_READERS_SLEEP),
+                                                  memory_order_release,
+                                                  memory_order_relaxed)) {
+            if (state & RW_READERS_SLEEP) {
+                futex_wake_32(&mem->rw_state, INT32_MAX);
+            }
+            return;
+        }
+    }
+}
+
+// ========================================
+// SNAPSHOTS COPY-ON-WRITE DE SEGMENTOS
+// ========================================
+
+// Crear una snapshot solo protege el segmento contra escritura (uffd-wp);
+// la primera escritura posterior sobre cada página la atiende un hilo que
+// guarda su contenido en las snapshots que aún no lo tienen y la
+// desprotege. El coste es proporcional a las páginas modificadas después,
+// no al tamaño del segmento. Si el respaldo no admite uffd-wp (arena o
+// archivo normal) la snapshot se copia entera.
+
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+
+typedef struct SegmentSnapshot {
+    _Atomic(SharedMemory64*) mem;     // Solo para páginas sin copia; NULL al destruirlo
+    uint64_t version;                 // Versión del segmento al tomarla
+    size_t unit;                      // Granularidad de copia (página del respaldo)
+    size_t num_units;
+    size_t size;
+    _Atomic(uint8_t*)* saved;         // Pre-imagen por página (NULL = sin cambios)
+    _Atomic uint64_t copied_units;
+    _Atomic bool incomplete;          // Falló una copia: la snapshot no es fiable
+    struct SegmentSnapshot* next;
+} SegmentSnapshot;
+
+struct SegmentCow {
+    int uffd;
+    size_t unit;
+    size_t length;                    // Rango registrado (múltiplo de unit)
+    pthread_t fault_thread;
+    _Atomic int running;
+    pthread_mutex_t lock;
+    SegmentSnapshot* snapshots;
+};
+
+static _Atomic uint64_t snapshots_taken = 0;
+static _Atomic uint64_t snapshot_wp_faults = 0;
+static _Atomic uint64_t snapshot_units_copied = 0;
+
+static int segment_cow_protect(SegmentCow* cow, void* addr, size_t len, bool protect) {
+    struct uffdio_writeprotect wp = {
+        .range = { .start = (uint64_t)(uintptr_t)addr, .len = len },
+        .mode = protect ? UFFDIO_WRITEPROTECT_MODE_WP : 0
+    };
+    return ioctl(cow->uffd, UFFDIO_WRITEPROTECT, &wp);
+}
+
+// Guardar la pre-imagen de una página en una snapshot
+static void snapshot_copy_unit(SegmentSnapshot* snap, SharedMemory64* mem, size_t unit) {
+    if (atomic_load_explicit(&snap->saved[unit], memory_order_relaxed)) return;
+    
+    size_t offset = unit * snap->unit;
+    size_t len = snap->size - offset < snap->unit ? snap->size - offset : snap->unit;
+    uint8_t* copy = (uint8_t*)malloc(len);
+    if (!copy) {
+        atomic_store_explicit(&snap->incomplete, true, memory_order_relaxed);
+        return;
+    }
+    memcpy(copy, (uint8_t*)mem->mmap_addr + offset, len);
+    atomic_store_explicit(&snap->saved[unit], copy, memory_order_release);
+    atomic_fetch_add_explicit(&snap->copied_units, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&snapshot_units_copied, 1, memory_order_relaxed);
+}
+
+static void* segment_cow_fault_thread(void* arg) {
+    SharedMemory64* mem = (SharedMemory64*)arg;
+    SegmentCow* cow = mem->cow;
+    
+    while (atomic_load(&cow->running)) {
+        struct pollfd pfd = { .fd = cow->uffd, .events = POLLIN };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        
+        struct uffd_msg event;
+        if (read(cow->uffd, &event, sizeof(event)) != sizeof(event)) continue;
+        if (event.event != UFFD_EVENT_PAGEFAULT ||
+            !(event.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP)) {
+            continue;
+        }
+        
+        size_t unit = (size_t)(event.arg.pagefault.address -
+                               (uint64_t)(uintptr_t)mem->mmap_addr) / cow->unit;
+        atomic_fetch_add(&snapshot_wp_faults, 1);
+        
+        // Guardar antes de desproteger: el escritor sigue bloqueado hasta entonces
+        pthread_mutex_lock(&cow->lock);
+        for (SegmentSnapshot* snap = cow->snapshots; snap; snap = snap->next) {
+            snapshot_copy_unit(snap, mem, unit);
+        }
+        pthread_mutex_unlock(&cow->lock);
+        
+        segment_cow_protect(cow, (uint8_t*)mem->mmap_addr + unit * cow->unit, cow->unit, false);
+    }
+    
+    return NULL;
+}
+
+// Registrar el segmento en modo uffd-wp (la primera vez que se toma una snapshot)
+static SegmentCow* segment_cow_setup(SharedMemory64* mem) {
+    if (mem->backing == SEGMENT_BACKING_ARENA) return NULL;
+    
+    // Sondear qué admite el kernel: WP sobre páginas aún no tocadas y sobre
+    // shmem/hugetlb (UFFDIO_API solo se puede llamar una vez por descriptor)
+    struct uffdio_api api = { .api = UFFD_API, .features = 0 };
+    int probe = (int)syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (probe < 0 || ioctl(probe, UFFDIO_API, &api) < 0) {
+        if (probe >= 0) close(probe);
+        return NULL;
+    }
+    close(probe);
+    
+    uint64_t features = api.features & (UFFD_FEATURE_WP_UNPOPULATED |
+                                        UFFD_FEATURE_WP_HUGETLBFS_SHMEM);
+    size_t unit = (mem->backing == SEGMENT_BACKING_POOL_2MB ||
+                   mem->backing == SEGMENT_BACKING_POOL_1GB)
+                  ? mem->backing_page_size : kernel64->system_info.page_size;
+    size_t length = round_up_size(mem->mmap_size, unit);
+    
+    // Sin WP sobre páginas vacías, una escritura en una página nunca tocada
+    // no fallaría: poblarlas antes
+    if (!(features & UFFD_FEATURE_WP_UNPOPULATED)) {
+        madvise(mem->mmap_addr, length, MADV_POPULATE_WRITE);
+    }
+    
+    SegmentCow* cow = (SegmentCow*)calloc(1, sizeof(SegmentCow));
+    if (!cow) return NULL;
+    cow->unit = unit;
+    cow->length = length;
+    cow->uffd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    
+    api = (struct uffdio_api){ .api = UFFD_API, .features = features };
+    struct uffdio_register reg = {
+        .range = { .start = (uint64_t)(uintptr_t)mem->mmap_addr, .len = length },
+        .mode = UFFDIO_REGISTER_MODE_WP
+    };
+    if (cow->uffd < 0 || ioctl(cow->uffd, UFFDIO_API, &api) < 0 ||
+        ioctl(cow->uffd, UFFDIO_REGISTER, &reg) < 0 ||
+        !(reg.ioctls & (1ULL << _UFFDIO_WRITEPROTECT))) {
+        if (cow->uffd >= 0) close(cow->uffd);
+        free(cow);
+        return NULL;
+    }
+    
+    pthread_mutex_init(&cow->lock, NULL);
+    mem->cow = cow;
+    atomic_store(&cow->running, 1);
+    pthread_create(&cow->fault_thread, NULL, segment_cow_fault_thread, mem);
+    numa_pin_thread(cow->fault_thread, mem->numa_node);
+    return cow;
+}
+
+// Tomar una snapshot consistente del segmento (respecto a quien use su lock)
+SegmentSnapshot* snapshot_shared_memory_64(SharedMemory64* mem) {
+    if (!mem) return NULL;
+    
+    SegmentSnapshot* snap = (SegmentSnapshot*)calloc(1, sizeof(SegmentSnapshot));
+    if (!snap) return NULL;
+    
+    acquire_write_lock_64(mem);
+    
+    SegmentCow* cow = mem->cow ? mem->cow : segment_cow_setup(mem);
+    atomic_init(&snap->mem, mem);
+    atomic_init(&snap->incomplete, false);
+    snap->size = mem->mmap_size;
+    snap->unit = cow ? cow->unit : kernel64->system_info.page_size;
+    snap->num_units = (snap->size + snap->unit - 1) / snap->unit;
+    snap->version = atomic_load(&mem->version);
+    snap->saved = calloc(snap->num_units ? snap->num_units : 1, sizeof(*snap->saved));
+    
+    if (!snap->saved) {
+        release_write_lock_64(mem);
+        free(snap);
+        return NULL;
+    }
+    
+    if (cow) {
+        pthread_mutex_lock(&cow->lock);
+        snap->next = cow->snapshots;
+        cow->snapshots = snap;
+        pthread_mutex_unlock(&cow->lock);
+        segment_cow_protect(cow, mem->mmap_addr, cow->length, true);
+    } else {
+        // Sin uffd-wp: copia completa bajo el lock. Ya no necesita el
+        // segmento, que puede destruirse antes que ella.
+        for (size_t unit = 0; unit < snap->num_units; unit++) {
+            snapshot_copy_unit(snap, mem, unit);
+        }
+        atomic_store_explicit(&snap->mem, NULL, memory_order_relaxed);
+    }
+    
+    release_write_lock_64(mem);
+    atomic_fetch_add(&snapshots_taken, 1);
+    return snap;
+}
+
+// Leer de la snapshot sin bloquear a los escritores del segmento. Con el
+// segmento ya destruido solo quedan las copias: sin ellas devuelve -1.
+int read_segment_snapshot(SegmentSnapshot* snap, size_t offset, void* buffer, size_t len) {
+    if (!snap || atomic_load(&snap->incomplete) || offset + len > snap->size) return -1;
+    
+    SharedMemory64* mem = atomic_load_explicit(&snap->mem, memory_order_acquire);
+    uint8_t* out = (uint8_t*)buffer;
+    while (len > 0) {
+        size_t unit = offset / snap->unit;
+        size_t in_unit = offset % snap->unit;
+        size_t chunk = snap->unit - in_unit < len ? snap->unit - in_unit : len;
+        
+        // Página sin copia: leerla del segmento y comprobar después que
+        // ningún escritor la preservó (y modificó) mientras tanto
+        uint8_t* saved = atomic_load_explicit(&snap->saved[unit], memory_order_acquire);
+        if (!saved && mem) {
+            memcpy(out, (uint8_t*)mem->mmap_addr + offset, chunk);
+            atomic_thread_fence(memory_order_acquire);
+            saved = atomic_load_explicit(&snap->saved[unit], memory_order_relaxed);
+        } else if (!saved) {
+            return -1;
+        }
+        if (saved) memcpy(out, saved + in_unit, chunk);
+        
+        out += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+void release_segment_snapshot(SegmentSnapshot* snap) {
+    if (!snap) return;
+    
+    SharedMemory64* mem = atomic_load_explicit(&snap->mem, memory_order_acquire);
+    SegmentCow* cow = mem ? mem->cow : NULL;
+    if (cow) {
+        pthread_mutex_lock(&cow->lock);
+        for (SegmentSnapshot** link = &cow->snapshots; *link; link = &(*link)->next) {
+            if (*link == snap) {
+                *link = snap->next;
+                break;
+            }
+        }
+        // Sin snapshots vivas, quitar la protección para no fallar en balde
+        if (!cow->snapshots) {
+            segment_cow_protect(cow, mem->mmap_addr, cow->length, false);
+        }
+        pthread_mutex_unlock(&cow->lock);
+    }
+    
+    for (size_t unit = 0; unit < snap->num_units; unit++) {
+        free(atomic_load(&snap->saved[unit]));
+    }
+    free((void*)snap->saved);
+    free(snap);
+}
+
+// Al destruir el segmento, las snapshots vivas se quedan con todas sus páginas
+static void segment_cow_detach(SharedMemory64* mem) {
+    SegmentCow* cow = mem->cow;
+    if (!cow) return;
+    
+    atomic_store(&cow->running, 0);
+    pthread_join(cow->fault_thread, NULL);
+    
+    pthread_mutex_lock(&cow->lock);
+    for (SegmentSnapshot* snap = cow->snapshots; snap; snap = snap->next) {
+        for (size_t unit = 0; unit < snap->num_units; unit++) {
+            snapshot_copy_unit(snap, mem, unit);
+        }
+        atomic_store_explicit(&snap->mem, NULL, memory_order_release);
+    }
+    pthread_mutex_unlock(&cow->lock);
+    
+    close(cow->uffd);
+    pthread_mutex_destroy(&cow->lock);
+    free(cow);
+    mem->cow = NULL;
+}
+
+typedef struct {
+    SegmentSnapshot* snap;
+    _Atomic int* running;
+    uint64_t passes;
+    uint64_t mismatches;
+} SnapshotReader;
+
+// Leer la snapshot completa una y otra vez mientras el segmento cambia
+static void* snapshot_reader_thread(void* arg) {
+    SnapshotReader* r = (SnapshotReader*)arg;
+    uint8_t* buffer = (uint8_t*)malloc(r->snap->unit);
+    
+    while (atomic_load(r->running)) {
+        for (size_t offset = 0; offset < r->snap->size; offset += r->snap->unit) {
+            size_t len = r->snap->size - offset < r->snap->unit ? r->snap->size - offset
+                                                                : r->snap->unit;
+            read_segment_snapshot(r->snap, offset, buffer, len);
+            if (buffer[0] != 0xA5 || buffer[len - 1] != 0xA5) r->mismatches++;
+        }
+        r->passes++;
+    }
+    
+    free(buffer);
+    return NULL;
+}
+
+// Coste de crear una snapshot y de escribir después en unas pocas páginas,
+// con un lector recorriendo la snapshot a la vez
+void benchmark_segment_snapshot(SharedMemory64* mem, int pages_written) {
+    memset(mem->mmap_addr, 0xA5, mem->mmap_size);
+    
+    uint64_t start = get_timestamp_ns();
+    SegmentSnapshot* snap = snapshot_shared_memory_64(mem);
+    uint64_t created = get_timestamp_ns() - start;
+    if (!snap) return;
+    
+    _Atomic int running = 1;
+    SnapshotReader reader = { .snap = snap, .running = &running };
+    pthread_t tid;
+    pthread_create(&tid, NULL, snapshot_reader_thread, &reader);
+    
+    unsigned int seed = 42;
+    size_t page_size = kernel64->system_info.page_size;
+    start = get_timestamp_ns();
+    for (int i = 0; i < pages_written; i++) {
+        size_t page = (size_t)rand_r(&seed) % (mem->mmap_size / page_size);
+        acquire_write_lock_64(mem);
+        memset((uint8_t*)mem->mmap_addr + page * page_size, 0x5A, page_size);
+        atomic_fetch_add(&mem->version, 1);
+        release_write_lock_64(mem);
+    }
+    uint64_t written = get_timestamp_ns() - start;
+    
+    usleep(100 * 1000);
+    atomic_store(&running, 0);
+    pthread_join(tid, NULL);
+    
+    printf("  Segmento de %zu MB (%s): snapshot en %lu us, %d escrituras en %lu us, "
+           "%lu páginas de %zu KB copiadas\n",
+           mem->mmap_size / (1024 * 1024), mem->cow ? "uffd-wp" : "copia completa",
+           created / 1000, pages_written, written / 1000,
+           atomic_load(&snap->copied_units), snap->unit / 1024);
+    printf("  Lector concurrente: %lu pasadas completas, %lu discrepancias\n",
+           reader.passes, reader.mismatches);
+    
+    release_segment_snapshot(snap);
+}
+
+void print_snapshot_stats(void) {
+    printf("  Snapshots: %lu tomadas | %lu fallos de escritura | %lu páginas copiadas\n",
+           atomic_load(&snapshots_taken), atomic_load(&snapshot_wp_faults),
+           atomic_load(&snapshot_units_copied));
+}
+
+// ========================================
+// MUESTRAS DE LATENCIA DE LOS BENCHMARKS
+// ========================================
+
+// Muestras (ns) de un hilo; al llenarse las siguientes se descartan
+typedef struct {
+    uint64_t* samples;
+    size_t count;
+    size_t capacity;
+} LatencyRecorder;
+
+#define LATENCY_SAMPLES_PER_THREAD (1 << 18)
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void latency_init(LatencyRecorder* rec) {
+    rec->samples = malloc(LATENCY_SAMPLES_PER_THREAD * sizeof(uint64_t));
+    rec->count = 0;
+    rec->capacity = rec->samples ? LATENCY_SAMPLES_PER_THREAD : 0;
+}
+
+static inline void latency_record(LatencyRecorder* rec, uint64_t ns) {
+    if (rec->count < rec->capacity) rec->samples[rec->count++] = ns;
+}
+
+// Pasar las muestras de un hilo al total (que empieza a cero) y liberarlas
+static void latency_merge(LatencyRecorder* total, LatencyRecorder* rec) {
+    if (rec->count > 0) {
+        uint64_t* grown = realloc(total->samples,
+                                  (total->count + rec->count) * sizeof(uint64_t));
+        if (grown) {
+            memcpy(grown + total->count, rec->samples, rec->count * sizeof(uint64_t));
+            total->samples = grown;
+            total->count += rec->count;
+            total->capacity = total->count;
+        }
+    }
+    free(rec->samples);
+    rec->samples = NULL;
+    rec->count = rec->capacity = 0;
+}
+
+// Ordenar antes de pedir percentiles
+static void latency_sort(LatencyRecorder* rec) {
+    if (rec->count > 1) qsort(rec->samples, rec->count, sizeof(uint64_t), compare_u64);
+}
+
+// Percentil (0-99) de unas muestras ordenadas; 0 si no hay ninguna
+static uint64_t latency_percentile(const LatencyRecorder* rec, int percent) {
+    return rec->count ? rec->samples[(rec->count * (size_t)percent) / 100] : 0;
+}
+
+// ========================================
+// BENCHMARK DE CONTENCIÓN DEL RWLOCK
+// ========================================
+
+typedef struct {
+    SharedMemory64* mem;
+    _Atomic int* running;
+    int write_percent;
+    uint64_t ops;
+    LatencyRecorder latency;     // Espera de adquisición
+} RwBenchWorker;
+
+static void* rwlock_bench_worker(void* arg) {
+    RwBenchWorker* w = (RwBenchWorker*)arg;
+    uint64_t* data = (uint64_t*)w->mem->mmap_addr;
+    numa_bind_thread_to_segment(w->mem);
+    unsigned int seed = (unsigned int)(uintptr_t)w;
+    
+    while (atomic_load_explicit(w->running, memory_order_relaxed)) {
+        int write = (int)(rand_r(&seed) % 100) < w->write_percent;
+        
+        uint64_t start = get_timestamp_ns();
+        if (write) acquire_write_lock_64(w->mem);
+        else acquire_read_lock_64(w->mem);
+        uint64_t waited = get_timestamp_ns() - start;
+        
+        // Sección crítica corta
+        if (write) {
+            data[0]++;
+            data[1] = data[0];
+            release_write_lock_64(w->mem);
+        } else {
+            volatile uint64_t sink = data[0] + data[1];
+            (void)sink;
+            release_read_lock_64(w->mem);
+        }
+        
+        latency_record(&w->latency, waited);
+        w->ops++;
+    }
+    
+    return NULL;
+}
+
+// Throughput y latencia p99 de adquisición con N hilos y un % de escrituras
+void benchmark_rwlock_64(SharedMemory64* mem, int threads, int write_percent,
+                         int duration_ms) {
+    _Atomic int running = 1;
+    RwBenchWorker* workers = calloc((size_t)threads, sizeof(RwBenchWorker));
+    pthread_t* tids = calloc((size_t)threads, sizeof(pthread_t));
+    
+    for (int i = 0; i < threads; i++) {
+        workers[i].mem = mem;
+        workers[i].running = &running;
+        workers[i].write_percent = write_percent;
+        latency_init(&workers[i].latency);
+        pthread_create(&tids[i], NULL, rwlock_bench_worker, &workers[i]);
+    }
+    
+    usleep((useconds_t)duration_ms * 1000);
+    atomic_store(&running, 0);
+    
+    uint64_t ops = 0;
+    LatencyRecorder all = { 0 };
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        ops += workers[i].ops;
+        latency_merge(&all, &workers[i].latency);
+    }
+    latency_sort(&all);
+    
+    printf("  %3d hilos, %2d%% escrituras: %8.2f Mops/s | p50 %6lu ns | p99 %8lu ns\n",
+           threads, write_percent, ops / (duration_ms / 1000.0) / 1e6,
+           latency_percentile(&all, 50), latency_percentile(&all, 99));
+    
+    free(all.samples);
+    free(workers);
+    free(tids);
+}
+
+// ========================================
+// BENCHMARK DE TLB CON HUGE PAGES
+// ========================================
+
+// Contador hardware de fallos de dTLB en lectura (-1 si no hay acceso)
+static int open_dtlb_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Accesos aleatorios dependientes (cada dirección depende de la lectura
+// anterior) para que la latencia de cada fallo de TLB no se solape
+static void tlb_random_walk(SharedMemory64* mem, uint64_t accesses, const char* label) {
+    volatile uint64_t* data = (volatile uint64_t*)mem->mmap_addr;
+    size_t words = mem->mmap_size / sizeof(uint64_t);
+    
+    // Tocar todo antes para no medir fallos de página
+    memset(mem->mmap_addr, 0, mem->mmap_size);
+    
+    int fd = open_dtlb_counter();
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    uint64_t start = get_timestamp_ns();
+    for (uint64_t i = 0; i < accesses; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        x += data[x % words];
+    }
+    uint64_t elapsed = get_timestamp_ns() - start;
+    
+    uint64_t misses = 0;
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) misses = 0;
+        close(fd);
+    }
+    
+    size_t thp = mem->backing == SEGMENT_BACKING_THP ? segment_thp_bytes(mem->mmap_addr) : 0;
+    printf("  %-10s respaldo %-9s (THP efectivas %4zu MB): %6.1f ns/acceso",
+           label, segment_backing_name(mem->backing), thp / (1024 * 1024),
+           (double)elapsed / accesses);
+    if (fd >= 0) {
+        printf(" | %6.3f fallos dTLB/acceso\n", (double)misses / accesses);
+    } else {
+        printf(" | contador dTLB no disponible\n");
+    }
+    
+    if (x == 42) printf("\n");  // Evitar que se elimine el bucle
+}
+
+// Mismo recorrido aleatorio sobre un segmento de 4 KB y otro con huge pages
+void benchmark_tlb_huge_pages(size_t size, uint64_t accesses) {
+    int node = numa_current_node();
+    
+    SharedMemory64* small = create_shared_memory_paged(size, kernel64->node_id, node,
+                                                       HUGE_POLICY_NONE);
+    if (small) {
+        tlb_random_walk(small, accesses, "4 KB");
+        destroy_shared_memory_64(small);
+    }
+    
+    SharedMemory64* huge = create_shared_memory_paged(size, kernel64->node_id, node,
+                                                      HUGE_POLICY_AUTO);
+    if (huge) {
+        tlb_random_walk(huge, accesses, "huge");
+        destroy_shared_memory_64(huge);
+    }
+}
+
+// ========================================
+// MEMORIA COMPARTIDA DISTRIBUIDA (DSM)
+// ========================================
+//
+// Un nodo home exporta un SharedMemory64 y los demás lo mapean. En el nodo
+// que mapea, la región está registrada en userfaultfd: un acceso a una
+// página ausente la pide al home y la instala con UFFDIO_COPY. Las copias
+// compartidas se instalan protegidas contra escritura (uffd-wp), así que
+// la primera escritura vuelve a fallar y pide exclusividad.
+//
+// Protocolo MSI con directorio en el home (pages.page_table):
+//   bit 63 = 0  páginas Shared/Invalid: bits 0-62 = nodos con copia
+//   bit 63 = 1  página Modified: bits 0-5 = nodo con la copia exclusiva
+// Las peticiones se atienden en orden por un único worker del home, que
+// invalida o recupera las copias remotas antes de conceder la página.
+
+#define DSM_BASE_PORT      9100          // Puerto = DSM_BASE_PORT + node_id
+#define DSM_PAGE_SIZE      4096
+#define DSM_MAX_CLIENTS    63
+#define DSM_MAX_SEGMENTS   16
+#define DSM_ACK_TIMEOUT_MS 2000          // Sin ACK en este plazo el cliente se da por caído
+#define DSM_ENTRY_MODIFIED (1ULL << 63)
+
+typedef enum {
+    DSM_MAP = 1,             // Cliente → home: mapear memory_id
+    DSM_MAP_REPLY,           // Home → cliente: tamaño (0 = no existe)
+    DSM_GET_SHARED,          // Fallo de lectura
+    DSM_GET_EXCLUSIVE,       // Fallo de escritura
+    DSM_GRANT_SHARED,        // Concesión con datos, solo lectura
+    DSM_GRANT_EXCLUSIVE,     // Concesión con datos, lectura/escritura
+    DSM_INVALIDATE,          // Home → cliente: descartar copia (M devuelve datos)
+    DSM_DOWNGRADE,           // Home → cliente: M → S devolviendo datos
+    DSM_ACK,                 // Cliente → home: invalidación/degradación hecha
+    DSM_WRITEBACK,           // Cliente → home: devolver página M al desmapear
+    DSM_UNMAP,
+    DSM_UNMAP_REPLY
+} DsmMessageType;
+
+#define DSM_FLAG_DATA 0x01   // Tras la cabecera viaja una página
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t flags;
+    memory_id_t memory_id;
+    uint64_t page;
+    uint64_t size;
+} DsmMessage;
+
+typedef enum { DSM_PAGE_INVALID = 0, DSM_PAGE_SHARED, DSM_PAGE_MODIFIED } DsmPageState;
+
+static int dsm_send(int fd, pthread_mutex_t* lock, uint8_t type, memory_id_t memory_id,
+                    uint64_t page, uint64_t size, const void* data) {
+    DsmMessage msg = {
+        .type = type,
+        .flags = data ? DSM_FLAG_DATA : 0,
+        .memory_id = memory_id,
+        .page = page,
+        .size = size
+    };
+    int rc = 0;
+    
+    pthread_mutex_lock(lock);
+    if (send(fd, &msg, sizeof(msg), MSG_NOSIGNAL) != (ssize_t)sizeof(msg)) rc = -1;
+    
+    const uint8_t* p = data;
+    size_t left = data ? DSM_PAGE_SIZE : 0;
+    while (rc == 0 && left > 0) {
+        ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+        if (n <= 0) rc = -1;
+        else { p += n; left -= (size_t)n; }
+    }
+    pthread_mutex_unlock(lock);
+    
+    return rc;
+}
+
+static int dsm_recv_exact(int fd, void* buf, size_t len) {
+    uint8_t* p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Recibir un mensaje; si trae página se copia en data (DSM_PAGE_SIZE bytes)
+static int dsm_recv(int fd, DsmMessage* msg, void* data) {
+    if (dsm_recv_exact(fd, msg, sizeof(*msg)) < 0) return -1;
+    if ((msg->flags & DSM_FLAG_DATA) && dsm_recv_exact(fd, data, DSM_PAGE_SIZE) < 0) return -1;
+    return 0;
+}
+
+// ---------- Home ----------
+
+typedef struct DsmRequest {
+    uint8_t type;
+    int slot;
+    uint64_t page;
+    uint8_t* data;               // Solo DSM_WRITEBACK
+    struct DsmRequest* next;
+} DsmRequest;
+
+typedef struct {
+    int fd;                      // -1 = slot libre
+    SharedMemory64* segment;
+    bool connected;
+    bool awaiting_ack;
+    pthread_mutex_t send_lock;
+} DsmClientSlot;
+
+typedef struct {
+    int listen_fd;
+    SharedMemory64* segments[DSM_MAX_SEGMENTS];
+    int segment_count;
+    DsmClientSlot clients[DSM_MAX_CLIENTS];
+    
+    DsmRequest* queue_head;
+    DsmRequest* queue_tail;
+    int pending_acks;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t queue_cond;
+    pthread_cond_t ack_cond;
+    pthread_t accept_thread;
+    pthread_t worker_thread;
+    _Atomic int running;
+    
+    _Atomic uint64_t grants;
+    _Atomic uint64_t invalidations;
+    _Atomic uint64_t recalls;
+} DsmHome;
+
+static DsmHome* dsm_home = NULL;
+
+static void dsm_enqueue(uint8_t type, int slot, uint64_t page, uint8_t* data) {
+    DsmRequest* req = calloc(1, sizeof(DsmRequest));
+    if (!req) {
+        free(data);
+        return;
+    }
+    req->type = type;
+    req->slot = slot;
+    req->page = page;
+    req->data = data;
+    
+    pthread_mutex_lock(&dsm_home->lock);
+    if (dsm_home->queue_tail) dsm_home->queue_tail->next = req;
+    else dsm_home->queue_head = req;
+    dsm_home->queue_tail = req;
+    pthread_cond_signal(&dsm_home->queue_cond);
+    pthread_mutex_unlock(&dsm_home->lock);
+}
+
+static inline uint8_t* dsm_home_page(SharedMemory64* seg, uint64_t page) {
+    return (uint8_t*)seg->mmap_addr + page * DSM_PAGE_SIZE;
+}
+
+static inline void dsm_mark_dirty(SharedMemory64* seg, uint64_t page) {
+    atomic_fetch_or(&seg->pages.dirty_bitmap[page / 64], 1ULL << (page % 64));
+    atomic_fetch_add(&seg->version, 1);
+}
+
+// Enviar invalidación/degradación a un conjunto de clientes y esperar sus ACK
+static void dsm_home_revoke(SharedMemory64* seg, uint64_t page, uint64_t targets, uint8_t type) {
+    pthread_mutex_lock(&dsm_home->lock);
+    for (int s = 0; s < DSM_MAX_CLIENTS; s++) {
+        if (!(targets & (1ULL << s))) continue;
+        DsmClientSlot* c = &dsm_home->clients[s];
+        if (!c->connected) continue;
+        
+        c->awaiting_ack = true;
+        dsm_home->pending_acks++;
+        pthread_mutex_unlock(&dsm_home->lock);
+        if (dsm_send(c->fd, &c->send_lock, type, seg->memory_id, page, 0, NULL) < 0) {
+            shutdown(c->fd, SHUT_RDWR);  // El lector del slot liberará el ACK
+        }
+        pthread_mutex_lock(&dsm_home->lock);
+    }
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += DSM_ACK_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (long)(DSM_ACK_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    
+    while (dsm_home->pending_acks > 0 && atomic_load(&dsm_home->running)) {
+        if (pthread_cond_timedwait(&dsm_home->ack_cond, &dsm_home->lock, &deadline) != ETIMEDOUT) {
+            continue;
+        }
+        
+        // Quien no respondió se trata como desconectado: su hilo lector sale
+        // al cerrar el socket y encola la liberación del slot
+        for (int s = 0; s < DSM_MAX_CLIENTS; s++) {
+            DsmClientSlot* c = &dsm_home->clients[s];
+            if (!c->awaiting_ack) continue;
+            fprintf(stderr, "[DSM] Cliente %d sin ACK en %d ms: desconectado\n",
+                    s, DSM_ACK_TIMEOUT_MS);
+            c->awaiting_ack = false;
+            c->connected = false;
+            dsm_home->pending_acks--;
+            shutdown(c->fd, SHUT_RDWR);
+        }
+    }
+    pthread_mutex_unlock(&dsm_home->lock);
+}
+
+static void dsm_home_grant(int slot, uint64_t page, bool exclusive) {
+    DsmClientSlot* c = &dsm_home->clients[slot];
+    SharedMemory64* seg = c->segment;
+    if (!seg || page >= seg->pages.num_pages) return;
+    
+    uint64_t entry = seg->pages.page_table[page];
+    
+    // Copia Modified en otro nodo (o en el propio, si se reenvía la
+    // petición): recuperar datos. Para lectura basta con degradarla a S.
+    if (entry & DSM_ENTRY_MODIFIED) {
+        int owner = (int)(entry & 0x3F);
+        bool invalidate = exclusive || owner == slot;
+        dsm_home_revoke(seg, page, 1ULL << owner, invalidate ? DSM_INVALIDATE : DSM_DOWNGRADE);
+        atomic_fetch_add(&dsm_home->recalls, 1);
+        entry = invalidate ? 0 : (1ULL << owner);
+    }
+    
+    if (exclusive) {
+        uint64_t sharers = entry & ~(1ULL << slot);
+        if (sharers) {
+            dsm_home_revoke(seg, page, sharers, DSM_INVALIDATE);
+            atomic_fetch_add(&dsm_home->invalidations, (uint64_t)__builtin_popcountll(sharers));
+        }
+        entry = DSM_ENTRY_MODIFIED | (uint64_t)slot;
+    } else {
+        entry |= 1ULL << slot;
+    }
+    
+    seg->pages.page_table[page] = entry;
+    atomic_fetch_add(&dsm_home->grants, 1);
+    
+    dsm_send(c->fd, &c->send_lock, exclusive ? DSM_GRANT_EXCLUSIVE : DSM_GRANT_SHARED,
+             seg->memory_id, page, 0, dsm_home_page(seg, page));
+}
+
+// Quitar un cliente del directorio de su segmento
+static void dsm_home_drop_client(int slot) {
+    SharedMemory64* seg = dsm_home->clients[slot].segment;
+    if (!seg) return;
+    
+    for (size_t p = 0; p < seg->pages.num_pages; p++) {
+        uint64_t entry = seg->pages.page_table[p];
+        if (entry & DSM_ENTRY_MODIFIED) {
+            // Sin writeback previo los cambios de esa página se pierden
+            if ((int)(entry & 0x3F) == slot) seg->pages.page_table[p] = 0;
+        } else {
+            seg->pages.page_table[p] = entry & ~(1ULL << slot);
+        }
+    }
+}
+
+static void* dsm_home_worker(void* arg) {
+    // Cerca de la memoria del primer segmento exportado
+    numa_pin_thread(pthread_self(), (int)(intptr_t)arg);
+    
+    while (1) {
+        pthread_mutex_lock(&dsm_home->lock);
+        while (!dsm_home->queue_head && atomic_load(&dsm_home->running)) {
+            pthread_cond_wait(&dsm_home->queue_cond, &dsm_home->lock);
+        }
+        DsmRequest* req = dsm_home->queue_head;
+        if (!req) {
+            pthread_mutex_unlock(&dsm_home->lock);
+            break;
+        }
+        dsm_home->queue_head = req->next;
+        if (!dsm_home->queue_head) dsm_home->queue_tail = NULL;
+        pthread_mutex_unlock(&dsm_home->lock);
+        
+        DsmClientSlot* c = &dsm_home->clients[req->slot];
+        SharedMemory64* seg = c->segment;
+        
+        switch (req->type) {
+            case DSM_GET_SHARED:
+            case DSM_GET_EXCLUSIVE:
+                if (c->connected) {
+                    dsm_home_grant(req->slot, req->page, req->type == DSM_GET_EXCLUSIVE);
+                }
+                break;
+                
+            case DSM_WRITEBACK:
+                if (seg && req->page < seg->pages.num_pages &&
+                    seg->pages.page_table[req->page] == (DSM_ENTRY_MODIFIED | (uint64_t)req->slot)) {
+                    memcpy(dsm_home_page(seg, req->page), req->data, DSM_PAGE_SIZE);
+                    dsm_mark_dirty(seg, req->page);
+                    seg->pages.page_table[req->page] = 0;
+                }
+                break;
+                
+            case DSM_UNMAP:
+                dsm_home_drop_client(req->slot);
+                if (c->connected) {
+                    dsm_send(c->fd, &c->send_lock, DSM_UNMAP_REPLY, seg ? seg->memory_id : 0,
+                             0, 0, NULL);
+                }
+                break;
+                
+            default:  // Desconexión: liberar el slot
+                dsm_home_drop_client(req->slot);
+                pthread_mutex_lock(&dsm_home->lock);
+                close(c->fd);
+                c->segment = NULL;
+                c->fd = -1;
+                pthread_mutex_unlock(&dsm_home->lock);
+                break;
+        }
+        
+        free(req->data);
+        free(req);
+    }
+    
+    return NULL;
+}
+
+static void* dsm_home_client_thread(void* arg) {
+    int slot = (int)(intptr_t)arg;
+    DsmClientSlot* c = &dsm_home->clients[slot];
+    DsmMessage msg;
+    uint8_t page[DSM_PAGE_SIZE];
+    
+    while (atomic_load(&dsm_home->running) && dsm_recv(c->fd, &msg, page) == 0) {
+        if (msg.type == DSM_MAP) {
+            c->segment = NULL;
+            for (int i = 0; i < dsm_home->segment_count; i++) {
+                if (dsm_home->segments[i]->memory_id == msg.memory_id) {
+                    c->segment = dsm_home->segments[i];
+                }
+            }
+            dsm_send(c->fd, &c->send_lock, DSM_MAP_REPLY, msg.memory_id, 0,
+                     c->segment ? c->segment->mmap_size : 0, NULL);
+            
+            // Las páginas de este cliente entran y salen de ese segmento
+            numa_bind_thread_to_segment(c->segment);
+        } else if (msg.type == DSM_ACK) {
+            // El worker está esperando: la página no la toca nadie más. Un
+            // ACK tardío (ya dado por caído) no escribe nada.
+            SharedMemory64* seg = c->segment;
+            pthread_mutex_lock(&dsm_home->lock);
+            if (c->awaiting_ack) {
+                if ((msg.flags & DSM_FLAG_DATA) && seg && msg.page < seg->pages.num_pages) {
+                    memcpy(dsm_home_page(seg, msg.page), page, DSM_PAGE_SIZE);
+                    dsm_mark_dirty(seg, msg.page);
+                }
+                c->awaiting_ack = false;
+                dsm_home->pending_acks--;
+                pthread_cond_broadcast(&dsm_home->ack_cond);
+            }
+            pthread_mutex_unlock(&dsm_home->lock);
+        } else if (msg.type == DSM_WRITEBACK) {
+            uint8_t* copy = malloc(DSM_PAGE_SIZE);
+            if (copy) {
+                memcpy(copy, page, DSM_PAGE_SIZE);
+                dsm_enqueue(DSM_WRITEBACK, slot, msg.page, copy);
+            }
+        } else if (msg.type == DSM_GET_SHARED || msg.type == DSM_GET_EXCLUSIVE ||
+                   msg.type == DSM_UNMAP) {
+            dsm_enqueue(msg.type, slot, msg.page, NULL);
+        }
+    }
+    
+    // Desconexión: no esperar más ACK de este nodo
+    pthread_mutex_lock(&dsm_home->lock);
+    c->connected = false;
+    if (c->awaiting_ack) {
+        c->awaiting_ack = false;
+        dsm_home->pending_acks--;
+        pthread_cond_broadcast(&dsm_home->ack_cond);
+    }
+    pthread_mutex_unlock(&dsm_home->lock);
+    
+    dsm_enqueue(0, slot, 0, NULL);
+    return NULL;
+}
+
+static void* dsm_home_accept_thread(void* arg) {
+    (void)arg;
+    
+    while (atomic_load(&dsm_home->running)) {
+        struct pollfd pfd = { .fd = dsm_home->listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        
+        int fd = accept(dsm_home->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        pthread_mutex_lock(&dsm_home->lock);
+        int slot = -1;
+        for (int s = 0; s < DSM_MAX_CLIENTS && slot < 0; s++) {
+            if (dsm_home->clients[s].fd < 0) slot = s;
+        }
+        if (slot >= 0) {
+            dsm_home->clients[slot].fd = fd;
+            dsm_home->clients[slot].connected = true;
+            dsm_home->clients[slot].segment = NULL;
+        }
+        pthread_mutex_unlock(&dsm_home->lock);
+        
+        pthread_t tid;
+        if (slot < 0 || pthread_create(&tid, NULL, dsm_home_client_thread,
+                                       (void*)(intptr_t)slot) != 0) {
+            if (slot >= 0) {
+                pthread_mutex_lock(&dsm_home->lock);
+                dsm_home->clients[slot].fd = -1;
+                dsm_home->clients[slot].connected = false;
+                pthread_mutex_unlock(&dsm_home->lock);
+            }
+            close(fd);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+    
+    return NULL;
+}
+
+// Exportar un segmento para que otros nodos lo mapeen (arranca el servidor
+// DSM del nodo en la primera llamada)
+int dsm_export_segment(SharedMemory64* mem) {
+    if (!mem || mem->mmap_size % DSM_PAGE_SIZE != 0) return -1;
+    
+    if (!dsm_home) {
+        dsm_home = calloc(1, sizeof(DsmHome));
+        if (!dsm_home) return -1;
+        
+        pthread_mutex_init(&dsm_home->lock, NULL);
+        pthread_cond_init(&dsm_home->queue_cond, NULL);
+        pthread_cond_init(&dsm_home->ack_cond, NULL);
+        for (int s = 0; s < DSM_MAX_CLIENTS; s++) {
+            dsm_home->clients[s].fd = -1;
+            pthread_mutex_init(&dsm_home->clients[s].send_lock, NULL);
+        }
+        
+        dsm_home->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(dsm_home->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(DSM_BASE_PORT + kernel64->node_id),
+            .sin_addr.s_addr = INADDR_ANY
+        };
+        if (bind(dsm_home->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            listen(dsm_home->listen_fd, 16) < 0) {
+            fprintf(stderr, "[DSM] No se pudo escuchar en el puerto %lu\n",
+                    DSM_BASE_PORT + kernel64->node_id);
+            close(dsm_home->listen_fd);
+            free(dsm_home);
+            dsm_home = NULL;
+            return -1;
+        }
+        
+        atomic_store(&dsm_home->running, 1);
+        pthread_create(&dsm_home->worker_thread, NULL, dsm_home_worker,
+                       (void*)(intptr_t)mem->numa_node);
+        pthread_create(&dsm_home->accept_thread, NULL, dsm_home_accept_thread, NULL);
+        
+        printf("[DSM] Home escuchando en puerto %lu\n", DSM_BASE_PORT + kernel64->node_id);
+    }
+    
+    if (dsm_home->segment_count >= DSM_MAX_SEGMENTS) return -1;
+    
+    pthread_mutex_lock(&dsm_home->lock);
+    dsm_home->segments[dsm_home->segment_count++] = mem;
+    pthread_mutex_unlock(&dsm_home->lock);
+    
+    printf("[DSM] Segmento %lu exportado (%zu páginas)\n", mem->memory_id, mem->pages.num_pages);
+    return 0;
+}
+
+void dsm_stop_home(void) {
+    if (!dsm_home) return;
+    
+    atomic_store(&dsm_home->running, 0);
+    pthread_mutex_lock(&dsm_home->lock);
+    pthread_cond_broadcast(&dsm_home->queue_cond);
+    pthread_cond_broadcast(&dsm_home->ack_cond);
+    pthread_mutex_unlock(&dsm_home->lock);
+    
+    pthread_join(dsm_home->accept_thread, NULL);
+    pthread_join(dsm_home->worker_thread, NULL);
+    close(dsm_home->listen_fd);
+    
+    printf("[DSM] Home: %lu concesiones, %lu invalidaciones, %lu recuperaciones\n",
+           atomic_load(&dsm_home->grants), atomic_load(&dsm_home->invalidations),
+           atomic_load(&dsm_home->recalls));
+    
+    // Los hilos de cliente siguen bloqueados en recv(): cerrar sus sockets
+    for (int s = 0; s < DSM_MAX_CLIENTS; s++) {
+        if (dsm_home->clients[s].fd >= 0) shutdown(dsm_home->clients[s].fd, SHUT_RDWR);
+    }
+}
+
+// ---------- Nodo que mapea ----------
+
+typedef struct {
+    memory_id_t memory_id;
+    node_id_t home_node;
+    uint8_t* base;
+    size_t size;
+    size_t num_pages;
+    uint8_t* page_state;         // DsmPageState por página
+    int numa_node;
+    
+    int uffd;
+    int sock;
+    pthread_mutex_t send_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t granted;
+    bool waiting_grant;
+    bool unmapped;
+    _Atomic int running;
+    pthread_t fault_thread;
+    pthread_t recv_thread;
+    
+    _Atomic uint64_t read_faults;
+    _Atomic uint64_t write_faults;
+    _Atomic uint64_t pages_fetched;
+    _Atomic uint64_t invalidations;
+} DsmMapping;
+
+static int dsm_uffd_writeprotect(DsmMapping* map, uint64_t page, bool protect) {
+    struct uffdio_writeprotect wp = {
+        .range = { .start = (uint64_t)(uintptr_t)(map->base + page * DSM_PAGE_SIZE),
+                   .len = DSM_PAGE_SIZE },
+        .mode = protect ? UFFDIO_WRITEPROTECT_MODE_WP : 0
+    };
+    return ioctl(map->uffd, UFFDIO_WRITEPROTECT, &wp);
+}
+
+static void dsm_uffd_wake(DsmMapping* map, uint64_t page) {
+    struct uffdio_range range = {
+        .start = (uint64_t)(uintptr_t)(map->base + page * DSM_PAGE_SIZE),
+        .len = DSM_PAGE_SIZE
+    };
+    ioctl(map->uffd, UFFDIO_WAKE, &range);
+}
+
+// Instalar una página concedida por el home (requiere map->lock)
+static void dsm_install_page(DsmMapping* map, uint64_t page, const uint8_t* data, bool exclusive) {
+    if (map->page_state[page] == DSM_PAGE_SHARED && exclusive) {
+        // Mejora S → M: los datos locales ya son los del home
+        dsm_uffd_writeprotect(map, page, false);
+    } else if (map->page_state[page] == DSM_PAGE_INVALID) {
+        struct uffdio_copy copy = {
+            .dst = (uint64_t)(uintptr_t)(map->base + page * DSM_PAGE_SIZE),
+            .src = (uint64_t)(uintptr_t)data,
+            .len = DSM_PAGE_SIZE,
+            .mode = exclusive ? 0 : UFFDIO_COPY_MODE_WP
+        };
+        if (ioctl(map->uffd, UFFDIO_COPY, &copy) < 0 && errno != EEXIST) {
+            perror("[DSM] UFFDIO_COPY");
+        }
+        atomic_fetch_add(&map->pages_fetched, 1);
+    }
+    
+    map->page_state[page] = exclusive ? DSM_PAGE_MODIFIED : DSM_PAGE_SHARED;
+}
+
+// Atender una invalidación/degradación del home (requiere map->lock)
+static void dsm_revoke_page(DsmMapping* map, uint64_t page, bool downgrade) {
+    uint8_t* addr = map->base + page * DSM_PAGE_SIZE;
+    uint8_t state = map->page_state[page];
+    
+    // Congelar escritores antes de copiar: sus escrituras fallarán de nuevo
+    // y pedirán la página cuando el home lo permita
+    if (state == DSM_PAGE_MODIFIED) {
+        dsm_uffd_writeprotect(map, page, true);
+    }
+    
+    const void* data = state == DSM_PAGE_MODIFIED ? addr : NULL;
+    
+    if (downgrade && state == DSM_PAGE_MODIFIED) {
+        map->page_state[page] = DSM_PAGE_SHARED;
+        dsm_send(map->sock, &map->send_lock, DSM_ACK, map->memory_id, page, 0, data);
+        return;
+    }
+    
+    dsm_send(map->sock, &map->send_lock, DSM_ACK, map->memory_id, page, 0, data);
+    if (state != DSM_PAGE_INVALID) {
+        madvise(addr, DSM_PAGE_SIZE, MADV_DONTNEED);
+        map->page_state[page] = DSM_PAGE_INVALID;
+    }
+    atomic_fetch_add(&map->invalidations, 1);
+}
+
+static void* dsm_recv_thread(void* arg) {
+    DsmMapping* map = (DsmMapping*)arg;
+    DsmMessage msg;
+    uint8_t* page = aligned_alloc(DSM_PAGE_SIZE, DSM_PAGE_SIZE);
+    
+    while (page && dsm_recv(map->sock, &msg, page) == 0) {
+        if (msg.page >= map->num_pages && msg.type != DSM_UNMAP_REPLY) continue;
+        
+        pthread_mutex_lock(&map->lock);
+        switch (msg.type) {
+            case DSM_GRANT_SHARED:
+            case DSM_GRANT_EXCLUSIVE:
+                dsm_install_page(map, msg.page, page, msg.type == DSM_GRANT_EXCLUSIVE);
+                map->waiting_grant = false;
+                pthread_cond_broadcast(&map->granted);
+                break;
+            case DSM_INVALIDATE:
+            case DSM_DOWNGRADE:
+                dsm_revoke_page(map, msg.page, msg.type == DSM_DOWNGRADE);
+                break;
+            case DSM_UNMAP_REPLY:
+                map->unmapped = true;
+                pthread_cond_broadcast(&map->granted);
+                break;
+        }
+        pthread_mutex_unlock(&map->lock);
+    }
+    
+    // Conexión perdida: desbloquear a quien espere
+    pthread_mutex_lock(&map->lock);
+    atomic_store(&map->running, 0);
+    map->waiting_grant = false;
+    map->unmapped = true;
+    pthread_cond_broadcast(&map->granted);
+    pthread_mutex_unlock(&map->lock);
+    
+    free(page);
+    return NULL;
+}
+
+// Procesar los fallos de página de la región: una petición al home a la vez
+static void* dsm_fault_thread(void* arg) {
+    DsmMapping* map = (DsmMapping*)arg;
+    
+    while (atomic_load(&map->running)) {
+        struct pollfd pfd = { .fd = map->uffd, .events = POLLIN };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        
+        struct uffd_msg event;
+        if (read(map->uffd, &event, sizeof(event)) != sizeof(event)) continue;
+        if (event.event != UFFD_EVENT_PAGEFAULT) continue;
+        
+        uint64_t page = (event.arg.pagefault.address - (uint64_t)(uintptr_t)map->base) /
+                        DSM_PAGE_SIZE;
+        bool write = event.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE;
+        
+        pthread_mutex_lock(&map->lock);
+        uint8_t state = map->page_state[page];
+        
+        // Fallo ya resuelto por una concesión anterior: solo despertar
+        if (state == DSM_PAGE_MODIFIED || (state == DSM_PAGE_SHARED && !write)) {
+            pthread_mutex_unlock(&map->lock);
+            dsm_uffd_wake(map, page);
+            continue;
+        }
+        
+        atomic_fetch_add(write ? &map->write_faults : &map->read_faults, 1);
+        map->waiting_grant = true;
+        pthread_mutex_unlock(&map->lock);
+        
+        dsm_send(map->sock, &map->send_lock, write ? DSM_GET_EXCLUSIVE : DSM_GET_SHARED,
+                 map->memory_id, page, 0, NULL);
+        
+        pthread_mutex_lock(&map->lock);
+        while (map->waiting_grant) {
+            pthread_cond_wait(&map->granted, &map->lock);
+        }
+        pthread_mutex_unlock(&map->lock);
+    }
+    
+    return NULL;
+}
+
+// Mapear un segmento remoto. Las páginas se traen bajo demanda al tocarlas.
+DsmMapping* dsm_map_remote(node_id_t home_node, const char* host, memory_id_t memory_id) {
+    DsmMapping* map = calloc(1, sizeof(DsmMapping));
+    if (!map) return NULL;
+    
+    map->memory_id = memory_id;
+    map->home_node = home_node;
+    map->uffd = -1;
+    pthread_mutex_init(&map->send_lock, NULL);
+    pthread_mutex_init(&map->lock, NULL);
+    pthread_cond_init(&map->granted, NULL);
+    
+    // Conectar con el home y consultar el tamaño del segmento
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DSM_BASE_PORT + home_node)
+    };
+    inet_pton(AF_INET, host, &addr.sin_addr);
+    
+    map->sock = socket(AF_INET, SOCK_STREAM, 0);
+    DsmMessage reply = {0};
+    if (map->sock < 0 || connect(map->sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        dsm_send(map->sock, &map->send_lock, DSM_MAP, memory_id, 0, 0, NULL) < 0 ||
+        dsm_recv(map->sock, &reply, NULL) < 0 || reply.type != DSM_MAP_REPLY || reply.size == 0) {
+        fprintf(stderr, "[DSM] No se pudo mapear el segmento %lu del nodo %lu\n",
+                memory_id, home_node);
+        goto fail;
+    }
+    
+    int one = 1;
+    setsockopt(map->sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    
+    map->size = reply.size;
+    map->num_pages = reply.size / DSM_PAGE_SIZE;
+    map->page_state = calloc(map->num_pages, 1);
+    map->base = mmap(NULL, map->size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (!map->page_state || map->base == MAP_FAILED) {
+        map->base = NULL;
+        goto fail;
+    }
+    map->numa_node = numa_current_node();
+    numa_bind_memory(map->base, map->size, map->numa_node);
+    
+    // Registrar la región: fallos por página ausente y por protección
+    map->uffd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    struct uffdio_api api = { .api = UFFD_API, .features = 0 };
+    struct uffdio_register reg = {
+        .range = { .start = (uint64_t)(uintptr_t)map->base, .len = map->size },
+        .mode = UFFDIO_REGISTER_MODE_MISSING | UFFDIO_REGISTER_MODE_WP
+    };
+    if (map->uffd < 0 || ioctl(map->uffd, UFFDIO_API, &api) < 0 ||
+        ioctl(map->uffd, UFFDIO_REGISTER, &reg) < 0 ||
+        !(reg.ioctls & (1ULL << _UFFDIO_WRITEPROTECT))) {
+        perror("[DSM] userfaultfd");
+        goto fail;
+    }
+    
+    atomic_store(&map->running, 1);
+    pthread_create(&map->recv_thread, NULL, dsm_recv_thread, map);
+    pthread_create(&map->fault_thread, NULL, dsm_fault_thread, map);
+    numa_pin_thread(map->recv_thread, map->numa_node);
+    numa_pin_thread(map->fault_thread, map->numa_node);
+    
+    printf("[DSM] Segmento %lu del nodo %lu mapeado en %p (%zu páginas)\n",
+           memory_id, home_node, (void*)map->base, map->num_pages);
+    return map;
+    
+fail:
+    if (map->uffd >= 0) close(map->uffd);
+    if (map->base) munmap(map->base, map->size);
+    if (map->sock >= 0) close(map->sock);
+    free(map->page_state);
+    free(map);
+    return NULL;
+}
+
+// Devolver las páginas modificadas al home y desmapear. El llamador debe
+// haber dejado de acceder a la región.
+void dsm_unmap(DsmMapping* map) {
+    if (!map) return;
+    
+    pthread_mutex_lock(&map->lock);
+    for (size_t p = 0; p < map->num_pages && atomic_load(&map->running); p++) {
+        if (map->page_state[p] == DSM_PAGE_MODIFIED) {
+            dsm_send(map->sock, &map->send_lock, DSM_WRITEBACK, map->memory_id, p, 0,
+                     map->base + p * DSM_PAGE_SIZE);
+            map->page_state[p] = DSM_PAGE_INVALID;
+        }
+    }
+    dsm_send(map->sock, &map->send_lock, DSM_UNMAP, map->memory_id, 0, 0, NULL);
+    while (!map->unmapped) {
+        pthread_cond_wait(&map->granted, &map->lock);
+    }
+    pthread_mutex_unlock(&map->lock);
+    
+    atomic_store(&map->running, 0);
+    shutdown(map->sock, SHUT_RDWR);
+    pthread_join(map->recv_thread, NULL);
+    pthread_join(map->fault_thread, NULL);
+    
+    printf("[DSM] Segmento %lu: %lu fallos de lectura, %lu de escritura, "
+           "%lu/%zu páginas traídas, %lu invalidaciones\n",
+           map->memory_id, atomic_load(&map->read_faults), atomic_load(&map->write_faults),
+           atomic_load(&map->pages_fetched), map->num_pages, atomic_load(&map->invalidations));
+    
+    close(map->uffd);
+    close(map->sock);
+    munmap(map->base, map->size);
+    free(map->page_state);
+    pthread_mutex_destroy(&map->send_lock);
+    pthread_mutex_destroy(&map->lock);
+    pthread_cond_destroy(&map->granted);
+    free(map);
+}
+
+// ========================================
+// WRITE-AHEAD LOG CON GROUP COMMIT
+// ========================================
+
+// Registros con CRC32C en segmentos de tamaño fijo, rellenos a cero al
+// crearlos: escribir en ellos no cambia el tamaño del archivo y fdatasync
+// no tiene que tocar metadatos. Los hilos copian su registro a un buffer y
+// esperan; el hilo de flush escribe el buffer entero con un solo fdatasync
+// mientras se llena el otro. La recuperación recorre los segmentos con mmap
+// y se detiene en el primer registro roto (escritura a medias). Una
+// instantánea de la máquina de estados permite borrar los segmentos que
+// ya cubre.
+
+#define WAL_SEGMENT_SIZE   (16 * 1024 * 1024)
+#define WAL_BUFFER_SIZE    (4 * 1024 * 1024)    // Por cada uno de los dos buffers
+#define WAL_MAX_RECORD     (1024 * 1024)
+#define WAL_SNAPSHOT_MAGIC 0x534E4150u          // "SNAP"
+#define WAL_DIR_DEFAULT    "/var/tmp/dos_wal"
+
+typedef enum {
+    WAL_END = 0,                 // Zona a cero: no hay más registros en el segmento
+    WAL_ENTRY,                   // Entrada del log (index, term, comando)
+    WAL_TRUNCATE,                // Entradas desde index descartadas
+    WAL_META                     // Término actual (term) y voto (index)
+} WalRecordType;
+
+typedef struct __attribute__((packed)) {
+    uint32_t crc;                // CRC32C del resto de la cabecera y los datos
+    uint32_t length;             // Bytes de datos
+    uint8_t type;
+    uint8_t reserved[7];
+    uint64_t index;
+    uint64_t term;
+} WalHeader;
+
+typedef struct {
+    uint8_t type;
+    uint64_t index;
+    uint64_t term;
+    const void* data;
+    size_t size;
+} WalRecord;
+
+// Instantánea: estado aplicado hasta last_index más el término y voto de
+// ese momento
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t crc;                // CRC32C de lo que sigue
+    uint64_t last_index;
+    uint64_t last_term;
+    uint64_t current_term;
+    uint64_t voted_for;
+    uint64_t size;
+} WalSnapshotHeader;
+
+typedef struct {
+    uint64_t last_index;
+    uint64_t last_term;
+    uint64_t current_term;
+    uint64_t voted_for;
+    const void* data;
+    size_t size;
+} WalSnapshot;
+
+typedef void (*WalReplayFn)(void* ctx, const WalRecord* rec);
+typedef void (*WalSnapshotFn)(void* ctx, const WalSnapshot* snap);
+
+typedef struct {
+    uint64_t seq;
+    uint64_t max_index;          // Mayor índice que menciona (para compactar)
+} WalSegmentInfo;
+
+typedef struct {
+    char dir[256];
+    
+    // Segmento en el que escribe el flush (solo lo toca ese hilo)
+    int fd;
+    size_t offset;
+    int spare_fd;                // Siguiente segmento, ya preasignado
+    
+    // Segmentos vivos, del más viejo al actual (bajo lock)
+    WalSegmentInfo* segments;
+    size_t segment_count;
+    size_t segment_capacity;
+    
+    // Group commit: los hilos llenan un buffer mientras se escribe el otro
+    uint8_t* buffers[2];
+    int filling;
+    size_t fill_size;
+    uint64_t appended_lsn;       // Bytes aceptados
+    uint64_t durable_lsn;        // Bytes en disco
+    uint64_t durable_index;      // Última entrada del log en disco
+    bool flushing;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t flush_cond;   // Hay algo que escribir
+    pthread_cond_t space_cond;   // Se liberó un buffer
+    pthread_cond_t durable_cond; // Avanzó durable_lsn
+    pthread_t flush_thread;
+    bool running;
+    
+    // Estadísticas
+    uint64_t records;
+    uint64_t syncs;
+    uint64_t bytes;
+    uint64_t snapshots;
+    uint64_t segments_removed;
+} Wal;
+
+// CRC32C por hardware (SSE4.2, implícito en -mavx2)
+static uint32_t wal_crc32c(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+    uint64_t c = ~crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) c = _mm_crc32_u8((uint32_t)c, *p++);
+    return ~(uint32_t)c;
+}
+
+static inline size_t wal_record_size(size_t length) {
+    return (sizeof(WalHeader) + length + 7) & ~(size_t)7;
+}
+
+static uint32_t wal_record_crc(const WalHeader* h, const void* data) {
+    uint32_t crc = wal_crc32c(0, (const uint8_t*)h + sizeof(h->crc), sizeof(*h) - sizeof(h->crc));
+    return wal_crc32c(crc, data, h->length);
+}
+
+static void wal_segment_path(const Wal* wal, uint64_t seq, char* path, size_t len) {
+    snprintf(path, len, "%s/wal-%016lx.seg", wal->dir, seq);
+}
+
+// Que una creación o un borrado sobrevivan a una caída
+static void wal_sync_dir(const char* dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Crear un segmento escrito entero a cero
+static int wal_create_segment(Wal* wal, uint64_t seq) {
+    char path[320];
+    wal_segment_path(wal, seq, path, sizeof(path));
+    
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    
+    static const uint8_t zeros[64 * 1024];
+    for (size_t done = 0; done < WAL_SEGMENT_SIZE; done += sizeof(zeros)) {
+        if (pwrite(fd, zeros, sizeof(zeros), (off_t)done) != (ssize_t)sizeof(zeros)) {
+            close(fd);
+            unlink(path);
+            return -1;
+        }
+    }
+    fsync(fd);
+    wal_sync_dir(wal->dir);
+    return fd;
+}
+
+// Añadir un segmento al final de la lista (requiere lock o exclusividad)
+static int wal_push_segment(Wal* wal, uint64_t seq) {
+    if (wal->segment_count == wal->segment_capacity) {
+        size_t capacity = wal->segment_capacity ? wal->segment_capacity * 2 : 16;
+        WalSegmentInfo* segments = realloc(wal->segments, capacity * sizeof(WalSegmentInfo));
+        if (!segments) return -1;
+        wal->segments = segments;
+        wal->segment_capacity = capacity;
+    }
+    wal->segments[wal->segment_count++] = (WalSegmentInfo){ .seq = seq, .max_index = 0 };
+    return 0;
+}
+
+// Pasar al siguiente segmento (hilo de flush). El anterior ya está en
+// disco: cada grupo termina con su fdatasync.
+static int wal_next_segment(Wal* wal) {
+    pthread_mutex_lock(&wal->lock);
+    uint64_t seq = wal->segments[wal->segment_count - 1].seq + 1;
+    pthread_mutex_unlock(&wal->lock);
+    
+    int fd = wal->spare_fd >= 0 ? wal->spare_fd : wal_create_segment(wal, seq);
+    wal->spare_fd = -1;
+    if (fd < 0) return -1;
+    
+    pthread_mutex_lock(&wal->lock);
+    int rc = wal_push_segment(wal, seq);
+    pthread_mutex_unlock(&wal->lock);
+    if (rc < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    fdatasync(wal->fd);
+    close(wal->fd);
+    wal->fd = fd;
+    wal->offset = 0;
+    return 0;
+}
+
+// Escribir un grupo en su sitio; devuelve la última entrada que deja en
+// disco (las truncadas dejan de contar)
+static int wal_write_group(Wal* wal, const uint8_t* buf, size_t size, uint64_t* durable_index) {
+    size_t pos = 0;
+    while (pos < size) {
+        // Tramo de registros que cabe en el segmento actual
+        size_t run = 0;
+        uint64_t max_index = 0;
+        while (pos + run < size) {
+            const WalHeader* h = (const WalHeader*)(buf + pos + run);
+            size_t rec = wal_record_size(h->length);
+            if (wal->offset + run + rec > WAL_SEGMENT_SIZE) break;
+            if (h->type == WAL_ENTRY) *durable_index = h->index;
+            else if (h->type == WAL_TRUNCATE && *durable_index >= h->index) *durable_index = h->index - 1;
+            if (h->type != WAL_META && h->index > max_index) max_index = h->index;
+            run += rec;
+        }
+        
+        if (run == 0) {
+            if (wal_next_segment(wal) < 0) return -1;
+            continue;
+        }
+        
+        for (size_t done = 0; done < run; ) {
+            ssize_t n = pwrite(wal->fd, buf + pos + done, run - done, (off_t)(wal->offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            done += (size_t)n;
+        }
+        wal->offset += run;
+        pos += run;
+        
+        pthread_mutex_lock(&wal->lock);
+        WalSegmentInfo* seg = &wal->segments[wal->segment_count - 1];
+        if (max_index > seg->max_index) seg->max_index = max_index;
+        pthread_mutex_unlock(&wal->lock);
+    }
+    
+    return fdatasync(wal->fd);
+}
+
+static void* wal_flush_thread(void* arg) {
+    Wal* wal = (Wal*)arg;
+    
+    pthread_mutex_lock(&wal->lock);
+    for (;;) {
+        while (wal->fill_size == 0 && wal->running) {
+            pthread_cond_wait(&wal->flush_cond, &wal->lock);
+        }
+        if (wal->fill_size == 0) break;
+        
+        // Cambiar de buffer: lo que llegue mientras tanto va al siguiente grupo
+        uint8_t* buf = wal->buffers[wal->filling];
+        size_t size = wal->fill_size;
+        uint64_t lsn = wal->appended_lsn;
+        uint64_t durable_index = wal->durable_index;
+        wal->filling ^= 1;
+        wal->fill_size = 0;
+        wal->flushing = true;
+        pthread_cond_broadcast(&wal->space_cond);
+        pthread_mutex_unlock(&wal->lock);
+        
+        if (wal_write_group(wal, buf, size, &durable_index) < 0) {
+            perror("[WAL] Escritura");
+        }
+        
+        // Preparar el próximo segmento fuera del camino de los commits
+        if (wal->spare_fd < 0 && wal->offset > WAL_SEGMENT_SIZE / 2) {
+            pthread_mutex_lock(&wal->lock);
+            uint64_t seq = wal->segments[wal->segment_count - 1].seq + 1;
+            pthread_mutex_unlock(&wal->lock);
+            wal->spare_fd = wal_create_segment(wal, seq);
+        }
+        
+        pthread_mutex_lock(&wal->lock);
+        wal->durable_lsn = lsn;
+        wal->durable_index = durable_index;
+        wal->flushing = false;
+        wal->syncs++;
+        wal->bytes += size;
+        pthread_cond_broadcast(&wal->durable_cond);
+        pthread_cond_broadcast(&wal->space_cond);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    
+    return NULL;
+}
+
+// ---------- Recuperación ----------
+
+static int compare_wal_seq(const void* a, const void* b) {
+    const WalSegmentInfo* x = a;
+    const WalSegmentInfo* y = b;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+// Mayor índice de instantánea por debajo de 'limit' (0 = ninguna)
+static uint64_t wal_find_snapshot(Wal* wal, uint64_t limit) {
+    DIR* dir = opendir(wal->dir);
+    if (!dir) return 0;
+    
+    uint64_t best = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned long index;
+        if (sscanf(entry->d_name, "snap-%lx.snap", &index) == 1 && index < limit && index > best) {
+            best = index;
+        }
+    }
+    closedir(dir);
+    return best;
+}
+
+// Cargar la instantánea válida más reciente (las dañadas se borran)
+static uint64_t wal_load_snapshot(Wal* wal, WalSnapshotFn on_snapshot, void* ctx) {
+    for (uint64_t index = wal_find_snapshot(wal, UINT64_MAX); index > 0;
+         index = wal_find_snapshot(wal, index)) {
+        char path[320];
+        snprintf(path, sizeof(path), "%s/snap-%016lx.snap", wal->dir, index);
+        
+        bool valid = false;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(WalSnapshotHeader)) {
+            void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                const WalSnapshotHeader* h = map;
+                valid = h->magic == WAL_SNAPSHOT_MAGIC &&
+                        h->size <= (uint64_t)st.st_size - sizeof(*h) &&
+                        wal_crc32c(0, (const uint8_t*)h + 8, sizeof(*h) - 8 + h->size) == h->crc;
+                if (valid && on_snapshot) {
+                    WalSnapshot snap = {
+                        .last_index = h->last_index,
+                        .last_term = h->last_term,
+                        .current_term = h->current_term,
+                        .voted_for = h->voted_for,
+                        .data = h + 1,
+                        .size = h->size
+                    };
+                    on_snapshot(ctx, &snap);
+                }
+                munmap(map, (size_t)st.st_size);
+            }
+        }
+        if (fd >= 0) close(fd);
+        if (valid) return index;
+        
+        fprintf(stderr, "[WAL] Instantánea %s dañada, se ignora\n", path);
+        unlink(path);
+    }
+    return 0;
+}
+
+// Recorrer un segmento con mmap. Devuelve el offset tras el último registro
+// válido y si terminó limpio (zona a cero) o en un registro roto.
+static size_t wal_replay_segment(Wal* wal, WalSegmentInfo* seg, WalReplayFn replay,
+                                 void* ctx, bool* torn) {
+    char path[320];
+    wal_segment_path(wal, seg->seq, path, sizeof(path));
+    
+    *torn = true;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    
+    size_t size = (size_t)st.st_size;
+    const uint8_t* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+    madvise((void*)base, size, MADV_SEQUENTIAL);
+    
+    size_t pos = 0;
+    while (pos + sizeof(WalHeader) <= size) {
+        const WalHeader* h = (const WalHeader*)(base + pos);
+        if (h->type == WAL_END) {
+            *torn = false;
+            break;
+        }
+        if (h->type > WAL_META || h->length > WAL_MAX_RECORD ||
+            pos + wal_record_size(h->length) > size ||
+            wal_record_crc(h, h + 1) != h->crc) {
+            break;
+        }
+        
+        WalRecord rec = {
+            .type = h->type,
+            .index = h->index,
+            .term = h->term,
+            .data = h + 1,
+            .size = h->length
+        };
+        if (replay) replay(ctx, &rec);
+        if (h->type != WAL_META && h->index > seg->max_index) seg->max_index = h->index;
+        wal->records++;
+        pos += wal_record_size(h->length);
+    }
+    if (pos + sizeof(WalHeader) > size) *torn = false;
+    
+    munmap((void*)base, size);
+    return pos;
+}
+
+// Abrir (o crear) el WAL de un directorio: primero la instantánea, luego
+// los registros en orden. Todo lo que sigue a un registro roto se descarta.
+Wal* wal_open(const char* dir, WalSnapshotFn on_snapshot, WalReplayFn replay, void* ctx) {
+    Wal* wal = calloc(1, sizeof(Wal));
+    if (!wal) return NULL;
+    
+    snprintf(wal->dir, sizeof(wal->dir), "%s", dir);
+    mkdir(wal->dir, 0700);
+    wal->fd = -1;
+    wal->spare_fd = -1;
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->flush_cond, NULL);
+    pthread_cond_init(&wal->space_cond, NULL);
+    pthread_cond_init(&wal->durable_cond, NULL);
+    wal->buffers[0] = malloc(WAL_BUFFER_SIZE);
+    wal->buffers[1] = malloc(WAL_BUFFER_SIZE);
+    if (!wal->buffers[0] || !wal->buffers[1]) goto fail;
+    
+    uint64_t snapshot_index = wal_load_snapshot(wal, on_snapshot, ctx);
+    wal->durable_index = snapshot_index;
+    
+    // Segmentos existentes, en orden
+    DIR* d = opendir(wal->dir);
+    if (!d) goto fail;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        unsigned long seq;
+        if (sscanf(entry->d_name, "wal-%lx.seg", &seq) == 1 && wal_push_segment(wal, seq) < 0) {
+            closedir(d);
+            goto fail;
+        }
+    }
+    closedir(d);
+    if (wal->segment_count > 1) {
+        qsort(wal->segments, wal->segment_count, sizeof(WalSegmentInfo), compare_wal_seq);
+    }
+    
+    uint64_t start = get_timestamp_ns();
+    size_t end = 0;
+    size_t last = 0;
+    bool torn = false;
+    for (size_t i = 0; i < wal->segment_count; i++) {
+        last = i;
+        end = wal_replay_segment(wal, &wal->segments[i], replay, ctx, &torn);
+        if (torn) break;
+    }
+    
+    // Lo posterior a un registro roto nunca se confirmó
+    if (torn) {
+        fprintf(stderr, "[WAL] Registro incompleto en el segmento %lu (offset %zu): "
+                "se descarta lo que sigue\n", wal->segments[last].seq, end);
+    }
+    for (size_t i = last + 1; i < wal->segment_count; i++) {
+        char path[320];
+        wal_segment_path(wal, wal->segments[i].seq, path, sizeof(path));
+        unlink(path);
+    }
+    if (wal->segment_count > 0) wal->segment_count = last + 1;
+    
+    if (wal->segment_count == 0) {
+        wal->fd = wal_create_segment(wal, 1);
+        if (wal->fd < 0 || wal_push_segment(wal, 1) < 0) goto fail;
+        end = 0;
+    } else {
+        char path[320];
+        wal_segment_path(wal, wal->segments[last].seq, path, sizeof(path));
+        wal->fd = open(path, O_RDWR | O_CLOEXEC);
+        if (wal->fd < 0) goto fail;
+        
+        // Poner a cero la cola: los restos de un registro roto no deben
+        // parecer válidos cuando se escriba encima
+        if (torn) {
+            static const uint8_t zeros[64 * 1024];
+            for (size_t pos = end; pos < WAL_SEGMENT_SIZE; pos += sizeof(zeros)) {
+                size_t chunk = WAL_SEGMENT_SIZE - pos < sizeof(zeros) ? WAL_SEGMENT_SIZE - pos : sizeof(zeros);
+                if (pwrite(wal->fd, zeros, chunk, (off_t)pos) != (ssize_t)chunk) break;
+            }
+            fdatasync(wal->fd);
+        }
+    }
+    wal->offset = end;
+    
+    // durable_index según el log recuperado
+    for (size_t i = 0; i < wal->segment_count; i++) {
+        if (wal->segments[i].max_index > wal->durable_index) {
+            wal->durable_index = wal->segments[i].max_index;
+        }
+    }
+    
+    if (snapshot_index > 0) {
+        printf("[WAL] %s: instantánea hasta %lu, %lu registros recuperados de %zu segmentos "
+               "en %.1f ms\n", wal->dir, snapshot_index, wal->records, wal->segment_count,
+               (get_timestamp_ns() - start) / 1e6);
+    } else if (wal->records > 0) {
+        printf("[WAL] %s: %lu registros recuperados de %zu segmentos en %.1f ms\n",
+               wal->dir, wal->records, wal->segment_count, (get_timestamp_ns() - start) / 1e6);
+    }
+    wal->records = 0;
+    
+    wal->running = true;
+    if (pthread_create(&wal->flush_thread, NULL, wal_flush_thread, wal) != 0) goto fail;
+    return wal;
+
+fail:
+    if (wal->fd >= 0) close(wal->fd);
+    free(wal->segments);
+    free(wal->buffers[0]);
+    free(wal->buffers[1]);
+    free(wal);
+    return NULL;
+}
+
+// ---------- Escritura ----------
+
+// Añadir un registro al grupo en curso. Devuelve su LSN para wal_sync()
+// (0 = error); el orden en disco es el de las llamadas.
+uint64_t wal_append(Wal* wal, uint8_t type, uint64_t index, uint64_t term,
+                    const void* data, size_t size) {
+    size_t rec = wal_record_size(size);
+    if (size > WAL_MAX_RECORD) return 0;
+    
+    WalHeader h = {
+        .length = (uint32_t)size,
+        .type = type,
+        .index = index,
+        .term = term
+    };
+    h.crc = wal_record_crc(&h, data);
+    
+    pthread_mutex_lock(&wal->lock);
+    // Buffer lleno: esperar a que el flush libere el otro
+    while (wal->running && wal->fill_size + rec > WAL_BUFFER_SIZE) {
+        pthread_cond_wait(&wal->space_cond, &wal->lock);
+    }
+    if (!wal->running) {
+        pthread_mutex_unlock(&wal->lock);
+        return 0;
+    }
+    
+    uint8_t* out = wal->buffers[wal->filling] + wal->fill_size;
+    memcpy(out, &h, sizeof(h));
+    if (size > 0) memcpy(out + sizeof(h), data, size);   // META y TRUNCATE no llevan datos
+    memset(out + sizeof(h) + size, 0, rec - sizeof(h) - size);
+    wal->fill_size += rec;
+    wal->appended_lsn += rec;
+    wal->records++;
+    uint64_t lsn = wal->appended_lsn;
+    
+    if (!wal->flushing) pthread_cond_signal(&wal->flush_cond);
+    pthread_mutex_unlock(&wal->lock);
+    
+    return lsn;
+}
+
+// Esperar a que todo hasta 'lsn' esté en disco
+int wal_sync(Wal* wal, uint64_t lsn) {
+    pthread_mutex_lock(&wal->lock);
+    while (wal->durable_lsn < lsn && (wal->running || wal->fill_size > 0 || wal->flushing)) {
+        pthread_cond_wait(&wal->durable_cond, &wal->lock);
+    }
+    int rc = wal->durable_lsn >= lsn ? 0 : -1;
+    pthread_mutex_unlock(&wal->lock);
+    return rc;
+}
+
+// Esperar al siguiente grupo tras *lsn (o timeout). Actualiza *lsn y
+// devuelve la última entrada del log en disco.
+uint64_t wal_wait_flush(Wal* wal, uint64_t* lsn, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)timeout_ms * 1000000L;
+    while (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    
+    pthread_mutex_lock(&wal->lock);
+    while (wal->durable_lsn == *lsn && wal->running) {
+        if (pthread_cond_timedwait(&wal->durable_cond, &wal->lock, &deadline) == ETIMEDOUT) break;
+    }
+    *lsn = wal->durable_lsn;
+    uint64_t index = wal->durable_index;
+    pthread_mutex_unlock(&wal->lock);
+    return index;
+}
+
+// Segmento en el que caen los registros que se añadan ahora
+uint64_t wal_current_segment(Wal* wal) {
+    pthread_mutex_lock(&wal->lock);
+    uint64_t seq = wal->segments[wal->segment_count - 1].seq;
+    pthread_mutex_unlock(&wal->lock);
+    return seq;
+}
+
+// ---------- Compactación ----------
+
+// Guardar una instantánea y borrar los segmentos anteriores a before_seq
+// cuyas entradas no pasan de discard_index (lo que aún necesite algún
+// seguidor se conserva)
+int wal_snapshot(Wal* wal, const WalSnapshot* snap, uint64_t discard_index, uint64_t before_seq) {
+    char path[320], tmp[336];
+    snprintf(path, sizeof(path), "%s/snap-%016lx.snap", wal->dir, snap->last_index);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    
+    WalSnapshotHeader h = {
+        .magic = WAL_SNAPSHOT_MAGIC,
+        .last_index = snap->last_index,
+        .last_term = snap->last_term,
+        .current_term = snap->current_term,
+        .voted_for = snap->voted_for,
+        .size = snap->size
+    };
+    h.crc = wal_crc32c(wal_crc32c(0, (const uint8_t*)&h + 8, sizeof(h) - 8), snap->data, snap->size);
+    
+    // Escribir aparte y renombrar: una instantánea a medias nunca tiene el nombre final
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    bool ok = write(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) &&
+              (snap->size == 0 || write(fd, snap->data, snap->size) == (ssize_t)snap->size) &&
+              fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    wal_sync_dir(wal->dir);
+    
+    // Instantáneas anteriores
+    DIR* dir = opendir(wal->dir);
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            unsigned long index;
+            if (sscanf(entry->d_name, "snap-%lx.snap", &index) == 1 && index < snap->last_index) {
+                char old[320];
+                snprintf(old, sizeof(old), "%s/snap-%016lx.snap", wal->dir, index);
+                unlink(old);
+            }
+        }
+        closedir(dir);
+    }
+    
+    // Segmentos ya cubiertos (siempre desde el más viejo, sin huecos)
+    pthread_mutex_lock(&wal->lock);
+    size_t removable = 0;
+    while (removable + 1 < wal->segment_count &&
+           wal->segments[removable].seq < before_seq &&
+           wal->segments[removable].max_index <= discard_index) {
+        removable++;
+    }
+    uint64_t* removed = malloc((removable ? removable : 1) * sizeof(uint64_t));
+    if (!removed) removable = 0;
+    for (size_t i = 0; i < removable; i++) removed[i] = wal->segments[i].seq;
+    memmove(wal->segments, wal->segments + removable,
+            (wal->segment_count - removable) * sizeof(WalSegmentInfo));
+    wal->segment_count -= removable;
+    wal->snapshots++;
+    wal->segments_removed += removable;
+    pthread_mutex_unlock(&wal->lock);
+    
+    for (size_t i = 0; i < removable; i++) {
+        wal_segment_path(wal, removed[i], path, sizeof(path));
+        unlink(path);
+    }
+    if (removable) wal_sync_dir(wal->dir);
+    free(removed);
+    
+    return 0;
+}
+
+// Escribir lo pendiente y cerrar
+void wal_close(Wal* wal) {
+    if (!wal) return;
+    
+    pthread_mutex_lock(&wal->lock);
+    wal->running = false;
+    pthread_cond_broadcast(&wal->flush_cond);
+    pthread_cond_broadcast(&wal->space_cond);
+    pthread_mutex_unlock(&wal->lock);
+    pthread_join(wal->flush_thread, NULL);
+    
+    if (wal->fd >= 0) close(wal->fd);
+    if (wal->spare_fd >= 0) close(wal->spare_fd);
+    free(wal->segments);
+    free(wal->buffers[0]);
+    free(wal->buffers[1]);
+    pthread_cond_destroy(&wal->durable_cond);
+    pthread_cond_destroy(&wal->space_cond);
+    pthread_cond_destroy(&wal->flush_cond);
+    pthread_mutex_destroy(&wal->lock);
+    free(wal);
+}
+
+// Borrar un directorio de WAL (benchmarks)
+void wal_remove_dir(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char file[512];
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        unlink(file);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// ---------- Benchmark ----------
+
+typedef struct {
+    Wal* wal;
+    _Atomic int* running;
+    _Atomic uint64_t* next_index;
+    uint64_t appends;
+    LatencyRecorder latency;     // Append → en disco
+} WalBenchWorker;
+
+static void* wal_bench_worker(void* arg) {
+    WalBenchWorker* w = (WalBenchWorker*)arg;
+    uint8_t payload[64];
+    memset(payload, 0x5A, sizeof(payload));
+    
+    while (atomic_load_explicit(w->running, memory_order_relaxed)) {
+        uint64_t start = get_timestamp_ns();
+        uint64_t index = atomic_fetch_add(w->next_index, 1);
+        uint64_t lsn = wal_append(w->wal, WAL_ENTRY, index, 1, payload, sizeof(payload));
+        if (lsn == 0 || wal_sync(w->wal, lsn) < 0) break;
+        
+        latency_record(&w->latency, get_timestamp_ns() - start);
+        w->appends++;
+    }
+    
+    return NULL;
+}
+
+static void wal_count_record(void* ctx, const WalRecord* rec) {
+    (void)rec;
+    (*(uint64_t*)ctx)++;
+}
+
+// Appends de 64 bytes con su espera de durabilidad desde N hilos: los que
+// llegan durante un fdatasync comparten el siguiente
+void benchmark_wal(const char* dir, int threads, int duration_ms) {
+    wal_remove_dir(dir);
+    Wal* wal = wal_open(dir, NULL, NULL, NULL);
+    if (!wal) {
+        fprintf(stderr, "[WAL] No se pudo abrir %s\n", dir);
+        return;
+    }
+    
+    _Atomic int running = 1;
+    _Atomic uint64_t next_index = 1;
+    WalBenchWorker* workers = calloc((size_t)threads, sizeof(WalBenchWorker));
+    pthread_t* tids = calloc((size_t)threads, sizeof(pthread_t));
+    
+    uint64_t start = get_timestamp_ns();
+    for (int i = 0; i < threads; i++) {
+        workers[i].wal = wal;
+        workers[i].running = &running;
+        workers[i].next_index = &next_index;
+        latency_init(&workers[i].latency);
+        pthread_create(&tids[i], NULL, wal_bench_worker, &workers[i]);
+    }
+    
+    usleep((useconds_t)duration_ms * 1000);
+    atomic_store(&running, 0);
+    
+    uint64_t appends = 0;
+    LatencyRecorder all = { 0 };
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        appends += workers[i].appends;
+        latency_merge(&all, &workers[i].latency);
+    }
+    double elapsed_s = (get_timestamp_ns() - start) / 1e9;
+    latency_sort(&all);
+    
+    pthread_mutex_lock(&wal->lock);
+    uint64_t syncs = wal->syncs;
+    pthread_mutex_unlock(&wal->lock);
+    
+    printf("  %3d hilos: %9.0f appends/s | %7.0f fdatasync/s | %6.1f registros/sync | "
+           "p50 %6.0f us | p99 %7.0f us\n",
+           threads, appends / elapsed_s, syncs / elapsed_s,
+           syncs ? (double)appends / syncs : 0.0,
+           latency_percentile(&all, 50) / 1e3, latency_percentile(&all, 99) / 1e3);
+    free(all.samples);
+    free(workers);
+    free(tids);
+    
+    // Recuperación: releer todo por mmap
+    wal_close(wal);
+    uint64_t replayed = 0;
+    start = get_timestamp_ns();
+    wal = wal_open(dir, NULL, wal_count_record, &replayed);
+    double replay_ms = (get_timestamp_ns() - start) / 1e6;
+    if (!wal) return;
+    
+    // Simular una caída a mitad de escritura: romper el último registro
+    uint8_t payload[64] = { 0 };
+    uint64_t seq = wal_current_segment(wal);
+    size_t torn_offset = wal->offset;
+    wal_sync(wal, wal_append(wal, WAL_ENTRY, atomic_load(&next_index), 1, payload, sizeof(payload)));
+    if (wal_current_segment(wal) != seq) torn_offset = 0;
+    char path[320];
+    wal_segment_path(wal, wal_current_segment(wal), path, sizeof(path));
+    wal_close(wal);
+    
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    uint8_t garbage = 0xFF;
+    if (fd >= 0) {
+        pwrite(fd, &garbage, 1, (off_t)(torn_offset + sizeof(WalHeader) + 10));
+        close(fd);
+    }
+    
+    uint64_t after_tear = 0;
+    wal = wal_open(dir, NULL, wal_count_record, &after_tear);
+    printf("            recuperación: %lu/%lu registros en %.1f ms | tras romper el último: "
+           "%lu (%s)\n", replayed, appends, replay_ms, after_tear,
+           after_tear == replayed ? "descartado" : "ERROR");
+    wal_close(wal);
+    wal_remove_dir(dir);
+}
+
+// ========================================
+// SINCRONIZACIÓN DISTRIBUIDA AVANZADA
+// ========================================
+
+// Consenso Raft. Elección con timeouts aleatorios, AppendEntries por lotes
+// con varios lotes en vuelo por seguidor, y commit por mayoría. Cada nodo
+// abre una conexión de salida por par y manda por ella todo (peticiones y
+// respuestas); lo que recibe llega por las conexiones entrantes. Así el
+// orden de TCP conserva el orden en que se numeraron los lotes.
+//
+// Con WAL (raft_open_wal) el log, el término y el voto sobreviven a un
+// reinicio. Una entrada cuenta para la mayoría solo cuando está en disco:
+// el líder usa su índice durable como su propio match y los seguidores
+// retrasan la respuesta hasta el fdatasync del grupo en que cayó el lote,
+// confirmando de una vez todos los lotes que cubre. Cada
+// RAFT_COMPACT_ENTRIES entradas aplicadas se guarda una instantánea de la
+// máquina de estados y se descarta el log que ya cubre.
+
+#define RAFT_BASE_PORT        9400      // Puerto = RAFT_BASE_PORT + node_id
+#define RAFT_MAX_PEERS        8
+#define RAFT_ELECTION_MIN_MS  150
+#define RAFT_ELECTION_MAX_MS  300
+#define RAFT_HEARTBEAT_MS     40
+#define RAFT_TICK_MS          10
+#define RAFT_MAX_BATCH        512       // Entradas por AppendEntries
+#define RAFT_MAX_INFLIGHT     8         // Lotes sin confirmar por seguidor
+#define RAFT_MAX_PAYLOAD      (1024 * 1024)
+#define RAFT_NO_VOTE          ((node_id_t)-1)
+#define RAFT_COMPACT_ENTRIES  65536     // Entradas aplicadas entre instantáneas
+
+typedef enum {
+    RAFT_REQUEST_VOTE = 1,
+    RAFT_VOTE_REPLY,
+    RAFT_APPEND,
+    RAFT_APPEND_REPLY
+} RaftMessageType;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t success;             // Voto concedido / lote aceptado
+    node_id_t from;
+    uint64_t term;
+    uint64_t index;              // Petición: anterior al lote o último del log
+                                 // Respuesta: último aceptado o pista del seguidor
+    uint64_t index_term;         // Término de 'index' (peticiones)
+    uint64_t commit;             // Commit del líder
+    uint32_t count;              // Entradas tras la cabecera
+                                 // (respuestas: lotes que confirma)
+    uint32_t size;               // Bytes tras la cabecera
+} RaftMessage;
+
+// En la red cada entrada va como término, longitud y comando
+typedef struct __attribute__((packed)) {
+    uint64_t term;
+    uint32_t length;
+} RaftWireEntry;
+
+typedef struct {
+    uint64_t index;
+    uint64_t term;
+    void* command;
+    size_t command_size;
+} RaftEntry;
+
+typedef struct {
+    node_id_t node_id;
+    char host[46];
+    int fd;                      // Conexión de salida (-1 = sin conectar)
+    pthread_mutex_t send_lock;   // Se toma antes de soltar el lock del nodo
+    
+    // Solo en el líder
+    uint64_t next_index;         // Siguiente entrada a mandar
+    uint64_t match_index;        // Última confirmada
+    int inflight;                // Lotes mandados sin respuesta
+    uint64_t last_send_ms;
+    uint64_t last_reply_ms;
+    uint64_t last_connect_ms;
+} RaftPeer;
+
+typedef struct ConsensusState {
+    node_id_t node_id;
+    node_id_t leader_id;
+    uint64_t current_term;
+    
+    enum { FOLLOWER, CANDIDATE, LEADER } state;
+    
+    // Log de operaciones: log[0] es la entrada log_base + 1
+    RaftEntry* log;
+    size_t log_size;
+    size_t log_capacity;
+    uint64_t log_base;
+    uint64_t log_base_term;
+    
+    // Máquina de estados
+    uint64_t commit_index;
+    uint64_t last_applied;
+    void (*apply)(struct ConsensusState*, const RaftEntry*);
+    void* apply_ctx;
+    
+    // Instantáneas de la máquina de estados (con WAL)
+    size_t (*snapshot)(struct ConsensusState*, void** data);
+    void (*restore)(struct ConsensusState*, const void* data, size_t size);
+    
+    // Votación
+    node_id_t voted_for;
+    uint64_t votes_received;
+    uint64_t election_deadline_ms;
+    unsigned int seed;
+    
+    RaftPeer peers[RAFT_MAX_PEERS];
+    int peer_count;
+    
+    // Transporte
+    int listen_fd;
+    int inbound_fds[RAFT_MAX_PEERS * 2];
+    pthread_t inbound_threads[RAFT_MAX_PEERS * 2];
+    int inbound_count;
+    pthread_t accept_thread;
+    pthread_t tick_thread;
+    _Atomic int running;
+    
+    // Persistencia (NULL = solo en memoria)
+    Wal* wal;
+    uint64_t durable_index;      // Última entrada del log en disco
+    uint64_t snapshot_index;     // Última instantánea guardada
+    uint64_t truncate_lsn;       // Hasta que este LSN esté en disco, el WAL
+                                 // aún cuenta entradas ya truncadas
+    pthread_t durable_thread;
+    
+    // Seguidor: respuesta a los lotes que esperan su fdatasync
+    struct {
+        node_id_t leader;
+        uint64_t term;
+        uint64_t index;          // Último índice aceptado
+        uint32_t batches;        // Lotes que confirma (0 = nada pendiente)
+    } pending_ack;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t commit_cond;
+    
+    // Estadísticas
+    uint64_t elections;
+    uint64_t appends_sent;
+    uint64_t entries_sent;
+    int max_inflight;
+    uint64_t snapshots;
+    uint64_t compacted;          // Entradas descartadas del log en memoria
+} ConsensusState;
+
+static ConsensusState* consensus = NULL;
+
+static inline uint64_t raft_now_ms(void) {
+    return get_timestamp_ns() / 1000000ULL;
+}
+
+// ---------- Log ----------
+
+static inline uint64_t raft_last_index(ConsensusState* cs) {
+    return cs->log_base + cs->log_size;
+}
+
+static inline RaftEntry* raft_entry(ConsensusState* cs, uint64_t index) {
+    return &cs->log[index - cs->log_base - 1];
+}
+
+// Término de una entrada (0 = fuera del log)
+static uint64_t raft_term_at(ConsensusState* cs, uint64_t index) {
+    if (index == cs->log_base) return cs->log_base_term;
+    if (index < cs->log_base || index > raft_last_index(cs)) return 0;
+    return raft_entry(cs, index)->term;
+}
+
+static int raft_log_append(ConsensusState* cs, uint64_t term, const void* command, size_t size) {
+    if (cs->log_size == cs->log_capacity) {
+        size_t capacity = cs->log_capacity ? cs->log_capacity * 2 : 1024;
+        RaftEntry* log = realloc(cs->log, capacity * sizeof(RaftEntry));
+        if (!log) return -1;
+        cs->log = log;
+        cs->log_capacity = capacity;
+    }
+    
+    RaftEntry* e = &cs->log[cs->log_size];
+    e->command = NULL;
+    if (size > 0) {
+        e->command = malloc(size);
+        if (!e->command) return -1;
+        memcpy(e->command, command, size);
+    }
+    e->index = raft_last_index(cs) + 1;
+    e->term = term;
+    e->command_size = size;
+    
+    if (cs->wal && wal_append(cs->wal, WAL_ENTRY, e->index, term, command, size) == 0) {
+        free(e->command);
+        return -1;
+    }
+    cs->log_size++;
+    return 0;
+}
+
+// Liberar las entradas desde 'index' hasta el final
+static void raft_log_drop(ConsensusState* cs, uint64_t index) {
+    while (raft_last_index(cs) >= index && cs->log_size > 0) {
+        free(cs->log[cs->log_size - 1].command);
+        cs->log_size--;
+    }
+}
+
+// Descartar desde 'index' hasta el final (conflicto con el líder)
+static void raft_log_truncate(ConsensusState* cs, uint64_t index) {
+    if (index > raft_last_index(cs)) return;
+    
+    raft_log_drop(cs, index);
+    if (cs->wal) {
+        cs->truncate_lsn = wal_append(cs->wal, WAL_TRUNCATE, index, 0, NULL, 0);
+        if (cs->durable_index >= index) cs->durable_index = index - 1;
+    }
+}
+
+// Descartar del log en memoria lo cubierto por una instantánea (hasta 'index')
+static void raft_log_compact(ConsensusState* cs, uint64_t index) {
+    if (index <= cs->log_base) return;
+    
+    uint64_t term = raft_term_at(cs, index);
+    size_t count = (size_t)(index - cs->log_base);
+    for (size_t i = 0; i < count; i++) free(cs->log[i].command);
+    memmove(cs->log, cs->log + count, (cs->log_size - count) * sizeof(RaftEntry));
+    cs->log_size -= count;
+    cs->log_base = index;
+    cs->log_base_term = term;
+    cs->compacted += count;
+}
+
+// Aplicar lo comprometido y despertar a quien espera
+static void raft_apply_committed(ConsensusState* cs) {
+    while (cs->last_applied < cs->commit_index) {
+        cs->last_applied++;
+        if (cs->apply) cs->apply(cs, raft_entry(cs, cs->last_applied));
+    }
+    pthread_cond_broadcast(&cs->commit_cond);
+}
+
+// ---------- Estado ----------
+
+static void raft_reset_election_timer(ConsensusState* cs) {
+    cs->election_deadline_ms = raft_now_ms() + RAFT_ELECTION_MIN_MS +
+        rand_r(&cs->seed) % (RAFT_ELECTION_MAX_MS - RAFT_ELECTION_MIN_MS);
+}
+
+// Término y voto en disco antes de que salga un mensaje que dependa de ellos
+static void raft_persist_meta(ConsensusState* cs) {
+    if (!cs->wal) return;
+    
+    uint64_t lsn = wal_append(cs->wal, WAL_META, cs->voted_for, cs->current_term, NULL, 0);
+    if (lsn == 0 || wal_sync(cs->wal, lsn) < 0) {
+        fprintf(stderr, "[RAFT] Nodo %lu: no se pudo guardar el término %lu\n",
+                cs->node_id, cs->current_term);
+    }
+}
+
+static void raft_step_down(ConsensusState* cs, uint64_t term) {
+    if (term > cs->current_term) {
+        cs->current_term = term;
+        cs->voted_for = RAFT_NO_VOTE;
+        raft_persist_meta(cs);
+    }
+    if (cs->state != FOLLOWER) raft_reset_election_timer(cs);
+    cs->state = FOLLOWER;
+}
+
+static RaftPeer* raft_find_peer(ConsensusState* cs, node_id_t node_id) {
+    for (int i = 0; i < cs->peer_count; i++) {
+        if (cs->peers[i].node_id == node_id) return &cs->peers[i];
+    }
+    return NULL;
+}
+
+// Mayor índice replicado en una mayoría (con WAL, en disco); solo cuenta si
+// es del término actual (las entradas anteriores se comprometen con él)
+static void raft_advance_commit(ConsensusState* cs) {
+    uint64_t match[RAFT_MAX_PEERS + 1];
+    int n = 0;
+    match[n++] = cs->wal ? cs->durable_index : raft_last_index(cs);
+    for (int i = 0; i < cs->peer_count; i++) match[n++] = cs->peers[i].match_index;
+    qsort(match, (size_t)n, sizeof(uint64_t), compare_u64);
+    
+    uint64_t majority = match[(n - 1) / 2];
+    if (majority > cs->commit_index && raft_term_at(cs, majority) == cs->current_term) {
+        cs->commit_index = majority;
+        raft_apply_committed(cs);
+    }
+}
+
+// ---------- Transporte ----------
+
+// Requiere send_lock del par
+static int raft_connect_peer(RaftPeer* p) {
+    if (p->fd >= 0) return 0;
+    
+    // No reintentar en cada mensaje contra un nodo caído
+    uint64_t now = raft_now_ms();
+    if (now - p->last_connect_ms < RAFT_HEARTBEAT_MS) return -1;
+    p->last_connect_ms = now;
+    
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(RAFT_BASE_PORT + p->node_id)
+    };
+    inet_pton(AF_INET, p->host, &addr.sin_addr);
+    
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    p->fd = fd;
+    return 0;
+}
+
+static int raft_write(RaftPeer* p, const void* buf, size_t len) {
+    const uint8_t* ptr = buf;
+    while (len > 0) {
+        ssize_t n = send(p->fd, ptr, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close(p->fd);
+            p->fd = -1;
+            return -1;
+        }
+        ptr += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Mandar a un par. Se entra con cs->lock y se sale sin él: el send_lock se
+// toma antes de soltarlo para que los lotes salgan en el orden numerado.
+static void raft_send_unlock(ConsensusState* cs, RaftPeer* p, RaftMessage* msg,
+                             const void* payload) {
+    pthread_mutex_lock(&p->send_lock);
+    pthread_mutex_unlock(&cs->lock);
+    
+    if (atomic_load(&cs->running) && raft_connect_peer(p) == 0 &&
+        raft_write(p, msg, sizeof(*msg)) == 0 && msg->size > 0) {
+        raft_write(p, payload, msg->size);
+    }
+    
+    pthread_mutex_unlock(&p->send_lock);
+}
+
+// Mandar el siguiente lote a un seguidor (o un heartbeat vacío). Se avanza
+// next_index sin esperar la respuesta: hasta RAFT_MAX_INFLIGHT lotes en
+// vuelo. Requiere cs->lock y lo suelta.
+static void raft_send_append(ConsensusState* cs, RaftPeer* p, bool heartbeat) {
+    uint64_t last = raft_last_index(cs);
+    if (cs->state != LEADER || p->inflight >= RAFT_MAX_INFLIGHT ||
+        (p->next_index > last && !heartbeat) || p->next_index <= cs->log_base) {
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    
+    uint64_t prev = p->next_index - 1;
+    uint32_t count = 0;
+    size_t size = 0;
+    while (prev + count < last && count < RAFT_MAX_BATCH) {
+        size_t entry = sizeof(RaftWireEntry) + raft_entry(cs, prev + count + 1)->command_size;
+        if (count > 0 && size + entry > RAFT_MAX_PAYLOAD) break;
+        size += entry;
+        count++;
+    }
+    
+    uint8_t* payload = size ? malloc(size) : NULL;
+    if (size && !payload) {
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    uint8_t* out = payload;
+    for (uint32_t i = 1; i <= count; i++) {
+        RaftEntry* e = raft_entry(cs, prev + i);
+        RaftWireEntry wire = { .term = e->term, .length = (uint32_t)e->command_size };
+        memcpy(out, &wire, sizeof(wire));
+        if (e->command_size > 0) {   // La entrada no-op del líder no tiene comando
+            memcpy(out + sizeof(wire), e->command, e->command_size);
+        }
+        out += sizeof(wire) + e->command_size;
+    }
+    
+    RaftMessage msg = {
+        .type = RAFT_APPEND,
+        .from = cs->node_id,
+        .term = cs->current_term,
+        .index = prev,
+        .index_term = raft_term_at(cs, prev),
+        .commit = cs->commit_index,
+        .count = count,
+        .size = (uint32_t)size
+    };
+    
+    p->next_index = prev + count + 1;
+    p->inflight++;
+    p->last_send_ms = raft_now_ms();
+    if (p->inflight > cs->max_inflight) cs->max_inflight = p->inflight;
+    cs->appends_sent++;
+    cs->entries_sent += count;
+    
+    raft_send_unlock(cs, p, &msg, payload);
+    free(payload);
+}
+
+// Llenar la ventana de cada seguidor. Requiere cs->lock y lo suelta.
+static void raft_replicate(ConsensusState* cs) {
+    for (int i = 0; i < cs->peer_count; i++) {
+        if (cs->state != LEADER) break;
+        raft_send_append(cs, &cs->peers[i], false);
+        pthread_mutex_lock(&cs->lock);
+    }
+    pthread_mutex_unlock(&cs->lock);
+}
+
+static void raft_become_leader(ConsensusState* cs) {
+    cs->state = LEADER;
+    cs->leader_id = cs->node_id;
+    
+    uint64_t now = raft_now_ms();
+    for (int i = 0; i < cs->peer_count; i++) {
+        RaftPeer* p = &cs->peers[i];
+        p->next_index = raft_last_index(cs) + 1;
+        p->match_index = 0;
+        p->inflight = 0;
+        p->last_reply_ms = now;
+        p->last_send_ms = 0;
+    }
+    
+    // Entrada vacía del término nuevo: compromete lo que quedó de antes
+    raft_log_append(cs, cs->current_term, NULL, 0);
+    if (cs->peer_count == 0) raft_advance_commit(cs);
+    
+    printf("[RAFT] Nodo %lu es líder (término %lu)\n", cs->node_id, cs->current_term);
+}
+
+// ---------- Mensajes ----------
+
+// Requiere cs->lock y lo suelta
+static void raft_handle_vote_request(ConsensusState* cs, RaftMessage* req) {
+    if (req->term > cs->current_term) {
+        raft_step_down(cs, req->term);
+        cs->leader_id = RAFT_NO_VOTE;
+    }
+    
+    // Solo a un candidato con el log al menos tan al día
+    uint64_t last_term = raft_term_at(cs, raft_last_index(cs));
+    bool up_to_date = req->index_term > last_term ||
+                      (req->index_term == last_term && req->index >= raft_last_index(cs));
+    bool grant = req->term == cs->current_term && up_to_date &&
+                 (cs->voted_for == RAFT_NO_VOTE || cs->voted_for == req->from);
+    if (grant) {
+        cs->voted_for = req->from;
+        raft_persist_meta(cs);
+        raft_reset_election_timer(cs);
+    }
+    
+    RaftPeer* p = raft_find_peer(cs, req->from);
+    if (!p) {
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    RaftMessage reply = {
+        .type = RAFT_VOTE_REPLY,
+        .success = grant,
+        .from = cs->node_id,
+        .term = cs->current_term
+    };
+    raft_send_unlock(cs, p, &reply, NULL);
+}
+
+static void raft_handle_vote_reply(ConsensusState* cs, RaftMessage* reply) {
+    if (reply->term > cs->current_term) {
+        raft_step_down(cs, reply->term);
+    } else if (cs->state == CANDIDATE && reply->term == cs->current_term && reply->success) {
+        cs->votes_received++;
+        if (cs->votes_received * 2 > (uint64_t)cs->peer_count + 1) {
+            raft_become_leader(cs);
+            raft_replicate(cs);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&cs->lock);
+}
+
+// Pista para el líder tras un rechazo: antes del primer índice del término
+// en conflicto, sin bajar de lo comprometido
+static uint64_t raft_conflict_hint(ConsensusState* cs, uint64_t index) {
+    if (index > raft_last_index(cs)) return raft_last_index(cs);
+    
+    uint64_t term = raft_term_at(cs, index);
+    while (index > cs->commit_index && index > cs->log_base && raft_term_at(cs, index) == term) {
+        index--;
+    }
+    return index;
+}
+
+static void raft_handle_append(ConsensusState* cs, RaftMessage* req, const uint8_t* payload) {
+    RaftMessage reply = {
+        .type = RAFT_APPEND_REPLY,
+        .from = cs->node_id,
+        .count = 1
+    };
+    
+    if (req->term >= cs->current_term) {
+        raft_step_down(cs, req->term);
+        cs->leader_id = req->from;
+        raft_reset_election_timer(cs);
+        
+        if (req->index > raft_last_index(cs) ||
+            (req->index > cs->log_base && raft_term_at(cs, req->index) != req->index_term)) {
+            reply.index = raft_conflict_hint(cs, req->index);
+        } else {
+            // Entradas ya presentes con el mismo término se saltan: los
+            // lotes pueden llegar repetidos tras un reenvío
+            uint64_t index = req->index;
+            const uint8_t* in = payload;
+            const uint8_t* end = payload + req->size;
+            bool ok = true;
+            for (uint32_t i = 0; i < req->count && ok; i++) {
+                RaftWireEntry wire;
+                if ((size_t)(end - in) < sizeof(wire)) { ok = false; break; }
+                memcpy(&wire, in, sizeof(wire));
+                in += sizeof(wire);
+                if ((size_t)(end - in) < wire.length) { ok = false; break; }
+                
+                index++;
+                if (index > cs->log_base) {
+                    if (index <= raft_last_index(cs) && raft_term_at(cs, index) != wire.term) {
+                        raft_log_truncate(cs, index);
+                    }
+                    if (index > raft_last_index(cs)) {
+                        ok = raft_log_append(cs, wire.term, in, wire.length) == 0;
+                    }
+                }
+                in += wire.length;
+            }
+            
+            if (ok) {
+                reply.success = 1;
+                reply.index = index;
+                uint64_t commit = req->commit < index ? req->commit : index;
+                if (commit > cs->commit_index) {
+                    cs->commit_index = commit;
+                    raft_apply_committed(cs);
+                }
+                
+                // Aún no está en disco: responde el hilo durable tras el
+                // fdatasync, junto con los lotes que lleguen mientras tanto
+                if (cs->wal && (index > cs->durable_index || cs->pending_ack.batches > 0)) {
+                    if (cs->pending_ack.leader != req->from || cs->pending_ack.term != cs->current_term) {
+                        cs->pending_ack.batches = 0;
+                    }
+                    cs->pending_ack.leader = req->from;
+                    cs->pending_ack.term = cs->current_term;
+                    if (cs->pending_ack.batches == 0 || index > cs->pending_ack.index) {
+                        cs->pending_ack.index = index;
+                    }
+                    cs->pending_ack.batches++;
+                    pthread_mutex_unlock(&cs->lock);
+                    return;
+                }
+            } else {
+                reply.index = raft_last_index(cs);
+            }
+        }
+    } else {
+        reply.index = raft_last_index(cs);
+    }
+    reply.term = cs->current_term;
+    
+    RaftPeer* p = raft_find_peer(cs, req->from);
+    if (!p) {
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    raft_send_unlock(cs, p, &reply, NULL);
+}
+
+static void raft_handle_append_reply(ConsensusState* cs, RaftMessage* reply) {
+    if (reply->term > cs->current_term) {
+        raft_step_down(cs, reply->term);
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    
+    RaftPeer* p = raft_find_peer(cs, reply->from);
+    if (cs->state != LEADER || reply->term < cs->current_term || !p) {
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    
+    p->last_reply_ms = raft_now_ms();
+    int acked = reply->count ? (int)reply->count : 1;
+    p->inflight = p->inflight > acked ? p->inflight - acked : 0;
+    
+    if (reply->success) {
+        if (reply->index > p->match_index) p->match_index = reply->index;
+        if (p->next_index <= p->match_index) p->next_index = p->match_index + 1;
+        raft_advance_commit(cs);
+    } else {
+        // Hueco o conflicto: vaciar la ventana y seguir desde la pista
+        uint64_t next = reply->index + 1;
+        if (next <= p->match_index) next = p->match_index + 1;
+        if (next < p->next_index) {
+            p->next_index = next;
+            p->inflight = 0;
+        }
+    }
+    
+    raft_send_append(cs, p, false);
+}
+
+typedef struct {
+    ConsensusState* cs;
+    int fd;
+} RaftConnection;
+
+static void* raft_recv_thread(void* arg) {
+    RaftConnection* conn = (RaftConnection*)arg;
+    ConsensusState* cs = conn->cs;
+    int fd = conn->fd;
+    free(conn);
+    
+    RaftMessage msg;
+    while (atomic_load(&cs->running) && dsm_recv_exact(fd, &msg, sizeof(msg)) == 0) {
+        if (msg.size > RAFT_MAX_PAYLOAD) break;
+        
+        uint8_t* payload = NULL;
+        if (msg.size > 0) {
+            payload = malloc(msg.size);
+            if (!payload || dsm_recv_exact(fd, payload, msg.size) < 0) {
+                free(payload);
+                break;
+            }
+        }
+        
+        pthread_mutex_lock(&cs->lock);
+        switch (msg.type) {
+            case RAFT_REQUEST_VOTE: raft_handle_vote_request(cs, &msg); break;
+            case RAFT_VOTE_REPLY:   raft_handle_vote_reply(cs, &msg); break;
+            case RAFT_APPEND:       raft_handle_append(cs, &msg, payload); break;
+            case RAFT_APPEND_REPLY: raft_handle_append_reply(cs, &msg); break;
+            default:                pthread_mutex_unlock(&cs->lock); break;
+        }
+        free(payload);
+    }
+    
+    return NULL;
+}
+
+static void* raft_accept_thread(void* arg) {
+    ConsensusState* cs = (ConsensusState*)arg;
+    
+    while (atomic_load(&cs->running)) {
+        struct pollfd pfd = { .fd = cs->listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        
+        int fd = accept(cs->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        RaftConnection* conn = malloc(sizeof(RaftConnection));
+        int slot = cs->inbound_count;
+        if (!conn || slot >= RAFT_MAX_PEERS * 2) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->cs = cs;
+        conn->fd = fd;
+        if (pthread_create(&cs->inbound_threads[slot], NULL, raft_recv_thread, conn) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        cs->inbound_fds[slot] = fd;
+        cs->inbound_count++;
+    }
+    
+    return NULL;
+}
+
+// Timeouts de elección en seguidores y candidatos; heartbeats y
+// recuperación de ventanas atascadas en el líder
+static void* raft_tick_thread(void* arg) {
+    ConsensusState* cs = (ConsensusState*)arg;
+    
+    while (atomic_load(&cs->running)) {
+        usleep(RAFT_TICK_MS * 1000);
+        
+        pthread_mutex_lock(&cs->lock);
+        uint64_t now = raft_now_ms();
+        
+        if (cs->state == LEADER) {
+            for (int i = 0; i < cs->peer_count && cs->state == LEADER; i++) {
+                RaftPeer* p = &cs->peers[i];
+                // Respuestas perdidas (conexión caída): reenviar desde lo confirmado
+                if (p->inflight > 0 && now - p->last_reply_ms > RAFT_ELECTION_MIN_MS) {
+                    p->inflight = 0;
+                    p->next_index = p->match_index + 1;
+                    p->last_reply_ms = now;
+                }
+                if (now - p->last_send_ms >= RAFT_HEARTBEAT_MS) {
+                    raft_send_append(cs, p, true);
+                    pthread_mutex_lock(&cs->lock);
+                }
+            }
+        } else if (now >= cs->election_deadline_ms) {
+            cs->state = CANDIDATE;
+            cs->current_term++;
+            cs->voted_for = cs->node_id;
+            cs->votes_received = 1;
+            cs->leader_id = RAFT_NO_VOTE;
+            cs->elections++;
+            raft_persist_meta(cs);
+            raft_reset_election_timer(cs);
+            
+            if (cs->peer_count == 0) {
+                raft_become_leader(cs);
+            } else {
+                RaftMessage req = {
+                    .type = RAFT_REQUEST_VOTE,
+                    .from = cs->node_id,
+                    .term = cs->current_term,
+                    .index = raft_last_index(cs),
+                    .index_term = raft_term_at(cs, raft_last_index(cs))
+                };
+                uint64_t term = cs->current_term;
+                for (int i = 0; i < cs->peer_count; i++) {
+                    if (cs->state != CANDIDATE || cs->current_term != term) break;
+                    raft_send_unlock(cs, &cs->peers[i], &req, NULL);
+                    pthread_mutex_lock(&cs->lock);
+                }
+            }
+        }
+        
+        pthread_mutex_unlock(&cs->lock);
+    }
+    
+    return NULL;
 }
 
-// Algoritmo de scheduling con machine learning básico
-node_id_t intelligent_task_assignment(Task64* task, Node64* nodes, int node_count) {
-    if (!task || !nodes || node_count == 0) return -1;
-    
-    double best_score = -1.0;
-    node_id_t best_node = -1;
-    
-    // Usar timestamp actual para predicción
-    uint64_t current_time = get_timestamp_ns();
+// Con WAL: tras cada fdatasync avanzar el match propio del líder, mandar
+// la respuesta diferida de los seguidores y, si toca, compactar
+static void raft_take_snapshot(ConsensusState* cs);
+
+static void* raft_durable_thread(void* arg) {
+    ConsensusState* cs = (ConsensusState*)arg;
+    uint64_t lsn = 0;
     
-    for (int i = 0; i < node_count; i++) {
-        Node64* node = &nodes[i];
-        
-        if (atomic_load(&node->status) == 0) continue;  // Nodo offline
-        
-        // Calcular score con múltiples factores
-        double cpu_score = 1.0 - (node->cpu_load / 100.0);
-        double mem_score = 1.0 - (node->memory_usage / 100.0);
-        double rep_score = node->reputation_score;
-        double task_score = 1.0 / (1.0 + atomic_load(&node->active_tasks));
+    while (atomic_load(&cs->running)) {
+        uint64_t durable = wal_wait_flush(cs->wal, &lsn, RAFT_TICK_MS);
         
-        // Considerar ancho de banda para tareas con muchos datos
-        double bw_score = 1.0;
-        if (task->data_size > 1024 * 1024) {  // Más de 1MB
-            bw_score = node->network_bandwidth_mbps / 1000.0;  // Normalizar a Gbps
+        pthread_mutex_lock(&cs->lock);
+        if (lsn >= cs->truncate_lsn) {
+            cs->durable_index = durable < raft_last_index(cs) ? durable : raft_last_index(cs);
         }
+        if (cs->state == LEADER) raft_advance_commit(cs);
         
-        // Score ponderado con pesos adaptativos
-        double score = (cpu_score * 0.3) + 
-                      (mem_score * 0.25) + 
-                      (rep_score * 0.2) + 
-                      (task_score * 0.15) + 
-                      (bw_score * 0.1);
-        
-        // Bonus por afinidad (si el nodo ya procesó tareas similares)
-        if (atomic_load(&node->total_tasks_completed) > 0) {
-            score *= 1.1;
+        if (cs->pending_ack.batches > 0 && cs->durable_index >= cs->pending_ack.index) {
+            RaftMessage reply = {
+                .type = RAFT_APPEND_REPLY,
+                .success = 1,
+                .from = cs->node_id,
+                .term = cs->pending_ack.term,
+                .index = cs->pending_ack.index,
+                .count = cs->pending_ack.batches
+            };
+            cs->pending_ack.batches = 0;
+            RaftPeer* p = raft_find_peer(cs, cs->pending_ack.leader);
+            if (p) {
+                raft_send_unlock(cs, p, &reply, NULL);
+                pthread_mutex_lock(&cs->lock);
+            }
         }
         
-        if (score > best_score) {
-            best_score = score;
-            best_node = node->node_id;
+        if (cs->snapshot && cs->last_applied - cs->snapshot_index >= RAFT_COMPACT_ENTRIES) {
+            raft_take_snapshot(cs);
         }
+        pthread_mutex_unlock(&cs->lock);
     }
     
-    if (best_node != -1) {
-        printf("[SCHEDULER] Tarea %lu asignada a nodo %lu (score: %.3f)\n", 
-               task->task_id, best_node, best_score);
+    return NULL;
+}
+
+// ---------- Persistencia ----------
+
+// Instantánea de lo aplicado. Requiere cs->lock; lo suelta mientras escribe.
+static void raft_take_snapshot(ConsensusState* cs) {
+    void* data = NULL;
+    size_t size = cs->snapshot(cs, &data);
+    WalSnapshot snap = {
+        .last_index = cs->last_applied,
+        .last_term = raft_term_at(cs, cs->last_applied),
+        .current_term = cs->current_term,
+        .voted_for = cs->voted_for,
+        .data = data,
+        .size = size
+    };
+    
+    // Sin InstallSnapshot: lo que aún necesita algún seguidor se queda
+    uint64_t discard = snap.last_index;
+    if (cs->state == LEADER) {
+        for (int i = 0; i < cs->peer_count; i++) {
+            if (cs->peers[i].match_index < discard) discard = cs->peers[i].match_index;
+        }
     }
+    uint64_t before_seq = wal_current_segment(cs->wal);
+    cs->snapshot_index = snap.last_index;
     
-    return best_node;
+    pthread_mutex_unlock(&cs->lock);
+    int rc = wal_snapshot(cs->wal, &snap, discard, before_seq);
+    free(data);
+    pthread_mutex_lock(&cs->lock);
+    
+    if (rc < 0) {
+        fprintf(stderr, "[RAFT] Nodo %lu: no se pudo guardar la instantánea en %lu\n",
+                cs->node_id, snap.last_index);
+        return;
+    }
+    raft_log_compact(cs, discard);
+    cs->snapshots++;
 }
 
-// ========================================
-// GESTIÓN DE MEMORIA DISTRIBUIDA AVANZADA
-// ========================================
+static void raft_restore_snapshot(void* ctx, const WalSnapshot* snap) {
+    ConsensusState* cs = (ConsensusState*)ctx;
+    
+    raft_log_drop(cs, cs->log_base + 1);
+    cs->log_base = snap->last_index;
+    cs->log_base_term = snap->last_term;
+    cs->commit_index = snap->last_index;
+    cs->last_applied = snap->last_index;
+    cs->snapshot_index = snap->last_index;
+    cs->current_term = snap->current_term;
+    cs->voted_for = (node_id_t)snap->voted_for;
+    if (cs->restore) cs->restore(cs, snap->data, snap->size);
+}
 
-// Crear memoria compartida con mmap para grandes datasets
-SharedMemory64* create_shared_memory_mmap(size_t size, node_id_t owner) {
-    SharedMemory64* mem = (SharedMemory64*)aligned_alloc(CACHE_LINE_SIZE, 
-                                                          sizeof(SharedMemory64));
-    if (!mem) return NULL;
+// Rehacer el log desde el WAL (sin volver a escribirlo: cs->wal aún es NULL)
+static void raft_replay_record(void* ctx, const WalRecord* rec) {
+    ConsensusState* cs = (ConsensusState*)ctx;
     
-    memset(mem, 0, sizeof(SharedMemory64));
+    switch (rec->type) {
+        case WAL_ENTRY:
+            if (rec->index <= cs->log_base || rec->index > raft_last_index(cs) + 1) break;
+            raft_log_truncate(cs, rec->index);
+            raft_log_append(cs, rec->term, rec->data, rec->size);
+            break;
+        case WAL_TRUNCATE:
+            // Las anteriores a la instantánea ya estaban comprometidas
+            if (rec->index > cs->log_base) raft_log_truncate(cs, rec->index);
+            break;
+        case WAL_META:
+            // Un segmento conservado puede traer metadatos más viejos que la instantánea
+            if (rec->term > cs->current_term ||
+                (rec->term == cs->current_term && cs->voted_for == RAFT_NO_VOTE)) {
+                cs->current_term = rec->term;
+                cs->voted_for = (node_id_t)rec->index;
+            }
+            break;
+    }
+}
+
+// ---------- API ----------
+
+ConsensusState* consensus_create(node_id_t node_id) {
+    ConsensusState* cs = (ConsensusState*)calloc(1, sizeof(ConsensusState));
+    if (!cs) return NULL;
     
-    mem->memory_id = atomic_fetch_add(&kernel64->next_memory_id, 1);
-    mem->owner_node = owner;
+    cs->node_id = node_id;
+    cs->state = FOLLOWER;
+    cs->current_term = 0;
+    cs->leader_id = RAFT_NO_VOTE;
+    cs->voted_for = RAFT_NO_VOTE;
+    cs->listen_fd = -1;
+    cs->seed = (unsigned int)(get_timestamp_ns() ^ (node_id * 2654435761u));
+    pthread_mutex_init(&cs->lock, NULL);
+    pthread_cond_init(&cs->commit_cond, NULL);
     
-    // Usar mmap para memoria grande
-    if (size > 1024 * 1024) {  // Más de 1MB
-        mem->mmap_addr = mmap(NULL, size, PROT_READ | PROT_WRITE, 
-                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
-        if (mem->mmap_addr == MAP_FAILED) {
-            // Fallback sin huge pages
-            mem->mmap_addr = mmap(NULL, size, PROT_READ | PROT_WRITE, 
-                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-        }
-        mem->mmap_size = size;
-    } else {
-        mem->mmap_addr = calloc(1, size);
-        mem->mmap_size = size;
-    }
+    return cs;
+}
+
+int raft_add_peer(ConsensusState* cs, node_id_t node_id, const char* host) {
+    if (cs->peer_count >= RAFT_MAX_PEERS) return -1;
     
-    // Inicializar gestión de páginas
-    mem->pages.page_size = 4096;
-    mem->pages.num_pages = (size + 4095) / 4096;
-    mem->pages.page_table = (uint64_t*)calloc(mem->pages.num_pages, sizeof(uint64_t));
-    mem->pages.dirty_bitmap = (_Atomic uint64_t*)calloc((mem->pages.num_pages + 63) / 64, 
-                                                        sizeof(uint64_t));
+    RaftPeer* p = &cs->peers[cs->peer_count++];
+    memset(p, 0, sizeof(*p));
+    p->node_id = node_id;
+    snprintf(p->host, sizeof(p->host), "%s", host);
+    p->fd = -1;
+    pthread_mutex_init(&p->send_lock, NULL);
+    return 0;
+}
+
+// Empezar a escuchar y a contar el timeout de elección
+int raft_start(ConsensusState* cs) {
+    cs->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(cs->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
     
-    atomic_store(&mem->version, 1);
-    atomic_store(&mem->readers, 0);
-    atomic_store(&mem->writers, 0);
-    atomic_store(&mem->lock, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(RAFT_BASE_PORT + cs->node_id),
+        .sin_addr.s_addr = INADDR_ANY
+    };
+    if (bind(cs->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(cs->listen_fd, 16) < 0) {
+        fprintf(stderr, "[RAFT] No se pudo escuchar en el puerto %lu\n",
+                RAFT_BASE_PORT + cs->node_id);
+        close(cs->listen_fd);
+        cs->listen_fd = -1;
+        return -1;
+    }
     
-    printf("[MEMORY] Memoria compartida %lu creada (%zu MB, %zu páginas)\n", 
-           mem->memory_id, size / (1024*1024), mem->pages.num_pages);
+    pthread_mutex_lock(&cs->lock);
+    raft_reset_election_timer(cs);
+    pthread_mutex_unlock(&cs->lock);
     
-    return mem;
+    atomic_store(&cs->running, 1);
+    pthread_create(&cs->accept_thread, NULL, raft_accept_thread, cs);
+    pthread_create(&cs->tick_thread, NULL, raft_tick_thread, cs);
+    if (cs->wal) pthread_create(&cs->durable_thread, NULL, raft_durable_thread, cs);
+    return 0;
 }
 
-// Read-write lock distribuido optimizado
-void acquire_read_lock_64(SharedMemory64* mem) {
-    while (1) {
-        uint32_t writers = atomic_load(&mem->writers);
-        if (writers == 0) {
-            atomic_fetch_add(&mem->readers, 1);
-            
-            // Verificar de nuevo
-            if (atomic_load(&mem->writers) == 0) {
-                break;
-            }
-            
-            atomic_fetch_sub(&mem->readers, 1);
+// Recuperar el término, el voto y el log de un directorio de WAL y seguir
+// escribiendo en él. Antes de raft_start().
+int raft_open_wal(ConsensusState* cs, const char* dir) {
+    pthread_mutex_lock(&cs->lock);
+    Wal* wal = wal_open(dir, raft_restore_snapshot, raft_replay_record, cs);
+    if (wal) {
+        cs->wal = wal;
+        cs->durable_index = raft_last_index(cs);
+    }
+    pthread_mutex_unlock(&cs->lock);
+    
+    return wal ? 0 : -1;
+}
+
+void raft_stop(ConsensusState* cs) {
+    if (!atomic_exchange(&cs->running, 0)) return;
+    
+    pthread_join(cs->accept_thread, NULL);
+    pthread_join(cs->tick_thread, NULL);
+    if (cs->wal) pthread_join(cs->durable_thread, NULL);
+    close(cs->listen_fd);
+    cs->listen_fd = -1;
+    
+    for (int i = 0; i < cs->peer_count; i++) {
+        RaftPeer* p = &cs->peers[i];
+        pthread_mutex_lock(&p->send_lock);
+        if (p->fd >= 0) {
+            close(p->fd);
+            p->fd = -1;
         }
-        
-        // Esperar con backoff exponencial
-        struct timespec ts = {0, 1000};  // 1 microsegundo
-        nanosleep(&ts, NULL);
+        pthread_mutex_unlock(&p->send_lock);
+    }
+    
+    for (int i = 0; i < cs->inbound_count; i++) {
+        shutdown(cs->inbound_fds[i], SHUT_RDWR);
+        pthread_join(cs->inbound_threads[i], NULL);
+        close(cs->inbound_fds[i]);
     }
+    cs->inbound_count = 0;
+    
+    // Nadie más va a comprometer: soltar a quien espera
+    pthread_mutex_lock(&cs->lock);
+    cs->state = FOLLOWER;
+    pthread_cond_broadcast(&cs->commit_cond);
+    pthread_mutex_unlock(&cs->lock);
 }
 
-void release_read_lock_64(SharedMemory64* mem) {
-    atomic_fetch_sub(&mem->readers, 1);
+void consensus_destroy(ConsensusState* cs) {
+    if (!cs) return;
+    
+    raft_stop(cs);
+    wal_close(cs->wal);
+    raft_log_drop(cs, cs->log_base + 1);
+    free(cs->log);
+    for (int i = 0; i < cs->peer_count; i++) {
+        pthread_mutex_destroy(&cs->peers[i].send_lock);
+    }
+    pthread_cond_destroy(&cs->commit_cond);
+    pthread_mutex_destroy(&cs->lock);
+    free(cs);
 }
 
-void acquire_write_lock_64(SharedMemory64* mem) {
-    atomic_fetch_add(&mem->writers, 1);
+// Proponer un comando en el líder. Devuelve su índice y término (0 = este
+// nodo no es líder). Si la ventana de un seguidor está llena el comando
+// sale en su próximo lote, junto con los que se acumulen mientras tanto.
+uint64_t raft_propose(ConsensusState* cs, const void* command, size_t size, uint64_t* term) {
+    pthread_mutex_lock(&cs->lock);
+    if (cs->state != LEADER || raft_log_append(cs, cs->current_term, command, size) < 0) {
+        pthread_mutex_unlock(&cs->lock);
+        return 0;
+    }
     
-    // Esperar a que no haya lectores
-    while (atomic_load(&mem->readers) > 0) {
-        struct timespec ts = {0, 1000};
-        nanosleep(&ts, NULL);
+    uint64_t index = raft_last_index(cs);
+    if (term) *term = cs->current_term;
+    if (cs->peer_count == 0) raft_advance_commit(cs);
+    
+    raft_replicate(cs);
+    return index;
+}
+
+// Esperar a que una entrada propuesta se comprometa (0) o se pierda con un
+// cambio de líder (-1)
+int raft_wait_commit(ConsensusState* cs, uint64_t index, uint64_t term, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
     }
     
-    // Adquirir lock exclusivo con futex
-    while (atomic_exchange(&mem->lock, 1) == 1) {
-        syscall(SYS_futex, &mem->lock, FUTEX_WAIT, 1, NULL, NULL, 0);
+    int rc = -1;
+    pthread_mutex_lock(&cs->lock);
+    while (atomic_load(&cs->running)) {
+        if (raft_term_at(cs, index) != term && index > cs->log_base) break;
+        if (cs->commit_index >= index) {
+            rc = 0;
+            break;
+        }
+        if (pthread_cond_timedwait(&cs->commit_cond, &cs->lock, &deadline) == ETIMEDOUT) break;
     }
+    pthread_mutex_unlock(&cs->lock);
+    return rc;
 }
 
-void release_write_lock_64(SharedMemory64* mem) {
-    atomic_store(&mem->lock, 0);
-    syscall(SYS_futex, &mem->lock, FUTEX_WAKE, 1, NULL, NULL, 0);
-    atomic_fetch_sub(&mem->writers, 1);
+void init_consensus(node_id_t node_id) {
+    consensus = consensus_create(node_id);
+    
+    // Con DOS_WAL_DIR el estado de consenso sobrevive a un reinicio
+    const char* dir = getenv("DOS_WAL_DIR");
+    if (consensus && dir && dir[0]) {
+        char path[256];
+        mkdir(dir, 0700);
+        snprintf(path, sizeof(path), "%s/nodo-%lu", dir, node_id);
+        if (raft_open_wal(consensus, path) < 0) {
+            fprintf(stderr, "[CONSENSUS] No se pudo abrir el WAL en %s\n", path);
+        }
+    }
+    
+    printf("[CONSENSUS] Sistema de consenso inicializado (nodo %lu)\n", node_id);
 }
 
-// ========================================
-// SINCRONIZACIÓN DISTRIBUIDA AVANZADA
-// ========================================
+// ---------- Benchmark ----------
 
-// Consenso distribuido simplificado (similar a Raft)
 typedef struct {
-    node_id_t node_id;
-    node_id_t leader_id;
-    uint64_t current_term;
-    
-    enum { FOLLOWER, CANDIDATE, LEADER } state;
+    ConsensusState* leader;
+    _Atomic int* running;
+    uint64_t commits;
+    LatencyRecorder latency;     // Propuesta → commit
+} RaftClient;
+
+static void* raft_client_thread(void* arg) {
+    RaftClient* c = (RaftClient*)arg;
+    uint64_t command[2] = { (uint64_t)(uintptr_t)c, 0 };
     
-    // Log de operaciones
-    struct {
-        uint64_t index;
-        uint64_t term;
-        void* command;
-        size_t command_size;
-    } *log;
-    size_t log_size;
-    size_t log_capacity;
+    while (atomic_load_explicit(c->running, memory_order_relaxed)) {
+        command[1]++;
+        uint64_t term = 0;
+        uint64_t start = get_timestamp_ns();
+        uint64_t index = raft_propose(c->leader, command, sizeof(command), &term);
+        if (index == 0 || raft_wait_commit(c->leader, index, term, 2000) < 0) break;
+        
+        latency_record(&c->latency, get_timestamp_ns() - start);
+        c->commits++;
+    }
     
-    // Votación
-    node_id_t voted_for;
-    uint64_t votes_received;
+    return NULL;
+}
+
+// Máquina de estados del benchmark: un hash de los comandos en orden
+// aplicado, para comparar réplicas
+typedef struct {
+    uint64_t hash;
+    uint64_t applied;
+} RaftBenchState;
+
+static void raft_bench_apply(ConsensusState* cs, const RaftEntry* e) {
+    RaftBenchState* st = (RaftBenchState*)cs->apply_ctx;
+    st->hash = (st->hash ^ wal_crc32c((uint32_t)e->index, e->command, e->command_size)) *
+               0x100000001B3ULL;
+    st->applied++;
+}
+
+static size_t raft_bench_snapshot(ConsensusState* cs, void** data) {
+    *data = malloc(sizeof(RaftBenchState));
+    if (!*data) return 0;
+    memcpy(*data, cs->apply_ctx, sizeof(RaftBenchState));
+    return sizeof(RaftBenchState);
+}
+
+static void raft_bench_restore(ConsensusState* cs, const void* data, size_t size) {
+    if (size == sizeof(RaftBenchState)) memcpy(cs->apply_ctx, data, size);
+}
+
+// Réplica del benchmark; con wal_dir guarda su log en wal_dir/nodo-N
+static ConsensusState* raft_bench_node(int node, int nodes, RaftBenchState* state,
+                                       const char* wal_dir) {
+    ConsensusState* cs = consensus_create((node_id_t)node);
+    if (!cs) return NULL;
+    for (int j = 1; j <= nodes; j++) {
+        if (j != node) raft_add_peer(cs, (node_id_t)j, "127.0.0.1");
+    }
     
-    pthread_mutex_t lock;
-} ConsensusState;
+    cs->apply = raft_bench_apply;
+    cs->apply_ctx = state;
+    if (wal_dir) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/nodo-%d", wal_dir, node);
+        cs->snapshot = raft_bench_snapshot;
+        cs->restore = raft_bench_restore;
+        if (raft_open_wal(cs, path) < 0) {
+            consensus_destroy(cs);
+            return NULL;
+        }
+    }
+    return cs;
+}
 
-static ConsensusState* consensus = NULL;
+static ConsensusState* raft_find_leader(ConsensusState** cluster, int nodes, int timeout_ms) {
+    uint64_t deadline = raft_now_ms() + (uint64_t)timeout_ms;
+    while (raft_now_ms() < deadline) {
+        for (int i = 0; i < nodes; i++) {
+            if (!cluster[i] || !atomic_load(&cluster[i]->running)) continue;
+            pthread_mutex_lock(&cluster[i]->lock);
+            bool leader = cluster[i]->state == LEADER;
+            pthread_mutex_unlock(&cluster[i]->lock);
+            if (leader) return cluster[i];
+        }
+        usleep(RAFT_TICK_MS * 1000);
+    }
+    return NULL;
+}
 
-void init_consensus(node_id_t node_id) {
-    consensus = (ConsensusState*)calloc(1, sizeof(ConsensusState));
-    consensus->node_id = node_id;
-    consensus->state = FOLLOWER;
-    consensus->current_term = 0;
-    consensus->log_capacity = 10000;
-    consensus->log = calloc(consensus->log_capacity, sizeof(consensus->log[0]));
-    pthread_mutex_init(&consensus->lock, NULL);
+// Clúster local de N réplicas en este proceso (puertos RAFT_BASE_PORT + 1..N):
+// commits/s y latencia de commit con varios clientes contra el líder, y
+// tiempo de reelección tras parar al líder. Con wal_dir cada réplica
+// persiste su log y el líder parado se reinicia desde su WAL.
+void benchmark_raft_cluster(int nodes, int clients, int duration_ms, const char* wal_dir) {
+    if (nodes < 1 || nodes > RAFT_MAX_PEERS + 1) return;
     
-    printf("[CONSENSUS] Sistema de consenso inicializado (nodo %lu)\n", node_id);
+    if (wal_dir) {
+        mkdir(wal_dir, 0700);
+        for (int i = 1; i <= nodes; i++) {
+            char path[256];
+            snprintf(path, sizeof(path), "%s/nodo-%d", wal_dir, i);
+            wal_remove_dir(path);
+        }
+    }
+    
+    ConsensusState* cluster[RAFT_MAX_PEERS + 1] = { 0 };
+    RaftBenchState states[RAFT_MAX_PEERS + 1] = { 0 };
+    for (int i = 0; i < nodes; i++) {
+        cluster[i] = raft_bench_node(i + 1, nodes, &states[i], wal_dir);
+        if (!cluster[i]) goto out;
+    }
+    
+    uint64_t start = raft_now_ms();
+    for (int i = 0; i < nodes; i++) {
+        if (raft_start(cluster[i]) < 0) goto out;
+    }
+    
+    ConsensusState* leader = raft_find_leader(cluster, nodes, 5000);
+    if (!leader) {
+        printf("  %d nodos: no se eligió líder\n", nodes);
+        goto out;
+    }
+    uint64_t election_ms = raft_now_ms() - start;
+    
+    _Atomic int running = 1;
+    RaftClient* workers = calloc((size_t)clients, sizeof(RaftClient));
+    pthread_t* tids = calloc((size_t)clients, sizeof(pthread_t));
+    
+    pthread_mutex_lock(&leader->lock);
+    uint64_t appends_before = leader->appends_sent;
+    uint64_t entries_before = leader->entries_sent;
+    pthread_mutex_unlock(&leader->lock);
+    
+    uint64_t bench_start = get_timestamp_ns();
+    for (int i = 0; i < clients; i++) {
+        workers[i].leader = leader;
+        workers[i].running = &running;
+        latency_init(&workers[i].latency);
+        pthread_create(&tids[i], NULL, raft_client_thread, &workers[i]);
+    }
+    
+    usleep((useconds_t)duration_ms * 1000);
+    atomic_store(&running, 0);
+    
+    uint64_t commits = 0;
+    LatencyRecorder all = { 0 };
+    for (int i = 0; i < clients; i++) {
+        pthread_join(tids[i], NULL);
+        commits += workers[i].commits;
+        latency_merge(&all, &workers[i].latency);
+    }
+    double elapsed_s = (get_timestamp_ns() - bench_start) / 1e9;
+    latency_sort(&all);
+    
+    pthread_mutex_lock(&leader->lock);
+    uint64_t appends = leader->appends_sent - appends_before;
+    uint64_t entries = leader->entries_sent - entries_before;
+    uint64_t commit_index = leader->commit_index;
+    uint64_t commit_term = raft_term_at(leader, commit_index);
+    uint64_t commit_hash = ((RaftBenchState*)leader->apply_ctx)->hash;
+    int max_inflight = leader->max_inflight;
+    pthread_mutex_unlock(&leader->lock);
+    
+    printf("  %d nodos, %2d clientes: %8.0f commits/s | p50 %6.0f us | p99 %7.0f us | "
+           "%5.1f entradas/lote | hasta %d lotes en vuelo\n",
+           nodes, clients, commits / elapsed_s, latency_percentile(&all, 50) / 1e3,
+           latency_percentile(&all, 99) / 1e3,
+           appends ? (double)entries / appends : 0.0, max_inflight);
+    free(all.samples);
+    free(workers);
+    free(tids);
+    
+    // Los seguidores conocen el commit con el siguiente mensaje del líder
+    usleep(2 * RAFT_HEARTBEAT_MS * 1000);
+    int caught_up = 0;
+    uint64_t snapshots = 0, compacted = 0;
+    for (int i = 0; i < nodes; i++) {
+        pthread_mutex_lock(&cluster[i]->lock);
+        // Mismo estado aplicado: mismo hash en el mismo índice
+        if (cluster[i]->last_applied == commit_index &&
+            raft_term_at(cluster[i], commit_index) == commit_term &&
+            states[i].hash == commit_hash) {
+            caught_up++;
+        }
+        snapshots += cluster[i]->snapshots;
+        compacted += cluster[i]->compacted;
+        pthread_mutex_unlock(&cluster[i]->lock);
+    }
+    
+    // Parar al líder y medir cuánto tarda el resto en elegir otro
+    int stopped = (int)leader->node_id;
+    uint64_t stop_ms = raft_now_ms();
+    raft_stop(leader);
+    ConsensusState* next = nodes > 2 ? raft_find_leader(cluster, nodes, 5000) : NULL;
+    
+    printf("           elección inicial %lu ms | %d/%d réplicas con el mismo estado en %lu | ",
+           election_ms, caught_up, nodes, commit_index);
+    if (next) {
+        printf("reelección %lu ms (nodo %lu)\n", raft_now_ms() - stop_ms, next->node_id);
+    } else {
+        printf("sin reelección\n");
+    }
+    
+    if (!wal_dir || !next) goto out;
+    printf("           WAL: %lu instantáneas, %lu entradas compactadas\n", snapshots, compacted);
+    
+    // Reiniciar al líder parado desde su WAL y esperar a que se ponga al día
+    pthread_mutex_lock(&next->lock);
+    uint64_t target = next->commit_index;
+    pthread_mutex_unlock(&next->lock);
+    
+    consensus_destroy(leader);
+    memset(&states[stopped - 1], 0, sizeof(RaftBenchState));
+    uint64_t restart_ns = get_timestamp_ns();
+    cluster[stopped - 1] = raft_bench_node(stopped, nodes, &states[stopped - 1], wal_dir);
+    if (!cluster[stopped - 1]) goto out;
+    ConsensusState* restarted = cluster[stopped - 1];
+    double recovery_ms = (get_timestamp_ns() - restart_ns) / 1e6;
+    
+    pthread_mutex_lock(&restarted->lock);
+    uint64_t recovered = raft_last_index(restarted);
+    uint64_t recovered_base = restarted->log_base;
+    pthread_mutex_unlock(&restarted->lock);
+    
+    raft_start(restarted);
+    uint64_t deadline = raft_now_ms() + 5000;
+    bool synced = false;
+    while (!synced && raft_now_ms() < deadline) {
+        pthread_mutex_lock(&restarted->lock);
+        synced = restarted->last_applied >= target;
+        pthread_mutex_unlock(&restarted->lock);
+        if (!synced) usleep(1000);
+    }
+    printf("           reinicio del nodo %d: %lu entradas recuperadas (instantánea en %lu) "
+           "en %.1f ms | ", stopped, recovered, recovered_base, recovery_ms);
+    if (synced) {
+        printf("al día con el commit %lu en %.1f ms\n", target,
+               (get_timestamp_ns() - restart_ns) / 1e6);
+    } else {
+        printf("no alcanzó el commit %lu\n", target);
+    }
+
+out:
+    for (int i = 0; i < nodes; i++) consensus_destroy(cluster[i]);
 }
 
 // ========================================
@@ -708,6 +5257,11 @@ int init_distributed_kernel_64(node_id_t node_id) {
     printf("[KERNEL] Memoria: %lu GB\n", kernel64->system_info.total_memory / (1024*1024*1024));
     printf("[KERNEL] Tamaño de página: %lu KB\n", kernel64->system_info.page_size / 1024);
     
+    detect_numa_topology();
+    printf("[KERNEL] Nodos NUMA: %d\n", kernel64->system_info.numa_nodes);
+    init_huge_page_pools();
+    init_shared_fd_segments();
+    
     // Inicializar subsistemas
     init_advanced_scheduler();
     init_consensus(node_id);
@@ -751,6 +5305,113 @@ void* example_ml_task(void* data) {
     return NULL;
 }
 
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    if (kernel64) atomic_store(&kernel64->running, 0);
+}
+
+// Modo DSM home: exportar un segmento y servir páginas hasta Ctrl+C
+static int run_dsm_home(size_t size_mb) {
+    SharedMemory64* mem = create_shared_memory_mmap(size_mb * 1024 * 1024, kernel64->node_id);
+    if (!mem) return EXIT_FAILURE;
+    
+    // Contenido inicial reconocible en cada página
+    for (size_t p = 0; p < mem->pages.num_pages; p++) {
+        snprintf((char*)mem->mmap_addr + p * DSM_PAGE_SIZE, 64, "home:pagina %zu", p);
+    }
+    
+    if (dsm_export_segment(mem) < 0) return EXIT_FAILURE;
+    
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    printf("[DSM] Mapear con: kernel_64bit <nodo> dsm-map %lu %lu <pagina> [texto] [espera_s]\n",
+           kernel64->node_id, mem->memory_id);
+    
+    while (atomic_load(&kernel64->running)) {
+        sleep(1);
+    }
+    
+    dsm_stop_home();
+    return EXIT_SUCCESS;
+}
+
+// Modo segmento compartido: exportar un memfd/archivo a los procesos del
+// host y mostrar lo que escriban en él
+static int run_shm_home(size_t size_mb) {
+    // En modo persistente se reutiliza el segmento de la ejecución anterior
+    SharedMemory64* mem = shm_first_export();
+    if (mem) {
+        printf("[SHM] Contenido conservado: \"%.63s\"\n", (char*)mem->mmap_addr);
+    } else {
+        mem = create_shared_memory_fd(size_mb * 1024 * 1024, kernel64->node_id,
+                                      numa_current_node());
+        if (!mem) return EXIT_FAILURE;
+        snprintf((char*)mem->mmap_addr, 64, "home:nodo %lu", kernel64->node_id);
+    }
+    
+    if (shm_export_segment(mem) < 0) return EXIT_FAILURE;
+    
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    printf("[SHM] Adjuntar con: kernel_64bit <nodo> shm-attach %lu %lu [texto]\n",
+           kernel64->node_id, mem->memory_id);
+    
+    char last[64] = "";
+    while (atomic_load(&kernel64->running)) {
+        // Mismas páginas físicas: los cambios de otros procesos se ven sin copia
+        if (strncmp(last, (char*)mem->mmap_addr, sizeof(last) - 1) != 0) {
+            snprintf(last, sizeof(last), "%s", (char*)mem->mmap_addr);
+            printf("[SHM] Segmento %lu: \"%s\"\n", mem->memory_id, last);
+        }
+        usleep(200 * 1000);
+    }
+    
+    shm_stop_fd_server();
+    print_shm_stats();
+    destroy_shared_memory_64(mem);
+    return EXIT_SUCCESS;
+}
+
+// Modo adjuntar: recibir el descriptor de otro proceso y escribir en el segmento
+static int run_shm_attach(node_id_t home, memory_id_t memory_id, const char* text) {
+    SharedMemory64* mem = shm_import_segment(home, memory_id);
+    if (!mem) return EXIT_FAILURE;
+    
+    printf("[SHM] Segmento %lu del nodo %lu: \"%.63s\"\n",
+           memory_id, home, (char*)mem->mmap_addr);
+    if (text) {
+        snprintf((char*)mem->mmap_addr, 64, "%s", text);
+        printf("[SHM] Escrito: \"%s\"\n", text);
+    }
+    
+    destroy_shared_memory_64(mem);
+    return EXIT_SUCCESS;
+}
+
+// Modo DSM cliente: leer una página remota, escribir en ella y releerla
+static int run_dsm_map(node_id_t home, memory_id_t memory_id, size_t page,
+                       const char* text, int wait_s) {
+    DsmMapping* map = dsm_map_remote(home, "127.0.0.1", memory_id);
+    if (!map) return EXIT_FAILURE;
+    if (page >= map->num_pages) page = map->num_pages - 1;
+    
+    char* addr = (char*)map->base + page * DSM_PAGE_SIZE;
+    printf("[DSM] Página %zu: \"%.63s\"\n", page, addr);
+    
+    if (text) {
+        snprintf(addr, 64, "%s", text);
+        printf("[DSM] Escrito en página %zu: \"%s\"\n", page, text);
+    }
+    
+    if (wait_s > 0) {
+        sleep((unsigned int)wait_s);
+        printf("[DSM] Página %zu tras %d s: \"%.63s\"\n", page, wait_s, addr);
+    }
+    
+    dsm_unmap(map);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char* argv[]) {
     node_id_t node_id = 0;
     
@@ -763,6 +5424,50 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
     
+    // Modos DSM (varios procesos en el mismo host, un node_id por proceso)
+    if (argc > 2 && strcmp(argv[2], "dsm-home") == 0) {
+        return run_dsm_home(argc > 3 ? strtoull(argv[3], NULL, 10) : 4);
+    }
+    if (argc > 2 && strcmp(argv[2], "shm-home") == 0) {
+        return run_shm_home(argc > 3 ? strtoull(argv[3], NULL, 10) : 4);
+    }
+    if (argc > 4 && strcmp(argv[2], "shm-attach") == 0) {
+        return run_shm_attach(strtoull(argv[3], NULL, 10), strtoull(argv[4], NULL, 10),
+                              argc > 5 ? argv[5] : NULL);
+    }
+    if (argc > 2 && strcmp(argv[2], "tlb-bench") == 0) {
+        size_t size_mb = argc > 3 ? strtoull(argv[3], NULL, 10) : 1024;
+        printf("=== BENCHMARK DE TLB (%zu MB, acceso aleatorio) ===\n", size_mb);
+        benchmark_tlb_huge_pages(size_mb * 1024 * 1024, 20 * 1000 * 1000);
+        print_huge_page_stats();
+        return EXIT_SUCCESS;
+    }
+    if (argc > 2 && strcmp(argv[2], "raft-bench") == 0) {
+        int clients = argc > 3 ? atoi(argv[3]) : 8;
+        int duration_ms = argc > 4 ? atoi(argv[4]) : 2000;
+        printf("=== BENCHMARK DE RAFT (clúster local, %d clientes) ===\n", clients);
+        const char* wal_dir = argc > 5 ? argv[5] : NULL;
+        if (wal_dir) printf("WAL en %s\n", wal_dir);
+        benchmark_raft_cluster(3, clients, duration_ms, wal_dir);
+        benchmark_raft_cluster(5, clients, duration_ms, wal_dir);
+        return EXIT_SUCCESS;
+    }
+    if (argc > 2 && strcmp(argv[2], "wal-bench") == 0) {
+        const char* dir = argc > 3 ? argv[3] : WAL_DIR_DEFAULT;
+        int duration_ms = argc > 4 ? atoi(argv[4]) : 2000;
+        printf("=== BENCHMARK DEL WAL (%s, appends de 64 bytes) ===\n", dir);
+        int threads[] = { 1, 16, 64, 256 };
+        for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+            benchmark_wal(dir, threads[i], duration_ms);
+        }
+        return EXIT_SUCCESS;
+    }
+    if (argc > 5 && strcmp(argv[2], "dsm-map") == 0) {
+        return run_dsm_map(strtoull(argv[3], NULL, 10), strtoull(argv[4], NULL, 10),
+                           strtoull(argv[5], NULL, 10), argc > 6 ? argv[6] : NULL,
+                           argc > 7 ? atoi(argv[7]) : 0);
+    }
+    
     // Crear nodos de ejemplo
     printf("=== CREANDO NODOS DE EJEMPLO ===\n");
     for (int i = 0; i < 3; i++) {
@@ -819,6 +5524,22 @@ int main(int argc, char* argv[]) {
         release_read_lock_64(mem1);
     }
     
+    // Contención del read-write lock
+    if (mem1) {
+        printf("\n=== BENCHMARK DE CONTENCIÓN RWLOCK ===\n");
+        int thread_counts[] = { 1, 4, 16 };
+        for (int i = 0; i < 3; i++) {
+            benchmark_rwlock_64(mem1, thread_counts[i], 10, 200);
+        }
+        benchmark_rwlock_64(mem1, 16, 50, 200);
+    }
+    
+    // Snapshots copy-on-write
+    if (mem2) {
+        printf("\n=== SNAPSHOTS COPY-ON-WRITE ===\n");
+        benchmark_segment_snapshot(mem2, 64);
+    }
+    
     // Demostración de SIMD
     printf("\n=== DEMOSTRACIÓN DE OPTIMIZACIONES SIMD ===\n");
     size_t vector_size = 10000;
@@ -855,6 +5576,10 @@ int main(int argc, char* argv[]) {
     printf("  Memoria asignada: %lu MB\n", 
            atomic_load(&kernel64->stats.total_memory_allocated) / (1024*1024));
     printf("  Mensajes de red: %lu\n", atomic_load(&kernel64->stats.total_network_messages));
+    print_numa_stats();
+    print_huge_page_stats();
+    print_shm_stats();
+    print_snapshot_stats();
     
     printf("\n[KERNEL] ✅ Sistema operativo descentralizado funcionando correctamente\n");
     printf("[KERNEL] Presiona Ctrl+C para salir...\n");
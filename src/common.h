@@ -7,6 +7,8 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -25,6 +27,7 @@
 #define DISCOVERY_PORT 9999
 #define HEARTBEAT_INTERVAL 5
 #define NODE_TIMEOUT 15
+#define VECTOR_CLOCK_ENTRIES 16  // Entradas de reloj vectorial por mensaje
 
 // ========================================
 // ENUMERACIONES
@@ -51,7 +54,11 @@ typedef enum {
     MSG_SYNC = 3,
     MSG_DISCOVERY = 4,
     MSG_LOCK_REQUEST = 5,
-    MSG_LOCK_RELEASE = 6
+    MSG_LOCK_RELEASE = 6,
+    MSG_LOCK_REPLY = 7,
+    MSG_TOKEN = 8,
+    MSG_BARRIER = 9,
+    MSG_TYPE_COUNT
 } MessageType;
 
 // ========================================
@@ -84,23 +91,42 @@ typedef struct {
     time_t completion_time;
 } Task;
 
-// Memoria compartida
+// Memoria compartida (metadatos compactos: caben en una línea de caché)
 typedef struct {
     int memory_id;
+    int owner_node;
     void* data;
     size_t size;
-    int owner_node;
-    int reference_count;
-    pthread_mutex_t lock;
-    int replicated_nodes[MAX_NODES];
-    int replication_count;
+    _Atomic int reference_count; // Sin lock: la última referencia libera
+    uint16_t replication_count;
+    uint16_t replica_capacity;
+    int* replicated_nodes;       // Fuera de línea, crece bajo demanda
+    uint8_t size_class;          // Clase slab del payload
+    _Atomic uint32_t seq;        // Seqlock: impar mientras hay una escritura
+    uint32_t version;            // Se incrementa en cada escritura
+    uint64_t* dirty_pages;       // Páginas escritas desde el último sync
 } SharedMemory;
 
+// Entrada de un reloj vectorial: eventos de envío vistos de un nodo
+typedef struct {
+    int32_t node_id;
+    uint32_t counter;
+} VectorClockEntry;
+
+// Reloj vectorial compacto: solo los nodos con contador distinto de cero
+typedef struct {
+    uint16_t count;
+    uint16_t truncated;          // No cupieron todas: no sirve para comparar
+    VectorClockEntry entries[VECTOR_CLOCK_ENTRIES];
+} VectorClockStamp;
+
 // Mensaje entre nodos
 typedef struct {
     MessageType type;
     int source_node;
     int dest_node;
+    uint64_t hlc;                // Reloj híbrido del emisor (0 = sin reloj)
+    VectorClockStamp vclock;     // count = 0 si el emisor no lo lleva
     char data[BUFFER_SIZE];
     int data_size;
     time_t timestamp;
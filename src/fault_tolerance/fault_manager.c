@@ -1,6 +1,7 @@
 #include "../common.h"
 #include "../scheduler/scheduler.h"
 #include "../memory/memory_manager.h"
+#include "../sync/sync.h"
 #include "fault_manager.h"
 
 // ========================================
@@ -69,10 +70,10 @@ void handle_node_failure(FaultToleranceManager* ftm, Node* failed_node) {
     if (memory_manager) {
         pthread_mutex_lock(&memory_manager->memory_lock);
         
-        for (int i = 0; i < memory_manager->block_count; i++) {
-            SharedMemory* mem = memory_manager->memory_blocks[i];
+        for (int i = 0; i < memory_table_size(); i++) {
+            SharedMemory* mem = memory_table_slot(i);
             
-            if (mem->owner_node == failed_node->node_id) {
+            if (mem && mem->owner_node == failed_node->node_id) {
                 log_info("   → Memoria %d necesita nueva réplica", mem->memory_id);
                 
                 // Encontrar nodo disponible para réplica
@@ -92,7 +93,10 @@ void handle_node_failure(FaultToleranceManager* ftm, Node* failed_node) {
     // 3. Actualizar reputación del nodo
     failed_node->reputation *= 0.5; // Penalizar
     
-    // 4. Notificar a otros nodos (simulado)
+    // 4. Locks distribuidos: dejar de esperar al nodo y recuperar el token
+    notify_lock_node_failure(failed_node->node_id);
+    
+    // 5. Notificar a otros nodos (simulado)
     log_info("   → Notificando fallo a otros nodos");
     
     log_info("✅ Recuperación completada para nodo %d", failed_node->node_id);
@@ -154,7 +158,25 @@ void create_checkpoint(FaultToleranceManager* ftm, const char* checkpoint_name)
         cp->node_states[i] = ftm->nodes[i];
     }
     
-    log_info("💾 Checkpoint '%s' creado (%d nodos)", checkpoint_name, ftm->node_count);
+    // Memoria: una snapshot copy-on-write por bloque, sin copiar datos ahora
+    cp->memory_snapshots = NULL;
+    cp->memory_count = 0;
+    if (memory_manager) {
+        int slots = memory_table_size();
+        cp->memory_snapshots = (MemorySnapshot**)calloc(slots ? slots : 1,
+                                                        sizeof(MemorySnapshot*));
+        // Los bloques liberados durante el recorrido siguen válidos hasta salir
+        epoch_enter();
+        for (int i = 0; i < slots && cp->memory_snapshots; i++) {
+            SharedMemory* mem = memory_table_slot(i);
+            MemorySnapshot* snap = mem ? snapshot_shared_memory(mem) : NULL;
+            if (snap) cp->memory_snapshots[cp->memory_count++] = snap;
+        }
+        epoch_exit();
+    }
+    
+    log_info("💾 Checkpoint '%s' creado (%d nodos, %d bloques de memoria)",
+             checkpoint_name, ftm->node_count, cp->memory_count);
     
     pthread_mutex_unlock(&ftm->lock);
 }
@@ -174,6 +196,11 @@ int restore_checkpoint(FaultToleranceManager* ftm, const char* checkpoint_name)
                 ftm->nodes[j] = cp->node_states[j];
             }
             
+            // Los bloques liberados desde entonces no se recrean
+            for (int j = 0; j < cp->memory_count; j++) {
+                restore_memory_snapshot(cp->memory_snapshots[j]);
+            }
+            
             pthread_mutex_unlock(&ftm->lock);
             return 0;
         }
@@ -244,6 +271,12 @@ void stop_fault_tolerance(FaultToleranceManager* ftm) {
 void destroy_fault_tolerance_manager(FaultToleranceManager* ftm) {
     if (ftm) {
         stop_fault_tolerance(ftm);
+        for (int i = 0; i < ftm->checkpoint_count; i++) {
+            for (int j = 0; j < ftm->checkpoints[i].memory_count; j++) {
+                release_memory_snapshot(ftm->checkpoints[i].memory_snapshots[j]);
+            }
+            free(ftm->checkpoints[i].memory_snapshots);
+        }
         pthread_mutex_destroy(&ftm->lock);
         free(ftm);
     }
@@ -2,6 +2,7 @@
 #define FAULT_MANAGER_H
 
 #include "../common.h"
+#include "../memory/memory_manager.h"
 
 // ========================================
 // ESTRUCTURAS DE TOLERANCIA A FALLOS
@@ -12,6 +13,8 @@ typedef struct {
     time_t timestamp;
     Node node_states[MAX_NODES];
     int node_count;
+    MemorySnapshot** memory_snapshots;  // Snapshots COW de los bloques vivos
+    int memory_count;
 } Checkpoint;
 
 typedef struct {
@@ -0,0 +1,70 @@
+// main_bench.c - Benchmarks de los módulos del SO Descentralizado
+// Los clústeres de sincronización son nodos locales sobre loopback
+
+#include "common.h"
+#include "memory/memory_manager.h"
+#include "sync/sync.h"
+
+static void usage(const char* prog) {
+    printf("Uso: %s <benchmark> [parámetros]\n", prog);
+    printf("  memory  [bytes] [ms]                Lecturas: seqlock frente a mutex\n");
+    printf("  lookups [ms]                        Búsquedas con liberaciones: lock frente a EBR\n");
+    printf("  mutex   [max_nodos] [ms]            Mutex por permisos y por token\n");
+    printf("  token   [max_nodos] [ms]            Solo el mutex por token\n");
+    printf("  barrier [max_nodos] [episodios]     Barrera en árbol y por diseminación\n");
+    printf("  split   [nodos] [iter] [cómputo_us] Barrera bloqueante, en dos fases y difusa\n");
+    printf("  all                                 Todos con los valores por defecto\n");
+}
+
+// Parámetro posicional i (tras el nombre del benchmark) o el valor por defecto
+static int arg_int(int argc, char* argv[], int i, int def) {
+    return argc > i + 1 ? atoi(argv[i + 1]) : def;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* mode = argv[1];
+    int all = strcmp(mode, "all") == 0;
+    if (all) argc = 1;   // "all" usa siempre los valores por defecto
+
+    int matched = all;
+    if (all || strcmp(mode, "memory") == 0) {
+        init_memory_manager();
+        benchmark_memory_reads((size_t)arg_int(argc, argv, 1, 64), arg_int(argc, argv, 2, 1000));
+        cleanup_memory_manager();
+        matched = 1;
+    }
+    if (all || strcmp(mode, "lookups") == 0) {
+        init_memory_manager();
+        benchmark_memory_lookups(arg_int(argc, argv, 1, 1000));
+        cleanup_memory_manager();
+        matched = 1;
+    }
+    if (all || strcmp(mode, "mutex") == 0) {
+        benchmark_lamport_mutex(arg_int(argc, argv, 1, 8), arg_int(argc, argv, 2, 1000));
+        matched = 1;
+    }
+    if (strcmp(mode, "token") == 0) {
+        benchmark_token_mutex(arg_int(argc, argv, 1, 8), arg_int(argc, argv, 2, 1000));
+        matched = 1;
+    }
+    if (all || strcmp(mode, "barrier") == 0) {
+        benchmark_distributed_barrier(arg_int(argc, argv, 1, 16), arg_int(argc, argv, 2, 200));
+        matched = 1;
+    }
+    if (all || strcmp(mode, "split") == 0) {
+        benchmark_split_barrier(arg_int(argc, argv, 1, 8), arg_int(argc, argv, 2, 200),
+                                arg_int(argc, argv, 3, 1000));
+        matched = 1;
+    }
+
+    if (!matched) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+#include "../common.h"
+#include "epoch.h"
+#include <stdatomic.h>
+#include <sched.h>
+
+// ========================================
+// RECLAMACIÓN POR ÉPOCAS
+// ========================================
+
+// Registro de un hilo: época observada al entrar, desplazada un bit, con el
+// bit bajo a 1 mientras está dentro de una sección (0 = fuera)
+typedef struct EpochRecord {
+    _Atomic uint64_t state;
+    int nesting;                  // Solo lo toca el hilo dueño
+    _Atomic int in_use;           // Libre para reutilizar cuando el hilo termina
+    struct EpochRecord* next;
+} EpochRecord;
+
+typedef struct RetiredNode {
+    void* ptr;
+    void (*destructor)(void*);
+    uint64_t epoch;               // Época global al retirarlo
+    struct RetiredNode* next;
+} RetiredNode;
+
+typedef struct {
+    _Atomic uint64_t global_epoch;
+    _Atomic(EpochRecord*) records; // Lista que solo crece
+    pthread_key_t record_key;
+
+    RetiredNode* retired;
+    size_t retired_count;
+    pthread_mutex_t retire_lock;
+
+    // Estadísticas
+    _Atomic uint64_t advances;
+    _Atomic uint64_t retired_total;
+    _Atomic uint64_t reclaimed;
+} EpochManager;
+
+#define EPOCH_ACTIVE 1ULL
+
+static EpochManager* epoch_manager = NULL;
+static _Thread_local EpochRecord* local_record = NULL;
+
+// ========================================
+// REGISTROS POR HILO
+// ========================================
+
+static void release_record(void* arg) {
+    EpochRecord* rec = (EpochRecord*)arg;
+    atomic_store(&rec->state, 0);
+    rec->nesting = 0;
+    atomic_store(&rec->in_use, 0);
+}
+
+static EpochRecord* get_record() {
+    if (local_record) return local_record;
+
+    // Reutilizar el registro de un hilo que ya terminó
+    EpochRecord* rec = atomic_load(&epoch_manager->records);
+    for (; rec; rec = rec->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&rec->in_use, &expected, 1)) break;
+    }
+
+    if (!rec) {
+        rec = (EpochRecord*)calloc(1, sizeof(EpochRecord));
+        if (!rec) return NULL;
+        atomic_init(&rec->in_use, 1);
+
+        EpochRecord* head = atomic_load(&epoch_manager->records);
+        do {
+            rec->next = head;
+        } while (!atomic_compare_exchange_weak(&epoch_manager->records, &head, rec));
+    }
+
+    local_record = rec;
+    pthread_setspecific(epoch_manager->record_key, rec);
+    return rec;
+}
+
+void epoch_enter() {
+    EpochRecord* rec = get_record();
+    if (!rec) return;
+
+    if (rec->nesting++ == 0) {
+        uint64_t epoch = atomic_load(&epoch_manager->global_epoch);
+        atomic_store_explicit(&rec->state, (epoch << 1) | EPOCH_ACTIVE, memory_order_relaxed);
+        // El anuncio debe ser visible antes de cargar punteros compartidos
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+}
+
+void epoch_exit() {
+    EpochRecord* rec = local_record;
+    if (!rec || rec->nesting == 0) return;
+
+    if (--rec->nesting == 0) {
+        atomic_store_explicit(&rec->state, 0, memory_order_release);
+    }
+}
+
+// ========================================
+// AVANCE DE ÉPOCA Y LIBERACIÓN
+// ========================================
+
+// La época avanza solo si todos los hilos dentro de una sección ya la vieron
+static void try_advance() {
+    uint64_t epoch = atomic_load(&epoch_manager->global_epoch);
+
+    for (EpochRecord* rec = atomic_load(&epoch_manager->records); rec; rec = rec->next) {
+        uint64_t state = atomic_load(&rec->state);
+        if ((state & EPOCH_ACTIVE) && (state >> 1) != epoch) return;
+    }
+
+    if (atomic_compare_exchange_strong(&epoch_manager->global_epoch, &epoch, epoch + 1)) {
+        atomic_fetch_add_explicit(&epoch_manager->advances, 1, memory_order_relaxed);
+    }
+}
+
+// Separar lo que ya cumplió el periodo de gracia (requiere retire_lock)
+static RetiredNode* collect_retired() {
+    try_advance();
+    uint64_t epoch = atomic_load(&epoch_manager->global_epoch);
+
+    RetiredNode* ready = NULL;
+    RetiredNode** link = &epoch_manager->retired;
+    while (*link) {
+        RetiredNode* node = *link;
+        if (node->epoch + 2 <= epoch) {
+            *link = node->next;
+            node->next = ready;
+            ready = node;
+            epoch_manager->retired_count--;
+        } else {
+            link = &node->next;
+        }
+    }
+    return ready;
+}
+
+// Los destructores corren fuera del lock: pueden volver a retirar
+static void run_destructors(RetiredNode* ready) {
+    while (ready) {
+        RetiredNode* next = ready->next;
+        ready->destructor(ready->ptr);
+        free(ready);
+        atomic_fetch_add_explicit(&epoch_manager->reclaimed, 1, memory_order_relaxed);
+        ready = next;
+    }
+}
+
+void epoch_retire(void* ptr, void (*destructor)(void*)) {
+    if (!ptr) return;
+
+    RetiredNode* node = (RetiredNode*)malloc(sizeof(RetiredNode));
+    if (!node) {
+        // Sin memoria para diferirlo: solo es seguro esperar fuera de una sección
+        if (local_record && local_record->nesting > 0) {
+            log_error("EBR: sin memoria para retirar %p, se pierde", ptr);
+            return;
+        }
+        uint64_t target = atomic_load(&epoch_manager->global_epoch) + 2;
+        while (atomic_load(&epoch_manager->global_epoch) < target) {
+            try_advance();
+            sched_yield();
+        }
+        destructor(ptr);
+        return;
+    }
+
+    node->ptr = ptr;
+    node->destructor = destructor;
+    atomic_fetch_add_explicit(&epoch_manager->retired_total, 1, memory_order_relaxed);
+
+    RetiredNode* ready = NULL;
+    pthread_mutex_lock(&epoch_manager->retire_lock);
+    node->epoch = atomic_load(&epoch_manager->global_epoch);
+    node->next = epoch_manager->retired;
+    epoch_manager->retired = node;
+    if (++epoch_manager->retired_count >= EPOCH_RECLAIM_THRESHOLD) {
+        ready = collect_retired();
+    }
+    pthread_mutex_unlock(&epoch_manager->retire_lock);
+
+    run_destructors(ready);
+}
+
+void epoch_barrier() {
+    for (;;) {
+        pthread_mutex_lock(&epoch_manager->retire_lock);
+        RetiredNode* ready = collect_retired();
+        size_t pending = epoch_manager->retired_count;
+        pthread_mutex_unlock(&epoch_manager->retire_lock);
+
+        run_destructors(ready);
+        if (pending == 0) break;
+        sched_yield();
+    }
+}
+
+// ========================================
+// INICIALIZACIÓN Y ESTADÍSTICAS
+// ========================================
+
+void init_epoch_reclamation() {
+    epoch_manager = (EpochManager*)calloc(1, sizeof(EpochManager));
+    atomic_init(&epoch_manager->global_epoch, 1);
+    pthread_mutex_init(&epoch_manager->retire_lock, NULL);
+    pthread_key_create(&epoch_manager->record_key, release_record);
+}
+
+void print_epoch_stats() {
+    if (!epoch_manager) return;
+
+    pthread_mutex_lock(&epoch_manager->retire_lock);
+    size_t pending = epoch_manager->retired_count;
+    pthread_mutex_unlock(&epoch_manager->retire_lock);
+
+    log_info("   EBR: época %lu (%lu avances) | %lu retirados, %lu liberados, %zu pendientes",
+             (unsigned long)atomic_load(&epoch_manager->global_epoch),
+             (unsigned long)atomic_load(&epoch_manager->advances),
+             (unsigned long)atomic_load(&epoch_manager->retired_total),
+             (unsigned long)atomic_load(&epoch_manager->reclaimed), pending);
+}
+
+void cleanup_epoch_reclamation() {
+    if (!epoch_manager) return;
+
+    epoch_barrier();
+
+    // El registro del hilo actual desaparece con la lista
+    if (local_record) {
+        pthread_setspecific(epoch_manager->record_key, NULL);
+        local_record = NULL;
+    }
+    pthread_key_delete(epoch_manager->record_key);
+
+    EpochRecord* rec = atomic_load(&epoch_manager->records);
+    while (rec) {
+        EpochRecord* next = rec->next;
+        free(rec);
+        rec = next;
+    }
+
+    pthread_mutex_destroy(&epoch_manager->retire_lock);
+    free(epoch_manager);
+    epoch_manager = NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include "../common.h"
+#include <stdint.h>
+
+// ========================================
+// RECLAMACIÓN POR ÉPOCAS (EBR)
+// ========================================
+
+// Los lectores delimitan sus accesos con epoch_enter()/epoch_exit(), que
+// solo publican la época global en un registro propio del hilo. Lo que se
+// retira con epoch_retire() se libera cuando la época global avanzó dos
+// veces: para entonces ningún hilo que pudiera verlo sigue dentro.
+
+// Retirados pendientes antes de intentar avanzar la época
+#define EPOCH_RECLAIM_THRESHOLD 64
+
+// ========================================
+// FUNCIONES PÚBLICAS
+// ========================================
+
+void init_epoch_reclamation();
+void cleanup_epoch_reclamation();
+
+// Sección de lectura (admite anidamiento)
+void epoch_enter();
+void epoch_exit();
+
+// Diferir destructor(ptr) hasta que ningún lector pueda tener el puntero
+void epoch_retire(void* ptr, void (*destructor)(void*));
+
+// Esperar a que se libere todo lo retirado (no llamar dentro de una sección)
+void epoch_barrier();
+
+// Estadísticas
+void print_epoch_stats();
+
+#endif // EPOCH_H
@@ -1,5 +1,6 @@
 #include "../common.h"
 #include "memory_manager.h"
+#include "slab.h"
 
 // ========================================
 // GESTOR DE MEMORIA DISTRIBUIDA
@@ -7,38 +8,105 @@
 
 DistributedMemoryManager* memory_manager = NULL;
 
+// Los metadatos de un bloque deben caber en una línea de caché
+_Static_assert(sizeof(SharedMemory) <= 64, "SharedMemory debe caber en 64 bytes");
+
+// Locks de bloque por franjas: sin mutex embebido en cada SharedMemory
+static pthread_mutex_t block_locks[MEMORY_LOCK_STRIPES];
+
+static inline pthread_mutex_t* block_lock(SharedMemory* mem) {
+    return &block_locks[(mem->memory_id & MEMORY_INDEX_MASK) % MEMORY_LOCK_STRIPES];
+}
+
 void init_memory_manager() {
-    memory_manager = (DistributedMemoryManager*)malloc(sizeof(DistributedMemoryManager));
+    memory_manager = (DistributedMemoryManager*)calloc(1, sizeof(DistributedMemoryManager));
+    atomic_store(&memory_manager->slot_count, 0);
+    memory_manager->free_head = -1;
     memory_manager->block_count = 0;
-    memory_manager->next_memory_id = 1;
+    memory_manager->seqlock_max_size = MEMORY_SEQLOCK_MAX;
     pthread_mutex_init(&memory_manager->memory_lock, NULL);
     
+    for (int i = 0; i < MEMORY_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&block_locks[i], NULL);
+    }
+    init_slab_allocator(sizeof(SharedMemory));
+    init_epoch_reclamation();
+    
     log_info("Gestor de memoria distribuida inicializado");
 }
 
+// Slot por índice, o NULL si su segmento aún no existe
+static MemorySlot* memory_slot(int index) {
+    MemorySlot* segment = atomic_load_explicit(
+        &memory_manager->segments[index >> MEMORY_SEGMENT_BITS], memory_order_acquire);
+    return segment ? &segment[index & (MEMORY_SEGMENT_SIZE - 1)] : NULL;
+}
+
+static inline MemorySlot* block_slot(SharedMemory* mem) {
+    return memory_slot(mem->memory_id & MEMORY_INDEX_MASK);
+}
+
+static inline int make_memory_handle(int index, uint32_t generation) {
+    return (int)((generation & MEMORY_GENERATION_MASK) << MEMORY_INDEX_BITS) | index;
+}
+
+// Obtener un slot libre (requiere memory_lock)
+static int reserve_memory_slot() {
+    if (memory_manager->free_head >= 0) {
+        int index = memory_manager->free_head;
+        memory_manager->free_head = memory_slot(index)->next_free;
+        return index;
+    }
+    
+    int index = atomic_load(&memory_manager->slot_count);
+    if (index > MEMORY_INDEX_MASK) return -1;
+    
+    // Nuevo segmento si el anterior se llenó
+    int seg = index >> MEMORY_SEGMENT_BITS;
+    if (!atomic_load(&memory_manager->segments[seg])) {
+        MemorySlot* segment = (MemorySlot*)calloc(MEMORY_SEGMENT_SIZE, sizeof(MemorySlot));
+        if (!segment) return -1;
+        for (int i = 0; i < MEMORY_SEGMENT_SIZE; i++) {
+            atomic_init(&segment[i].generation, 1);
+        }
+        atomic_store_explicit(&memory_manager->segments[seg], segment, memory_order_release);
+    }
+    
+    atomic_store(&memory_manager->slot_count, index + 1);
+    return index;
+}
+
 SharedMemory* allocate_shared_memory(size_t size, int owner_node) {
     pthread_mutex_lock(&memory_manager->memory_lock);
     
-    if (memory_manager->block_count >= MAX_MEMORY_BLOCKS) {
+    int index = reserve_memory_slot();
+    if (index < 0) {
         log_error("No hay espacio para más bloques de memoria");
         pthread_mutex_unlock(&memory_manager->memory_lock);
         return NULL;
     }
+    MemorySlot* slot = memory_slot(index);
     
-    SharedMemory* mem = (SharedMemory*)malloc(sizeof(SharedMemory));
-    mem->data = malloc(size);
+    // Metadatos y datos salen del slab (ya inicializados a cero)
+    SharedMemory* mem = (SharedMemory*)slab_alloc_record();
+    void* data = mem ? slab_alloc(size, &mem->size_class) : NULL;
+    if (!data) {
+        log_error("No se pudo asignar memoria para %zu bytes", size);
+        slab_free_record(mem);
+        slot->next_free = memory_manager->free_head;
+        memory_manager->free_head = index;
+        pthread_mutex_unlock(&memory_manager->memory_lock);
+        return NULL;
+    }
+    mem->data = data;
     mem->size = size;
     mem->owner_node = owner_node;
-    mem->reference_count = 1;
-    mem->memory_id = memory_manager->next_memory_id++;
-    mem->replication_count = 0;
-    pthread_mutex_init(&mem->lock, NULL);
+    atomic_store(&mem->reference_count, 1);
+    mem->version = 1;
+    mem->memory_id = make_memory_handle(index, atomic_load(&slot->generation));
     
-    // Inicializar datos a cero
-    memset(mem->data, 0, size);
-    memset(mem->replicated_nodes, -1, sizeof(mem->replicated_nodes));
-    
-    memory_manager->memory_blocks[memory_manager->block_count++] = mem;
+    atomic_store_explicit(&slot->block, mem, memory_order_release);
+    memory_manager->block_count++;
     
     log_info("Memoria asignada: ID=%d, Tamaño=%zu bytes, Propietario=Nodo %d", 
              mem->memory_id, size, owner_node);
@@ -47,58 +115,212 @@ SharedMemory* allocate_shared_memory(size_t size, int owner_node) {
     return mem;
 }
 
-int free_shared_memory(int memory_id) {
-    pthread_mutex_lock(&memory_manager->memory_lock);
-    
-    for (int i = 0; i < memory_manager->block_count; i++) {
-        SharedMemory* mem = memory_manager->memory_blocks[i];
-        if (mem->memory_id == memory_id) {
-            mem->reference_count--;
+// Devolver datos, réplicas y metadatos al asignador
+static void release_shared_memory(SharedMemory* mem) {
+    slab_free(mem->data, mem->size, mem->size_class);
+    free(mem->replicated_nodes);
+    free(mem->dirty_pages);
+    slab_free_record(mem);
+}
+
+// Destructor diferido por EBR
+static void retire_shared_memory(void* ptr) {
+    release_shared_memory((SharedMemory*)ptr);
+}
+
+static inline size_t memory_pages(SharedMemory* mem) {
+    return (mem->size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+}
+
+// Guardar la pre-imagen de las páginas [first, last] en las snapshots que
+// aún no la tienen (requiere el lock del bloque)
+static int preserve_snapshot_pages(SharedMemory* mem, MemorySnapshot* head,
+                                   size_t first, size_t last) {
+    for (MemorySnapshot* snap = head; snap; snap = snap->next) {
+        for (size_t page = first; page <= last; page++) {
+            if (atomic_load_explicit(&snap->pages[page], memory_order_relaxed)) continue;
             
-            if (mem->reference_count <= 0) {
-                log_info("Liberando memoria ID=%d", memory_id);
-                pthread_mutex_destroy(&mem->lock);
-                free(mem->data);
-                free(mem);
-                
-                // Reorganizar array
-                for (int j = i; j < memory_manager->block_count - 1; j++) {
-                    memory_manager->memory_blocks[j] = memory_manager->memory_blocks[j + 1];
-                }
-                memory_manager->block_count--;
-            }
+            size_t offset = page * MEMORY_PAGE_SIZE;
+            size_t len = mem->size - offset < MEMORY_PAGE_SIZE ? mem->size - offset
+                                                                : MEMORY_PAGE_SIZE;
+            uint8_t* copy = (uint8_t*)malloc(len);
+            if (!copy) return -1;
+            memcpy(copy, (char*)mem->data + offset, len);
             
-            pthread_mutex_unlock(&memory_manager->memory_lock);
-            return 0;
+            // Publicar la copia antes de que la escritura toque la página
+            atomic_store_explicit(&snap->pages[page], copy, memory_order_release);
+            atomic_fetch_add_explicit(&snap->copied_pages, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&memory_manager->snapshot_pages_copied, 1,
+                                      memory_order_relaxed);
         }
     }
+    return 0;
+}
+
+// Validar un handle contra la generación actual de su slot
+static MemorySlot* lookup_memory_slot(int memory_id) {
+    if (memory_id <= 0) return NULL;
     
-    pthread_mutex_unlock(&memory_manager->memory_lock);
-    return -1;
+    int index = memory_id & MEMORY_INDEX_MASK;
+    uint32_t generation = (uint32_t)(memory_id >> MEMORY_INDEX_BITS);
+    
+    if (index >= atomic_load_explicit(&memory_manager->slot_count, memory_order_acquire)) {
+        return NULL;
+    }
+    
+    MemorySlot* slot = memory_slot(index);
+    if (!slot || (atomic_load_explicit(&slot->generation, memory_order_acquire) &
+                  MEMORY_GENERATION_MASK) != generation) {
+        return NULL;
+    }
+    
+    return slot;
 }
 
-SharedMemory* get_shared_memory(int memory_id) {
-    pthread_mutex_lock(&memory_manager->memory_lock);
+// Soltar una referencia. La última despublica el bloque; los metadatos y
+// los datos se liberan cuando ningún lector dentro de una sección EBR puede
+// tener todavía el puntero.
+int free_shared_memory(int memory_id) {
+    epoch_enter();
     
-    for (int i = 0; i < memory_manager->block_count; i++) {
-        if (memory_manager->memory_blocks[i]->memory_id == memory_id) {
-            SharedMemory* mem = memory_manager->memory_blocks[i];
-            pthread_mutex_unlock(&memory_manager->memory_lock);
-            return mem;
+    MemorySlot* slot = lookup_memory_slot(memory_id);
+    SharedMemory* mem = slot ? atomic_load_explicit(&slot->block, memory_order_acquire) : NULL;
+    if (!mem || mem->memory_id != memory_id) {
+        epoch_exit();
+        return -1;
+    }
+    
+    int refs = atomic_load(&mem->reference_count);
+    do {
+        if (refs <= 0) {
+            epoch_exit();
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&mem->reference_count, &refs, refs - 1));
+    
+    if (refs == 1) {
+        pthread_mutex_lock(&memory_manager->memory_lock);
+        log_info("Liberando memoria ID=%d", memory_id);
+        
+        // Las snapshots vivas se quedan con todas las páginas que les faltan.
+        // Si no caben se invalidan: sus páginas sin copiar apuntarían a datos
+        // que EBR va a liberar.
+        pthread_mutex_lock(block_lock(mem));
+        int complete = !slot->snapshots || mem->size == 0 ||
+            preserve_snapshot_pages(mem, slot->snapshots, 0, memory_pages(mem) - 1) == 0;
+        if (!complete) {
+            log_error("Snapshots del bloque %d invalidadas: sin memoria para copiarlas", memory_id);
+        }
+        for (MemorySnapshot* snap = slot->snapshots; snap; snap = snap->next) {
+            if (!complete) atomic_store_explicit(&snap->invalid, 1, memory_order_relaxed);
+            atomic_store_explicit(&snap->block, NULL, memory_order_release);
         }
+        slot->snapshots = NULL;
+        pthread_mutex_unlock(block_lock(mem));
+        
+        // Invalidar el handle antes de devolver el slot a la lista libre
+        atomic_store_explicit(&slot->block, NULL, memory_order_release);
+        uint32_t next = (atomic_load(&slot->generation) + 1) & MEMORY_GENERATION_MASK;
+        atomic_store_explicit(&slot->generation, next ? next : 1, memory_order_release);
+        
+        slot->next_free = memory_manager->free_head;
+        memory_manager->free_head = memory_id & MEMORY_INDEX_MASK;
+        memory_manager->block_count--;
+        pthread_mutex_unlock(&memory_manager->memory_lock);
     }
     
-    pthread_mutex_unlock(&memory_manager->memory_lock);
-    return NULL;
+    epoch_exit();
+    
+    if (refs == 1) {
+        epoch_retire(mem, retire_shared_memory);
+    }
+    return 0;
+}
+
+// Búsqueda O(1) sin lock: el puntero es válido mientras dure la sección
+// epoch_enter()/epoch_exit() en que se obtuvo
+SharedMemory* get_shared_memory(int memory_id) {
+    MemorySlot* slot = lookup_memory_slot(memory_id);
+    if (!slot) return NULL;
+    
+    SharedMemory* mem = atomic_load_explicit(&slot->block, memory_order_acquire);
+    
+    // El slot pudo liberarse entre la validación y la carga
+    if (!mem || mem->memory_id != memory_id) return NULL;
+    
+    return mem;
+}
+
+// Tomar una referencia propia para usar el bloque fuera de una sección EBR
+// (se suelta con free_shared_memory)
+SharedMemory* acquire_shared_memory(int memory_id) {
+    epoch_enter();
+    
+    SharedMemory* mem = get_shared_memory(memory_id);
+    if (mem) {
+        // Un bloque que ya llegó a cero no se resucita
+        int refs = atomic_load(&mem->reference_count);
+        do {
+            if (refs <= 0) {
+                mem = NULL;
+                break;
+            }
+        } while (!atomic_compare_exchange_weak(&mem->reference_count, &refs, refs + 1));
+    }
+    
+    epoch_exit();
+    return mem;
+}
+
+// Búsqueda y lectura en una sola sección EBR
+int read_shared_memory_by_id(int memory_id, void* buffer, size_t size, size_t offset) {
+    epoch_enter();
+    SharedMemory* mem = get_shared_memory(memory_id);
+    int rc = mem ? read_shared_memory(mem, buffer, size, offset) : -1;
+    epoch_exit();
+    return rc;
+}
+
+int memory_table_size() {
+    return atomic_load_explicit(&memory_manager->slot_count, memory_order_acquire);
+}
+
+SharedMemory* memory_table_slot(int index) {
+    MemorySlot* slot = memory_slot(index);
+    return slot ? atomic_load_explicit(&slot->block, memory_order_acquire) : NULL;
 }
 
 int write_shared_memory(SharedMemory* mem, void* data, size_t size, size_t offset) {
     if (!mem || !data) return -1;
     if (offset + size > mem->size) return -1;
     
-    pthread_mutex_lock(&mem->lock);
+    pthread_mutex_lock(block_lock(mem));
+    
+    // Copy-on-write: primera escritura sobre una página desde una snapshot
+    MemorySnapshot* snapshots = block_slot(mem)->snapshots;
+    if (snapshots && size > 0 &&
+        preserve_snapshot_pages(mem, snapshots, offset / MEMORY_PAGE_SIZE,
+                                (offset + size - 1) / MEMORY_PAGE_SIZE) < 0) {
+        pthread_mutex_unlock(block_lock(mem));
+        log_error("Sin memoria para preservar páginas de snapshot (bloque %d)", mem->memory_id);
+        return -1;
+    }
+    
+    // Secuencia impar durante la copia: los lectores optimistas reintentan
+    atomic_fetch_add_explicit(&mem->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
     memcpy((char*)mem->data + offset, data, size);
-    pthread_mutex_unlock(&mem->lock);
+    atomic_fetch_add_explicit(&mem->seq, 1, memory_order_release);
+    mem->version++;
+    
+    // Solo hace falta seguir páginas si hay réplicas que sincronizar
+    if (mem->dirty_pages && size > 0) {
+        for (size_t page = offset / MEMORY_PAGE_SIZE;
+             page <= (offset + size - 1) / MEMORY_PAGE_SIZE; page++) {
+            mem->dirty_pages[page / 64] |= 1ULL << (page % 64);
+        }
+    }
+    pthread_mutex_unlock(block_lock(mem));
     
     log_debug("Escritura en memoria %d: %zu bytes en offset %zu", 
               mem->memory_id, size, offset);
@@ -109,55 +331,260 @@ int read_shared_memory(SharedMemory* mem, void* buffer, size_t size, size_t offs
     if (!mem || !buffer) return -1;
     if (offset + size > mem->size) return -1;
     
-    pthread_mutex_lock(&mem->lock);
+    // Bloques pequeños: copiar sin lock y repetir si un escritor intervino
+    if (mem->size <= memory_manager->seqlock_max_size) {
+        uint32_t start, end;
+        do {
+            start = atomic_load_explicit(&mem->seq, memory_order_acquire);
+            if (start & 1) continue;
+            memcpy(buffer, (char*)mem->data + offset, size);
+            atomic_thread_fence(memory_order_acquire);
+            end = atomic_load_explicit(&mem->seq, memory_order_relaxed);
+        } while ((start & 1) || start != end);
+        
+        return 0;
+    }
+    
+    pthread_mutex_lock(block_lock(mem));
     memcpy(buffer, (char*)mem->data + offset, size);
-    pthread_mutex_unlock(&mem->lock);
+    pthread_mutex_unlock(block_lock(mem));
     
     log_debug("Lectura de memoria %d: %zu bytes desde offset %zu", 
               mem->memory_id, size, offset);
     return 0;
 }
 
+void set_seqlock_threshold(size_t max_size) {
+    memory_manager->seqlock_max_size = max_size;
+    log_info("Lectura optimista para bloques <= %zu bytes", max_size);
+}
+
 int replicate_memory(SharedMemory* mem, int target_node) {
     if (!mem) return -1;
     
-    pthread_mutex_lock(&mem->lock);
+    pthread_mutex_lock(block_lock(mem));
     
     // Verificar si ya está replicado en ese nodo
     for (int i = 0; i < mem->replication_count; i++) {
         if (mem->replicated_nodes[i] == target_node) {
-            pthread_mutex_unlock(&mem->lock);
+            pthread_mutex_unlock(block_lock(mem));
             return 0; // Ya replicado
         }
     }
     
-    // Agregar nodo a lista de réplicas
-    if (mem->replication_count < MAX_NODES) {
+    // Agregar nodo a lista de réplicas (la lista crece duplicándose)
+    if (mem->replication_count == mem->replica_capacity &&
+        mem->replica_capacity < MAX_NODES) {
+        int capacity = mem->replica_capacity ? mem->replica_capacity * 2 : 2;
+        if (capacity > MAX_NODES) capacity = MAX_NODES;
+        int* nodes = (int*)realloc(mem->replicated_nodes, capacity * sizeof(int));
+        if (!nodes) {
+            pthread_mutex_unlock(block_lock(mem));
+            return -1;
+        }
+        mem->replicated_nodes = nodes;
+        mem->replica_capacity = (uint16_t)capacity;
+    }
+    
+    // Primera réplica: empezar a seguir páginas, todas pendientes
+    if (!mem->dirty_pages) {
+        size_t words = (memory_pages(mem) + 63) / 64;
+        mem->dirty_pages = (uint64_t*)malloc(words * sizeof(uint64_t));
+        if (!mem->dirty_pages) {
+            pthread_mutex_unlock(block_lock(mem));
+            return -1;
+        }
+        memset(mem->dirty_pages, 0xFF, words * sizeof(uint64_t));
+    }
+    
+    if (mem->replication_count < mem->replica_capacity) {
         mem->replicated_nodes[mem->replication_count++] = target_node;
-        mem->reference_count++;
+        atomic_fetch_add(&mem->reference_count, 1);
         
         log_info("Memoria %d replicada al nodo %d (réplicas: %d)", 
                  mem->memory_id, target_node, mem->replication_count);
     }
     
-    pthread_mutex_unlock(&mem->lock);
+    pthread_mutex_unlock(block_lock(mem));
     return 0;
 }
 
 void sync_memory_replicas(SharedMemory* mem) {
     if (!mem || mem->replication_count == 0) return;
     
-    pthread_mutex_lock(&mem->lock);
+    pthread_mutex_lock(block_lock(mem));
     
-    log_info("Sincronizando memoria %d con %d réplicas", 
-             mem->memory_id, mem->replication_count);
+    // Agrupar las páginas sucias en tramos contiguos: cada tramo es un envío
+    size_t pages = memory_pages(mem);
+    size_t dirty = 0, runs = 0;
+    for (size_t page = 0; page < pages; page++) {
+        if (mem->dirty_pages[page / 64] & (1ULL << (page % 64))) {
+            if (page == 0 || !(mem->dirty_pages[(page - 1) / 64] & (1ULL << ((page - 1) % 64)))) {
+                runs++;
+            }
+            dirty++;
+        }
+    }
+    
+    if (dirty == 0) {
+        pthread_mutex_unlock(block_lock(mem));
+        return;
+    }
+    
+    size_t bytes = dirty * MEMORY_PAGE_SIZE;
+    if (bytes > mem->size) bytes = mem->size;
+    
+    log_info("Sincronizando memoria %d v%u con %d réplicas: %zu páginas en %zu tramos",
+             mem->memory_id, mem->version, mem->replication_count, dirty, runs);
     
-    // En una implementación real, enviaríamos los datos a cada réplica
     for (int i = 0; i < mem->replication_count; i++) {
-        log_debug("  -> Sincronizando con nodo %d", mem->replicated_nodes[i]);
+        log_debug("  -> Nodo %d: %zu bytes", mem->replicated_nodes[i], bytes);
+    }
+    
+    memset(mem->dirty_pages, 0, (pages + 63) / 64 * sizeof(uint64_t));
+    pthread_mutex_unlock(block_lock(mem));
+}
+
+// ========================================
+// SNAPSHOTS COPY-ON-WRITE
+// ========================================
+
+MemorySnapshot* snapshot_shared_memory(SharedMemory* mem) {
+    if (!mem) return NULL;
+    
+    // La tabla de páginas empieza a cero: nada se copia al crearla
+    size_t pages = memory_pages(mem);
+    MemorySnapshot* snap = (MemorySnapshot*)calloc(1, sizeof(MemorySnapshot));
+    _Atomic(uint8_t*)* table = calloc(pages ? pages : 1, sizeof(*table));
+    if (!snap || !table) {
+        free(snap);
+        free(table);
+        return NULL;
     }
     
-    pthread_mutex_unlock(&mem->lock);
+    snap->pages = table;
+    snap->memory_id = mem->memory_id;
+    snap->size = mem->size;
+    atomic_init(&snap->block, mem);
+    atomic_init(&snap->invalid, 0);
+    snap->timestamp = time(NULL);
+    
+    MemorySlot* slot = block_slot(mem);
+    pthread_mutex_lock(block_lock(mem));
+    snap->version = mem->version;
+    snap->next = slot->snapshots;
+    slot->snapshots = snap;
+    pthread_mutex_unlock(block_lock(mem));
+    
+    atomic_fetch_add(&memory_manager->snapshot_count, 1);
+    log_debug("Snapshot de memoria %d v%u (%zu páginas)", mem->memory_id, snap->version, pages);
+    return snap;
+}
+
+// Lectura sin lock: las páginas preservadas salen de la copia; el resto, del
+// bloque, comprobando después que ningún escritor la preservó mientras tanto.
+// Devuelve -1 si la snapshot quedó invalidada al liberar su bloque.
+int read_memory_snapshot(MemorySnapshot* snap, void* buffer, size_t size, size_t offset) {
+    if (!snap || !buffer) return -1;
+    if (offset + size > snap->size) return -1;
+    
+    // El bloque puede liberarse durante la lectura: la sección EBR mantiene
+    // válidos sus datos hasta que salimos
+    epoch_enter();
+    char* out = (char*)buffer;
+    while (size > 0) {
+        size_t page = offset / MEMORY_PAGE_SIZE;
+        size_t in_page = offset % MEMORY_PAGE_SIZE;
+        size_t len = MEMORY_PAGE_SIZE - in_page < size ? MEMORY_PAGE_SIZE - in_page : size;
+        
+        uint8_t* saved = atomic_load_explicit(&snap->pages[page], memory_order_acquire);
+        if (!saved) {
+            // Sin bloque (liberado) solo valen las copias, y si quedó
+            // inválida puede no haberlas
+            SharedMemory* mem = atomic_load_explicit(&snap->block, memory_order_acquire);
+            if (mem) {
+                memcpy(out, (char*)mem->data + offset, len);
+                atomic_thread_fence(memory_order_acquire);
+            }
+            saved = atomic_load_explicit(&snap->pages[page], memory_order_relaxed);
+            if (!saved && (!mem || atomic_load(&snap->invalid))) {
+                epoch_exit();
+                return -1;
+            }
+        }
+        if (saved) memcpy(out, saved + in_page, len);
+        
+        out += len;
+        offset += len;
+        size -= len;
+    }
+    epoch_exit();
+    return 0;
+}
+
+// Volver al contenido de la snapshot reescribiendo solo las páginas que
+// cambiaron desde que se tomó
+int restore_memory_snapshot(MemorySnapshot* snap) {
+    if (!snap || atomic_load(&snap->invalid)) return -1;
+    
+    SharedMemory* mem = acquire_shared_memory(snap->memory_id);
+    if (!mem) return -1;
+    if (mem->size != snap->size) {
+        free_shared_memory(mem->memory_id);
+        return -1;
+    }
+    
+    int rc = 0;
+    size_t restored = 0;
+    for (size_t page = 0; page < memory_pages(mem); page++) {
+        uint8_t* saved = atomic_load_explicit(&snap->pages[page], memory_order_acquire);
+        if (!saved) continue;
+        
+        size_t offset = page * MEMORY_PAGE_SIZE;
+        size_t len = mem->size - offset < MEMORY_PAGE_SIZE ? mem->size - offset
+                                                            : MEMORY_PAGE_SIZE;
+        if (write_shared_memory(mem, saved, len, offset) < 0) {
+            rc = -1;
+            break;
+        }
+        restored++;
+    }
+    free_shared_memory(mem->memory_id);
+    
+    if (rc == 0) {
+        log_info("Memoria %d restaurada a v%u (%zu páginas)", snap->memory_id, snap->version,
+                 restored);
+    }
+    return rc;
+}
+
+void release_memory_snapshot(MemorySnapshot* snap) {
+    if (!snap) return;
+    
+    // La sección EBR mantiene el bloque mientras se desengancha; si se libera
+    // a la vez, free_shared_memory() ya vació la lista bajo el mismo lock
+    epoch_enter();
+    SharedMemory* mem = get_shared_memory(snap->memory_id);
+    if (mem) {
+        MemorySlot* slot = block_slot(mem);
+        pthread_mutex_lock(block_lock(mem));
+        for (MemorySnapshot** link = &slot->snapshots; *link; link = &(*link)->next) {
+            if (*link == snap) {
+                *link = snap->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(block_lock(mem));
+    }
+    epoch_exit();
+    
+    size_t pages = (snap->size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+    for (size_t page = 0; page < pages; page++) {
+        free(atomic_load(&snap->pages[page]));
+    }
+    free((void*)snap->pages);
+    free(snap);
+    atomic_fetch_sub(&memory_manager->snapshot_count, 1);
 }
 
 void print_memory_stats() {
@@ -166,8 +593,9 @@ void print_memory_stats() {
     size_t total_allocated = 0;
     int replicated_blocks = 0;
     
-    for (int i = 0; i < memory_manager->block_count; i++) {
-        SharedMemory* mem = memory_manager->memory_blocks[i];
+    for (int i = 0; i < memory_table_size(); i++) {
+        SharedMemory* mem = memory_table_slot(i);
+        if (!mem) continue;
         total_allocated += mem->size;
         if (mem->replication_count > 0) {
             replicated_blocks++;
@@ -177,25 +605,235 @@ void print_memory_stats() {
     log_info("📊 Estadísticas de Memoria:");
     log_info("   Bloques: %d | Total: %zu KB | Replicados: %d",
              memory_manager->block_count, total_allocated / 1024, replicated_blocks);
+    log_info("   Snapshots: %d vivas | %lu páginas copiadas al escribir",
+             atomic_load(&memory_manager->snapshot_count),
+             (unsigned long)atomic_load(&memory_manager->snapshot_pages_copied));
+    print_epoch_stats();
+    print_slab_stats();
     
     pthread_mutex_unlock(&memory_manager->memory_lock);
 }
 
+// ========================================
+// BENCHMARK DE LECTORES
+// ========================================
+
+typedef struct {
+    SharedMemory* mem;
+    atomic_int* running;
+    uint64_t reads;
+} ReadBenchArgs;
+
+static void* bench_reader(void* arg) {
+    ReadBenchArgs* args = (ReadBenchArgs*)arg;
+    char buffer[MEMORY_SEQLOCK_MAX * 16];
+    size_t len = args->mem->size < sizeof(buffer) ? args->mem->size : sizeof(buffer);
+    
+    while (atomic_load_explicit(args->running, memory_order_relaxed)) {
+        read_shared_memory(args->mem, buffer, len, 0);
+        args->reads++;
+    }
+    return NULL;
+}
+
+static void* bench_writer(void* arg) {
+    ReadBenchArgs* args = (ReadBenchArgs*)arg;
+    char value[8] = {0};
+    
+    // Escritor de fondo a ~1 kHz para que los lectores vean reintentos
+    while (atomic_load_explicit(args->running, memory_order_relaxed)) {
+        value[0]++;
+        write_shared_memory(args->mem, value, sizeof(value), 0);
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static double bench_read_throughput(SharedMemory* mem, int threads, int duration_ms) {
+    atomic_int running = 1;
+    pthread_t tids[64], writer;
+    ReadBenchArgs args[64];
+    ReadBenchArgs writer_args = { mem, &running, 0 };
+    
+    for (int i = 0; i < threads; i++) {
+        args[i] = (ReadBenchArgs){ mem, &running, 0 };
+        pthread_create(&tids[i], NULL, bench_reader, &args[i]);
+    }
+    pthread_create(&writer, NULL, bench_writer, &writer_args);
+    
+    usleep((useconds_t)duration_ms * 1000);
+    atomic_store(&running, 0);
+    
+    uint64_t total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        total += args[i].reads;
+    }
+    pthread_join(writer, NULL);
+    
+    return total / (duration_ms / 1000.0) / 1e6;
+}
+
+void benchmark_memory_reads(size_t block_size, int duration_ms) {
+    static const int thread_counts[] = { 1, 8, 64 };
+    
+    SharedMemory* mem = allocate_shared_memory(block_size, 0);
+    if (!mem) return;
+    
+    size_t saved = memory_manager->seqlock_max_size;
+    
+    log_info("📊 Benchmark de lectura (bloque de %zu bytes, %d ms por prueba):",
+             block_size, duration_ms);
+    log_info("   Hilos |   Mutex (M lect/s) | Seqlock (M lect/s)");
+    
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        memory_manager->seqlock_max_size = 0;
+        double locked = bench_read_throughput(mem, thread_counts[i], duration_ms);
+        
+        memory_manager->seqlock_max_size = block_size;
+        double optimistic = bench_read_throughput(mem, thread_counts[i], duration_ms);
+        
+        log_info("   %5d | %18.2f | %18.2f", thread_counts[i], locked, optimistic);
+    }
+    
+    memory_manager->seqlock_max_size = saved;
+    free_shared_memory(mem->memory_id);
+}
+
+// ========================================
+// BENCHMARK DE BÚSQUEDAS CON LIBERACIONES
+// ========================================
+
+#define LOOKUP_BENCH_BLOCKS 1024
+
+typedef struct {
+    _Atomic int* ids;
+    atomic_int* running;
+    int use_mutex;
+    unsigned int seed;
+    uint64_t lookups;
+} LookupBenchArgs;
+
+// Lector: buscar un handle al azar y leer 8 bytes. Con use_mutex reproduce
+// lo que había que hacer antes para no leer un bloque ya liberado.
+static void* bench_lookup_reader(void* arg) {
+    LookupBenchArgs* args = (LookupBenchArgs*)arg;
+    char buffer[8];
+    
+    while (atomic_load_explicit(args->running, memory_order_relaxed)) {
+        int id = atomic_load_explicit(&args->ids[rand_r(&args->seed) % LOOKUP_BENCH_BLOCKS],
+                                      memory_order_relaxed);
+        if (args->use_mutex) {
+            pthread_mutex_lock(&memory_manager->memory_lock);
+            SharedMemory* mem = get_shared_memory(id);
+            if (mem) read_shared_memory(mem, buffer, sizeof(buffer), 0);
+            pthread_mutex_unlock(&memory_manager->memory_lock);
+        } else {
+            read_shared_memory_by_id(id, buffer, sizeof(buffer), 0);
+        }
+        args->lookups++;
+    }
+    return NULL;
+}
+
+// Liberar y reasignar bloques continuamente mientras los lectores buscan
+static void* bench_lookup_churn(void* arg) {
+    LookupBenchArgs* args = (LookupBenchArgs*)arg;
+    
+    while (atomic_load_explicit(args->running, memory_order_relaxed)) {
+        int i = rand_r(&args->seed) % LOOKUP_BENCH_BLOCKS;
+        SharedMemory* mem = allocate_shared_memory(64, 0);
+        if (!mem) continue;
+        
+        free_shared_memory(atomic_exchange(&args->ids[i], mem->memory_id));
+        args->lookups++;
+        usleep(10000);  // ~100 rotaciones/s: cada una deja un bloque retirado
+    }
+    return NULL;
+}
+
+static double bench_lookup_throughput(_Atomic int* ids, int threads, int use_mutex,
+                                      int duration_ms, uint64_t* churned) {
+    atomic_int running = 1;
+    pthread_t tids[64], churn;
+    LookupBenchArgs args[64];
+    LookupBenchArgs churn_args = { ids, &running, use_mutex, 12345, 0 };
+    
+    for (int i = 0; i < threads; i++) {
+        args[i] = (LookupBenchArgs){ ids, &running, use_mutex, (unsigned int)i + 1, 0 };
+        pthread_create(&tids[i], NULL, bench_lookup_reader, &args[i]);
+    }
+    pthread_create(&churn, NULL, bench_lookup_churn, &churn_args);
+    
+    usleep((useconds_t)duration_ms * 1000);
+    atomic_store(&running, 0);
+    
+    uint64_t total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        total += args[i].lookups;
+    }
+    pthread_join(churn, NULL);
+    *churned = churn_args.lookups;
+    
+    return total / (duration_ms / 1000.0) / 1e6;
+}
+
+void benchmark_memory_lookups(int duration_ms) {
+    static const int thread_counts[] = { 1, 8, 64 };
+    _Atomic int ids[LOOKUP_BENCH_BLOCKS];
+    
+    for (int i = 0; i < LOOKUP_BENCH_BLOCKS; i++) {
+        SharedMemory* mem = allocate_shared_memory(64, 0);
+        atomic_init(&ids[i], mem ? mem->memory_id : 0);
+    }
+    
+    log_info("📊 Benchmark de búsqueda+lectura con liberaciones concurrentes (%d ms por prueba):",
+             duration_ms);
+    log_info("   Hilos | memory_lock (M/s) |   EBR (M/s) | Liberados (lock/EBR)");
+    
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        uint64_t freed_locked, freed_epoch;
+        double locked = bench_lookup_throughput(ids, thread_counts[i], 1, duration_ms,
+                                                &freed_locked);
+        double epoch = bench_lookup_throughput(ids, thread_counts[i], 0, duration_ms,
+                                               &freed_epoch);
+        log_info("   %5d | %17.2f | %11.2f | %lu/%lu", thread_counts[i], locked, epoch,
+                 (unsigned long)freed_locked, (unsigned long)freed_epoch);
+    }
+    
+    for (int i = 0; i < LOOKUP_BENCH_BLOCKS; i++) {
+        free_shared_memory(atomic_load(&ids[i]));
+    }
+    epoch_barrier();
+    print_epoch_stats();
+}
+
 void cleanup_memory_manager() {
     if (memory_manager) {
         pthread_mutex_lock(&memory_manager->memory_lock);
         
         // Liberar todos los bloques
-        for (int i = 0; i < memory_manager->block_count; i++) {
-            SharedMemory* mem = memory_manager->memory_blocks[i];
-            pthread_mutex_destroy(&mem->lock);
-            free(mem->data);
-            free(mem);
+        for (int i = 0; i < memory_table_size(); i++) {
+            SharedMemory* mem = memory_table_slot(i);
+            if (!mem) continue;
+            release_shared_memory(mem);
+        }
+        
+        for (int i = 0; i < MEMORY_TABLE_SEGMENTS; i++) {
+            free(atomic_load(&memory_manager->segments[i]));
         }
         
         pthread_mutex_unlock(&memory_manager->memory_lock);
         pthread_mutex_destroy(&memory_manager->memory_lock);
         free(memory_manager);
         memory_manager = NULL;
+        
+        for (int i = 0; i < MEMORY_LOCK_STRIPES; i++) {
+            pthread_mutex_destroy(&block_locks[i]);
+        }
+        // Lo retirado aún vive en el slab: liberarlo antes de desmontarlo
+        cleanup_epoch_reclamation();
+        cleanup_slab_allocator();
     }
 }
\ No newline at end of file
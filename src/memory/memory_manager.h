@@ -2,16 +2,67 @@
 #define MEMORY_MANAGER_H
 
 #include "../common.h"
+#include <stdint.h>
+#include <stdatomic.h>
+#include "epoch.h"
 
 // ========================================
 // ESTRUCTURAS DEL GESTOR DE MEMORIA
 // ========================================
 
+// Los IDs de memoria son handles: índice de slot en los bits bajos y
+// generación en los altos. Liberar un bloque incrementa la generación del
+// slot, así que un handle viejo deja de validar aunque el slot se reutilice.
+#define MEMORY_INDEX_BITS      20
+#define MEMORY_INDEX_MASK      ((1 << MEMORY_INDEX_BITS) - 1)
+#define MEMORY_GENERATION_MASK 0x7FF   // 11 bits: el handle sigue siendo un int positivo
+
+// La tabla crece por segmentos que nunca se mueven, para que los lectores
+// puedan indexarla sin lock mientras otro hilo la amplía
+#define MEMORY_SEGMENT_BITS    10
+#define MEMORY_SEGMENT_SIZE    (1 << MEMORY_SEGMENT_BITS)
+#define MEMORY_TABLE_SEGMENTS  (1 << (MEMORY_INDEX_BITS - MEMORY_SEGMENT_BITS))
+
+// Locks de lectura/escritura compartidos por franjas de bloques
+#define MEMORY_LOCK_STRIPES    64
+
+// Granularidad del seguimiento de escrituras para la replicación
+#define MEMORY_PAGE_SIZE       4096
+
+// Bloques de hasta este tamaño se leen sin lock (seqlock) por defecto
+#define MEMORY_SEQLOCK_MAX     256
+
+// Snapshot copy-on-write de un bloque: crearla no copia nada; la primera
+// escritura sobre cada página guarda antes su contenido en pages[]. Las
+// páginas que siguen a NULL se leen del bloque vivo.
+typedef struct MemorySnapshot {
+    int memory_id;
+    size_t size;
+    uint32_t version;            // Versión del bloque al tomarla
+    time_t timestamp;
+    _Atomic(SharedMemory*) block; // NULL si el bloque se liberó
+    _Atomic int invalid;         // 1 = liberado sin poder copiar todas sus páginas
+    _Atomic(uint8_t*)* pages;    // Pre-imagen por página (NULL = sin cambios)
+    _Atomic size_t copied_pages;
+    struct MemorySnapshot* next; // Snapshots vivas del bloque (lock de franja)
+} MemorySnapshot;
+
 typedef struct {
-    SharedMemory* memory_blocks[MAX_MEMORY_BLOCKS];
-    int block_count;
-    int next_memory_id;
-    pthread_mutex_t memory_lock;
+    _Atomic(SharedMemory*) block;
+    _Atomic uint32_t generation;
+    int next_free;               // Siguiente slot libre (-1 = fin)
+    MemorySnapshot* snapshots;   // Snapshots vivas del bloque del slot
+} MemorySlot;
+
+typedef struct {
+    _Atomic(MemorySlot*) segments[MEMORY_TABLE_SEGMENTS];
+    _Atomic int slot_count;      // Slots usados alguna vez (high-water mark)
+    int free_head;               // Lista de slots libres (-1 = vacía)
+    int block_count;             // Bloques vivos
+    size_t seqlock_max_size;     // Umbral de lectura optimista (0 = desactivada)
+    _Atomic int snapshot_count;  // Snapshots vivas
+    _Atomic uint64_t snapshot_pages_copied;
+    pthread_mutex_t memory_lock; // Solo para asignar/liberar
 } DistributedMemoryManager;
 
 // ========================================
@@ -22,14 +73,32 @@ typedef struct {
 void init_memory_manager();
 void cleanup_memory_manager();
 
-// Gestión de memoria
+// Gestión de memoria. Los bloques se liberan por reclamación por épocas
+// (epoch.h): un puntero de get_shared_memory() o memory_table_slot() sigue
+// siendo válido hasta el epoch_exit() de la sección en que se obtuvo.
 SharedMemory* allocate_shared_memory(size_t size, int owner_node);
-int free_shared_memory(int memory_id);
-SharedMemory* get_shared_memory(int memory_id);
+int free_shared_memory(int memory_id);          // Suelta una referencia
+SharedMemory* get_shared_memory(int memory_id); // Dentro de epoch_enter/exit
+SharedMemory* acquire_shared_memory(int memory_id); // Referencia propia
+
+// Recorrido de la tabla (devuelve NULL en slots libres)
+int memory_table_size();
+SharedMemory* memory_table_slot(int index);
 
 // Operaciones de lectura/escritura
 int write_shared_memory(SharedMemory* mem, void* data, size_t size, size_t offset);
 int read_shared_memory(SharedMemory* mem, void* buffer, size_t size, size_t offset);
+int read_shared_memory_by_id(int memory_id, void* buffer, size_t size, size_t offset);
+
+// Lectura optimista: bloques <= max_size se leen sin lock
+void set_seqlock_threshold(size_t max_size);
+
+// Snapshots copy-on-write (creación O(1), coste proporcional a las
+// páginas escritas después)
+MemorySnapshot* snapshot_shared_memory(SharedMemory* mem);
+int read_memory_snapshot(MemorySnapshot* snap, void* buffer, size_t size, size_t offset);
+int restore_memory_snapshot(MemorySnapshot* snap);
+void release_memory_snapshot(MemorySnapshot* snap);
 
 // Replicación
 int replicate_memory(SharedMemory* mem, int target_node);
@@ -38,6 +107,12 @@ void sync_memory_replicas(SharedMemory* mem);
 // Estadísticas
 void print_memory_stats();
 
+// Benchmark de lectores (1, 8 y 64 hilos): seqlock frente a mutex
+void benchmark_memory_reads(size_t block_size, int duration_ms);
+
+// Benchmark de búsqueda+lectura mientras otro hilo libera: memory_lock frente a EBR
+void benchmark_memory_lookups(int duration_ms);
+
 // Variable global
 extern DistributedMemoryManager* memory_manager;
 
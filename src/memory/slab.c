@@ -0,0 +1,340 @@
+#include "../common.h"
+#include "slab.h"
+#include <sys/mman.h>
+#include <stdatomic.h>
+
+// ========================================
+// ASIGNADOR SLAB
+// ========================================
+
+// Los objetos libres se enlazan a través de su primera palabra
+typedef struct SlabObject {
+    struct SlabObject* next;
+} SlabObject;
+
+// Registro de cada región pedida con mmap, para liberarlas al final
+typedef struct SlabRegion {
+    void* base;
+    size_t length;
+    struct SlabRegion* next;
+} SlabRegion;
+
+typedef struct {
+    size_t object_size;
+    SlabObject* free_list;        // Lista central (requiere lock)
+    int free_count;
+    pthread_mutex_t lock;
+} SlabClass;
+
+// Caché local de un hilo para una clase
+typedef struct {
+    SlabObject* head;
+    int count;
+} SlabCache;
+
+typedef struct {
+    SlabCache classes[SLAB_CLASS_COUNT + 1];  // La última es la de registros
+} SlabThreadCache;
+
+typedef struct {
+    SlabClass classes[SLAB_CLASS_COUNT + 1];
+    SlabRegion* regions;
+    pthread_mutex_t region_lock;
+    pthread_key_t cache_key;
+
+    // Estadísticas
+    _Atomic uint64_t slab_allocs;
+    _Atomic uint64_t slab_frees;
+    _Atomic uint64_t large_allocs;
+    _Atomic uint64_t large_frees;
+    _Atomic uint64_t cache_hits;
+    _Atomic size_t mapped_bytes;
+    _Atomic size_t large_bytes;
+} SlabAllocator;
+
+#define SLAB_RECORD_CLASS SLAB_CLASS_COUNT
+
+static SlabAllocator* slab_allocator = NULL;
+static _Thread_local SlabThreadCache* thread_cache = NULL;
+
+// ========================================
+// CLASES DE TAMAÑO
+// ========================================
+
+static int size_to_class(size_t size) {
+    int shift = SLAB_MIN_SHIFT;
+    while (shift <= SLAB_MAX_SHIFT && ((size_t)1 << shift) < size) {
+        shift++;
+    }
+    return shift <= SLAB_MAX_SHIFT ? shift - SLAB_MIN_SHIFT : -1;
+}
+
+static size_t page_round(size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+// Pedir un slab nuevo y trocearlo en la lista central (requiere lock de clase)
+static int refill_class(SlabClass* cls) {
+    size_t length = cls->object_size * 16;
+    if (length < SLAB_SIZE) length = SLAB_SIZE;
+    length = page_round(length);
+
+    void* base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return -1;
+
+    SlabRegion* region = (SlabRegion*)malloc(sizeof(SlabRegion));
+    if (!region) {
+        munmap(base, length);
+        return -1;
+    }
+    region->base = base;
+    region->length = length;
+
+    pthread_mutex_lock(&slab_allocator->region_lock);
+    region->next = slab_allocator->regions;
+    slab_allocator->regions = region;
+    pthread_mutex_unlock(&slab_allocator->region_lock);
+
+    size_t count = length / cls->object_size;
+    for (size_t i = count; i > 0; i--) {
+        SlabObject* obj = (SlabObject*)((char*)base + (i - 1) * cls->object_size);
+        obj->next = cls->free_list;
+        cls->free_list = obj;
+    }
+    cls->free_count += (int)count;
+    atomic_fetch_add(&slab_allocator->mapped_bytes, length);
+
+    return 0;
+}
+
+// ========================================
+// CACHÉ POR HILO
+// ========================================
+
+// Devolver objetos de la caché local a la lista central
+static void flush_cache(SlabCache* cache, int class_index, int keep) {
+    SlabClass* cls = &slab_allocator->classes[class_index];
+
+    pthread_mutex_lock(&cls->lock);
+    while (cache->count > keep) {
+        SlabObject* obj = cache->head;
+        cache->head = obj->next;
+        cache->count--;
+        obj->next = cls->free_list;
+        cls->free_list = obj;
+        cls->free_count++;
+    }
+    pthread_mutex_unlock(&cls->lock);
+}
+
+static void destroy_thread_cache(void* arg) {
+    SlabThreadCache* tc = (SlabThreadCache*)arg;
+    if (slab_allocator) {
+        for (int i = 0; i <= SLAB_CLASS_COUNT; i++) {
+            flush_cache(&tc->classes[i], i, 0);
+        }
+    }
+    free(tc);
+}
+
+static SlabThreadCache* get_thread_cache() {
+    if (!thread_cache) {
+        thread_cache = (SlabThreadCache*)calloc(1, sizeof(SlabThreadCache));
+        if (thread_cache) {
+            pthread_setspecific(slab_allocator->cache_key, thread_cache);
+        }
+    }
+    return thread_cache;
+}
+
+static void* cache_pop(int class_index) {
+    SlabThreadCache* tc = get_thread_cache();
+    SlabClass* cls = &slab_allocator->classes[class_index];
+
+    if (!tc) {
+        // Sin caché local: ir directamente a la lista central
+        pthread_mutex_lock(&cls->lock);
+        if (!cls->free_list && refill_class(cls) < 0) {
+            pthread_mutex_unlock(&cls->lock);
+            return NULL;
+        }
+        SlabObject* obj = cls->free_list;
+        cls->free_list = obj->next;
+        cls->free_count--;
+        pthread_mutex_unlock(&cls->lock);
+        return obj;
+    }
+
+    SlabCache* cache = &tc->classes[class_index];
+    if (cache->head) {
+        atomic_fetch_add_explicit(&slab_allocator->cache_hits, 1, memory_order_relaxed);
+    } else {
+        // Traer un lote de la lista central
+        pthread_mutex_lock(&cls->lock);
+        if (!cls->free_list && refill_class(cls) < 0) {
+            pthread_mutex_unlock(&cls->lock);
+            return NULL;
+        }
+        while (cls->free_list && cache->count < SLAB_TLS_BATCH) {
+            SlabObject* obj = cls->free_list;
+            cls->free_list = obj->next;
+            cls->free_count--;
+            obj->next = cache->head;
+            cache->head = obj;
+            cache->count++;
+        }
+        pthread_mutex_unlock(&cls->lock);
+    }
+
+    SlabObject* obj = cache->head;
+    cache->head = obj->next;
+    cache->count--;
+    return obj;
+}
+
+static void cache_push(int class_index, void* ptr) {
+    SlabThreadCache* tc = get_thread_cache();
+    SlabObject* obj = (SlabObject*)ptr;
+
+    if (!tc) {
+        SlabClass* cls = &slab_allocator->classes[class_index];
+        pthread_mutex_lock(&cls->lock);
+        obj->next = cls->free_list;
+        cls->free_list = obj;
+        cls->free_count++;
+        pthread_mutex_unlock(&cls->lock);
+        return;
+    }
+
+    SlabCache* cache = &tc->classes[class_index];
+    obj->next = cache->head;
+    cache->head = obj;
+    cache->count++;
+
+    // Caché llena: devolver la mitad a la lista central
+    if (cache->count > SLAB_TLS_CAPACITY) {
+        flush_cache(cache, class_index, SLAB_TLS_BATCH);
+    }
+}
+
+// ========================================
+// API PÚBLICA
+// ========================================
+
+void init_slab_allocator(size_t record_size) {
+    slab_allocator = (SlabAllocator*)calloc(1, sizeof(SlabAllocator));
+
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slab_allocator->classes[i].object_size = (size_t)1 << (i + SLAB_MIN_SHIFT);
+        pthread_mutex_init(&slab_allocator->classes[i].lock, NULL);
+    }
+
+    // Registros redondeados a múltiplo de 16 para mantener la alineación
+    size_t rounded = (record_size + 15) & ~(size_t)15;
+    slab_allocator->classes[SLAB_RECORD_CLASS].object_size = rounded;
+    pthread_mutex_init(&slab_allocator->classes[SLAB_RECORD_CLASS].lock, NULL);
+
+    pthread_mutex_init(&slab_allocator->region_lock, NULL);
+    pthread_key_create(&slab_allocator->cache_key, destroy_thread_cache);
+
+    log_info("Asignador slab inicializado (%d clases, %zu-%zu bytes)",
+             SLAB_CLASS_COUNT, (size_t)1 << SLAB_MIN_SHIFT, (size_t)1 << SLAB_MAX_SHIFT);
+}
+
+void* slab_alloc(size_t size, uint8_t* size_class) {
+    if (size == 0) size = 1;
+
+    int class_index = size_to_class(size);
+    if (class_index < 0) {
+        // Bloque grande: mmap directo, el kernel ya lo entrega a cero
+        size_t length = page_round(size);
+        void* ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) return NULL;
+
+        atomic_fetch_add(&slab_allocator->large_allocs, 1);
+        atomic_fetch_add(&slab_allocator->large_bytes, length);
+        *size_class = SLAB_CLASS_LARGE;
+        return ptr;
+    }
+
+    void* ptr = cache_pop(class_index);
+    if (!ptr) return NULL;
+
+    // Los objetos reciclados pueden tener datos previos
+    memset(ptr, 0, size);
+    atomic_fetch_add_explicit(&slab_allocator->slab_allocs, 1, memory_order_relaxed);
+    *size_class = (uint8_t)class_index;
+    return ptr;
+}
+
+void slab_free(void* ptr, size_t size, uint8_t size_class) {
+    if (!ptr) return;
+
+    if (size_class == SLAB_CLASS_LARGE) {
+        size_t length = page_round(size ? size : 1);
+        munmap(ptr, length);
+        atomic_fetch_add(&slab_allocator->large_frees, 1);
+        atomic_fetch_sub(&slab_allocator->large_bytes, length);
+        return;
+    }
+
+    cache_push(size_class, ptr);
+    atomic_fetch_add_explicit(&slab_allocator->slab_frees, 1, memory_order_relaxed);
+}
+
+void* slab_alloc_record() {
+    void* record = cache_pop(SLAB_RECORD_CLASS);
+    if (record) {
+        memset(record, 0, slab_allocator->classes[SLAB_RECORD_CLASS].object_size);
+    }
+    return record;
+}
+
+void slab_free_record(void* record) {
+    if (record) cache_push(SLAB_RECORD_CLASS, record);
+}
+
+void print_slab_stats() {
+    if (!slab_allocator) return;
+
+    log_info("   Slab: %lu asignaciones | %lu liberaciones | %lu aciertos de caché local",
+             (unsigned long)atomic_load(&slab_allocator->slab_allocs),
+             (unsigned long)atomic_load(&slab_allocator->slab_frees),
+             (unsigned long)atomic_load(&slab_allocator->cache_hits));
+    log_info("   Slab: %zu KB mapeados | Grandes (mmap): %lu vivos, %zu KB",
+             atomic_load(&slab_allocator->mapped_bytes) / 1024,
+             (unsigned long)(atomic_load(&slab_allocator->large_allocs) -
+                             atomic_load(&slab_allocator->large_frees)),
+             atomic_load(&slab_allocator->large_bytes) / 1024);
+}
+
+void cleanup_slab_allocator() {
+    if (!slab_allocator) return;
+
+    // La caché del hilo actual apunta a slabs que van a desaparecer
+    if (thread_cache) {
+        pthread_setspecific(slab_allocator->cache_key, NULL);
+        free(thread_cache);
+        thread_cache = NULL;
+    }
+    pthread_key_delete(slab_allocator->cache_key);
+
+    SlabRegion* region = slab_allocator->regions;
+    while (region) {
+        SlabRegion* next = region->next;
+        munmap(region->base, region->length);
+        free(region);
+        region = next;
+    }
+
+    for (int i = 0; i <= SLAB_CLASS_COUNT; i++) {
+        pthread_mutex_destroy(&slab_allocator->classes[i].lock);
+    }
+    pthread_mutex_destroy(&slab_allocator->region_lock);
+
+    free(slab_allocator);
+    slab_allocator = NULL;
+}
@@ -0,0 +1,44 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "../common.h"
+#include <stdint.h>
+
+// ========================================
+// ASIGNADOR SLAB POR CLASES DE TAMAÑO
+// ========================================
+
+// Clases de potencias de dos entre 16 B y 64 KB; lo que supere el máximo
+// se pide directamente con mmap
+#define SLAB_MIN_SHIFT     4
+#define SLAB_MAX_SHIFT     16
+#define SLAB_CLASS_COUNT   (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+#define SLAB_CLASS_LARGE   0xFF
+
+// Tamaño mínimo de cada slab pedido al sistema
+#define SLAB_SIZE          (256 * 1024)
+
+// Caché por hilo: se rellena/vacía contra la lista central por lotes
+#define SLAB_TLS_BATCH     32
+#define SLAB_TLS_CAPACITY  (2 * SLAB_TLS_BATCH)
+
+// ========================================
+// FUNCIONES PÚBLICAS
+// ========================================
+
+// Inicialización (record_size: tamaño de los registros de metadatos)
+void init_slab_allocator(size_t record_size);
+void cleanup_slab_allocator();
+
+// Payloads: devuelve memoria a cero y la clase usada en size_class
+void* slab_alloc(size_t size, uint8_t* size_class);
+void slab_free(void* ptr, size_t size, uint8_t size_class);
+
+// Registros de metadatos de tamaño fijo
+void* slab_alloc_record();
+void slab_free_record(void* record);
+
+// Estadísticas
+void print_slab_stats();
+
+#endif // SLAB_H
@@ -1,5 +1,6 @@
 #include "../common.h"
 #include "network.h"
+#include "../sync/sync.h"
 #include <sys/select.h>
 #include <fcntl.h>
 
@@ -64,6 +65,18 @@ int broadcast_message(Node nodes[], int node_count, Message* msg, int exclude_no
     return success_count;
 }
 
+int send_message_to(NetworkManager* nm, int node_id, Message* msg) {
+    for (int i = 0; i < nm->node_count; i++) {
+        if (nm->nodes[i].node_id == node_id) {
+            clock_stamp_message(nm->clock, msg);
+            int rc = send_message(&nm->nodes[i], msg);
+            if (rc == 0) nm->messages_sent++;
+            return rc;
+        }
+    }
+    return -1;
+}
+
 void* network_listener_thread(void* arg) {
     NetworkManager* nm = (NetworkManager*)arg;
     
@@ -88,7 +101,8 @@ void* network_listener_thread(void* arg) {
         return NULL;
     }
     
-    if (listen(server_fd, 10) < 0) {
+    // Cola amplia: cada mensaje es una conexión y los locks generan ráfagas
+    if (listen(server_fd, SOMAXCONN) < 0) {
         log_error("Error en listen: %s", strerror(errno));
         close(server_fd);
         return NULL;
@@ -122,7 +136,7 @@ void* network_listener_thread(void* arg) {
             int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
             if (client_fd >= 0) {
                 Message msg;
-                ssize_t received = recv(client_fd, &msg, sizeof(Message), 0);
+                ssize_t received = recv(client_fd, &msg, sizeof(Message), MSG_WAITALL);
                 
                 if (received > 0) {
                     nm->messages_received++;
@@ -141,6 +155,12 @@ void* network_listener_thread(void* arg) {
 
 void process_received_message(NetworkManager* nm, Message* msg) {
     log_debug("Mensaje recibido: tipo=%d, origen=%d", msg->type, msg->source_node);
+    clock_receive_message(nm->clock, msg);
+    
+    if (msg->type >= 0 && msg->type < MSG_TYPE_COUNT && nm->handlers[msg->type]) {
+        nm->handlers[msg->type](nm->handler_context[msg->type], msg);
+        return;
+    }
     
     switch(msg->type) {
         case MSG_HEARTBEAT:
@@ -165,7 +185,8 @@ void process_received_message(NetworkManager* nm, Message* msg) {
             
         case MSG_LOCK_REQUEST:
         case MSG_LOCK_RELEASE:
-            log_debug("Mensaje de lock recibido");
+        case MSG_LOCK_REPLY:
+            log_debug("Mensaje de lock recibido sin mutex registrado");
             break;
             
         default:
@@ -210,28 +231,38 @@ void handle_discovery(NetworkManager* nm, Message* msg) {
 
 void send_heartbeat(NetworkManager* nm) {
     Message msg;
+    memset(&msg, 0, sizeof(msg));
     msg.type = MSG_HEARTBEAT;
     msg.source_node = nm->node_id;
     msg.dest_node = -1; // Broadcast
     msg.data_size = 0;
+    clock_stamp_message(nm->clock, &msg);
     
     broadcast_message(nm->nodes, nm->node_count, &msg, nm->node_id);
     log_debug("💓 Heartbeat enviado");
 }
 
 NetworkManager* create_network_manager(int node_id, int port) {
-    NetworkManager* nm = (NetworkManager*)malloc(sizeof(NetworkManager));
+    NetworkManager* nm = (NetworkManager*)calloc(1, sizeof(NetworkManager));
     nm->node_id = node_id;
     nm->port = port;
     nm->running = 0;
     nm->node_count = 0;
     nm->messages_sent = 0;
     nm->messages_received = 0;
+    nm->clock = create_logical_clock(node_id);
     
     log_info("Gestor de red creado para nodo %d en puerto %d", node_id, port);
     return nm;
 }
 
+void register_message_handler(NetworkManager* nm, MessageType type,
+                              MessageHandler handler, void* context) {
+    if (type < 0 || type >= MSG_TYPE_COUNT) return;
+    nm->handler_context[type] = context;
+    nm->handlers[type] = handler;
+}
+
 void start_network_manager(NetworkManager* nm) {
     nm->running = 1;
     pthread_create(&nm->listener_thread, NULL, network_listener_thread, nm);
@@ -249,6 +280,7 @@ void stop_network_manager(NetworkManager* nm) {
 void destroy_network_manager(NetworkManager* nm) {
     if (nm) {
         stop_network_manager(nm);
+        destroy_logical_clock(nm->clock);
         free(nm);
     }
 }
\ No newline at end of file
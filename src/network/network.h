@@ -7,6 +7,11 @@
 // ESTRUCTURAS DE RED
 // ========================================
 
+// Manejador de un tipo de mensaje registrado por otro módulo (p. ej. sync)
+typedef void (*MessageHandler)(void* context, Message* msg);
+
+struct LogicalClock;
+
 typedef struct {
     int node_id;
     int port;
@@ -16,6 +21,9 @@ typedef struct {
     int running;
     int messages_sent;
     int messages_received;
+    MessageHandler handlers[MSG_TYPE_COUNT];
+    void* handler_context[MSG_TYPE_COUNT];
+    struct LogicalClock* clock;  // Sella lo que sale y avanza con lo que llega
 } NetworkManager;
 
 // ========================================
@@ -33,6 +41,13 @@ int send_message(Node* dest_node, Message* msg);
 int broadcast_message(Node nodes[], int node_count, Message* msg, int exclude_node);
 void send_heartbeat(NetworkManager* nm);
 
+// Enviar a un nodo conocido por ID
+int send_message_to(NetworkManager* nm, int node_id, Message* msg);
+
+// Entregar los mensajes de un tipo a otro módulo en lugar de procesarlos aquí
+void register_message_handler(NetworkManager* nm, MessageType type,
+                              MessageHandler handler, void* context);
+
 // Procesamiento de mensajes
 void* network_listener_thread(void* arg);
 void process_received_message(NetworkManager* nm, Message* msg);
@@ -1,65 +1,186 @@
 #include "../common.h"
 #include "sync.h"
+#include <stddef.h>
 
 // ========================================
-// SINCRONIZACIÓN DISTRIBUIDA (Algoritmo de Lamport)
+// SINCRONIZACIÓN DISTRIBUIDA (Ricart-Agrawala)
 // ========================================
 
-LamportMutex* create_lamport_mutex(int node_id) {
-    LamportMutex* mutex = (LamportMutex*)malloc(sizeof(LamportMutex));
-    mutex->timestamp = 0;
+// Mutex con red registrados, para enrutar los mensajes que llegan
+static LamportMutex* networked_mutexes = NULL;
+static pthread_mutex_t networked_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void token_acquire(LamportMutex* mutex);
+static void token_release(LamportMutex* mutex);
+
+static LamportMutex* alloc_lamport_mutex(int node_id, int lock_id) {
+    LamportMutex* mutex = (LamportMutex*)calloc(1, sizeof(LamportMutex));
+    if (!mutex) return NULL;
+    mutex->lock_id = lock_id;
     mutex->node_id = node_id;
-    mutex->requesting = 0;
-    mutex->granted = 0;
-    mutex->replies_received = 0;
     pthread_mutex_init(&mutex->lock, NULL);
     pthread_cond_init(&mutex->cond, NULL);
+    return mutex;
+}
+
+LamportMutex* create_lamport_mutex(int node_id) {
+    LamportMutex* mutex = alloc_lamport_mutex(node_id, 0);
     
     log_info("Mutex de Lamport creado para nodo %d", node_id);
     return mutex;
 }
 
-void acquire_distributed_lock(LamportMutex* mutex, int total_nodes) {
+static int send_lock_message(NetworkManager* nm, int dest, MessageType type,
+                             int lock_id, int timestamp, int request_timestamp) {
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = type;
+    msg.source_node = nm->node_id;
+    msg.dest_node = dest;
+    
+    LockMessage body = { lock_id, timestamp, request_timestamp };
+    memcpy(msg.data, &body, sizeof(body));
+    msg.data_size = sizeof(body);
+    
+    return send_message_to(nm, dest, &msg);
+}
+
+static int node_is_down(NetworkManager* nm, int node_id) {
+    for (int i = 0; i < nm->node_count; i++) {
+        if (nm->nodes[i].node_id == node_id) {
+            return nm->nodes[i].status == NODE_OFFLINE || nm->nodes[i].status == NODE_FAILED;
+        }
+    }
+    return 1;
+}
+
+// Contar como respondido a un par (requiere mutex->lock)
+static void mark_replied(LamportMutex* mutex, int node_id) {
+    for (int i = 0; i < mutex->awaiting_count; i++) {
+        if (mutex->awaiting[i] == node_id) {
+            mutex->awaiting[i] = -1;
+            mutex->replies_received++;
+            pthread_cond_broadcast(&mutex->cond);
+            return;
+        }
+    }
+}
+
+void acquire_distributed_lock(LamportMutex* mutex) {
+    if (mutex->algorithm == LOCK_TOKEN) {
+        token_acquire(mutex);
+        return;
+    }
+    
     pthread_mutex_lock(&mutex->lock);
     
+    // Un solo hilo local compite por el lock distribuido a la vez
+    while (mutex->requesting || mutex->granted) {
+        pthread_cond_wait(&mutex->cond, &mutex->lock);
+    }
+    
     mutex->requesting = 1;
-    mutex->timestamp++;
+    mutex->request_timestamp = ++mutex->timestamp;
     mutex->replies_received = 0;
+    mutex->awaiting_count = 0;
+    
+    NetworkManager* nm = mutex->network;
+    if (nm) {
+        for (int i = 0; i < nm->node_count; i++) {
+            Node* node = &nm->nodes[i];
+            if (node->node_id != mutex->node_id &&
+                node->status != NODE_OFFLINE && node->status != NODE_FAILED) {
+                mutex->awaiting[mutex->awaiting_count++] = node->node_id;
+            }
+        }
+    }
+    
+    int timestamp = mutex->request_timestamp;
+    int peers = mutex->awaiting_count;
+    int targets[MAX_NODES];
+    memcpy(targets, mutex->awaiting, peers * sizeof(int));
+    
+    log_debug("🔒 Nodo %d solicitando lock %d (timestamp: %d, %d pares)",
+              mutex->node_id, mutex->lock_id, timestamp, peers);
+    pthread_mutex_unlock(&mutex->lock);
     
-    log_info("🔒 Nodo %d solicitando lock (timestamp: %d)", 
-             mutex->node_id, mutex->timestamp);
+    // Peticiones fuera del lock: las respuestas pueden llegar mientras tanto
+    int sent = 0;
+    for (int i = 0; i < peers; i++) {
+        if (send_lock_message(nm, targets[i], MSG_LOCK_REQUEST, mutex->lock_id,
+                              timestamp, 0) == 0) {
+            sent++;
+        } else {
+            // Inalcanzable: no puede estar dentro ni competir
+            pthread_mutex_lock(&mutex->lock);
+            mark_replied(mutex, targets[i]);
+            pthread_mutex_unlock(&mutex->lock);
+        }
+    }
     
-    // En implementación real, enviaríamos REQUEST a todos los nodos
-    // Aquí simulamos espera de respuestas
+    pthread_mutex_lock(&mutex->lock);
+    mutex->messages_sent += sent;
     
-    // Esperar confirmación de todos los nodos
-    while (mutex->replies_received < total_nodes - 1) {
-        // Timeout simulado
+    while (mutex->replies_received < mutex->awaiting_count) {
         struct timespec ts;
         clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec += 2; // 2 segundos timeout
+        ts.tv_sec += LOCK_REPLY_CHECK_MS / 1000;
+        ts.tv_nsec += (LOCK_REPLY_CHECK_MS % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
         
-        int result = pthread_cond_timedwait(&mutex->cond, &mutex->lock, &ts);
-        if (result == ETIMEDOUT) {
-            log_debug("Timeout esperando respuestas, asumiendo granted");
-            mutex->replies_received = total_nodes - 1;
+        if (pthread_cond_timedwait(&mutex->cond, &mutex->lock, &ts) == ETIMEDOUT) {
+            // Un par que el detector de fallos dio por caído ya no responderá
+            for (int i = 0; i < mutex->awaiting_count; i++) {
+                int node = mutex->awaiting[i];
+                if (node >= 0 && node_is_down(nm, node)) {
+                    log_info("Nodo %d caído: se omite su respuesta al lock %d",
+                             node, mutex->lock_id);
+                    mark_replied(mutex, node);
+                }
+            }
         }
     }
     
+    mutex->requesting = 0;
     mutex->granted = 1;
-    log_info("✅ Nodo %d obtuvo el lock", mutex->node_id);
+    mutex->acquisitions++;
+    log_debug("✅ Nodo %d obtuvo el lock %d", mutex->node_id, mutex->lock_id);
     
     pthread_mutex_unlock(&mutex->lock);
 }
 
 void release_distributed_lock(LamportMutex* mutex) {
+    int nodes[MAX_NODES], timestamps[MAX_NODES];
+    
+    if (mutex->algorithm == LOCK_TOKEN) {
+        token_release(mutex);
+        return;
+    }
+    
     pthread_mutex_lock(&mutex->lock);
     
-    mutex->requesting = 0;
     mutex->granted = 0;
+    int count = mutex->deferred_count;
+    memcpy(nodes, mutex->deferred_nodes, count * sizeof(int));
+    memcpy(timestamps, mutex->deferred_timestamps, count * sizeof(int));
+    mutex->deferred_count = 0;
+    int clock = ++mutex->timestamp;
+    
+    log_debug("🔓 Nodo %d liberando lock %d (%d respuestas diferidas)",
+              mutex->node_id, mutex->lock_id, count);
+    pthread_mutex_unlock(&mutex->lock);
     
-    log_info("🔓 Nodo %d liberando lock", mutex->node_id);
+    // Contestar a quienes esperaban antes de dejar competir a otro hilo local
+    for (int i = 0; i < count; i++) {
+        send_lock_message(mutex->network, nodes[i], MSG_LOCK_REPLY, mutex->lock_id,
+                          clock, timestamps[i]);
+    }
     
+    pthread_mutex_lock(&mutex->lock);
+    mutex->messages_sent += count;
     pthread_cond_broadcast(&mutex->cond);
     pthread_mutex_unlock(&mutex->lock);
 }
@@ -67,149 +188,1600 @@ void release_distributed_lock(LamportMutex* mutex) {
 void handle_lock_request(LamportMutex* mutex, int requesting_node, int request_timestamp) {
     pthread_mutex_lock(&mutex->lock);
     
-    // Comparar timestamps (algoritmo de Lamport)
-    int should_grant = 0;
-    
-    if (!mutex->requesting) {
-        should_grant = 1;
-    } else if (request_timestamp < mutex->timestamp) {
-        should_grant = 1;
-    } else if (request_timestamp == mutex->timestamp && requesting_node < mutex->node_id) {
-        should_grant = 1;
+    if (request_timestamp > mutex->timestamp) {
+        mutex->timestamp = request_timestamp;
     }
+    int clock = ++mutex->timestamp;
+    
+    // Diferir si estamos dentro, o si nuestra petición es anterior
+    int defer = mutex->granted ||
+                (mutex->requesting &&
+                 (mutex->request_timestamp < request_timestamp ||
+                  (mutex->request_timestamp == request_timestamp &&
+                   mutex->node_id < requesting_node)));
     
-    if (should_grant) {
-        log_debug("Nodo %d: Concediendo lock a nodo %d", 
+    if (defer && mutex->deferred_count < MAX_NODES) {
+        mutex->deferred_nodes[mutex->deferred_count] = requesting_node;
+        mutex->deferred_timestamps[mutex->deferred_count] = request_timestamp;
+        mutex->deferred_count++;
+        log_debug("Nodo %d: Postergando respuesta a nodo %d",
                   mutex->node_id, requesting_node);
-        // Enviar REPLY al nodo solicitante
     } else {
-        log_debug("Nodo %d: Postergando respuesta a nodo %d", 
-                  mutex->node_id, requesting_node);
+        defer = 0;
+        mutex->messages_sent++;
     }
     
     pthread_mutex_unlock(&mutex->lock);
+    
+    if (!defer) {
+        log_debug("Nodo %d: Concediendo lock a nodo %d", mutex->node_id, requesting_node);
+        send_lock_message(mutex->network, requesting_node, MSG_LOCK_REPLY, mutex->lock_id,
+                          clock, request_timestamp);
+    }
 }
 
-void handle_lock_reply(LamportMutex* mutex) {
+void handle_lock_reply(LamportMutex* mutex, int replying_node, int request_timestamp) {
     pthread_mutex_lock(&mutex->lock);
     
-    mutex->replies_received++;
+    // Las respuestas a una petición anterior no cuentan
+    if (mutex->requesting && request_timestamp == mutex->request_timestamp) {
+        mark_replied(mutex, replying_node);
+    }
+    
+    pthread_mutex_unlock(&mutex->lock);
+}
+
+static LamportMutex* find_networked_mutex(NetworkManager* nm, int lock_id) {
+    pthread_mutex_lock(&networked_lock);
+    LamportMutex* mutex = networked_mutexes;
+    while (mutex && (mutex->network != nm || mutex->lock_id != lock_id)) {
+        mutex = mutex->next;
+    }
+    pthread_mutex_unlock(&networked_lock);
+    return mutex;
+}
+
+// Entrada desde el listener de red
+static void lock_message_handler(void* context, Message* msg) {
+    NetworkManager* nm = (NetworkManager*)context;
+    LockMessage body;
+    if (msg->data_size < (int)sizeof(body)) return;
+    memcpy(&body, msg->data, sizeof(body));
+    
+    LamportMutex* mutex = find_networked_mutex(nm, body.lock_id);
+    
+    if (msg->type == MSG_LOCK_REQUEST) {
+        if (mutex) {
+            handle_lock_request(mutex, msg->source_node, body.timestamp);
+        } else {
+            // Sin interés en ese lock: conceder en el acto
+            send_lock_message(nm, msg->source_node, MSG_LOCK_REPLY, body.lock_id,
+                              body.timestamp, body.timestamp);
+        }
+    } else if (msg->type == MSG_LOCK_REPLY && mutex) {
+        pthread_mutex_lock(&mutex->lock);
+        if (body.timestamp > mutex->timestamp) mutex->timestamp = body.timestamp;
+        pthread_mutex_unlock(&mutex->lock);
+        handle_lock_reply(mutex, msg->source_node, body.request_timestamp);
+    }
+}
+
+LamportMutex* create_networked_mutex(NetworkManager* nm, int lock_id) {
+    LamportMutex* mutex = alloc_lamport_mutex(nm->node_id, lock_id);
+    if (!mutex) return NULL;
+    mutex->network = nm;
+    
+    register_message_handler(nm, MSG_LOCK_REQUEST, lock_message_handler, nm);
+    register_message_handler(nm, MSG_LOCK_REPLY, lock_message_handler, nm);
+    
+    pthread_mutex_lock(&networked_lock);
+    mutex->next = networked_mutexes;
+    networked_mutexes = mutex;
+    pthread_mutex_unlock(&networked_lock);
+    
+    log_debug("Mutex distribuido %d creado en nodo %d", lock_id, nm->node_id);
+    return mutex;
+}
+
+// ========================================
+// MUTEX POR TOKEN (árbol de Raymond)
+// ========================================
+
+// Envíos decididos bajo el lock y hechos fuera de él
+typedef struct {
+    int token_to;                // Pasar el token a este vecino
+    int request_to;              // Pedir el token a este vecino
+    int generation;
+} TokenAction;
+
+static int send_token_message(LamportMutex* mutex, int dest, int kind, int generation, int flag) {
+    TokenMessage body;
+    memset(&body, 0, offsetof(TokenMessage, members));
+    body.lock_id = mutex->lock_id;
+    body.kind = kind;
+    body.generation = generation;
+    body.flag = flag;
+    
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_TOKEN;
+    msg.source_node = mutex->node_id;
+    msg.dest_node = dest;
+    memcpy(msg.data, &body, offsetof(TokenMessage, members));
+    msg.data_size = offsetof(TokenMessage, members);
+    
+    return send_message_to(mutex->network, dest, &msg);
+}
+
+static int member_index(TokenState* t, int node_id) {
+    for (int i = 0; i < t->member_count; i++) {
+        if (t->members[i] == node_id) return i;
+    }
+    return -1;
+}
+
+// Vecino por el que se llega a 'root' en el árbol binario sobre members[]
+static int token_next_hop(TokenState* t, int self, int root) {
+    int i = member_index(t, self);
+    int r = member_index(t, root);
+    if (i < 0 || r < 0 || i == r) return self;
+    
+    int x = r;
+    while (x > i) x = (x - 1) / 2;
+    if (x != i) return t->members[(i - 1) / 2];
+    
+    // Somos ancestro de la raíz: bajar por el hijo que la contiene
+    int child = r;
+    while ((child - 1) / 2 != i) child = (child - 1) / 2;
+    return t->members[child];
+}
+
+static void token_enqueue(TokenState* t, int node_id) {
+    for (int i = 0; i < t->queue_count; i++) {
+        if (t->queue[(t->queue_head + i) % MAX_NODES] == node_id) return;
+    }
+    if (t->queue_count < MAX_NODES) {
+        t->queue[(t->queue_head + t->queue_count) % MAX_NODES] = node_id;
+        t->queue_count++;
+    }
+}
+
+// Pasar el token o pedirlo según la cola (requiere mutex->lock)
+static void token_advance(LamportMutex* mutex, TokenAction* act) {
+    TokenState* t = mutex->token;
+    act->token_to = -1;
+    act->request_to = -1;
+    act->generation = t->generation;
+    
+    if (t->holder == mutex->node_id && !t->in_use && t->queue_count > 0) {
+        int head = t->queue[t->queue_head];
+        if (head == mutex->node_id) {
+            t->queue_head = (t->queue_head + 1) % MAX_NODES;
+            t->queue_count--;
+            t->in_use = 1;
+            t->asked = 0;
+            pthread_cond_broadcast(&mutex->cond);
+        } else if (!t->frozen) {
+            t->queue_head = (t->queue_head + 1) % MAX_NODES;
+            t->queue_count--;
+            t->holder = head;
+            t->asked = 0;
+            act->token_to = head;
+        }
+    }
+    
+    if (!t->frozen && t->holder != mutex->node_id && t->queue_count > 0 && !t->asked) {
+        t->asked = 1;
+        act->request_to = t->holder;
+    }
+}
+
+static void start_token_recovery(LamportMutex* mutex);
+
+static void mark_node_failed(NetworkManager* nm, int node_id) {
+    for (int i = 0; i < nm->node_count; i++) {
+        if (nm->nodes[i].node_id == node_id) {
+            nm->nodes[i].status = NODE_FAILED;
+        }
+    }
+}
+
+// Coordinador de la recuperación: el nodo vivo de menor ID
+static int token_coordinator(LamportMutex* mutex) {
+    NetworkManager* nm = mutex->network;
+    int lowest = mutex->node_id;
+    for (int i = 0; i < nm->node_count; i++) {
+        Node* node = &nm->nodes[i];
+        if (node->node_id < lowest &&
+            node->status != NODE_OFFLINE && node->status != NODE_FAILED) {
+            lowest = node->node_id;
+        }
+    }
+    return lowest;
+}
+
+// Token perdido o vecino caído: recuperar aquí o avisar al coordinador
+static void request_token_recovery(LamportMutex* mutex) {
+    for (;;) {
+        int coordinator = token_coordinator(mutex);
+        if (coordinator == mutex->node_id) {
+            pthread_mutex_lock(&mutex->lock);
+            start_token_recovery(mutex);
+            pthread_mutex_unlock(&mutex->lock);
+            return;
+        }
+        if (send_token_message(mutex, coordinator, TOKEN_RECOVER, 0, 0) == 0) {
+            pthread_mutex_lock(&mutex->lock);
+            mutex->messages_sent++;
+            pthread_mutex_unlock(&mutex->lock);
+            return;
+        }
+        mark_node_failed(mutex->network, coordinator);
+    }
+}
+
+static int token_perform(LamportMutex* mutex, TokenAction* act) {
+    int sent = 0;
+    
+    if (act->token_to >= 0) {
+        // Si el vecino también espera de vuelta, la petición viaja con el token
+        int again = act->request_to == act->token_to;
+        if (send_token_message(mutex, act->token_to, TOKEN_GRANT, act->generation, again) == 0) {
+            sent++;
+        } else {
+            // El token no salió: sigue aquí, pero hay que rehacer el árbol sin ese vecino
+            log_error("Token del lock %d no entregado a nodo %d", mutex->lock_id, act->token_to);
+            pthread_mutex_lock(&mutex->lock);
+            if (mutex->token->generation == act->generation) {
+                mutex->token->holder = mutex->node_id;
+            }
+            pthread_mutex_unlock(&mutex->lock);
+            mark_node_failed(mutex->network, act->token_to);
+            request_token_recovery(mutex);
+        }
+        if (again) act->request_to = -1;
+    }
     
-    if (mutex->replies_received >= mutex->replies_received) {
-        pthread_cond_signal(&mutex->cond);
+    if (act->request_to >= 0) {
+        if (send_token_message(mutex, act->request_to, TOKEN_REQUEST, act->generation, 0) == 0) {
+            sent++;
+        } else {
+            mark_node_failed(mutex->network, act->request_to);
+            request_token_recovery(mutex);
+        }
     }
     
+    if (sent) {
+        pthread_mutex_lock(&mutex->lock);
+        mutex->messages_sent += sent;
+        pthread_mutex_unlock(&mutex->lock);
+    }
+    return sent;
+}
+
+static void token_acquire(LamportMutex* mutex) {
+    TokenState* t = mutex->token;
+    TokenAction act;
+    
+    pthread_mutex_lock(&mutex->lock);
+    while (mutex->requesting || mutex->granted) {
+        pthread_cond_wait(&mutex->cond, &mutex->lock);
+    }
+    mutex->requesting = 1;
+    uint64_t messages_before = mutex->messages_sent;
+    token_enqueue(t, mutex->node_id);
+    token_advance(mutex, &act);
     pthread_mutex_unlock(&mutex->lock);
+    
+    token_perform(mutex, &act);
+    
+    pthread_mutex_lock(&mutex->lock);
+    while (!t->in_use) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += TOKEN_LOSS_TIMEOUT_MS / 1000;
+        ts.tv_nsec += (TOKEN_LOSS_TIMEOUT_MS % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        
+        if (pthread_cond_timedwait(&mutex->cond, &mutex->lock, &ts) == ETIMEDOUT &&
+            !t->in_use && !t->frozen) {
+            log_error("⚠️  Lock %d: sin token tras %d ms, se sospecha pérdida",
+                      mutex->lock_id, TOKEN_LOSS_TIMEOUT_MS);
+            pthread_mutex_unlock(&mutex->lock);
+            request_token_recovery(mutex);
+            pthread_mutex_lock(&mutex->lock);
+        }
+    }
+    
+    mutex->requesting = 0;
+    mutex->granted = 1;
+    mutex->acquisitions++;
+    if (mutex->messages_sent == messages_before) t->local_entries++;
+    pthread_mutex_unlock(&mutex->lock);
+}
+
+static void token_release(LamportMutex* mutex) {
+    TokenAction act;
+    
+    pthread_mutex_lock(&mutex->lock);
+    mutex->token->in_use = 0;
+    mutex->granted = 0;
+    token_advance(mutex, &act);
+    pthread_cond_broadcast(&mutex->cond);
+    pthread_mutex_unlock(&mutex->lock);
+    
+    token_perform(mutex, &act);
+}
+
+// Nueva generación: árbol sobre los miembros vivos con el token en 'root'
+// (requiere mutex->lock)
+static void token_apply_reset(LamportMutex* mutex, int generation, int root,
+                              const int* members, int count) {
+    TokenState* t = mutex->token;
+    
+    t->generation = generation;
+    if (t->promised < generation) t->promised = generation;
+    memcpy(t->members, members, count * sizeof(int));
+    t->member_count = count;
+    
+    t->holder = token_next_hop(t, mutex->node_id, root);
+    if (t->holder != mutex->node_id) t->in_use = 0;
+    t->queue_head = 0;
+    t->queue_count = 0;
+    t->asked = 0;
+    
+    // Las peticiones de la generación anterior se pierden: repetir la propia
+    if (mutex->requesting && !t->in_use) token_enqueue(t, mutex->node_id);
+}
+
+static int compare_node_ids(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Esperar hasta que ningún sondeado siga en 'pending' (requiere mutex->lock)
+static void wait_probe_replies(LamportMutex* mutex, int pending) {
+    TokenState* t = mutex->token;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += TOKEN_RECOVERY_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (TOKEN_RECOVERY_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    
+    for (;;) {
+        int waiting = 0;
+        for (int i = 0; i < t->probe_count; i++) {
+            if (t->probe_state[i] == pending) waiting++;
+        }
+        if (waiting == 0) return;
+        if (pthread_cond_timedwait(&mutex->cond, &mutex->lock, &deadline) == ETIMEDOUT) return;
+    }
+}
+
+enum { PROBE_PENDING, PROBE_NO_TOKEN, PROBE_HAS_TOKEN, PROBE_RESET_SENT, PROBE_ACKED, PROBE_LOST };
+
+// Sondear a todos, elegir la raíz (quien tenga el token, o nosotros con uno
+// nuevo), difundir el árbol y reanudar
+static void* token_recovery_thread(void* arg) {
+    LamportMutex* mutex = (LamportMutex*)arg;
+    TokenState* t = mutex->token;
+    NetworkManager* nm = mutex->network;
+    int self = mutex->node_id;
+    
+    pthread_mutex_lock(&mutex->lock);
+    int generation = (t->promised > t->generation ? t->promised : t->generation) + 1;
+    t->promised = generation;
+    t->coordinator = self;
+    t->frozen = 1;
+    t->recoveries++;
+    int root = (t->holder == self) ? self : -1;
+    
+    t->probe_count = 0;
+    for (int i = 0; i < nm->node_count; i++) {
+        Node* node = &nm->nodes[i];
+        if (node->node_id != self &&
+            node->status != NODE_OFFLINE && node->status != NODE_FAILED) {
+            t->probe_nodes[t->probe_count] = node->node_id;
+            t->probe_state[t->probe_count] = PROBE_PENDING;
+            t->probe_count++;
+        }
+    }
+    int count = t->probe_count;
+    int targets[MAX_NODES];
+    memcpy(targets, t->probe_nodes, count * sizeof(int));
+    pthread_mutex_unlock(&mutex->lock);
+    
+    log_info("🔄 Lock %d: recuperando token (generación %d, %d pares)",
+             mutex->lock_id, generation, count);
+    
+    // Fase 1: congelar a todos y averiguar si alguien conserva el token
+    for (int i = 0; i < count; i++) {
+        if (send_token_message(mutex, targets[i], TOKEN_PROBE, generation, 0) != 0) {
+            pthread_mutex_lock(&mutex->lock);
+            t->probe_state[i] = PROBE_LOST;
+            pthread_mutex_unlock(&mutex->lock);
+        }
+    }
+    
+    pthread_mutex_lock(&mutex->lock);
+    wait_probe_replies(mutex, PROBE_PENDING);
+    
+    if (t->promised != generation) {
+        // Otro coordinador empezó una generación posterior
+        t->recovering = 0;
+        pthread_cond_broadcast(&mutex->cond);
+        pthread_mutex_unlock(&mutex->lock);
+        return NULL;
+    }
+    
+    int members[MAX_NODES];
+    int member_count = 0;
+    members[member_count++] = self;
+    for (int i = 0; i < t->probe_count; i++) {
+        if (t->probe_state[i] == PROBE_NO_TOKEN || t->probe_state[i] == PROBE_HAS_TOKEN) {
+            members[member_count++] = t->probe_nodes[i];
+            if (t->probe_state[i] == PROBE_HAS_TOKEN) root = t->probe_nodes[i];
+            t->probe_state[i] = PROBE_RESET_SENT;
+        } else {
+            t->probe_state[i] = PROBE_LOST;
+        }
+    }
+    qsort(members, member_count, sizeof(int), compare_node_ids);
+    
+    if (root < 0) {
+        root = self;
+        t->regenerations++;
+        log_info("🔑 Lock %d: token perdido, regenerado en nodo %d (generación %d)",
+                 mutex->lock_id, self, generation);
+    }
+    
+    token_apply_reset(mutex, generation, root, members, member_count);
+    pthread_mutex_unlock(&mutex->lock);
+    
+    // Fase 2: nuevo árbol en todos los miembros
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_TOKEN;
+    msg.source_node = self;
+    TokenMessage body;
+    memset(&body, 0, sizeof(body));
+    body.lock_id = mutex->lock_id;
+    body.kind = TOKEN_RESET;
+    body.generation = generation;
+    body.root = root;
+    body.member_count = member_count;
+    memcpy(body.members, members, member_count * sizeof(int));
+    memcpy(msg.data, &body, sizeof(body));
+    msg.data_size = sizeof(body);
+    
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&mutex->lock);
+        int state = t->probe_state[i];
+        pthread_mutex_unlock(&mutex->lock);
+        if (state != PROBE_RESET_SENT) continue;
+        
+        msg.dest_node = targets[i];
+        if (send_message_to(nm, targets[i], &msg) == 0) {
+            sent++;
+        } else {
+            pthread_mutex_lock(&mutex->lock);
+            t->probe_state[i] = PROBE_LOST;
+            pthread_mutex_unlock(&mutex->lock);
+        }
+    }
+    
+    pthread_mutex_lock(&mutex->lock);
+    wait_probe_replies(mutex, PROBE_RESET_SENT);
+    pthread_mutex_unlock(&mutex->lock);
+    
+    // Fase 3: reanudar; las peticiones pendientes salen hacia la nueva raíz
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&mutex->lock);
+        int lost = t->probe_state[i] == PROBE_LOST;
+        pthread_mutex_unlock(&mutex->lock);
+        if (lost) continue;
+        if (send_token_message(mutex, targets[i], TOKEN_RESUME, generation, 0) == 0) sent++;
+    }
+    
+    TokenAction act;
+    pthread_mutex_lock(&mutex->lock);
+    mutex->messages_sent += sent + count;
+    if (t->promised == generation) {
+        t->frozen = 0;
+        token_advance(mutex, &act);
+    } else {
+        act.token_to = act.request_to = -1;
+    }
+    t->recovering = 0;
+    pthread_cond_broadcast(&mutex->cond);
+    pthread_mutex_unlock(&mutex->lock);
+    
+    token_perform(mutex, &act);
+    
+    log_info("✅ Lock %d: árbol reconstruido con %d miembros, token en nodo %d",
+             mutex->lock_id, member_count, root);
+    return NULL;
+}
+
+// Lanzar la recuperación si no hay una en curso (requiere mutex->lock)
+static void start_token_recovery(LamportMutex* mutex) {
+    if (mutex->token->recovering) return;
+    
+    pthread_t thread;
+    mutex->token->recovering = 1;
+    if (pthread_create(&thread, NULL, token_recovery_thread, mutex) != 0) {
+        mutex->token->recovering = 0;
+        return;
+    }
+    pthread_detach(thread);
+}
+
+static void handle_token_message(LamportMutex* mutex, int source, TokenMessage* body) {
+    TokenState* t = mutex->token;
+    TokenAction act = { -1, -1, 0 };
+    int reply_kind = -1, reply_flag = 0;
+    
+    pthread_mutex_lock(&mutex->lock);
+    
+    // Solo se acepta tráfico de la generación vigente y sin sondeo pendiente
+    int current = body->generation == t->generation && t->promised == t->generation;
+    
+    switch (body->kind) {
+        case TOKEN_REQUEST:
+            if (!current) break;
+            token_enqueue(t, source);
+            token_advance(mutex, &act);
+            break;
+            
+        case TOKEN_GRANT:
+            if (!current) break;
+            t->holder = mutex->node_id;
+            if (body->flag) token_enqueue(t, source);
+            token_advance(mutex, &act);
+            break;
+            
+        case TOKEN_PROBE:
+            if (body->generation <= t->promised) break;
+            t->promised = body->generation;
+            t->coordinator = source;
+            t->frozen = 1;
+            reply_kind = TOKEN_PROBE_REPLY;
+            reply_flag = t->holder == mutex->node_id;
+            break;
+            
+        case TOKEN_PROBE_REPLY:
+        case TOKEN_RESET_ACK:
+            if (!t->recovering || t->coordinator != mutex->node_id ||
+                body->generation != t->promised) break;
+            for (int i = 0; i < t->probe_count; i++) {
+                if (t->probe_nodes[i] != source) continue;
+                if (body->kind == TOKEN_RESET_ACK) {
+                    if (t->probe_state[i] == PROBE_RESET_SENT) t->probe_state[i] = PROBE_ACKED;
+                } else if (t->probe_state[i] == PROBE_PENDING) {
+                    t->probe_state[i] = body->flag ? PROBE_HAS_TOKEN : PROBE_NO_TOKEN;
+                }
+            }
+            pthread_cond_broadcast(&mutex->cond);
+            break;
+            
+        case TOKEN_RESET:
+            if (body->generation != t->promised || source != t->coordinator) break;
+            token_apply_reset(mutex, body->generation, body->root,
+                              body->members, body->member_count);
+            reply_kind = TOKEN_RESET_ACK;
+            break;
+            
+        case TOKEN_RESUME:
+            if (body->generation != t->generation || source != t->coordinator) break;
+            t->frozen = 0;
+            token_advance(mutex, &act);
+            pthread_cond_broadcast(&mutex->cond);
+            break;
+            
+        case TOKEN_RECOVER:
+            start_token_recovery(mutex);
+            break;
+    }
+    
+    int generation = t->promised;
+    pthread_mutex_unlock(&mutex->lock);
+    
+    if (reply_kind >= 0 &&
+        send_token_message(mutex, source, reply_kind, generation, reply_flag) == 0) {
+        pthread_mutex_lock(&mutex->lock);
+        mutex->messages_sent++;
+        pthread_mutex_unlock(&mutex->lock);
+    }
+    token_perform(mutex, &act);
+}
+
+static void token_message_handler(void* context, Message* msg) {
+    TokenMessage body;
+    if (msg->data_size < (int)offsetof(TokenMessage, members)) return;
+    memset(&body, 0, sizeof(body));
+    memcpy(&body, msg->data, msg->data_size < (int)sizeof(body) ? msg->data_size : (int)sizeof(body));
+    if (body.member_count < 0 || body.member_count > MAX_NODES) return;
+    
+    LamportMutex* mutex = find_networked_mutex((NetworkManager*)context, body.lock_id);
+    if (mutex && mutex->algorithm == LOCK_TOKEN) {
+        handle_token_message(mutex, msg->source_node, &body);
+    }
+}
+
+LamportMutex* create_token_mutex(NetworkManager* nm, int lock_id) {
+    LamportMutex* mutex = alloc_lamport_mutex(nm->node_id, lock_id);
+    if (!mutex) return NULL;
+    
+    TokenState* t = (TokenState*)calloc(1, sizeof(TokenState));
+    if (!t) {
+        destroy_lamport_mutex(mutex);
+        return NULL;
+    }
+    mutex->network = nm;
+    mutex->algorithm = LOCK_TOKEN;
+    mutex->token = t;
+    
+    // Árbol inicial sobre la tabla de nodos; el token empieza en el menor ID
+    t->members[t->member_count++] = nm->node_id;
+    for (int i = 0; i < nm->node_count && t->member_count < MAX_NODES; i++) {
+        Node* node = &nm->nodes[i];
+        if (node->node_id != nm->node_id &&
+            node->status != NODE_OFFLINE && node->status != NODE_FAILED) {
+            t->members[t->member_count++] = node->node_id;
+        }
+    }
+    qsort(t->members, t->member_count, sizeof(int), compare_node_ids);
+    t->generation = t->promised = 1;
+    t->coordinator = -1;
+    t->holder = token_next_hop(t, nm->node_id, t->members[0]);
+    
+    register_message_handler(nm, MSG_TOKEN, token_message_handler, nm);
+    
+    pthread_mutex_lock(&networked_lock);
+    mutex->next = networked_mutexes;
+    networked_mutexes = mutex;
+    pthread_mutex_unlock(&networked_lock);
+    
+    log_debug("Mutex por token %d creado en nodo %d (%d miembros)",
+              lock_id, nm->node_id, t->member_count);
+    return mutex;
+}
+
+void notify_lock_node_failure(int node_id) {
+    pthread_mutex_lock(&networked_lock);
+    
+    for (LamportMutex* mutex = networked_mutexes; mutex; mutex = mutex->next) {
+        if (mutex->node_id == node_id) continue;
+        mark_node_failed(mutex->network, node_id);
+        
+        pthread_mutex_lock(&mutex->lock);
+        if (mutex->algorithm == LOCK_TOKEN) {
+            // Solo el coordinador reconstruye; los demás esperan su sondeo
+            if (member_index(mutex->token, node_id) >= 0 &&
+                token_coordinator(mutex) == mutex->node_id) {
+                start_token_recovery(mutex);
+            }
+        } else {
+            mark_replied(mutex, node_id);
+        }
+        pthread_mutex_unlock(&mutex->lock);
+    }
+    
+    pthread_mutex_unlock(&networked_lock);
 }
 
 void destroy_lamport_mutex(LamportMutex* mutex) {
     if (mutex) {
+        if (mutex->network) {
+            pthread_mutex_lock(&networked_lock);
+            for (LamportMutex** link = &networked_mutexes; *link; link = &(*link)->next) {
+                if (*link == mutex) {
+                    *link = mutex->next;
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&networked_lock);
+        }
+        if (mutex->token) {
+            // Una recuperación en curso todavía usa el mutex
+            pthread_mutex_lock(&mutex->lock);
+            while (mutex->token->recovering) {
+                pthread_cond_wait(&mutex->cond, &mutex->lock);
+            }
+            pthread_mutex_unlock(&mutex->lock);
+            free(mutex->token);
+        }
         pthread_mutex_destroy(&mutex->lock);
         pthread_cond_destroy(&mutex->cond);
         free(mutex);
     }
 }
 
+// ========================================
+// BENCHMARK DEL MUTEX DISTRIBUIDO
+// ========================================
+
+#define LOCK_BENCH_PORT_BASE 18400
+
+typedef struct {
+    LamportMutex* mutex;
+    atomic_int* running;
+    atomic_int* inside;          // Hilos en la sección crítica (debe ser <= 1)
+    atomic_int* violations;
+    uint64_t acquisitions;
+    uint64_t total_ns;
+} LockBenchArgs;
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void* bench_lock_worker(void* arg) {
+    LockBenchArgs* args = (LockBenchArgs*)arg;
+    
+    while (atomic_load(args->running)) {
+        uint64_t start = bench_now_ns();
+        acquire_distributed_lock(args->mutex);
+        args->total_ns += bench_now_ns() - start;
+        
+        if (atomic_fetch_add(args->inside, 1) != 0) {
+            atomic_fetch_add(args->violations, 1);
+        }
+        atomic_fetch_sub(args->inside, 1);
+        
+        release_distributed_lock(args->mutex);
+        args->acquisitions++;
+    }
+    return NULL;
+}
+
+static void* bench_destroy_network(void* arg) {
+    destroy_network_manager((NetworkManager*)arg);
+    return NULL;
+}
+
+// Un NetworkManager por nodo en 127.0.0.1, cada uno con la tabla completa.
+// Las primitivas se crean después, antes de que nadie envíe nada.
+static void bench_loopback_cluster_start(NetworkManager** nms, int nodes, int port_base) {
+    for (int i = 0; i < nodes; i++) {
+        nms[i] = create_network_manager(i, port_base + i);
+        for (int j = 0; j < nodes; j++) {
+            Node* node = &nms[i]->nodes[j];
+            memset(node, 0, sizeof(*node));
+            node->node_id = j;
+            snprintf(node->ip_address, sizeof(node->ip_address), "127.0.0.1");
+            node->port = port_base + j;
+            node->status = NODE_IDLE;
+        }
+        nms[i]->node_count = nodes;
+        start_network_manager(nms[i]);
+    }
+    usleep(200000);  // Dar tiempo a los listeners para hacer bind
+}
+
+// Parar las redes en paralelo: cada listener tarda hasta 1 s en salir
+static void bench_loopback_cluster_stop(NetworkManager** nms, int nodes) {
+    pthread_t* stoppers = calloc(nodes, sizeof(pthread_t));
+    if (!stoppers) {
+        for (int i = 0; i < nodes; i++) destroy_network_manager(nms[i]);
+        return;
+    }
+    for (int i = 0; i < nodes; i++) {
+        pthread_create(&stoppers[i], NULL, bench_destroy_network, nms[i]);
+    }
+    for (int i = 0; i < nodes; i++) {
+        pthread_join(stoppers[i], NULL);
+    }
+    free(stoppers);
+}
+
+// Un NetworkManager por nodo en 127.0.0.1; 'active' nodos compiten por el
+// mismo lock (1 = un solo nodo entrando una y otra vez)
+static void bench_lock_cluster(LockAlgorithm algorithm, int nodes, int active,
+                               int port_base, int duration_ms) {
+    NetworkManager* nms[MAX_NODES];
+    LamportMutex* mutexes[MAX_NODES];
+    LockBenchArgs args[MAX_NODES];
+    pthread_t workers[MAX_NODES];
+    atomic_int running = 1, inside = 0, violations = 0;
+    
+    bench_loopback_cluster_start(nms, nodes, port_base);
+    for (int i = 0; i < nodes; i++) {
+        mutexes[i] = algorithm == LOCK_TOKEN ? create_token_mutex(nms[i], 1)
+                                             : create_networked_mutex(nms[i], 1);
+    }
+    
+    // En el caso de un solo nodo activo, el token empieza lejos de él
+    int first = active < nodes ? nodes - active : 0;
+    for (int i = first; i < nodes; i++) {
+        args[i] = (LockBenchArgs){ mutexes[i], &running, &inside, &violations, 0, 0 };
+        pthread_create(&workers[i], NULL, bench_lock_worker, &args[i]);
+    }
+    
+    usleep((useconds_t)duration_ms * 1000);
+    atomic_store(&running, 0);
+    
+    uint64_t total = 0, total_ns = 0, messages = 0;
+    for (int i = first; i < nodes; i++) {
+        pthread_join(workers[i], NULL);
+        total += args[i].acquisitions;
+        total_ns += args[i].total_ns;
+    }
+    for (int i = 0; i < nodes; i++) {
+        pthread_mutex_lock(&mutexes[i]->lock);
+        messages += mutexes[i]->messages_sent;
+        pthread_mutex_unlock(&mutexes[i]->lock);
+    }
+    
+    bench_loopback_cluster_stop(nms, nodes);
+    for (int i = 0; i < nodes; i++) {
+        destroy_lamport_mutex(mutexes[i]);
+    }
+    
+    log_info("   %-7s | %5d | %7d | %10.1f | %12.3f | %8.2f | %d",
+             algorithm == LOCK_TOKEN ? "Token" : "Permiso", nodes, active,
+             total / (duration_ms / 1000.0),
+             total ? total_ns / (double)total / 1e6 : 0.0,
+             total ? messages / (double)total : 0.0, atomic_load(&violations));
+}
+
+// De 2 a max_nodes nodos, con todos compitiendo y con uno solo repitiendo
+static void bench_mutex_sweep(LockAlgorithm first, LockAlgorithm last,
+                              int max_nodes, int duration_ms) {
+    if (max_nodes > MAX_NODES) max_nodes = MAX_NODES;
+    
+    log_info("📊 Benchmark de mutex distribuido (un hilo por nodo activo, %d ms por prueba):",
+             duration_ms);
+    log_info("   Modo    | Nodos | Activos |   Adq/s    | Latencia ms  | Msgs/adq | Violaciones");
+    
+    int port_base = LOCK_BENCH_PORT_BASE;
+    for (int nodes = 2; nodes <= max_nodes; nodes *= 2) {
+        for (int algorithm = first; algorithm <= (int)last; algorithm++) {
+            bench_lock_cluster((LockAlgorithm)algorithm, nodes, nodes, port_base, duration_ms);
+            port_base += nodes;
+            bench_lock_cluster((LockAlgorithm)algorithm, nodes, 1, port_base, duration_ms);
+            port_base += nodes;
+        }
+    }
+}
+
+void benchmark_lamport_mutex(int max_nodes, int duration_ms) {
+    bench_mutex_sweep(LOCK_PERMISSION, LOCK_TOKEN, max_nodes, duration_ms);
+}
+
+void benchmark_token_mutex(int max_nodes, int duration_ms) {
+    bench_mutex_sweep(LOCK_TOKEN, LOCK_TOKEN, max_nodes, duration_ms);
+}
+
 // ========================================
 // BARRERAS DISTRIBUIDAS
 // ========================================
 
-DistributedBarrier* create_distributed_barrier(int node_id, int total_nodes) {
-    DistributedBarrier* barrier = (DistributedBarrier*)malloc(sizeof(DistributedBarrier));
+// Barreras con red registradas, para enrutar los mensajes que llegan
+static DistributedBarrier* networked_barriers = NULL;
+static pthread_mutex_t barriers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static DistributedBarrier* alloc_barrier(int node_id, int barrier_id, int local_threads) {
+    DistributedBarrier* barrier = (DistributedBarrier*)calloc(1, sizeof(DistributedBarrier));
+    if (!barrier) return NULL;
+    barrier->barrier_id = barrier_id;
     barrier->node_id = node_id;
-    barrier->total_nodes = total_nodes;
-    barrier->arrived_count = 0;
-    barrier->generation = 0;
+    barrier->local_threads = local_threads > 0 ? local_threads : 1;
     pthread_mutex_init(&barrier->lock, NULL);
     pthread_cond_init(&barrier->cond, NULL);
-    
-    memset(barrier->arrived_nodes, 0, sizeof(barrier->arrived_nodes));
+    return barrier;
+}
+
+DistributedBarrier* create_distributed_barrier(int node_id, int total_nodes) {
+    DistributedBarrier* barrier = alloc_barrier(node_id, 0, total_nodes);
+    if (!barrier) return NULL;
+    barrier->total_nodes = total_nodes;
     
     log_info("Barrera distribuida creada para nodo %d (%d nodos totales)", 
              node_id, total_nodes);
     return barrier;
 }
 
-void wait_at_barrier(DistributedBarrier* barrier) {
+static DistributedBarrier* find_networked_barrier(NetworkManager* nm, int barrier_id) {
+    pthread_mutex_lock(&barriers_lock);
+    DistributedBarrier* barrier = networked_barriers;
+    while (barrier && (barrier->network != nm || barrier->barrier_id != barrier_id)) {
+        barrier = barrier->next;
+    }
+    pthread_mutex_unlock(&barriers_lock);
+    return barrier;
+}
+
+// Envíos decididos bajo el lock y hechos fuera de él
+typedef struct {
+    int count;
+    int dest[BARRIER_TREE_ARITY + 32];
+    BarrierMessage body[BARRIER_TREE_ARITY + 32];
+} BarrierAction;
+
+static void barrier_queue(DistributedBarrier* barrier, BarrierAction* act, int index,
+                          int kind, int episode, int round) {
+    act->dest[act->count] = barrier->members[index];
+    act->body[act->count] = (BarrierMessage){ barrier->barrier_id, kind, episode, round };
+    act->count++;
+}
+
+static void barrier_perform(DistributedBarrier* barrier, BarrierAction* act) {
+    int sent = 0;
+    
+    for (int i = 0; i < act->count; i++) {
+        Message msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = MSG_BARRIER;
+        msg.source_node = barrier->node_id;
+        msg.dest_node = act->dest[i];
+        memcpy(msg.data, &act->body[i], sizeof(BarrierMessage));
+        msg.data_size = sizeof(BarrierMessage);
+        
+        if (send_message_to(barrier->network, act->dest[i], &msg) == 0) {
+            sent++;
+        } else {
+            log_error("Barrera %d: no se pudo avisar al nodo %d", barrier->barrier_id,
+                      act->dest[i]);
+        }
+    }
+    
+    if (sent) {
+        pthread_mutex_lock(&barrier->lock);
+        barrier->messages_sent += sent;
+        pthread_mutex_unlock(&barrier->lock);
+    }
+}
+
+// Episodio completado en todos los nodos (requiere barrier->lock)
+static void barrier_complete(DistributedBarrier* barrier) {
+    if (barrier->net_started) {
+        barrier->network_ns += bench_now_ns() - barrier->net_start_ns;
+    }
+    log_debug("✅ Barrera liberada (generación %d)", barrier->generation);
+    barrier->generation++;
+    barrier->net_started = 0;
+    barrier->net_round = 0;
+    barrier->net_sent = 0;
+    pthread_cond_broadcast(&barrier->cond);
+}
+
+// Árbol combinador: esperar a los hijos, avisar al padre y propagar la
+// liberación hacia abajo desde la raíz. Devuelve 1 si el episodio terminó.
+static int tree_progress(DistributedBarrier* barrier, BarrierAction* act) {
+    int episode = barrier->generation;
+    int slot = episode & 1;
+    int self = barrier->self_index;
+    int first_child = self * BARRIER_TREE_ARITY + 1;
+    int children = barrier->total_nodes - first_child;
+    if (children < 0) children = 0;
+    if (children > BARRIER_TREE_ARITY) children = BARRIER_TREE_ARITY;
+    
+    if (barrier->tree_arrivals[slot] < children) return 0;
+    
+    if (self != 0) {
+        if (!barrier->net_sent) {
+            barrier_queue(barrier, act, (self - 1) / BARRIER_TREE_ARITY,
+                          BARRIER_ARRIVE, episode, 0);
+            barrier->net_sent = 1;
+        }
+        if (!barrier->tree_released[slot]) return 0;
+    }
+    
+    // Ningún hijo puede volver a usar esta paridad antes de nuestra liberación
+    barrier->tree_arrivals[slot] = 0;
+    barrier->tree_released[slot] = 0;
+    for (int i = 0; i < children; i++) {
+        barrier_queue(barrier, act, first_child + i, BARRIER_RELEASE, episode, 0);
+    }
+    return 1;
+}
+
+// Diseminación: en la ronda k avisar a (i + 2^k) y esperar a (i - 2^k) mod N
+static int dissemination_progress(DistributedBarrier* barrier, BarrierAction* act) {
+    int episode = barrier->generation;
+    int slot = episode & 1;
+    int n = barrier->total_nodes;
+    
+    while ((1 << barrier->net_round) < n) {
+        if (!barrier->net_sent) {
+            barrier_queue(barrier, act, (barrier->self_index + (1 << barrier->net_round)) % n,
+                          BARRIER_ROUND, episode, barrier->net_round);
+            barrier->net_sent = 1;
+        }
+        if (!(barrier->rounds_seen[slot] & (1u << barrier->net_round))) return 0;
+        barrier->net_round++;
+        barrier->net_sent = 0;
+    }
+    
+    barrier->rounds_seen[slot] = 0;
+    return 1;
+}
+
+// Llevar la fase de red tan lejos como permitan los mensajes recibidos; la
+// llama quien cambie el estado (requiere barrier->lock)
+static void barrier_progress(DistributedBarrier* barrier, BarrierAction* act) {
+    while (barrier->generation < barrier->local_episode) {
+        if (!barrier->network || barrier->total_nodes <= 1) {
+            barrier_complete(barrier);
+            continue;
+        }
+        
+        // Un episodio cruza la red solo cuando el anterior terminó
+        if (!barrier->net_started) {
+            barrier->net_started = 1;
+            barrier->net_start_ns = bench_now_ns();
+        }
+        
+        int done = barrier->algorithm == BARRIER_TREE ? tree_progress(barrier, act)
+                                                      : dissemination_progress(barrier, act);
+        if (!done) break;
+        barrier_complete(barrier);
+    }
+}
+
+// Entrada desde el listener de red: anotar y avanzar la fase de red
+static void barrier_message_handler(void* context, Message* msg) {
+    NetworkManager* nm = (NetworkManager*)context;
+    BarrierMessage body;
+    if (msg->data_size < (int)sizeof(body)) return;
+    memcpy(&body, msg->data, sizeof(body));
+    
+    DistributedBarrier* barrier = find_networked_barrier(nm, body.barrier_id);
+    if (!barrier) {
+        log_debug("Mensaje de barrera %d sin barrera registrada", body.barrier_id);
+        return;
+    }
+    
+    BarrierAction act = { 0 };
+    int slot = body.episode & 1;
+    
     pthread_mutex_lock(&barrier->lock);
+    if (body.kind == BARRIER_ARRIVE) {
+        barrier->tree_arrivals[slot]++;
+    } else if (body.kind == BARRIER_RELEASE) {
+        barrier->tree_released[slot] = 1;
+    } else if (body.kind == BARRIER_ROUND && body.round >= 0 && body.round < 32) {
+        barrier->rounds_seen[slot] |= 1u << body.round;
+    }
+    barrier_progress(barrier, &act);
+    pthread_mutex_unlock(&barrier->lock);
     
-    int my_generation = barrier->generation;
-    barrier->arrived_nodes[barrier->node_id] = 1;
+    barrier_perform(barrier, &act);
+}
+
+DistributedBarrier* create_networked_barrier(NetworkManager* nm, int barrier_id,
+                                             int local_threads,
+                                             BarrierAlgorithm algorithm) {
+    DistributedBarrier* barrier = alloc_barrier(nm->node_id, barrier_id, local_threads);
+    if (!barrier) return NULL;
+    barrier->network = nm;
+    barrier->algorithm = algorithm;
+    
+    // Mismo orden en todos los nodos: la posición define vecinos y padre
+    int count = 0;
+    barrier->members[count++] = nm->node_id;
+    for (int i = 0; i < nm->node_count && count < MAX_NODES; i++) {
+        if (nm->nodes[i].node_id != nm->node_id) {
+            barrier->members[count++] = nm->nodes[i].node_id;
+        }
+    }
+    qsort(barrier->members, count, sizeof(int), compare_node_ids);
+    barrier->total_nodes = count;
+    for (int i = 0; i < count; i++) {
+        if (barrier->members[i] == nm->node_id) barrier->self_index = i;
+    }
+    
+    register_message_handler(nm, MSG_BARRIER, barrier_message_handler, nm);
+    
+    pthread_mutex_lock(&barriers_lock);
+    barrier->next = networked_barriers;
+    networked_barriers = barrier;
+    pthread_mutex_unlock(&barriers_lock);
+    
+    log_debug("Barrera %d (%s) creada en nodo %d: %d nodos, %d hilos locales",
+              barrier_id, algorithm == BARRIER_TREE ? "árbol" : "diseminación",
+              nm->node_id, count, barrier->local_threads);
+    return barrier;
+}
+
+int barrier_arrive(DistributedBarrier* barrier) {
+    BarrierAction act = { 0 };
+    
+    pthread_mutex_lock(&barrier->lock);
+    
+    // Barrera difusa: no adelantarse más episodios de los que se toleran
+    while (barrier->local_episode - barrier->generation > barrier->slack) {
+        pthread_cond_wait(&barrier->cond, &barrier->lock);
+    }
+    
+    int phase = barrier->local_episode;
+    int my_sense = !barrier->sense;
     barrier->arrived_count++;
     
-    log_info("🚧 Nodo %d esperando en barrera (%d/%d)", 
-             barrier->node_id, barrier->arrived_count, barrier->total_nodes);
+    log_debug("🚧 Nodo %d llega a la barrera (%d/%d)", 
+              barrier->node_id, barrier->arrived_count, barrier->local_threads);
     
-    if (barrier->arrived_count == barrier->total_nodes) {
-        // Todos llegaron, liberar barrera
-        log_info("✅ Barrera liberada (generación %d)", barrier->generation);
-        barrier->generation++;
+    if (barrier->arrived_count < barrier->local_threads) {
+        // Esperar a que el último hilo local invierta el sentido
+        while (barrier->sense != my_sense) {
+            pthread_cond_wait(&barrier->cond, &barrier->lock);
+        }
+    } else {
+        // Último hilo local: el nodo entra en la fase de red
         barrier->arrived_count = 0;
-        memset(barrier->arrived_nodes, 0, sizeof(barrier->arrived_nodes));
+        barrier->local_episode++;
+        barrier->sense = my_sense;
         pthread_cond_broadcast(&barrier->cond);
-    } else {
-        // Esperar a que todos lleguen
-        while (barrier->generation == my_generation) {
+        barrier_progress(barrier, &act);
+    }
+    
+    pthread_mutex_unlock(&barrier->lock);
+    
+    if (act.count) barrier_perform(barrier, &act);
+    return phase;
+}
+
+int barrier_test(DistributedBarrier* barrier, int phase) {
+    pthread_mutex_lock(&barrier->lock);
+    int done = barrier->generation > phase;
+    pthread_mutex_unlock(&barrier->lock);
+    return done;
+}
+
+void barrier_wait(DistributedBarrier* barrier, int phase) {
+    pthread_mutex_lock(&barrier->lock);
+    if (barrier->generation <= phase) {
+        uint64_t start = bench_now_ns();
+        while (barrier->generation <= phase) {
             pthread_cond_wait(&barrier->cond, &barrier->lock);
         }
+        barrier->blocked_ns += bench_now_ns() - start;
     }
+    pthread_mutex_unlock(&barrier->lock);
+}
+
+void set_barrier_slack(DistributedBarrier* barrier, int slack) {
+    if (slack < 0) slack = 0;
+    if (slack > BARRIER_MAX_SLACK) slack = BARRIER_MAX_SLACK;
     
+    pthread_mutex_lock(&barrier->lock);
+    barrier->slack = slack;
+    pthread_cond_broadcast(&barrier->cond);
     pthread_mutex_unlock(&barrier->lock);
 }
 
+void wait_at_barrier(DistributedBarrier* barrier) {
+    barrier_wait(barrier, barrier_arrive(barrier));
+}
+
 void destroy_distributed_barrier(DistributedBarrier* barrier) {
-    if (barrier) {
-        pthread_mutex_destroy(&barrier->lock);
-        pthread_cond_destroy(&barrier->cond);
-        free(barrier);
+    if (!barrier) return;
+    
+    if (barrier->network) {
+        pthread_mutex_lock(&barriers_lock);
+        DistributedBarrier** link = &networked_barriers;
+        while (*link && *link != barrier) link = &(*link)->next;
+        if (*link) *link = barrier->next;
+        pthread_mutex_unlock(&barriers_lock);
     }
+    
+    pthread_mutex_destroy(&barrier->lock);
+    pthread_cond_destroy(&barrier->cond);
+    free(barrier);
 }
 
 // ========================================
-// RELOJ LÓGICO DE LAMPORT
+// BENCHMARK DE BARRERAS
+// ========================================
+
+#define BARRIER_BENCH_PORT_BASE 19000
+#define BARRIER_BENCH_THREADS 2  // Hilos por nodo: la fase local también cuenta
+
+#define SPLIT_BENCH_PORT_BASE 20200
+
+typedef struct {
+    DistributedBarrier* barrier;
+    int episodes;
+    int slack;                   // Solo benchmark_split_barrier
+    int compute_us;
+    unsigned int seed;
+} BarrierBenchArgs;
+
+static void* bench_barrier_worker(void* arg) {
+    BarrierBenchArgs* args = (BarrierBenchArgs*)arg;
+    for (int i = 0; i < args->episodes; i++) {
+        wait_at_barrier(args->barrier);
+    }
+    return NULL;
+}
+
+// Red de nodos en 127.0.0.1 con una barrera en cada uno
+static void bench_barrier_start(NetworkManager** nms, DistributedBarrier** barriers,
+                                int nodes, int port_base, int threads,
+                                BarrierAlgorithm algorithm) {
+    bench_loopback_cluster_start(nms, nodes, port_base);
+    for (int i = 0; i < nodes; i++) {
+        barriers[i] = create_networked_barrier(nms[i], 1, threads, algorithm);
+    }
+}
+
+static void bench_barrier_stop(NetworkManager** nms, DistributedBarrier** barriers,
+                               int nodes) {
+    bench_loopback_cluster_stop(nms, nodes);
+    for (int i = 0; i < nodes; i++) {
+        destroy_distributed_barrier(barriers[i]);
+    }
+}
+
+static void bench_barrier_cluster(BarrierAlgorithm algorithm, int nodes,
+                                  int port_base, int episodes) {
+    NetworkManager** nms = calloc(nodes, sizeof(NetworkManager*));
+    DistributedBarrier** barriers = calloc(nodes, sizeof(DistributedBarrier*));
+    pthread_t* workers = calloc((size_t)nodes * BARRIER_BENCH_THREADS, sizeof(pthread_t));
+    BarrierBenchArgs* args = calloc(nodes, sizeof(BarrierBenchArgs));
+    if (!nms || !barriers || !workers || !args) {
+        free(nms); free(barriers); free(workers); free(args);
+        return;
+    }
+    
+    bench_barrier_start(nms, barriers, nodes, port_base, BARRIER_BENCH_THREADS, algorithm);
+    
+    // Un episodio de calentamiento fuera de la medida
+    uint64_t start = 0;
+    for (int warm = 1; warm >= 0; warm--) {
+        if (!warm) start = bench_now_ns();
+        for (int i = 0; i < nodes; i++) {
+            args[i] = (BarrierBenchArgs){ barriers[i], warm ? 1 : episodes, 0, 0, 0 };
+            for (int t = 0; t < BARRIER_BENCH_THREADS; t++) {
+                pthread_create(&workers[i * BARRIER_BENCH_THREADS + t], NULL,
+                               bench_barrier_worker, &args[i]);
+            }
+        }
+        for (int i = 0; i < nodes * BARRIER_BENCH_THREADS; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        if (warm) {
+            for (int i = 0; i < nodes; i++) {
+                barriers[i]->messages_sent = 0;
+                barriers[i]->network_ns = 0;
+            }
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    
+    uint64_t messages = 0, network_ns = 0;
+    for (int i = 0; i < nodes; i++) {
+        messages += barriers[i]->messages_sent;
+        network_ns += barriers[i]->network_ns;
+    }
+    
+    bench_barrier_stop(nms, barriers, nodes);
+    
+    // Ambos nombres llevan una letra de dos bytes
+    log_info("   %-13s | %5d | %11.3f | %13.3f | %9.2f",
+             algorithm == BARRIER_TREE ? "Árbol" : "Diseminación", nodes,
+             elapsed / (double)episodes / 1e6,
+             network_ns / (double)nodes / episodes / 1e6,
+             messages / (double)nodes / episodes);
+    
+    free(nms);
+    free(barriers);
+    free(workers);
+    free(args);
+}
+
+void benchmark_distributed_barrier(int max_nodes, int episodes) {
+    if (episodes < 1) episodes = 1;
+    
+    log_info("📊 Benchmark de barreras (%d hilos por nodo, %d episodios por prueba):",
+             BARRIER_BENCH_THREADS, episodes);
+    log_info("   Modo         | Nodos | Latencia ms | Fase red ms   | Msgs/nodo");
+    
+    int port_base = BARRIER_BENCH_PORT_BASE;
+    for (int nodes = 4; nodes <= max_nodes; nodes *= 2) {
+        if (nodes > MAX_NODES) {
+            log_info("   %d nodos: omitido (la tabla de nodos admite %d)", nodes, MAX_NODES);
+            continue;
+        }
+        for (int algorithm = BARRIER_TREE; algorithm <= BARRIER_DISSEMINATION; algorithm++) {
+            bench_barrier_cluster((BarrierAlgorithm)algorithm, nodes, port_base, episodes);
+            port_base += nodes;
+        }
+    }
+}
+
+// Cómputo de duración irregular: entre la mitad y 1,5 veces compute_us.
+// Se duerme en lugar de calcular: los nodos simulados comparten las CPUs
+// de este host y deben comportarse como máquinas distintas.
+static void bench_compute(BarrierBenchArgs* args) {
+    uint64_t ns = (uint64_t)args->compute_us * (500 + rand_r(&args->seed) % 1001);
+    struct timespec ts = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+    nanosleep(&ts, NULL);
+}
+
+// Iteración k: calcular, llegar y esperar solo a la barrera de k - slack
+static void* bench_split_worker(void* arg) {
+    BarrierBenchArgs* args = (BarrierBenchArgs*)arg;
+    int phases[BARRIER_MAX_SLACK + 1];
+    
+    for (int k = 0; k < args->episodes; k++) {
+        bench_compute(args);
+        phases[k % (args->slack + 1)] = barrier_arrive(args->barrier);
+        if (k >= args->slack) {
+            barrier_wait(args->barrier, phases[(k - args->slack) % (args->slack + 1)]);
+        }
+    }
+    
+    // Cerrar los episodios que quedaron abiertos
+    int first = args->episodes - args->slack;
+    for (int k = first < 0 ? 0 : first; k < args->episodes; k++) {
+        barrier_wait(args->barrier, phases[k % (args->slack + 1)]);
+    }
+    return NULL;
+}
+
+static void bench_split_cluster(int nodes, int slack, int port_base,
+                                int iterations, int compute_us) {
+    NetworkManager** nms = calloc(nodes, sizeof(NetworkManager*));
+    DistributedBarrier** barriers = calloc(nodes, sizeof(DistributedBarrier*));
+    pthread_t* workers = calloc(nodes, sizeof(pthread_t));
+    BarrierBenchArgs* args = calloc(nodes, sizeof(BarrierBenchArgs));
+    if (!nms || !barriers || !workers || !args) {
+        free(nms); free(barriers); free(workers); free(args);
+        return;
+    }
+    
+    bench_barrier_start(nms, barriers, nodes, port_base, 1, BARRIER_TREE);
+    for (int i = 0; i < nodes; i++) {
+        set_barrier_slack(barriers[i], slack);
+        args[i] = (BarrierBenchArgs){ barriers[i], iterations, slack, compute_us,
+                                      (unsigned int)(i * 7919 + 1) };
+    }
+    
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < nodes; i++) {
+        pthread_create(&workers[i], NULL, bench_split_worker, &args[i]);
+    }
+    for (int i = 0; i < nodes; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    
+    uint64_t blocked_ns = 0;
+    for (int i = 0; i < nodes; i++) {
+        blocked_ns += barriers[i]->blocked_ns;
+    }
+    
+    bench_barrier_stop(nms, barriers, nodes);
+    
+    log_info("   %-10s | %7d | %10.3f | %8.1f%%",
+             slack == 0 ? "Bloqueante" : slack == 1 ? "Dos fases" : "Difusa",
+             slack, elapsed / (double)iterations / 1e6,
+             100.0 * blocked_ns / ((double)elapsed * nodes));
+    
+    free(nms);
+    free(barriers);
+    free(workers);
+    free(args);
+}
+
+void benchmark_split_barrier(int nodes, int iterations, int compute_us) {
+    if (nodes > MAX_NODES) nodes = MAX_NODES;
+    if (iterations < 1) iterations = 1;
+    
+    log_info("📊 Benchmark de barrera en dos fases (%d nodos, %d iteraciones, "
+             "cómputo %d µs ±50%%):", nodes, iterations, compute_us);
+    log_info("   Modo       | Holgura | ms/iter    | Bloqueado");
+    
+    int port_base = SPLIT_BENCH_PORT_BASE;
+    for (int slack = 0; slack <= 2; slack++) {
+        bench_split_cluster(nodes, slack, port_base, iterations, compute_us);
+        port_base += nodes;
+    }
+}
+
+// ========================================
+// RELOJ LÓGICO HÍBRIDO
 // ========================================
 
 LogicalClock* create_logical_clock(int node_id) {
-    LogicalClock* clock = (LogicalClock*)malloc(sizeof(LogicalClock));
-    clock->timestamp = 0;
+    LogicalClock* clock = (LogicalClock*)calloc(1, sizeof(LogicalClock));
+    if (!clock) return NULL;
     clock->node_id = node_id;
-    pthread_mutex_init(&clock->lock, NULL);
+    atomic_init(&clock->hlc, 0);
     
     log_debug("Reloj lógico creado para nodo %d", node_id);
     return clock;
 }
 
-int increment_clock(LogicalClock* clock) {
-    pthread_mutex_lock(&clock->lock);
-    clock->timestamp++;
-    int ts = clock->timestamp;
-    pthread_mutex_unlock(&clock->lock);
-    return ts;
+static uint64_t wall_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
 }
 
-int update_clock(LogicalClock* clock, int received_timestamp) {
-    pthread_mutex_lock(&clock->lock);
+// Evento local o envío: el tiempo físico si avanzó, si no el contador (un
+// contador desbordado pasa al milisegundo siguiente)
+uint64_t increment_clock(LogicalClock* clock) {
+    uint64_t physical = wall_clock_ms() << HLC_LOGICAL_BITS;
+    uint64_t old = atomic_load(&clock->hlc);
+    uint64_t next;
+    do {
+        next = physical > old ? physical : old + 1;
+    } while (!atomic_compare_exchange_weak(&clock->hlc, &old, next));
+    return next;
+}
+
+// Recepción: el máximo entre el propio, el recibido y el físico, y el
+// contador por encima de los que compartan ese tiempo
+uint64_t update_clock(LogicalClock* clock, uint64_t received_timestamp) {
+    uint64_t now = wall_clock_ms();
     
-    if (received_timestamp > clock->timestamp) {
-        clock->timestamp = received_timestamp;
+    if (HLC_PHYSICAL_MS(received_timestamp) > now + HLC_MAX_DRIFT_MS) {
+        // Un reloj muy adelantado arrastraría a todo el clúster: solo contar
+        // el evento
+        atomic_fetch_add_explicit(&clock->drift_rejections, 1, memory_order_relaxed);
+        log_debug("HLC: sello %lu demasiado adelantado, ignorado",
+                  (unsigned long)HLC_PHYSICAL_MS(received_timestamp));
+        return increment_clock(clock);
     }
-    clock->timestamp++;
     
-    int ts = clock->timestamp;
-    pthread_mutex_unlock(&clock->lock);
-    return ts;
+    uint64_t physical = now << HLC_LOGICAL_BITS;
+    uint64_t old = atomic_load(&clock->hlc);
+    uint64_t next;
+    do {
+        uint64_t latest = old > received_timestamp ? old : received_timestamp;
+        next = physical > latest ? physical : latest + 1;
+    } while (!atomic_compare_exchange_weak(&clock->hlc, &old, next));
+    return next;
 }
 
-int get_clock_time(LogicalClock* clock) {
-    pthread_mutex_lock(&clock->lock);
-    int ts = clock->timestamp;
-    pthread_mutex_unlock(&clock->lock);
-    return ts;
+uint64_t get_clock_time(LogicalClock* clock) {
+    return atomic_load(&clock->hlc);
+}
+
+// ========================================
+// RELOJ VECTORIAL
+// ========================================
+
+void enable_vector_clock(LogicalClock* clock) {
+    if (!clock || clock->vector) return;
+    
+    VectorClock* vector = (VectorClock*)calloc(1, sizeof(VectorClock));
+    if (!vector) return;
+    pthread_mutex_init(&vector->slot_lock, NULL);
+    vector->node_ids[0] = clock->node_id;
+    atomic_store(&vector->count, 1);
+    clock->vector = vector;
+}
+
+// Hueco de un nodo; crearlo si hace falta (NULL si no queda sitio)
+static _Atomic uint32_t* vector_slot(VectorClock* vector, int node_id) {
+    int count = atomic_load_explicit(&vector->count, memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        if (vector->node_ids[i] == node_id) return &vector->counters[i];
+    }
+    
+    pthread_mutex_lock(&vector->slot_lock);
+    _Atomic uint32_t* slot = NULL;
+    count = atomic_load(&vector->count);
+    for (int i = 0; i < count && !slot; i++) {
+        if (vector->node_ids[i] == node_id) slot = &vector->counters[i];
+    }
+    if (!slot && count < MAX_NODES) {
+        vector->node_ids[count] = node_id;
+        slot = &vector->counters[count];
+        // El ID queda visible antes que el nuevo tamaño
+        atomic_store_explicit(&vector->count, count + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&vector->slot_lock);
+    return slot;
+}
+
+static void vector_merge_entry(VectorClock* vector, int node_id, uint32_t counter) {
+    _Atomic uint32_t* slot = vector_slot(vector, node_id);
+    if (!slot) return;
+    
+    uint32_t current = atomic_load(slot);
+    while (counter > current &&
+           !atomic_compare_exchange_weak(slot, &current, counter)) {
+    }
+}
+
+// Vista compacta: el propio nodo primero y luego los contadores no nulos
+static void vector_snapshot(VectorClock* vector, VectorClockStamp* stamp) {
+    int count = atomic_load_explicit(&vector->count, memory_order_acquire);
+    
+    stamp->count = 0;
+    stamp->truncated = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t counter = atomic_load(&vector->counters[i]);
+        if (counter == 0) continue;
+        if (stamp->count == VECTOR_CLOCK_ENTRIES) {
+            stamp->truncated = 1;
+            break;
+        }
+        stamp->entries[stamp->count].node_id = vector->node_ids[i];
+        stamp->entries[stamp->count].counter = counter;
+        stamp->count++;
+    }
+}
+
+static uint32_t stamp_counter(const VectorClockStamp* stamp, int node_id) {
+    for (int i = 0; i < stamp->count && i < VECTOR_CLOCK_ENTRIES; i++) {
+        if (stamp->entries[i].node_id == node_id) return stamp->entries[i].counter;
+    }
+    return 0;
+}
+
+CausalOrder compare_vector_stamps(const VectorClockStamp* a, const VectorClockStamp* b) {
+    if (a->truncated || b->truncated) return CAUSAL_UNKNOWN;
+    
+    int a_ahead = 0, b_ahead = 0;
+    for (int i = 0; i < a->count && i < VECTOR_CLOCK_ENTRIES; i++) {
+        uint32_t other = stamp_counter(b, a->entries[i].node_id);
+        if (a->entries[i].counter > other) a_ahead = 1;
+        if (a->entries[i].counter < other) b_ahead = 1;
+    }
+    for (int i = 0; i < b->count && i < VECTOR_CLOCK_ENTRIES; i++) {
+        if (stamp_counter(a, b->entries[i].node_id) < b->entries[i].counter) b_ahead = 1;
+    }
+    
+    if (a_ahead && b_ahead) return CAUSAL_CONCURRENT;
+    if (a_ahead) return CAUSAL_AFTER;
+    if (b_ahead) return CAUSAL_BEFORE;
+    return CAUSAL_EQUAL;
+}
+
+// ========================================
+// RELOJES EN LOS MENSAJES
+// ========================================
+
+void clock_stamp_message(LogicalClock* clock, Message* msg) {
+    if (!clock) return;
+    
+    msg->hlc = increment_clock(clock);
+    
+    if (clock->vector) {
+        // Cada envío es un evento propio
+        atomic_fetch_add(&clock->vector->counters[0], 1);
+        vector_snapshot(clock->vector, &msg->vclock);
+    } else {
+        msg->vclock.count = 0;
+        msg->vclock.truncated = 0;
+    }
+}
+
+void clock_receive_message(LogicalClock* clock, Message* msg) {
+    if (!clock || msg->hlc == 0) return;
+    
+    update_clock(clock, msg->hlc);
+    
+    if (clock->vector) {
+        int count = msg->vclock.count;
+        if (count > VECTOR_CLOCK_ENTRIES) count = VECTOR_CLOCK_ENTRIES;
+        for (int i = 0; i < count; i++) {
+            vector_merge_entry(clock->vector, msg->vclock.entries[i].node_id,
+                               msg->vclock.entries[i].counter);
+        }
+    }
 }
 
 void destroy_logical_clock(LogicalClock* clock) {
     if (clock) {
-        pthread_mutex_destroy(&clock->lock);
+        if (clock->vector) {
+            pthread_mutex_destroy(&clock->vector->slot_lock);
+            free(clock->vector);
+        }
         free(clock);
     }
-}
\ No newline at end of file
+}
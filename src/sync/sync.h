@@ -2,62 +2,300 @@
 #define SYNC_H
 
 #include "../common.h"
+#include "../network/network.h"
 
 // ========================================
 // ESTRUCTURAS DE SINCRONIZACIÓN
 // ========================================
 
-// Mutex distribuido (Algoritmo de Lamport)
+// Algoritmo de exclusión mutua, elegido al crear cada lock
+typedef enum {
+    LOCK_PERMISSION = 0,         // Ricart-Agrawala: 2(N-1) mensajes por entrada
+    LOCK_TOKEN = 1               // Árbol de Raymond: O(log N), 0 si ya tiene el token
+} LockAlgorithm;
+
+// Estado del modo token (árbol de Raymond). Los nodos forman un árbol
+// binario fijo sobre 'members'; 'holder' apunta al vecino por el que se llega
+// al token. Quien lo tiene lo conserva tras liberar, así que volver a entrar
+// no envía nada. Cada token tiene una generación: al regenerarlo se descarta
+// todo lo que llegue de la anterior.
 typedef struct {
-    int timestamp;
+    int generation;              // Generación del token vigente
+    int promised;                // Mayor generación sondeada (congela las previas)
+    int coordinator;             // Nodo que dirige la recuperación en curso
+    int frozen;                  // Sin envíos hasta TOKEN_RESUME
+    int recovering;              // Este nodo coordina una recuperación
+    
+    int holder;                  // node_id propio = tenemos el token
+    int in_use;
+    int asked;                   // Ya se pidió el token a 'holder'
+    int queue[MAX_NODES];        // FIFO de vecinos (o nosotros) que lo piden
+    int queue_head;
+    int queue_count;
+    
+    int members[MAX_NODES];      // Nodos del árbol, ordenados por ID
+    int member_count;
+    
+    // Respuestas durante la recuperación (solo el coordinador)
+    int probe_nodes[MAX_NODES];
+    int probe_state[MAX_NODES];
+    int probe_count;
+    
+    // Estadísticas
+    uint64_t local_entries;      // Entradas sin ningún mensaje
+    uint64_t recoveries;
+    uint64_t regenerations;
+} TokenState;
+
+// Mutex distribuido (Ricart-Agrawala con reloj de Lamport). Para entrar se
+// pide permiso a todos los pares; quien está dentro, o pidió antes (menor
+// timestamp, o menor ID a igualdad), difiere su respuesta hasta liberar.
+// Coste: 2(N-1) mensajes y la latencia del par más lento.
+typedef struct LamportMutex {
+    int lock_id;
+    int timestamp;               // Reloj de Lamport del mutex
+    int request_timestamp;       // Timestamp de la petición en curso
     int node_id;
     int requesting;
     int granted;
     int replies_received;
+    
+    // Pares a los que se pidió permiso (-1 = ya respondió o cayó)
+    int awaiting[MAX_NODES];
+    int awaiting_count;
+    
+    // Respuestas diferidas hasta liberar: nodo y timestamp de su petición
+    int deferred_nodes[MAX_NODES];
+    int deferred_timestamps[MAX_NODES];
+    int deferred_count;
+    
+    NetworkManager* network;     // NULL = exclusión solo entre hilos locales
+    LockAlgorithm algorithm;
+    TokenState* token;           // Solo en LOCK_TOKEN
+    struct LamportMutex* next;   // Mutex registrados para recibir mensajes
+    
+    // Estadísticas
+    uint64_t acquisitions;
+    uint64_t messages_sent;
+    
     pthread_mutex_t lock;
     pthread_cond_t cond;
 } LamportMutex;
 
-// Barrera distribuida
+// Contenido de MSG_LOCK_REQUEST / MSG_LOCK_REPLY
 typedef struct {
-    int node_id;
-    int total_nodes;
-    int arrived_count;
-    int arrived_nodes[MAX_NODES];
+    int lock_id;
+    int timestamp;               // Reloj del emisor
+    int request_timestamp;       // Petición que se contesta (solo REPLY)
+} LockMessage;
+
+// Tiempo entre comprobaciones de pares caídos mientras se espera
+#define LOCK_REPLY_CHECK_MS 1000
+
+// Contenido de MSG_TOKEN
+typedef enum {
+    TOKEN_REQUEST = 0,
+    TOKEN_GRANT = 1,             // flag = el emisor también lo quiere de vuelta
+    TOKEN_PROBE = 2,             // Recuperación: congelar y decir si se tiene
+    TOKEN_PROBE_REPLY = 3,       // flag = tiene el token
+    TOKEN_RESET = 4,             // Nueva generación, raíz y miembros
+    TOKEN_RESET_ACK = 5,
+    TOKEN_RESUME = 6,
+    TOKEN_RECOVER = 7            // Pedir al coordinador que recupere
+} TokenMessageKind;
+
+typedef struct {
+    int lock_id;
+    int kind;
     int generation;
+    int flag;
+    int root;
+    int member_count;
+    int members[MAX_NODES];
+} TokenMessage;
+
+// Espera sin token antes de sospechar que se perdió
+#define TOKEN_LOSS_TIMEOUT_MS 5000
+// Espera de respuestas en cada fase de la recuperación
+#define TOKEN_RECOVERY_TIMEOUT_MS 2000
+
+// Algoritmo de la fase entre nodos de una barrera
+typedef enum {
+    BARRIER_TREE = 0,            // Árbol combinador: 2·log_k(N) rondas, N-1 llegadas
+    BARRIER_DISSEMINATION = 1    // Diseminación: log2(N) rondas, N·log2(N) mensajes
+} BarrierAlgorithm;
+
+// Hijos por nodo en el árbol combinador
+#define BARRIER_TREE_ARITY 4
+
+// Barrera distribuida. Los hilos locales se sincronizan primero entre sí
+// con inversión de sentido; el último en llegar representa al nodo en la
+// fase de red, así que de cada host sale un solo mensaje por ronda. La fase
+// de red avanza sola (al llegar, al recibir cada mensaje), por lo que se
+// puede llegar y seguir trabajando: barrier_arrive() / barrier_test() /
+// barrier_wait(). Los episodios cruzan la red de uno en uno y sus mensajes
+// se guardan según su paridad: un nodo nunca adelanta a otro en más de uno.
+typedef struct DistributedBarrier {
+    int barrier_id;
+    int node_id;
+    int total_nodes;             // Nodos participantes (hilos, sin red)
+    int local_threads;           // Hilos de este nodo que esperan en ella
+    int arrived_count;           // Hilos locales ya llegados
+    int sense;                   // Se invierte al completar cada llegada local
+    int local_episode;           // Episodios con todos los hilos locales llegados
+    int generation;              // Episodios completados en todos los nodos
+    int slack;                   // Episodios sin completar que tolera este nodo
+    
+    // Fase de red del episodio 'generation'
+    int net_started;
+    int net_round;               // Diseminación: ronda en curso
+    int net_sent;                // Ya salió el mensaje de la etapa/ronda actual
+    uint64_t net_start_ns;
+    
+    NetworkManager* network;     // NULL = barrera solo entre hilos locales
+    BarrierAlgorithm algorithm;
+    int members[MAX_NODES];      // Nodos participantes, ordenados por ID
+    int self_index;
+    
+    // Mensajes recibidos, por paridad del episodio
+    int tree_arrivals[2];        // Hijos que ya llegaron
+    int tree_released[2];        // El padre ya liberó
+    uint32_t rounds_seen[2];     // Diseminación: bit k = ronda k recibida
+    
+    struct DistributedBarrier* next;  // Barreras registradas para recibir mensajes
+    
+    // Estadísticas
+    uint64_t messages_sent;
+    uint64_t network_ns;         // Tiempo total en la fase de red
+    uint64_t blocked_ns;         // Tiempo bloqueado en barrier_wait()
+    
     pthread_mutex_t lock;
-    pthread_cond_t cond;
+    pthread_cond_t cond;         // Cambio de sentido o episodio completado
 } DistributedBarrier;
 
-// Reloj lógico de Lamport
+// Máxima holgura de una barrera difusa
+#define BARRIER_MAX_SLACK 8
+
+// Contenido de MSG_BARRIER
+typedef enum {
+    BARRIER_ARRIVE = 0,          // Árbol: el subárbol del emisor llegó
+    BARRIER_RELEASE = 1,         // Árbol: liberar hacia abajo
+    BARRIER_ROUND = 2            // Diseminación: ronda 'round' completada
+} BarrierMessageKind;
+
 typedef struct {
-    int timestamp;
+    int barrier_id;
+    int kind;
+    int episode;
+    int round;
+} BarrierMessage;
+
+// Reloj vectorial de un nodo. Los contadores se actualizan con CAS; el
+// mutex solo protege la asignación de huecos a nodos nuevos.
+typedef struct {
+    int node_ids[MAX_NODES];
+    _Atomic uint32_t counters[MAX_NODES];
+    _Atomic int count;
+    pthread_mutex_t slot_lock;
+} VectorClock;
+
+// Reloj lógico híbrido (HLC): tiempo físico en ms en los bits altos y un
+// contador lógico en los 16 bajos. Sigue al reloj de pared, pero nunca
+// retrocede y respeta la causalidad de los mensajes. Se actualiza con CAS,
+// sin locks; el reloj vectorial es opcional.
+typedef struct LogicalClock {
+    _Atomic uint64_t hlc;
     int node_id;
-    pthread_mutex_t lock;
+    VectorClock* vector;         // NULL = sin reloj vectorial
+    
+    // Estadísticas
+    _Atomic uint64_t drift_rejections;
 } LogicalClock;
 
+#define HLC_LOGICAL_BITS 16
+#define HLC_PHYSICAL_MS(hlc) ((hlc) >> HLC_LOGICAL_BITS)
+#define HLC_LOGICAL(hlc) ((hlc) & ((1ULL << HLC_LOGICAL_BITS) - 1))
+
+// Adelanto máximo aceptado del reloj físico de otro nodo
+#define HLC_MAX_DRIFT_MS 60000
+
+// Orden causal entre dos sellos vectoriales
+typedef enum {
+    CAUSAL_EQUAL = 0,
+    CAUSAL_BEFORE,
+    CAUSAL_AFTER,
+    CAUSAL_CONCURRENT,
+    CAUSAL_UNKNOWN               // Algún sello estaba truncado
+} CausalOrder;
+
 // ========================================
 // FUNCIONES PÚBLICAS
 // ========================================
 
-// Mutex de Lamport
+// Mutex de Lamport. Con create_networked_mutex() los pares son los nodos
+// vivos del NetworkManager; destruirlo después de parar la red.
 LamportMutex* create_lamport_mutex(int node_id);
-void acquire_distributed_lock(LamportMutex* mutex, int total_nodes);
+LamportMutex* create_networked_mutex(NetworkManager* nm, int lock_id);
+// Modo token: todos los nodos deben crearlo con la misma tabla de nodos
+LamportMutex* create_token_mutex(NetworkManager* nm, int lock_id);
+void acquire_distributed_lock(LamportMutex* mutex);
 void release_distributed_lock(LamportMutex* mutex);
 void handle_lock_request(LamportMutex* mutex, int requesting_node, int request_timestamp);
-void handle_lock_reply(LamportMutex* mutex);
+void handle_lock_reply(LamportMutex* mutex, int replying_node, int request_timestamp);
 void destroy_lamport_mutex(LamportMutex* mutex);
 
-// Barreras
+// Aviso del gestor de fallos: deja de esperar al nodo y, en modo token,
+// reconstruye el árbol (regenerando el token si se perdió con él)
+void notify_lock_node_failure(int node_id);
+
+// Benchmark: adquisiciones/s con 2..max_nodes nodos locales por loopback,
+// en ambos algoritmos y con un solo nodo repitiendo entradas
+void benchmark_lamport_mutex(int max_nodes, int duration_ms);
+
+// Igual, solo con el algoritmo de token
+void benchmark_token_mutex(int max_nodes, int duration_ms);
+
+// Barreras. create_distributed_barrier() solo sincroniza 'total_nodes' hilos
+// del proceso. En create_networked_barrier() participan todos los nodos de la
+// tabla del NetworkManager, con 'local_threads' hilos en cada uno; todos deben
+// crearla antes de que alguno espere. Destruirla después de parar la red.
 DistributedBarrier* create_distributed_barrier(int node_id, int total_nodes);
+DistributedBarrier* create_networked_barrier(NetworkManager* nm, int barrier_id,
+                                             int local_threads,
+                                             BarrierAlgorithm algorithm);
 void wait_at_barrier(DistributedBarrier* barrier);
 void destroy_distributed_barrier(DistributedBarrier* barrier);
 
-// Reloj lógico
+// Barrera en dos fases. barrier_arrive() espera solo a los hilos locales y
+// devuelve la fase del episodio; barrier_test() dice si ya se completó en
+// todos los nodos y barrier_wait() bloquea hasta entonces. Con holgura s
+// (barrera difusa) este nodo puede llegar hasta s episodios por delante del
+// último completado antes de que barrier_arrive() lo frene.
+int barrier_arrive(DistributedBarrier* barrier);
+int barrier_test(DistributedBarrier* barrier, int phase);
+void barrier_wait(DistributedBarrier* barrier, int phase);
+void set_barrier_slack(DistributedBarrier* barrier, int slack);
+
+// Benchmark: latencia por episodio de 4 a max_nodes nodos locales por
+// loopback, con ambos algoritmos
+void benchmark_distributed_barrier(int max_nodes, int episodes);
+
+// Benchmark: iteraciones con cómputo irregular entre barreras, bloqueando
+// en cada una frente a solapar el cómputo con la barrera anterior
+void benchmark_split_barrier(int nodes, int iterations, int compute_us);
+
+// Reloj lógico híbrido
 LogicalClock* create_logical_clock(int node_id);
-int increment_clock(LogicalClock* clock);
-int update_clock(LogicalClock* clock, int received_timestamp);
-int get_clock_time(LogicalClock* clock);
+uint64_t increment_clock(LogicalClock* clock);
+uint64_t update_clock(LogicalClock* clock, uint64_t received_timestamp);
+uint64_t get_clock_time(LogicalClock* clock);
+void enable_vector_clock(LogicalClock* clock);
 void destroy_logical_clock(LogicalClock* clock);
 
+// Sellar un mensaje al enviarlo y avanzar el reloj al recibirlo (ambas
+// aceptan clock = NULL). Las llama la capa de red.
+void clock_stamp_message(LogicalClock* clock, Message* msg);
+void clock_receive_message(LogicalClock* clock, Message* msg);
+CausalOrder compare_vector_stamps(const VectorClockStamp* a, const VectorClockStamp* b);
+
 #endif // SYNC_H
\ No newline at end of file
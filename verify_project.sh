@@ -67,6 +67,10 @@ echo ""
 echo -e "${BLUE}=== Módulo Memory ===${NC}"
 check_file "src/memory/memory_manager.h"
 check_file "src/memory/memory_manager.c"
+check_file "src/memory/slab.h"
+check_file "src/memory/slab.c"
+check_file "src/memory/epoch.h"
+check_file "src/memory/epoch.c"
 echo ""
 
 echo -e "${BLUE}=== Módulo Network ===${NC}"